@@ -0,0 +1,147 @@
+#include "arena.h"
+#include "fake_cluster.h"
+#include "session_manager.h"
+#include "tenants.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+/*
+   Starts and ends sessions on a fake cluster for hours of virtual time: pause, resume, skip, owner changes,
+   suspended guilds, both cancel paths, and sessions that run to their end. After a warmup the live heap blocks,
+   anonymous memory and open fds must stop growing, and everything the manager holds must be released at the end.
+
+   usage: churn_soak [cycles], more than the 26000 of the warmup
+*/
+
+using namespace std::chrono_literals;
+using Flag = SessionManager::Session::Flag;
+
+constexpr int64_t BlocksBudget = 1000;
+constexpr int64_t AnonBudgetKiB = 1024;
+constexpr int64_t FdsBudget = 0;
+constexpr uint64_t Guilds = 8;
+constexpr uint64_t Channels = 1000;
+constexpr uint64_t Owners = 2000;
+constexpr long RunToEnd = 13; // every 13th session isn't canceled
+
+int main(int argc, char **argv)
+{
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  long cycles = argc > 1 ? atol(argv[1]) : 1'000'000;
+  // Until every owner had a session run to its end the stats store is still getting its first entry for some of them
+  long warmup = std::max<long>(cycles / 10, Owners * RunToEnd);
+  if (cycles <= warmup)
+  {
+    printf("churn_soak: the %ld cycles of warmup leave nothing to measure, run more than that\n", warmup);
+    return 2;
+  }
+
+  fake::World w;
+  w.Bot.KeepCalls = 0;
+
+  std::vector<dpp::channel *> channels;
+  for (uint64_t g = 0; g < Guilds; g++)
+    fake::AddGuild(fake::Guild + g);
+  for (uint64_t c = 0; c < Channels; c++)
+    channels.push_back(&w.Room(100 + c, {}, "room " + std::to_string(c), fake::Guild + c % Guilds));
+
+  int64_t blocks0 = 0;
+  int64_t anon0 = 0;
+  int64_t fds0 = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (long i = 0; i < cycles; i++)
+  {
+    dpp::channel *channel = channels[i % Channels];
+    dpp::snowflake owner = 1000 + i % Owners;
+    dpp::snowflake other = 900000 + i % Owners;
+    fake::Join(w.Bot, channel->guild_id, channel->id, owner);
+    fake::Join(w.Bot, channel->guild_id, channel->id, other);
+
+    flag_t flags = static_cast<flag_t>(Flag::Mute) | (i % 11 == 0 ? static_cast<flag_t>(Flag::Voice) : 0);
+    w.Manager.StartSession(owner, channel, 1, 1, 2, flags);
+    auto *session = w.Manager.GetSessionByOwnerId(owner);
+    if (!session)
+    {
+      printf("cycle %ld: the session didn't start\n", i);
+      return 1;
+    }
+    session->Pause(w.Manager);
+    session->Resume(w.Manager);
+    session->SkipPhase(w.Manager);
+    if (i % 3 == 0)
+    {
+      w.Manager.ChangeOwnerId(session, other);
+      std::swap(owner, other);
+    }
+    if (i % 7 == 0)
+    {
+      dpp::snowflake guild_id = channel->guild_id;
+      w.Manager.SuspendGuild(guild_id);
+      w.Manager.ReconcileGuilds({&guild_id, 1});
+    }
+
+    // Some sessions run to their end, the others are canceled one way or the other
+    session = w.Manager.GetSessionByOwnerId(owner);
+    if (session && i % RunToEnd != 0)
+    {
+      if (i % 2)
+        w.Manager.CancelSession(session, [](SessionManager::Session const &) {});
+      else
+        w.Manager.CancelSession(owner);
+    }
+    if (!session || i % RunToEnd != 0)
+    {
+      fake::Join(w.Bot, channel->guild_id, 0, owner);
+      fake::Join(w.Bot, channel->guild_id, 0, other);
+    }
+    fake::Run(1s);
+
+    if (i == warmup)
+    {
+      blocks0 = mem::LiveBlocks();
+      anon0 = fake::AnonKiB();
+      fds0 = tenant::OpenFds();
+    }
+    if (i % (cycles / 5 + 1) == 0 || i == cycles - 1)
+      printf(
+          "%8ld: anon %lu KiB, fds %lu, live blocks %ld, %zu timers | %s\n",
+          i,
+          fake::AnonKiB(),
+          tenant::OpenFds(),
+          mem::LiveBlocks(),
+          w.Bot.Timers(),
+          w.Manager.Report().c_str());
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  int64_t blocks = mem::LiveBlocks() - blocks0;
+  int64_t anon = static_cast<int64_t>(fake::AnonKiB()) - anon0;
+  int64_t fds = static_cast<int64_t>(tenant::OpenFds()) - fds0;
+  printf("%ld cycles in %.1fs, growth after warmup: %ld KiB, %ld blocks, %ld fds\n", cycles, seconds, anon, blocks, fds);
+
+  // The sessions left running end on their own, then the renames and status messages they left drain
+  fake::Run(20min);
+  printf(
+      "drained: %zu timers, %zu answers pending | %s\n",
+      w.Bot.Timers(),
+      w.Bot.PendingAnswers(),
+      w.Manager.Report().c_str());
+
+  int failed = 0;
+  auto check = [&](bool ok, char const *what) {
+    if (!ok)
+    {
+      printf("over budget: %s\n", what);
+      failed = 1;
+    }
+  };
+  check(blocks <= BlocksBudget, "live heap blocks");
+  check(anon <= AnonBudgetKiB, "anonymous memory");
+  check(fds <= FdsBudget, "open fds");
+  check(w.Manager.GetActiveSessions() == 0, "sessions left");
+  check(w.Manager.Board.Tracked() == 0, "status messages left");
+  check(w.Manager.Renames.Pending() == 0, "renames left");
+  check(w.Bot.PendingAnswers() == 0, "REST answers left");
+  return failed;
+}
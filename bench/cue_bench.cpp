@@ -0,0 +1,132 @@
+#include "cue_composer.h"
+#include "fake_cluster.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+/*
+   Composes "N minutes left in work/break session M" cues out of fragments written to a temporary directory:
+   misses through a cache too small for the mix (every cue concatenated again), hits on the few cues a running bot
+   repeats, and hits from several threads at once. Every cue must have the packets and duration of its fragments.
+
+   usage: cue_bench [cues]
+*/
+
+constexpr double MissBudget = 5'000; // cues per second, the request's "thousands per second"
+constexpr double HitBudget = 50'000;
+constexpr size_t FragmentPackets = 25; // 500ms of 20ms packets
+constexpr unsigned Threads = 4;
+
+struct Spec
+{
+  unsigned Minutes;
+  bool Break;
+  unsigned Session;
+};
+
+static size_t Compose(CueComposer &cues, Spec s, size_t &packets)
+{
+  std::vector<std::string_view> tokens;
+  tokens.reserve(8);
+  CueComposer::NumberTokens(s.Minutes, tokens);
+  tokens.insert(tokens.end(), {"minutes_left_in", s.Break ? "break" : "work", "session"});
+  CueComposer::NumberTokens(s.Session, tokens);
+  auto cue = cues.Compose(tokens);
+  packets = cue ? cue->Sizes.size() : 0;
+  return tokens.size();
+}
+
+int main(int argc, char **argv)
+{
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  size_t count = argc > 1 ? atol(argv[1]) : 1'000'000;
+
+  std::string dir = fake::TempDir();
+  std::vector<std::string> tokens = {"minutes_left_in", "work", "break", "session"};
+  for (unsigned n = 0; n <= 20; n++)
+    tokens.push_back(std::to_string(n));
+  for (unsigned n = 30; n <= 90; n += 10)
+    tokens.push_back(std::to_string(n));
+  for (auto const &token : tokens)
+    if (!fake::WriteOpus(dir + "/" + token + ".opus", FragmentPackets))
+    {
+      printf("couldn't write the fragments to %s\n", dir.c_str());
+      return 2;
+    }
+
+  // 1-60 minutes, both phases, sessions 1-8: 960 cues against the 64 the composer keeps
+  std::vector<Spec> mix;
+  for (unsigned m = 1; m <= 60; m++)
+    for (bool b : {0, 1})
+      for (unsigned s = 1; s <= 8; s++)
+        mix.push_back({m, b, s});
+  std::mt19937 rng(42);
+  std::vector<Spec> order(count);
+  for (auto &s : order)
+    s = mix[rng() % mix.size()];
+
+  int failed = 0;
+  auto check = [&](bool ok, char const *what) {
+    if (!ok)
+    {
+      printf("over budget: %s\n", what);
+      failed = 1;
+    }
+  };
+  using clock = std::chrono::steady_clock;
+  auto rate = [](size_t n, clock::time_point t0) {
+    return n / std::chrono::duration<double>(clock::now() - t0).count();
+  };
+
+  CueComposer cold(dir);
+  size_t wrong = 0;
+  auto t0 = clock::now();
+  for (auto const &s : order)
+  {
+    size_t packets;
+    wrong += Compose(cold, s, packets) * FragmentPackets != packets;
+  }
+  double misses = rate(count, t0);
+  printf("%zu cues from %zu kinds, %zu cached: %.0f cues/s\n", count, mix.size(), cold.CachedCues(), misses);
+
+  // What a bot repeats: the 5 minute cue of the first sessions
+  CueComposer hot(dir);
+  t0 = clock::now();
+  for (size_t i = 0; i < count; i++)
+  {
+    size_t packets;
+    wrong += Compose(hot, {5, bool(i & 1), unsigned(i % 8 + 1)}, packets) * FragmentPackets != packets;
+  }
+  double hits = rate(count, t0);
+  printf("%zu cues from 16 kinds: %.0f cues/s\n", count, hits);
+
+  std::vector<std::thread> threads;
+  std::atomic<size_t> wrong_threads{0};
+  t0 = clock::now();
+  for (unsigned t = 0; t < Threads; t++)
+    threads.emplace_back(
+        [&, t]
+        {
+          for (size_t i = t; i < count; i += Threads)
+          {
+            size_t packets;
+            if (Compose(hot, {5, bool(i & 1), unsigned(i % 8 + 1)}, packets) * FragmentPackets != packets)
+              wrong_threads++;
+          }
+        });
+  for (auto &t : threads)
+    t.join();
+  double shared = rate(count, t0);
+  wrong += wrong_threads;
+  printf("%zu cues on %u threads: %.0f cues/s\n", count, Threads, shared);
+
+  check(!wrong, "cues without the packets of their fragments");
+  check(cold.CachedCues() <= 64, "the cache outgrew its capacity");
+  check(misses >= MissBudget, "composing uncached cues");
+  check(hits >= HitBudget, "cached cues");
+  check(shared >= HitBudget, "cached cues from several threads");
+  return failed;
+}
@@ -0,0 +1,109 @@
+#include "fake_cluster.h"
+#include "opus_track.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <unistd.h>
+#include <vector>
+
+/*
+   Demuxes the bundled transition sounds and a long generated track with OpusTrack: packets per second, MB/s and
+   bytes copied out of the mapping. liboggz is gone, so the reference is the least the old path did: read() the file
+   through a BUFSIZ*2 buffer, as oggz_read did, which copies every byte once before any packet is parsed.
+
+   usage: demux_bench [rounds] [generated packets]
+*/
+
+constexpr double PacketsBudget = 250'000; // per second, opening included, unoptimized builds reach twice that
+
+using clock_type = std::chrono::steady_clock;
+
+static double Seconds(clock_type::time_point t0)
+{
+  return std::chrono::duration<double>(clock_type::now() - t0).count();
+}
+
+// Reads path in BUFSIZ*2 chunks, what oggz_read copied before its callback saw a packet
+static size_t ReadChunks(const char *path)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return 0;
+  char buf[BUFSIZ * 2];
+  size_t copied = 0;
+  for (ssize_t n; (n = read(fd, buf, sizeof(buf))) > 0;)
+    copied += n;
+  close(fd);
+  return copied;
+}
+
+int main(int argc, char **argv)
+{
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  unsigned rounds = argc > 1 ? atol(argv[1]) : 2000;
+  size_t generated = argc > 2 ? atol(argv[2]) : 180'000; // an hour of 20ms packets
+
+  std::string long_track = fake::TempDir() + "/hour.opus";
+  if (!fake::WriteOpus(long_track, generated, 120))
+  {
+    printf("couldn't write %s\n", long_track.c_str());
+    return 2;
+  }
+
+  int failed = 0;
+  auto check = [&](bool ok, char const *what) {
+    if (!ok)
+    {
+      printf("over budget: %s\n", what);
+      failed = 1;
+    }
+  };
+
+  struct Input
+  {
+    std::string Path;
+    unsigned Rounds;
+  };
+  for (auto const &[path, n] : {Input{"assests/audio/BreakToWork.opus", rounds},
+                                Input{"assests/audio/WorkToBreak.opus", rounds},
+                                Input{long_track, std::max(1u, rounds / 500)}})
+  {
+    size_t bytes = std::filesystem::file_size(path);
+    size_t packets = 0, copied = 0;
+    bool open = 1;
+    auto t0 = clock_type::now();
+    for (unsigned i = 0; i < n; i++)
+    {
+      OpusTrack track(path.c_str());
+      open &= track.IsOpen();
+      packets += track.Packets().size();
+      copied += track.CopiedBytes();
+    }
+    double mapped = Seconds(t0);
+
+    size_t read_copied = 0;
+    t0 = clock_type::now();
+    for (unsigned i = 0; i < n; i++)
+      read_copied += ReadChunks(path.c_str());
+    double chunked = Seconds(t0);
+
+    printf(
+        "%s: %zu packets, %zu KiB\n"
+        "  mmap demux  %10.0f packets/s %8.1f MB/s, %zu bytes copied per open\n"
+        "  read chunks                   %8.1f MB/s, %zu bytes copied per open, before parsing\n",
+        path.c_str(),
+        packets / n,
+        bytes / 1024,
+        packets / mapped,
+        bytes * n / mapped / 1e6,
+        copied / n,
+        bytes * n / chunked / 1e6,
+        read_copied / n);
+    check(open, "a track didn't open");
+    check(copied == 0, "packets copied out of the mapping");
+    check(packets / mapped >= PacketsBudget, "demuxed packets per second");
+  }
+  return failed;
+}
@@ -0,0 +1,151 @@
+#include "session_handoff.h"
+#include "fake_cluster.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/*
+   Claim throughput of the handoff directory with several processes: snapshots of many guilds are written, then
+   forked processes claim them, first one process, then one per cluster of a sharded deployment, then processes
+   racing for the same guilds (two builds running side by side). Every snapshot must be claimed exactly once.
+   With more than one CPU the clusters must also claim faster together than one process alone.
+
+   usage: handoff_bench [snapshots] [processes]
+*/
+
+using namespace std::chrono_literals;
+
+constexpr uint32_t Shards = 64;
+
+struct Round
+{
+  double Seconds;
+  size_t Claimed;
+  size_t Duplicates;
+  size_t Missing;
+};
+
+// Writes the snapshots, then has every map in maps claim from its own process until the directory is empty
+static Round Claim(std::string const &dir, size_t snapshots, std::vector<handoff::ShardMap> const &maps)
+{
+  handoff::Directory handoff(dir);
+  for (size_t i = 0; i < snapshots; i++)
+  {
+    handoff::Snapshot s;
+    s.OwnerId = 1'000'000 + i;
+    s.GuildId = (i + 1) << 22; // guild i is on shard (i + 1) % Shards
+    s.ChannelId = 2'000'000 + i;
+    s.Members = {s.OwnerId};
+    s.ReleasedAtMs = utl::WallMs();
+    handoff.Put(s);
+  }
+
+  // Each child writes the owners it claimed to its pipe
+  std::vector<std::pair<pid_t, int>> children;
+  auto t0 = std::chrono::steady_clock::now();
+  for (auto const &map : maps)
+  {
+    int fds[2];
+    if (pipe(fds))
+      return {};
+    pid_t pid = fork();
+    if (!pid)
+    {
+      close(fds[0]);
+      std::vector<uint64_t> owners;
+      for (int idle = 0; idle < 3;)
+      {
+        std::vector<handoff::Snapshot> claimed;
+        if (!handoff.Claim(map, 0, claimed))
+        {
+          idle++;
+          continue;
+        }
+        idle = 0;
+        for (auto const &s : claimed)
+        {
+          owners.push_back(s.OwnerId);
+          handoff.Done(s);
+        }
+      }
+      size_t bytes = owners.size() * sizeof(uint64_t);
+      _exit(write(fds[1], owners.data(), bytes) == ssize_t(bytes) ? 0 : 1);
+    }
+    close(fds[1]);
+    children.emplace_back(pid, fds[0]);
+  }
+
+  std::vector<uint8_t> seen(snapshots);
+  Round r{};
+  for (auto [pid, fd] : children)
+  {
+    uint64_t owner;
+    while (read(fd, &owner, sizeof(owner)) == sizeof(owner))
+      if (owner >= 1'000'000 && owner < 1'000'000 + snapshots && seen[owner - 1'000'000]++)
+        r.Duplicates++;
+    close(fd);
+    waitpid(pid, nullptr, 0);
+  }
+  r.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  for (uint8_t n : seen)
+  {
+    r.Claimed += n > 0;
+    r.Missing += n == 0;
+  }
+  return r;
+}
+
+int main(int argc, char **argv)
+{
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  size_t snapshots = argc > 1 ? atol(argv[1]) : 20'000;
+  uint32_t processes = argc > 2 ? atol(argv[2]) : 4;
+  unsigned cpus = std::thread::hardware_concurrency();
+
+  std::vector<handoff::ShardMap> alone{{Shards, 0, 1}}, clusters, racing;
+  for (uint32_t i = 0; i < processes; i++)
+  {
+    clusters.push_back({Shards, i, processes});
+    racing.push_back({Shards, 0, 1});
+  }
+
+  int failed = 0;
+  double one = 0, many = 0;
+  for (auto const &[name, maps] :
+       {std::pair{"1 process", &alone}, std::pair{"1 per cluster", &clusters}, std::pair{"racing", &racing}})
+  {
+    Round r = Claim(fake::TempDir(), snapshots, *maps);
+    printf(
+        "%-14s %zu processes: %zu claimed in %.3fs (%.0f/s), %zu twice, %zu missed\n",
+        name,
+        maps->size(),
+        r.Claimed,
+        r.Seconds,
+        r.Claimed / r.Seconds,
+        r.Duplicates,
+        r.Missing);
+    if (r.Duplicates || r.Missing)
+    {
+      printf("over budget: every snapshot must be claimed once\n");
+      failed = 1;
+    }
+    if (maps == &alone)
+      one = r.Seconds;
+    else if (maps == &clusters)
+      many = r.Seconds;
+  }
+  if (cpus < 2)
+    printf("%u CPU, the speedup of the clusters (%.2fx) isn't checked\n", cpus, one / many);
+  else if (many > one * 0.9)
+  {
+    printf("over budget: %u clusters claimed %.2fx as fast as one process on %u CPUs\n", processes, one / many, cpus);
+    failed = 1;
+  }
+  return failed;
+}
@@ -0,0 +1,188 @@
+#include "topology.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <sched.h>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/*
+   Lateness of the timer thread and of the audio thread while busy threads keep every CPU loaded. A thread placed
+   for the timer role wakes every 20ms, as it does for voice frames, and posts a job to the audio thread each time.
+   The timer's lateness is how far past the tick it woke, the audio's how long the posted job waited to run. One run
+   with the default layout, one with both roles SCHED_FIFO and, with more than one CPU, on the last CPU. Each run is
+   a process of its own since the layout is set once per process. The placed run must stay in budget when the kernel
+   accepted the placement, a refused placement (no CAP_SYS_NICE) is reported and not checked.
+
+   usage: jitter_bench [seconds per run] [busy threads]
+*/
+
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+constexpr auto Tick = 20ms;
+constexpr double TimerP99BudgetMs = 1;
+constexpr double AudioP99BudgetMs = 1;
+
+struct Figures
+{
+  double P50, P99, Max; // ms
+};
+
+struct Run
+{
+  Figures Timer, Audio;
+  bool Placed; // the kernel runs both threads SCHED_FIFO
+};
+
+static Figures Summarize(std::vector<double> &ms)
+{
+  if (ms.empty())
+    return {};
+  std::sort(ms.begin(), ms.end());
+  return {ms[ms.size() / 2], ms[ms.size() * 99 / 100], ms.back()};
+}
+
+// Runs in the child: places the roles from spec, loads the CPUs and measures for seconds
+static Run Measure(std::string const &spec, double seconds, unsigned busy)
+{
+  topo::Layout layout;
+  std::string error;
+  if (!topo::Parse(spec.c_str(), layout, error))
+  {
+    printf("%s\n", error.c_str());
+    return {};
+  }
+  topo::Start(layout);
+
+  std::atomic<bool> stop{0};
+  std::vector<std::thread> load;
+  for (unsigned i = 0; i < busy; i++)
+    load.emplace_back(
+        [&]
+        {
+          while (!stop.load(std::memory_order_relaxed))
+            ;
+        });
+
+  std::vector<double> timer_ms, audio_ms; // audio_ms is only touched on the audio thread
+  bool timer_fifo = 0;
+  std::promise<bool> audio_fifo;
+  std::thread timer(
+      [&]
+      {
+        topo::Adopt(topo::Role::Timer);
+        timer_fifo = sched_getscheduler(0) == SCHED_FIFO;
+        topo::PostAudio([&] { audio_fifo.set_value(sched_getscheduler(0) == SCHED_FIFO); });
+
+        size_t ticks = static_cast<size_t>(seconds / std::chrono::duration<double>(Tick).count());
+        timer_ms.reserve(ticks);
+        audio_ms.reserve(ticks);
+        auto next = Clock::now();
+        for (size_t i = 0; i < ticks; i++)
+        {
+          next += Tick;
+          std::this_thread::sleep_until(next);
+          auto woke = Clock::now();
+          timer_ms.push_back(std::chrono::duration<double, std::milli>(woke - next).count());
+          topo::PostAudio(
+              [&audio_ms, woke]
+              { audio_ms.push_back(std::chrono::duration<double, std::milli>(Clock::now() - woke).count()); });
+        }
+      });
+  timer.join();
+
+  // Jobs run in order, once this one ran every sample is in
+  std::promise<void> drained;
+  topo::PostAudio([&] { drained.set_value(); });
+  drained.get_future().wait();
+  stop = 1;
+  for (auto &t : load)
+    t.join();
+
+  bool placed = timer_fifo && audio_fifo.get_future().get();
+  return {Summarize(timer_ms), Summarize(audio_ms), placed};
+}
+
+// Forks a process for the run and reads its figures back through a pipe
+static bool RunIn(std::string const &spec, double seconds, unsigned busy, Run &out)
+{
+  int fds[2];
+  if (pipe(fds))
+    return 0;
+  pid_t pid = fork();
+  if (!pid)
+  {
+    close(fds[0]);
+    Run run = Measure(spec, seconds, busy);
+    bool ok = write(fds[1], &run, sizeof(run)) == sizeof(run);
+    _exit(ok ? 0 : 1); // the audio thread never returns, don't wait on it
+  }
+  close(fds[1]);
+  bool ok = pid > 0 && read(fds[0], &out, sizeof(out)) == sizeof(out);
+  close(fds[0]);
+  int status = 0;
+  if (pid > 0)
+    waitpid(pid, &status, 0);
+  return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void Print(char const *name, Run const &r)
+{
+  printf(
+      "%-9s timer p50 %6.2fms p99 %6.2fms max %6.2fms | audio p50 %6.2fms p99 %6.2fms max %6.2fms\n",
+      name,
+      r.Timer.P50,
+      r.Timer.P99,
+      r.Timer.Max,
+      r.Audio.P50,
+      r.Audio.P99,
+      r.Audio.Max);
+}
+
+int main(int argc, char **argv)
+{
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  double seconds = argc > 1 ? atof(argv[1]) : 20;
+  unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+  unsigned busy = argc > 2 ? atoi(argv[2]) : cpus * 4;
+
+  // With one CPU there is nothing to pin to, only the priorities apply
+  std::string cpu = cpus > 1 ? std::to_string(cpus - 1) : "";
+  std::string placed_spec = "timer=" + cpu + "/10;audio=" + cpu + "/20";
+  printf("%u CPUs, %u busy threads, %.0fs per run, placed: %s\n", cpus, busy, seconds, placed_spec.c_str());
+  if (cpus == 1)
+    printf("one CPU: the placed run only changes priorities, affinity isn't exercised\n");
+
+  Run def, placed;
+  if (!RunIn("", seconds, busy, def) || !RunIn(placed_spec, seconds, busy, placed))
+  {
+    printf("a run failed\n");
+    return 1;
+  }
+  Print("default", def);
+  Print("placed", placed);
+
+  int failed = 0;
+  auto check = [&](bool ok, char const *what) {
+    if (!ok)
+    {
+      printf("over budget: %s\n", what);
+      failed = 1;
+    }
+  };
+  if (!placed.Placed)
+    printf("the kernel refused SCHED_FIFO, the placed run isn't checked\n");
+  else
+  {
+    check(placed.Timer.P99 <= TimerP99BudgetMs, "timer p99 lateness when placed");
+    check(placed.Audio.P99 <= AudioP99BudgetMs, "audio p99 wait when placed");
+  }
+  return failed;
+}
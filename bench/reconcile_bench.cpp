@@ -0,0 +1,105 @@
+#include "fake_cluster.h"
+#include "session_manager.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+/*
+   Reconciliation after a shard outage: every guild has a session, the shards drop, a third of the owners and some
+   members leave and others join meanwhile, then the shards come back and ReconcileShard diffs every session against
+   the cache. Also times GUILD_CREATE for guilds that were never suspended, which every guild goes through on connect.
+
+   usage: reconcile_bench [guilds]
+*/
+
+using namespace std::chrono_literals;
+using Flag = SessionManager::Session::Flag;
+using ms = std::chrono::duration<double, std::milli>;
+
+constexpr uint32_t Shards = 16;
+constexpr double ReconcileBudgetUs = 100;  // per guild, unoptimized build
+constexpr double GuildCreateBudgetUs = 1; // per guild that isn't suspended
+
+int main(int argc, char **argv)
+{
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  uint64_t guilds = argc > 1 ? atol(argv[1]) : 10'000;
+
+  fake::World w(Shards);
+  w.Bot.KeepCalls = 0;
+
+  // Guild g is on shard g % Shards, like Discord's (id >> 22) % shards
+  std::vector<dpp::snowflake> ids;
+  for (uint64_t g = 0; g < guilds; g++)
+  {
+    dpp::snowflake guild_id = (g + 1) << 22;
+    ids.push_back(guild_id);
+    fake::AddGuild(guild_id, (g + 1) % Shards);
+    dpp::snowflake owner = 10'000'000 + g * 8;
+    w.Room(1'000'000 + g, {owner, owner + 1, owner + 2}, "study", guild_id);
+    w.Start(owner, 1'000'000 + g, 25, 5, 4);
+  }
+  fake::Run(1s);
+  w.Manager.CheckShards();
+
+  for (auto const &[_, shard] : w.Bot.get_shards())
+    shard->connected = 0;
+  w.Manager.CheckShards();
+  size_t suspended = 0;
+  for (uint64_t g = 0; g < guilds; g++)
+    if (auto *s = w.Manager.GetSessionByOwnerId(10'000'000 + g * 8))
+      suspended += SessionManager::HasFlag(s->Flags, Flag::Suspended);
+
+  // While the shards were down: a third of the owners left, every guild lost a member and got a new one
+  for (uint64_t g = 0; g < guilds; g++)
+  {
+    if (g % 3 == 0)
+      fake::Join(w.Bot, ids[g], 0, 10'000'000 + g * 8);
+    fake::Join(w.Bot, ids[g], 0, 10'000'000 + g * 8 + 2);
+    fake::Join(w.Bot, ids[g], 1'000'000 + g, 10'000'000 + g * 8 + 3);
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (auto const &[id, shard] : w.Bot.get_shards())
+  {
+    shard->connected = 1;
+    w.Manager.ReconcileShard(id);
+  }
+  double reconcile = ms(std::chrono::steady_clock::now() - t0).count();
+
+  t0 = std::chrono::steady_clock::now();
+  for (dpp::snowflake id : ids)
+    w.Manager.ReconcileGuilds({&id, 1});
+  double guild_create = ms(std::chrono::steady_clock::now() - t0).count();
+  fake::Settle();
+
+  size_t running = 0, members = 0, expected = 0;
+  for (uint64_t g = 0; g < guilds; g++)
+  {
+    dpp::snowflake owner = 10'000'000 + g * 8 + (g % 3 == 0);
+    expected += g % 3 == 0 ? 2 : 3;
+    if (auto *s = w.Manager.GetSessionByOwnerId(owner); s && !SessionManager::HasFlag(s->Flags, Flag::Suspended))
+    {
+      running++;
+      members += s->MembersId.size();
+    }
+  }
+  printf("%lu guilds, %zu suspended: reconcile %.1fms (%.2fus per guild), ", guilds, suspended, reconcile,
+         reconcile * 1000 / guilds);
+  printf("GUILD_CREATE of the reconciled guilds %.2fms (%.3fus per guild)\n", guild_create, guild_create * 1000 / guilds);
+  printf("%zu sessions running again with %zu members\n", running, members);
+
+  int failed = 0;
+  auto check = [&](bool ok, char const *what) {
+    if (!ok)
+    {
+      printf("over budget: %s\n", what);
+      failed = 1;
+    }
+  };
+  check(suspended == guilds, "sessions not suspended");
+  check(running == guilds && members == expected, "sessions not reconciled");
+  check(reconcile * 1000 / guilds <= ReconcileBudgetUs, "reconcile time");
+  check(guild_create * 1000 / guilds <= GuildCreateBudgetUs, "GUILD_CREATE time");
+  return failed;
+}
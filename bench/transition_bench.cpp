@@ -0,0 +1,115 @@
+#include "fake_cluster.h"
+#include "session_manager.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+/*
+   CPU cost of phase transitions when many sessions change phase in the same second: sessions started together
+   end their work phase in one batch, then sessions started over half a minute do the same with POMODORO_PHASE_GRID
+   at 60s. The cost per transition covers the batch and the REST calls it makes on the fake cluster, which answers
+   right away.
+
+   usage: transition_bench [sessions] [guilds]
+*/
+
+using namespace std::chrono_literals;
+using Flag = SessionManager::Session::Flag;
+
+constexpr double TransitionBudgetUs = 100; // per transition, unoptimized build
+constexpr unsigned WorkMinutes = 25;
+
+struct Batch
+{
+  size_t Transitions = 0;
+  double Us = 0;
+  uint64_t Lookups = 0;
+};
+
+// Steps one second at a time until no session is in its work phase, the step with the most transitions is the batch
+static Batch Largest(SessionManager &manager, std::vector<dpp::snowflake> const &owners)
+{
+  Batch largest;
+  for (size_t working = owners.size(); working;)
+  {
+    uint64_t lookups = fake::GuildLookups();
+    auto t0 = std::chrono::steady_clock::now();
+    fake::Run(1s);
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    size_t now_working = 0;
+    for (dpp::snowflake owner : owners)
+      if (auto *s = manager.GetSessionByOwnerId(owner))
+        now_working += !SessionManager::HasFlag(s->Flags, Flag::Break);
+    if (now_working < working && working - now_working > largest.Transitions)
+      largest = {working - now_working, us, fake::GuildLookups() - lookups};
+    working = now_working;
+  }
+  return largest;
+}
+
+int main(int argc, char **argv)
+{
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  uint64_t sessions = argc > 1 ? atol(argv[1]) : 10'000;
+  uint64_t guilds = argc > 2 ? atol(argv[2]) : 500;
+
+  fake::World w;
+  w.Bot.KeepCalls = 0;
+
+  std::vector<dpp::snowflake> owners;
+  for (uint64_t g = 0; g < guilds; g++)
+    fake::AddGuild(1 + g);
+  for (uint64_t i = 0; i < sessions; i++)
+  {
+    dpp::snowflake owner = 10'000'000 + i * 2;
+    w.Room(100'000 + i, {owner, owner + 1}, "room", 1 + i % guilds);
+    owners.push_back(owner);
+  }
+  auto start = [&](uint64_t i) { w.Start(owners[i], 100'000 + i, WorkMinutes, 5, 2); };
+
+  int failed = 0;
+  auto check = [&](bool ok, char const *what) {
+    if (!ok)
+    {
+      printf("over budget: %s\n", what);
+      failed = 1;
+    }
+  };
+  auto report = [&](char const *name, Batch const &b)
+  {
+    printf(
+        "%s: %zu transitions in one batch, %.1fms, %.2fus each, %lu guild lookups\n",
+        name,
+        b.Transitions,
+        b.Us / 1000,
+        b.Us / std::max<size_t>(b.Transitions, 1),
+        b.Lookups);
+    check(b.Transitions == sessions, "transitions that missed the batch");
+    check(b.Lookups <= guilds, "guild lookups per batch");
+    check(b.Us / std::max<size_t>(b.Transitions, 1) <= TransitionBudgetUs, "cost per transition");
+  };
+
+  // Started in the same second
+  for (uint64_t i = 0; i < sessions; i++)
+    start(i);
+  unsigned work_s = w.Manager.GetSessionByOwnerId(owners[0])->WorkPeriod;
+  report("same start", Largest(w.Manager, owners));
+  for (dpp::snowflake owner : owners)
+    w.Manager.CancelSession(owner);
+  fake::Run(1min);
+
+  // Started over 30 seconds, rounded up to a 60s grid: the first phase end is right after a grid line so the last
+  // one is before the next
+  w.Manager.PhaseGrid = 60;
+  auto tick = [] { return std::chrono::duration_cast<std::chrono::seconds>(utl::Clock::now().time_since_epoch()); };
+  while ((tick().count() + work_s) % w.Manager.PhaseGrid != 1)
+    fake::Run(1s);
+  for (uint64_t i = 0; i < sessions; i++)
+  {
+    start(i);
+    if (i % (sessions / 30 + 1) == 0)
+      fake::Run(1s);
+  }
+  report("grid of 60s", Largest(w.Manager, owners));
+  return failed;
+}
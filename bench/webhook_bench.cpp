@@ -0,0 +1,167 @@
+#include "fake_cluster.h"
+#include "webhook_pool.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+
+/*
+   A burst of announcements with Discord's buckets modeled on the fake cluster: 5 bot messages per 5s per channel,
+   5 executions per 2s per webhook. Every channel gets 8 announcements queued behind 3 other bot messages; a tenth of
+   the channels refuse webhooks, and webhook posts now and then time out, fail with a 5xx (both shown anyway) or hit
+   a deleted webhook (404, not shown). Compares how late announcements show up posted as the bot and through the
+   pool, and checks the pool shows every announcement exactly once: refused posts are resent, unanswered ones aren't.
+
+   usage: webhook_bench [channels]
+*/
+
+using namespace std::chrono_literals;
+using clock_type = utl::Clock;
+
+constexpr size_t Announcements = 8;
+constexpr size_t OtherMessages = 3;
+
+struct Result
+{
+  std::vector<double> Lateness; // seconds, of every announcement shown
+  size_t Duplicates = 0;
+  size_t Missing = 0;
+};
+
+// Answers calls as Discord's buckets would, and records when each announcement was shown
+class Discord
+{
+public:
+  explicit Discord(dpp::cluster &bot) : _bot(bot)
+  {
+  }
+
+  fake::Answer operator()(fake::Call const &call)
+  {
+    fake::Answer a = fake::Default(_bot, call);
+    if (call.Route == "create_webhook" && call.Id % 10 == 0)
+      return fake::Fail(403, 50013, "Missing Permissions");
+    if (call.Route != "message_create" && call.Route != "execute_webhook")
+      return a;
+
+    bool hooked = call.Route == "execute_webhook";
+    auto &sent = _buckets[{hooked, call.Id}];
+    auto at = call.At;
+    if (sent.size() >= 5)
+      at = std::max(at, sent[sent.size() - 5] + (hooked ? 2s : 5s));
+    sent.push_back(at);
+    a.Delay = at - call.At;
+
+    if (hooked)
+    {
+      size_t i = _executions++;
+      if (i % 50 == 29)
+        return fake::Fail(404, 10015, "Unknown Webhook", a.Delay);
+      if (i % 20 == 7)
+      {
+        Shown[call.Content].push_back(at); // taken, the answer is lost
+        return fake::Timeout(a.Delay + 10s);
+      }
+      if (i % 50 == 13)
+      {
+        Shown[call.Content].push_back(at);
+        return fake::Fail(502, 0, "Bad Gateway", a.Delay);
+      }
+    }
+    Shown[call.Content].push_back(at);
+    return a;
+  }
+
+  std::map<std::string, std::vector<clock_type::time_point>> Shown;
+
+private:
+  dpp::cluster &_bot;
+  std::map<std::pair<bool, dpp::snowflake>, std::deque<clock_type::time_point>> _buckets;
+  size_t _executions = 0;
+};
+
+static Result Burst(uint64_t channels, bool pooled)
+{
+  fake::World w; // a cluster of its own per run, the buckets start empty
+  Discord discord(w.Bot);
+  w.Bot.Responder = [&discord](fake::Call const &call) { return discord(call); };
+  WebhookPool pool(w.Bot);
+  // The webhooks of a running bot are ready before the burst
+  if (pooled)
+  {
+    for (uint64_t c = 1; c <= channels; c++)
+      pool.Post(c, fmt::format("earlier {}", c));
+    fake::Run(30s);
+  }
+
+  auto t0 = clock_type::now();
+  for (uint64_t c = 1; c <= channels; c++)
+    for (size_t i = 0; i < OtherMessages; i++)
+      w.Bot.message_create(dpp::message(c, fmt::format("other {} {}", c, i)));
+  for (size_t k = 0; k < Announcements; k++)
+    for (uint64_t c = 1; c <= channels; c++)
+    {
+      std::string text = fmt::format("announcement {} {}", c, k);
+      if (pooled)
+        pool.Post(c, std::move(text));
+      else
+        w.Bot.message_create(dpp::message(c, std::move(text)));
+    }
+  fake::Run(5min);
+
+  Result r;
+  for (uint64_t c = 1; c <= channels; c++)
+    for (size_t k = 0; k < Announcements; k++)
+    {
+      auto it = discord.Shown.find(fmt::format("announcement {} {}", c, k));
+      if (it == discord.Shown.end())
+      {
+        r.Missing++;
+        continue;
+      }
+      r.Duplicates += it->second.size() - 1;
+      r.Lateness.push_back(std::chrono::duration<double>(it->second.front() - t0).count());
+    }
+  std::sort(r.Lateness.begin(), r.Lateness.end());
+  return r;
+}
+
+int main(int argc, char **argv)
+{
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  uint64_t channels = argc > 1 ? atol(argv[1]) : 200;
+
+  int failed = 0;
+  auto check = [&](bool ok, char const *what) {
+    if (!ok)
+    {
+      printf("over budget: %s\n", what);
+      failed = 1;
+    }
+  };
+
+  double means[2];
+  for (bool pooled : {0, 1})
+  {
+    Result r = Burst(channels, pooled);
+    double sum = 0;
+    for (double l : r.Lateness)
+      sum += l;
+    size_t n = std::max<size_t>(r.Lateness.size(), 1);
+    means[pooled] = sum / n;
+    auto pct = [&](double p) { return r.Lateness.empty() ? 0 : r.Lateness[std::min(n - 1, size_t(p * n))]; };
+    printf(
+        "%-13s mean lateness %.2fs, p50 %.1fs, p99 %.1fs, %zu shown twice, %zu never shown\n",
+        pooled ? "webhook pool:" : "bot messages:",
+        means[pooled],
+        pct(0.5),
+        pct(0.99),
+        r.Duplicates,
+        r.Missing);
+    check(r.Duplicates == 0, "announcements shown twice");
+    check(r.Missing == 0, "announcements never shown");
+  }
+  check(means[1] < means[0], "the pool isn't faster than posting as the bot");
+  return failed;
+}
@@ -0,0 +1,230 @@
+#include "opus_track.h"
+#include <array>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+constexpr size_t PageHeaderSize = 27; // up to the segment table
+constexpr uint8_t ContinuedPage = 0x01;
+constexpr uint8_t FirstPage = 0x02;
+
+// Ogg's CRC-32: polynomial 0x04c11db7, not reflected, initial value and final xor 0
+static constexpr auto CrcTable = []
+{
+  std::array<uint32_t, 256> table{};
+  for (uint32_t i = 0; i < 256; ++i)
+  {
+    uint32_t r = i << 24;
+    for (int bit = 0; bit < 8; ++bit)
+      r = r & 0x80000000u ? (r << 1) ^ 0x04c11db7u : r << 1;
+    table[i] = r;
+  }
+  return table;
+}();
+
+static inline uint32_t Crc(uint32_t crc, const uint8_t *data, size_t len) noexcept
+{
+  for (size_t i = 0; i < len; ++i)
+    crc = (crc << 8) ^ CrcTable[(crc >> 24) ^ data[i]];
+  return crc;
+}
+
+static inline uint32_t Le32(const uint8_t *p) noexcept
+{
+  return p[0] | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24;
+}
+
+static inline int64_t Le64(const uint8_t *p) noexcept
+{
+  return static_cast<int64_t>(Le32(p) | uint64_t(Le32(p + 4)) << 32);
+}
+
+OpusTrack::OpusTrack(const char *path) noexcept
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd == -1 || fstat(fd, &st) == -1 || st.st_size == 0)
+  {
+    _error = fmt::format("Couldn't open '{}'", path);
+    if (fd != -1)
+      close(fd);
+    return;
+  }
+
+  void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping keeps the file
+  if (map == MAP_FAILED)
+  {
+    _error = fmt::format("Couldn't map '{}'", path);
+    return;
+  }
+  _map = static_cast<const uint8_t *>(map);
+  _size = st.st_size;
+  madvise(map, _size, MADV_SEQUENTIAL);
+
+  if (!Demux())
+  {
+    _error = fmt::format("'{}': {}", path, _error);
+    _packets.clear();
+  }
+}
+
+OpusTrack::~OpusTrack()
+{
+  if (_map)
+    munmap(const_cast<uint8_t *>(_map), _size);
+}
+
+bool OpusTrack::Demux() noexcept
+{
+  uint32_t serial = 0;
+  bool found_stream = 0;
+  uint64_t packet_no = 0; // of the stream, 0 is OpusHead and 1 OpusTags
+  uint16_t pre_skip = 0;
+  int64_t last_granule = -1;
+  std::vector<uint8_t> partial; // packet continued on the next page
+  bool in_partial = 0;
+
+  auto finish = [&](const uint8_t *data, size_t len) noexcept
+  {
+    std::span<const uint8_t> packet(data, len);
+    if (in_partial)
+    {
+      partial.insert(partial.end(), data, data + len);
+      auto &joined = _joined.emplace_back(std::make_unique<uint8_t[]>(partial.size()));
+      std::memcpy(joined.get(), partial.data(), partial.size());
+      _copied += partial.size();
+      packet = {joined.get(), partial.size()};
+      partial.clear();
+      in_partial = 0;
+    }
+
+    if (packet_no == 0)
+    {
+      if (packet.size() < 19 || std::memcmp(packet.data(), "OpusHead", 8))
+        return 0;
+      pre_skip = packet[10] | packet[11] << 8;
+    }
+    else if (packet_no > 1 && !packet.empty()) // 1 is OpusTags
+      _packets.push_back(packet);
+    packet_no++;
+    return 1;
+  };
+
+  for (size_t pos = 0; pos < _size;)
+  {
+    const uint8_t *page = _map + pos;
+    if (_size - pos < PageHeaderSize || std::memcmp(page, "OggS", 4) || page[4] != 0)
+    {
+      _error = fmt::format("no Ogg page at byte {}", pos);
+      return 0;
+    }
+    uint8_t type = page[5];
+    uint8_t segments = page[26];
+    size_t header_len = PageHeaderSize + segments;
+    if (_size - pos < header_len)
+    {
+      _error = fmt::format("truncated page at byte {}", pos);
+      return 0;
+    }
+    const uint8_t *lacing = page + PageHeaderSize;
+    size_t body_len = 0;
+    for (size_t i = 0; i < segments; ++i)
+      body_len += lacing[i];
+    if (_size - pos - header_len < body_len)
+    {
+      _error = fmt::format("truncated page at byte {}", pos);
+      return 0;
+    }
+
+    // The CRC covers the whole page with its own field read as zero
+    static constexpr uint8_t zeros[4] = {};
+    uint32_t crc = Crc(0, page, 22);
+    crc = Crc(crc, zeros, 4);
+    crc = Crc(crc, page + 26, header_len - 26 + body_len);
+    if (crc != Le32(page + 22))
+    {
+      _error = fmt::format("CRC mismatch in page at byte {}", pos);
+      return 0;
+    }
+    pos += header_len + body_len;
+
+    // Other multiplexed streams are skipped
+    if (!found_stream)
+    {
+      if (!(type & FirstPage))
+        continue;
+      serial = Le32(page + 14);
+      found_stream = 1;
+    }
+    else if (Le32(page + 14) != serial)
+      continue;
+
+    if (!(type & ContinuedPage) && in_partial) // the previous page promised a continuation
+    {
+      partial.clear();
+      in_partial = 0;
+    }
+
+    const uint8_t *body = page + header_len;
+    const uint8_t *packet_start = body;
+    size_t packet_len = 0;
+    size_t i = 0;
+    if ((type & ContinuedPage) && !in_partial) // the start of this packet was dropped, so is its end
+    {
+      while (i < segments && lacing[i] == 255)
+        packet_start += lacing[i++];
+      if (i < segments)
+        packet_start += lacing[i++];
+    }
+    for (; i < segments; ++i)
+    {
+      packet_len += lacing[i];
+      if (lacing[i] == 255)
+        continue;
+      if (!finish(packet_start, packet_len))
+      {
+        _error = "not an Opus stream";
+        return 0;
+      }
+      packet_start += packet_len;
+      packet_len = 0;
+    }
+    if (packet_len) // runs into the next page
+    {
+      partial.insert(partial.end(), packet_start, packet_start + packet_len);
+      in_partial = 1;
+    }
+
+    int64_t granule = Le64(page + 6);
+    if (granule != -1)
+      last_granule = granule;
+  }
+
+  if (!found_stream || packet_no < 2)
+  {
+    _error = "not an Opus stream";
+    return 0;
+  }
+  _samples = last_granule > pre_skip ? last_granule - pre_skip : 0;
+  return 1;
+}
+
+std::shared_ptr<const OpusTrack> OpusTrack::Shared(std::string const &path) noexcept
+{
+  static std::mutex mtx;
+  static std::unordered_map<std::string, std::shared_ptr<const OpusTrack>> tracks;
+  std::lock_guard lock(mtx);
+  if (auto it = tracks.find(path); it != tracks.end())
+    return it->second;
+  // A file that didn't open is tried again next time, it may have been missing or still being written
+  auto track = std::make_shared<const OpusTrack>(path.c_str());
+  if (track->IsOpen())
+    tracks.emplace(path, track);
+  return track;
+}
@@ -0,0 +1,81 @@
+#ifndef OPUS_TRACK_H
+#define OPUS_TRACK_H
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+   Ogg/Opus file demuxed straight out of a read-only memory mapping.
+   Opening walks every page once, checks its CRC and indexes the packets of the first Opus stream; a packet is a span
+   into the mapping, only packets continued across pages are copied to be made contiguous (Opus voice packets
+   practically never are). Tracks are immutable once open so one track can be played by several threads.
+*/
+class OpusTrack
+{
+public:
+  static constexpr uint32_t SampleRate = 48000; // Opus granule positions always count 48kHz samples
+
+  explicit OpusTrack(const char *path) noexcept;
+  ~OpusTrack();
+  OpusTrack(OpusTrack const &) = delete;
+  OpusTrack &operator=(OpusTrack const &) = delete;
+
+  /*
+     @return false if the file couldn't be mapped or isn't a valid Ogg/Opus file, Error() tells why
+  */
+  bool IsOpen() const noexcept
+  {
+    return _error.empty();
+  }
+  std::string const &Error() const noexcept
+  {
+    return _error;
+  }
+
+  /*
+     @brief Audio packets in stream order, the OpusHead and OpusTags headers aren't included
+  */
+  std::span<const std::span<const uint8_t>> Packets() const noexcept
+  {
+    return _packets;
+  }
+
+  /*
+     @return playback length in seconds from the last granule position minus the pre-skip
+  */
+  double Duration() const noexcept
+  {
+    return _samples / double(SampleRate);
+  }
+
+  /*
+     @return bytes copied while demuxing, packets continued across pages
+  */
+  size_t CopiedBytes() const noexcept
+  {
+    return _copied;
+  }
+
+  /*
+     @brief Opens path once and keeps it mapped for the life of the process, later calls share the same track.
+     A track that didn't open isn't kept, the next call opens the file again
+     @return the track, check IsOpen()
+  */
+  static std::shared_ptr<const OpusTrack> Shared(std::string const &path) noexcept;
+
+private:
+  bool Demux() noexcept;
+
+  const uint8_t *_map = nullptr;
+  size_t _size = 0;
+  std::string _error;
+  std::vector<std::span<const uint8_t>> _packets;
+  std::vector<std::unique_ptr<uint8_t[]>> _joined; // packets continued across pages
+  int64_t _samples = 0;
+  size_t _copied = 0;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include "event_capture.h"
+#include <dpp/appcommand.h>
+#include <variant>
+
+namespace capture
+{
+static void CopyOptions(std::vector<dpp::command_data_option> const &from, std::vector<Option> &to)
+{
+  to.resize(from.size());
+  for (size_t i = 0; i < from.size(); ++i)
+  {
+    auto const &src = from[i];
+    Option &dst = to[i];
+    dst.Name = src.name;
+    if (auto v = std::get_if<std::string>(&src.value))
+    {
+      dst.Type = ValueType::String;
+      dst.Str = *v;
+    }
+    else if (auto v = std::get_if<int64_t>(&src.value))
+    {
+      dst.Type = ValueType::Integer;
+      dst.Int = *v;
+    }
+    else if (auto v = std::get_if<bool>(&src.value))
+    {
+      dst.Type = ValueType::Boolean;
+      dst.Int = *v;
+    }
+    else if (auto v = std::get_if<dpp::snowflake>(&src.value))
+    {
+      dst.Type = ValueType::Snowflake;
+      dst.Int = static_cast<int64_t>(static_cast<uint64_t>(*v));
+    }
+    else if (auto v = std::get_if<double>(&src.value))
+    {
+      dst.Type = ValueType::Double;
+      dst.Real = *v;
+    }
+    CopyOptions(src.options, dst.Options);
+  }
+}
+
+Recorder::Recorder(const char *path) noexcept : _log(path), _start(std::chrono::steady_clock::now())
+{
+}
+
+uint64_t Recorder::NowNs() const noexcept
+{
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now() - _start).count();
+}
+
+void Recorder::Record(dpp::slashcommand_t const &event) noexcept
+{
+  auto const *cmd = std::get_if<dpp::command_interaction>(&event.command.data);
+  if (!cmd)
+    return;
+  Event e{};
+  e.Type = Kind::SlashCommand;
+  e.TimeNs = NowNs();
+  e.GuildId = event.command.guild_id;
+  e.ChannelId = event.command.channel_id;
+  e.UserId = event.command.usr.id;
+  e.Locale = event.command.guild_locale;
+  e.Command = cmd->name;
+  CopyOptions(cmd->options, e.Options);
+  _log.Append(e);
+}
+
+void Recorder::Record(dpp::voice_state_update_t const &event) noexcept
+{
+  Event e{};
+  e.Type = Kind::VoiceState;
+  e.TimeNs = NowNs();
+  e.GuildId = event.state.guild_id;
+  e.ChannelId = event.state.channel_id;
+  e.UserId = event.state.user_id;
+  e.Flags = event.state.is_self_mute() | event.state.is_self_deaf() << 1;
+  _log.Append(e);
+}
+
+void Recorder::Record(dpp::button_click_t const &event) noexcept
+{
+  Event e{};
+  e.Type = Kind::ButtonClick;
+  e.TimeNs = NowNs();
+  e.GuildId = event.command.guild_id;
+  e.ChannelId = event.command.channel_id;
+  e.UserId = event.command.usr.id;
+  e.Locale = event.command.guild_locale;
+  e.Command = event.custom_id;
+  _log.Append(e);
+}
+} // namespace capture
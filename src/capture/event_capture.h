@@ -0,0 +1,39 @@
+#ifndef EVENT_CAPTURE_H
+#define EVENT_CAPTURE_H
+#include "event_log.h"
+#include <chrono>
+#include <dpp/dispatcher.h>
+
+namespace capture
+{
+/*
+   Capture mode: copies the incoming events the session logic reacts to into an event log, see event_log.h.
+   Enabled with POMODORO_CAPTURE=<path>, tools/replay reads the log back.
+*/
+class Recorder
+{
+public:
+  explicit Recorder(const char *path) noexcept;
+
+  bool IsOpen() const noexcept
+  {
+    return _log.IsOpen();
+  }
+
+  void Record(dpp::slashcommand_t const &event) noexcept;
+  void Record(dpp::voice_state_update_t const &event) noexcept;
+  void Record(dpp::button_click_t const &event) noexcept;
+  void Flush() noexcept
+  {
+    _log.Flush();
+  }
+
+private:
+  uint64_t NowNs() const noexcept;
+
+  Writer _log;
+  std::chrono::steady_clock::time_point _start;
+};
+} // namespace capture
+
+#endif
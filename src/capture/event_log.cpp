@@ -0,0 +1,235 @@
+#include "event_log.h"
+#include <algorithm>
+#include <cstring>
+
+namespace capture
+{
+constexpr char Magic[4] = {'P', 'M', 'C', 'P'};
+constexpr uint8_t Version = 1;
+constexpr uint32_t MaxRecord = 1u << 20; // a record bigger than this means the log is corrupt
+constexpr size_t MaxDepth = 4;          // slash command options nest at most group > subcommand > option
+
+// Encoding
+
+static void PutInt(std::string &buf, uint64_t v, size_t bytes) noexcept
+{
+  for (size_t i = 0; i < bytes; ++i)
+    buf.push_back(static_cast<char>(v >> (8 * i)));
+}
+
+static void PutStr(std::string &buf, std::string const &s) noexcept
+{
+  size_t len = std::min<size_t>(s.size(), UINT16_MAX);
+  PutInt(buf, len, 2);
+  buf.append(s, 0, len);
+}
+
+static void PutOptions(std::string &buf, std::vector<Option> const &options) noexcept
+{
+  size_t count = std::min<size_t>(options.size(), UINT8_MAX);
+  PutInt(buf, count, 1);
+  for (size_t i = 0; i < count; ++i)
+  {
+    Option const &o = options[i];
+    PutStr(buf, o.Name);
+    PutInt(buf, static_cast<uint8_t>(o.Type), 1);
+    switch (o.Type)
+    {
+    case ValueType::String:
+      PutStr(buf, o.Str);
+      break;
+    case ValueType::Integer:
+    case ValueType::Boolean:
+    case ValueType::Snowflake:
+      PutInt(buf, o.Int, 8);
+      break;
+    case ValueType::Double:
+    {
+      uint64_t bits;
+      std::memcpy(&bits, &o.Real, sizeof(bits));
+      PutInt(buf, bits, 8);
+      break;
+    }
+    case ValueType::None:
+      break;
+    }
+    PutOptions(buf, o.Options);
+  }
+}
+
+// Decoding, every Get fails once the record is exhausted
+
+struct Cursor
+{
+  const char *Pos;
+  const char *End;
+
+  bool GetInt(uint64_t &v, size_t bytes) noexcept
+  {
+    if (size_t(End - Pos) < bytes)
+      return 0;
+    v = 0;
+    for (size_t i = 0; i < bytes; ++i)
+      v |= uint64_t(static_cast<uint8_t>(Pos[i])) << (8 * i);
+    Pos += bytes;
+    return 1;
+  }
+
+  bool GetStr(std::string &s) noexcept
+  {
+    uint64_t len;
+    if (!GetInt(len, 2) || size_t(End - Pos) < len)
+      return 0;
+    s.assign(Pos, len);
+    Pos += len;
+    return 1;
+  }
+
+  bool GetOptions(std::vector<Option> &options, size_t depth) noexcept
+  {
+    uint64_t count;
+    if (depth > MaxDepth || !GetInt(count, 1))
+      return 0;
+    options.resize(count);
+    for (Option &o : options)
+    {
+      uint64_t type, v;
+      if (!GetStr(o.Name) || !GetInt(type, 1))
+        return 0;
+      o.Type = static_cast<ValueType>(type);
+      switch (o.Type)
+      {
+      case ValueType::String:
+        if (!GetStr(o.Str))
+          return 0;
+        break;
+      case ValueType::Integer:
+      case ValueType::Boolean:
+      case ValueType::Snowflake:
+        if (!GetInt(v, 8))
+          return 0;
+        o.Int = static_cast<int64_t>(v);
+        break;
+      case ValueType::Double:
+        if (!GetInt(v, 8))
+          return 0;
+        std::memcpy(&o.Real, &v, sizeof(v));
+        break;
+      case ValueType::None:
+        break;
+      default:
+        return 0;
+      }
+      if (!GetOptions(o.Options, depth + 1))
+        return 0;
+    }
+    return 1;
+  }
+};
+
+// Writer
+
+Writer::Writer(const char *path) noexcept : _file(std::fopen(path, "wb"))
+{
+  if (!_file)
+    return;
+  std::setvbuf(_file, nullptr, _IOFBF, 1 << 16);
+  char header[8] = {Magic[0], Magic[1], Magic[2], Magic[3], static_cast<char>(Version), 0, 0, 0};
+  std::fwrite(header, 1, sizeof(header), _file);
+}
+
+Writer::~Writer()
+{
+  if (_file)
+    std::fclose(_file);
+}
+
+void Writer::Append(Event const &e) noexcept
+{
+  if (!_file)
+    return;
+  std::lock_guard lock(_mtx);
+  _buf.assign(4, '\0'); // length, filled in below
+  PutInt(_buf, static_cast<uint8_t>(e.Type), 1);
+  PutInt(_buf, e.TimeNs, 8);
+  PutInt(_buf, e.GuildId, 8);
+  PutInt(_buf, e.ChannelId, 8);
+  PutInt(_buf, e.UserId, 8);
+  PutInt(_buf, e.Flags, 1);
+  PutStr(_buf, e.Locale);
+  PutStr(_buf, e.Command);
+  PutOptions(_buf, e.Options);
+
+  uint32_t len = _buf.size() - 4;
+  for (size_t i = 0; i < 4; ++i)
+    _buf[i] = static_cast<char>(len >> (8 * i));
+  std::fwrite(_buf.data(), 1, _buf.size(), _file);
+}
+
+void Writer::Flush() noexcept
+{
+  std::lock_guard lock(_mtx);
+  if (_file)
+    std::fflush(_file);
+}
+
+// Reader
+
+Reader::Reader(const char *path) noexcept : _file(std::fopen(path, "rb"))
+{
+  if (!_file)
+    return;
+  char header[8];
+  if (std::fread(header, 1, sizeof(header), _file) != sizeof(header) || std::memcmp(header, Magic, 4) ||
+      header[4] != Version)
+  {
+    std::fclose(_file);
+    _file = nullptr;
+  }
+}
+
+Reader::~Reader()
+{
+  if (_file)
+    std::fclose(_file);
+}
+
+bool Reader::Fail() noexcept
+{
+  _corrupt = 1;
+  return 0;
+}
+
+bool Reader::Next(Event &out) noexcept
+{
+  if (!_file || _corrupt)
+    return 0;
+  unsigned char len_bytes[4];
+  size_t got = std::fread(len_bytes, 1, 4, _file);
+  if (got == 0)
+    return 0; // End of the log
+  if (got != 4)
+    return Fail();
+  uint32_t len = len_bytes[0] | len_bytes[1] << 8 | len_bytes[2] << 16 | uint32_t(len_bytes[3]) << 24;
+  if (len > MaxRecord)
+    return Fail();
+  _buf.resize(len);
+  if (std::fread(_buf.data(), 1, len, _file) != len)
+    return Fail();
+
+  Cursor c{_buf.data(), _buf.data() + len};
+  uint64_t kind, flags;
+  if (!c.GetInt(kind, 1) || !c.GetInt(out.TimeNs, 8) || !c.GetInt(out.GuildId, 8) || !c.GetInt(out.ChannelId, 8) ||
+      !c.GetInt(out.UserId, 8) || !c.GetInt(flags, 1) || !c.GetStr(out.Locale) || !c.GetStr(out.Command))
+    return Fail();
+  if (kind < static_cast<uint8_t>(Kind::SlashCommand) || kind > static_cast<uint8_t>(Kind::ButtonClick))
+    return Fail();
+  out.Type = static_cast<Kind>(kind);
+  out.Flags = flags;
+  out.Options.clear();
+  if (!c.GetOptions(out.Options, 0) || c.Pos != c.End)
+    return Fail();
+  _records++;
+  return 1;
+}
+} // namespace capture
@@ -0,0 +1,137 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+   Compact binary log of incoming gateway events, written by capture mode and read back by tools/replay.
+   The format doesn't depend on D++ so the tool builds without it.
+
+   File: "PMCP" version(1) 3 padding bytes, then records of u32 length followed by the payload:
+     u8 kind, u64 time (ns since capture start), u64 guild, u64 channel, u64 user, u8 flags,
+     str locale, str command, u8 option count, options...
+   An option is str name, u8 type, the value for its type and its own u8 count of nested options.
+   Integers are little endian, str is a u16 length and the bytes.
+*/
+namespace capture
+{
+enum class Kind : uint8_t
+{
+  SlashCommand = 1,
+  VoiceState = 2,
+  ButtonClick = 3 // Command holds the custom id
+};
+
+enum class ValueType : uint8_t
+{
+  None = 0,
+  String,
+  Integer,
+  Boolean,
+  Snowflake,
+  Double
+};
+
+struct Option
+{
+  std::string Name;
+  ValueType Type = ValueType::None;
+  std::string Str;
+  int64_t Int = 0; // Integer, Boolean and Snowflake
+  double Real = 0;
+  std::vector<Option> Options; // subcommand options
+};
+
+struct Event
+{
+  Kind Type;
+  uint64_t TimeNs;
+  uint64_t GuildId;
+  uint64_t ChannelId; // voice state: the channel joined, 0 when leaving
+  uint64_t UserId;
+  uint8_t Flags; // voice state: bit-0 self mute, bit-1 self deaf
+  std::string Locale;
+  std::string Command;
+  std::vector<Option> Options;
+};
+
+class Writer
+{
+public:
+  /*
+     @brief Creates the log at path, truncating it
+  */
+  explicit Writer(const char *path) noexcept;
+  ~Writer();
+  Writer(Writer const &) = delete;
+  Writer &operator=(Writer const &) = delete;
+
+  bool IsOpen() const noexcept
+  {
+    return _file;
+  }
+
+  /*
+     @brief Appends an event, safe to call from several threads
+  */
+  void Append(Event const &event) noexcept;
+  void Flush() noexcept;
+
+private:
+  std::FILE *_file = nullptr;
+  std::mutex _mtx;
+  std::string _buf; // reused encoding buffer
+};
+
+class Reader
+{
+public:
+  explicit Reader(const char *path) noexcept;
+  ~Reader();
+  Reader(Reader const &) = delete;
+  Reader &operator=(Reader const &) = delete;
+
+  /*
+     @return false if the file couldn't be opened or isn't an event log
+  */
+  bool IsOpen() const noexcept
+  {
+    return _file;
+  }
+
+  /*
+     @brief Reads the next event
+     @return false at the end of the log or on a record that can't be read, see Corrupt
+  */
+  bool Next(Event &out) noexcept;
+
+  /*
+     @return true if Next stopped on a truncated or malformed record rather than at the end of the log
+  */
+  bool Corrupt() const noexcept
+  {
+    return _corrupt;
+  }
+
+  /*
+     @return records read so far, the index of the corrupt one once Next failed on it
+  */
+  uint64_t Records() const noexcept
+  {
+    return _records;
+  }
+
+private:
+  bool Fail() noexcept;
+
+  std::FILE *_file = nullptr;
+  std::string _buf;
+  uint64_t _records = 0;
+  bool _corrupt = 0;
+};
+} // namespace capture
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/*
+   The clock sessions and their schedulers measure phases on. It's std::chrono::steady_clock, except in the build the
+   tests and benchmarks link (POMODORO_VIRTUAL_CLOCK), where it only moves when Advance is called and hours of phases
+   run in milliseconds. Tracing, the watchdog and the handler timers always use the real clocks.
+*/
+namespace utl
+{
+#ifdef POMODORO_VIRTUAL_CLOCK
+struct Clock
+{
+  using duration = std::chrono::steady_clock::duration;
+  using rep = duration::rep;
+  using period = duration::period;
+  using time_point = std::chrono::time_point<Clock>;
+  static constexpr bool is_steady = true;
+
+  static time_point now() noexcept
+  {
+    return time_point(duration(_now.load(std::memory_order_acquire)));
+  }
+
+  static void Advance(duration by) noexcept
+  {
+    _now.fetch_add(by.count(), std::memory_order_acq_rel);
+  }
+
+private:
+  // A day in, time_point{} means "never" in the schedulers and "now - window" must not go below it
+  static inline std::atomic<rep> _now{std::chrono::duration_cast<duration>(std::chrono::hours(24)).count()};
+};
+#else
+using Clock = std::chrono::steady_clock;
+#endif
+
+/*
+   @return wall-clock time in ms, for deadlines shared with other processes. Moves with Clock in the virtual build
+*/
+inline int64_t WallMs() noexcept
+{
+  using namespace std::chrono;
+#ifdef POMODORO_VIRTUAL_CLOCK
+  static const int64_t base = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count() -
+                              duration_cast<milliseconds>(Clock::now().time_since_epoch()).count();
+  return base + duration_cast<milliseconds>(Clock::now().time_since_epoch()).count();
+#else
+  return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+#endif
+}
+} // namespace utl
+
+#endif
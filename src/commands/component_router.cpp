@@ -0,0 +1,21 @@
+#include "component_router.h"
+#include "load_shedder.h"
+#include "watchdog.h"
+
+void ComponentRouter::Add(uint8_t tag, Handler handler) noexcept
+{
+  _handlers[tag] = std::move(handler);
+}
+
+bool ComponentRouter::Dispatch(dpp::button_click_t const &event) noexcept
+{
+  shed::HandlerTimer timer;
+  watchdog::Busy busy("component_router.dispatch");
+  uint8_t tag, action;
+  uint32_t handle;
+  if (!Decode(event.custom_id, tag, action, handle) || !_handlers[tag])
+    return 0;
+
+  _handlers[tag](event, action, handle);
+  return 1;
+}
@@ -0,0 +1,66 @@
+#ifndef COMPONENT_ROUTER_H
+#define COMPONENT_ROUTER_H
+#include <cstdint>
+#include <dpp/dispatcher.h>
+#include <functional>
+#include <string_view>
+
+/*
+   Routes button clicks by a fixed layout custom_id: [tag][action][handle as 8 hex digits].
+   The tag picks the handler in O(1) and decoding never allocates.
+*/
+class ComponentRouter
+{
+public:
+  using Handler = std::function<void(dpp::button_click_t const &, uint8_t action, uint32_t handle)>;
+
+  static constexpr size_t IdLength = 10;
+  using Id = char[IdLength + 1]; // null terminated
+
+  static void Encode(Id &out, uint8_t tag, uint8_t action, uint32_t handle) noexcept
+  {
+    constexpr char hex[] = "0123456789abcdef";
+    out[0] = tag;
+    out[1] = action;
+    for (int i = 0; i < 8; ++i)
+      out[2 + i] = hex[(handle >> (28 - 4 * i)) & 0xf];
+    out[IdLength] = '\0';
+  }
+
+  /*
+     @return false if custom_id doesn't have the router layout
+  */
+  static bool Decode(std::string_view custom_id, uint8_t &tag, uint8_t &action, uint32_t &handle) noexcept
+  {
+    if (custom_id.size() != IdLength)
+      return 0;
+    tag = custom_id[0];
+    action = custom_id[1];
+    handle = 0;
+    for (size_t i = 2; i < IdLength; ++i)
+    {
+      char c = custom_id[i];
+      uint32_t digit;
+      if (c >= '0' && c <= '9')
+        digit = c - '0';
+      else if (c >= 'a' && c <= 'f')
+        digit = c - 'a' + 10;
+      else
+        return 0;
+      handle = handle << 4 | digit;
+    }
+    return 1;
+  }
+
+  void Add(uint8_t tag, Handler handler) noexcept;
+
+  /*
+     @return false if the custom_id isn't valid or no handler has its tag
+  */
+  bool Dispatch(dpp::button_click_t const &event) noexcept;
+
+private:
+  Handler _handlers[256];
+};
+
+#endif
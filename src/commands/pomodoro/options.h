@@ -0,0 +1,303 @@
+#ifndef POMODORO_OPTIONS_H
+#define POMODORO_OPTIONS_H
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <dpp/appcommand.h>
+#include <dpp/channel.h>
+#include <dpp/cluster.h>
+#include <dpp/snowflake.h>
+#include <fmt/format.h>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <variant>
+
+/*
+   Slash command options are described once in a constexpr table per subcommand, both the dpp::command_option
+   definitions and the typed parser are generated from it so the two can't drift apart.
+*/
+namespace opt
+{
+enum class Kind : uint8_t
+{
+  Integer,
+  Boolean,
+  String,
+  Channel, // voice channels only, it's the only kind the bot works with
+  User
+};
+
+struct Spec
+{
+  std::string_view Name;
+  std::string_view Description; // ", defaults to ..." is appended for optional integers and booleans
+  Kind Type;
+  bool Required = 0;
+  int64_t Min = 0; // Integer only, inclusive
+  int64_t Max = 0;
+  int64_t Default = 0; // Integer and Boolean
+};
+
+template <size_t A, size_t B>
+constexpr std::array<Spec, A + B> Concat(std::array<Spec, A> const &a, std::array<Spec, B> const &b) noexcept
+{
+  std::array<Spec, A + B> res{};
+  for (size_t i = 0; i < A; ++i)
+    res[i] = a[i];
+  for (size_t i = 0; i < B; ++i)
+    res[A + i] = b[i];
+  return res;
+}
+
+// Lets option names be template arguments: values.Get<"work">()
+template <size_t N> //
+struct Name
+{
+  char Data[N];
+  constexpr Name(const char (&str)[N]) noexcept
+  {
+    for (size_t i = 0; i < N; ++i)
+      Data[i] = str[i];
+  }
+  constexpr operator std::string_view() const noexcept
+  {
+    return {Data, N - 1};
+  }
+};
+
+/*
+   @brief Index of an option in the schema, a name that isn't in it fails the build
+*/
+template <auto const &Schema> //
+consteval size_t IndexOf(std::string_view name)
+{
+  for (size_t i = 0; i < Schema.size(); ++i)
+    if (Schema[i].Name == name)
+      return i;
+  throw "Option isn't in the schema";
+}
+
+/*
+   @brief Adds the options of the schema to a subcommand
+*/
+template <auto const &Schema> //
+void AddOptions(dpp::command_option &cmd)
+{
+  for (Spec const &s : Schema)
+  {
+    std::string description(s.Description);
+    dpp::command_option_type type = dpp::co_integer;
+    switch (s.Type)
+    {
+    case Kind::Integer:
+      if (!s.Required)
+        description += fmt::format(", defaults to {}", s.Default);
+      break;
+    case Kind::Boolean:
+      type = dpp::co_boolean;
+      if (!s.Required)
+        description += s.Default ? ", defaults to on" : ", defaults to off";
+      break;
+    case Kind::String:
+      type = dpp::co_string;
+      break;
+    case Kind::Channel:
+      type = dpp::co_channel;
+      break;
+    case Kind::User:
+      type = dpp::co_user;
+      break;
+    }
+
+    dpp::command_option option(type, std::string(s.Name), description, s.Required);
+    if (s.Type == Kind::Integer)
+      option.set_min_value(s.Min).set_max_value(s.Max);
+    else if (s.Type == Kind::Channel)
+      option.add_channel_type(dpp::CHANNEL_VOICE);
+    cmd.add_option(std::move(option));
+  }
+}
+
+/*
+   @brief Typed values of a subcommand, options that weren't given hold their defaults.
+   Strings point into the interaction so they must not outlive the event.
+*/
+template <auto const &Schema> //
+class Values
+{
+  static constexpr size_t N = Schema.size();
+  static_assert(N <= 32, "Presence is tracked in 32 bits");
+
+public:
+  constexpr Values() noexcept
+  {
+    for (size_t i = 0; i < N; ++i)
+      _ints[i] = Schema[i].Default;
+  }
+
+  /*
+     @brief Reads the options of a subcommand, options that aren't in the schema are ignored.
+     @param error set to a message for the user when a value is out of range or has the wrong type
+     @return false if an option isn't valid
+  */
+  bool Parse(dpp::command_data_option const &subcmd, std::string &error, dpp::cluster *bot = nullptr)
+  {
+    for (auto const &option : subcmd.options)
+    {
+      size_t i = Find(option.name);
+      if (i == N)
+        continue;
+      Spec const &s = Schema[i];
+      bool ok = 0;
+      switch (s.Type)
+      {
+      case Kind::Integer:
+        if (auto v = std::get_if<int64_t>(&option.value))
+        {
+          if (*v < s.Min || *v > s.Max)
+          {
+            error = fmt::format("`{}` must be between {} and {}", s.Name, s.Min, s.Max);
+            return 0;
+          }
+          _ints[i] = *v;
+          ok = 1;
+        }
+        break;
+      case Kind::Boolean:
+        if (auto v = std::get_if<bool>(&option.value))
+        {
+          _ints[i] = *v;
+          ok = 1;
+        }
+        break;
+      case Kind::String:
+        if (auto v = std::get_if<std::string>(&option.value))
+        {
+          _strs[i] = *v;
+          ok = 1;
+        }
+        break;
+      case Kind::Channel:
+      case Kind::User:
+        if (auto v = std::get_if<dpp::snowflake>(&option.value))
+        {
+          _ints[i] = static_cast<int64_t>(static_cast<uint64_t>(*v));
+          ok = 1;
+        }
+        break;
+      }
+
+      if (!ok)
+      {
+        error = "Bot error happened; please contact Melal";
+        if (bot)
+          bot->log(dpp::loglevel::ll_error, fmt::format("Option {} has an unexpected type", option.name));
+        return 0;
+      }
+      _present |= 1u << i;
+    }
+    return 1;
+  }
+
+  template <Name name> //
+  auto Get() const noexcept
+  {
+    constexpr size_t I = IndexOf<Schema>(name);
+    constexpr Kind K = Schema[I].Type;
+    if constexpr (K == Kind::Integer)
+      return _ints[I];
+    else if constexpr (K == Kind::Boolean)
+      return _ints[I] != 0;
+    else if constexpr (K == Kind::String)
+      return _strs[I];
+    else
+      return dpp::snowflake(static_cast<uint64_t>(_ints[I]));
+  }
+
+  template <Name name> //
+  bool Has() const noexcept
+  {
+    return _present >> IndexOf<Schema>(name) & 1u;
+  }
+
+  bool Empty() const noexcept
+  {
+    return !_present;
+  }
+
+private:
+  static size_t Find(std::string_view name) noexcept
+  {
+    for (size_t i = 0; i < N; ++i)
+      if (Schema[i].Name == name)
+        return i;
+    return N;
+  }
+
+  std::array<int64_t, N> _ints{}; // integers, booleans and snowflakes
+  std::array<std::string_view, N> _strs{};
+  uint32_t _present = 0;
+};
+} // namespace opt
+
+// Schemas -----------
+
+namespace opt::pomodoro
+{
+constexpr int64_t MaxPeriod = 4 * 60; // minutes
+constexpr int64_t MaxRepeat = 24;
+constexpr int64_t DefaultLeaderboardSize = 10;
+constexpr int64_t MaxLeaderboardSize = 25;
+constexpr int64_t MaxCueSet = 15; // CueComposer::MaxCueSet
+
+// Shared by start and schedule
+inline constexpr std::array<Spec, 5> Session{{
+    {"work", "Work period in minutes", Kind::Integer, 0, 1, MaxPeriod, 40},
+    {"break", "Break period in minutes", Kind::Integer, 0, 1, MaxPeriod, 15},
+    {"repeat", "How many work sessions", Kind::Integer, 0, 1, MaxRepeat, 3},
+    {"mute", "If you want the bot to mute members during work sessions", Kind::Boolean},
+    {"voice", "If you want the bot to join and notify when a work/break session ends", Kind::Boolean},
+}};
+
+inline constexpr auto Start = Session;
+
+inline constexpr std::array<Spec, 2> Set{{
+    {"mute", "Turn mute between session on/off", Kind::Boolean},
+    {"voice", "Turn voice notifications between session on/off", Kind::Boolean},
+}};
+
+inline constexpr auto Schedule = Concat(
+    std::array<Spec, 3>{{
+        {"time", "Start time as HH:MM in UTC", Kind::String, 1},
+        {"channel", "Voice channel to run the session in", Kind::Channel, 1},
+        {"days", "daily, weekdays, weekends or a list like mon,wed,fri, defaults to daily", Kind::String},
+    }},
+    Session);
+
+// Saved defaults of start and schedule, the session options that are given are saved
+inline constexpr auto Prefs = Concat(
+    std::array<Spec, 3>{{
+        {"server", "Save the defaults of this server instead of yours, needs Manage Server", Kind::Boolean},
+        {"cues", "Voice cue set, 0 is the standard one", Kind::Integer, 0, 0, MaxCueSet, 0},
+        {"reset", "Forget the saved defaults", Kind::Boolean},
+    }},
+    Session);
+
+inline constexpr std::array<Spec, 1> Unschedule{{
+    {"id", "Schedule id given by /pomodoro schedule", Kind::Integer, 1, 0, std::numeric_limits<int32_t>::max()},
+}};
+
+inline constexpr std::array<Spec, 1> Room{{
+    {"channel", "Voice channel to add to the session", Kind::Channel, 1},
+}};
+
+inline constexpr std::array<Spec, 1> Stats{{
+    {"user", "Whose stats to show, defaults to you", Kind::User},
+}};
+
+inline constexpr std::array<Spec, 1> Leaderboard{{
+    {"count", "How many members to show", Kind::Integer, 0, 1, MaxLeaderboardSize, DefaultLeaderboardSize},
+}};
+} // namespace opt::pomodoro
+#endif
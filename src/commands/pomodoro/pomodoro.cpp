@@ -1,5 +1,8 @@
 #include "pomodoro.h"
+#include "options.h"
 #include "session_manager.h"
+#include "trace.h"
+#include "watchdog.h"
 #include "utils.h"
 #include <dpp/appcommand.h>
 #include <dpp/cache.h>
@@ -10,15 +13,18 @@
 #include <dpp/message.h>
 #include <dpp/snowflake.h>
 #include <fmt/format.h>
-#include <optional>
+#include "arena.h"
+#include "load_shedder.h"
+#include <algorithm>
+#include <iterator>
 
-constexpr unsigned DefaultWorkPeriod = 40;
-constexpr unsigned DefaultBreakPeriod = 15;
-constexpr unsigned DefaultRepeat = 3;
+namespace schema = opt::pomodoro;
+static_assert(schema::MaxCueSet == CueComposer::MaxCueSet);
 
 // constructor-------
 
-Pomodoro::Pomodoro(SessionManager &Manager) noexcept : ManagerRef(Manager)
+Pomodoro::Pomodoro(SessionManager &Manager, RecurringScheduler &Scheduler, ProfileStore &Profiles) noexcept
+    : ManagerRef(Manager), SchedulerRef(Scheduler), ProfilesRef(Profiles)
 {
   ManagerRef.Bot.log(DL::ll_info, "Pomodoro init");
 }
@@ -28,37 +34,22 @@ Pomodoro::Pomodoro(SessionManager &Manager) noexcept : ManagerRef(Manager)
 // Helper functions--
 
 /*
-   @brief Get a value from a command_data_option variant.
-   @param bot if provided then the function will use the bot to log errors.
-   @param event if provided then the function will reply to the event when error happend.
-   @return returns the value if it's there and nullopt if not.
+   @brief Parses the options of subcmd with the given schema.
+   @return false if an option isn't valid, the event is already replied to in that case.
  */
-template <class T>
+template <auto const &Schema>
 [[nodiscard]]
-static inline std::optional<T> GetValueSafe(
-    dpp::command_data_option const &option,
-    dpp::cluster *bot = nullptr,
-    dpp::slashcommand_t const *event = nullptr) noexcept
+static inline bool ParseOptions(
+    Pomodoro &self,
+    dpp::slashcommand_t const &event,
+    dpp::command_data_option const &subcmd,
+    opt::Values<Schema> &out) noexcept
 {
-  static_assert(
-      std::disjunction_v<
-          std::is_same<T, std::string>,
-          std::is_same<T, int64_t>,
-          std::is_same<T, bool>,
-          std::is_same<T, dpp::snowflake>,
-          std::is_same<T, double>>,
-      "T must be a valid command_value type");
-
-  if (const T *v = std::get_if<T>(&option.value))
-    return *v;
-
-  if (event)
-    event->reply("Bot error happened; please contact Melal");
-
-  if (bot)
-    bot->log(DL::ll_error, fmt::format("Error when trying to get value from option {}", option.name));
-
-  return std::nullopt;
+  std::string error;
+  if (out.Parse(subcmd, error, &self.ManagerRef.Bot))
+    return 1;
+  event.reply(msg_fl(error, dpp::m_ephemeral));
+  return 0;
 }
 
 template <bool owner_search, bool member_search> // IsInActiveSession
@@ -84,8 +75,88 @@ static inline SessionManager::Session *IsInActiveSession(Pomodoro &self, dpp::sn
   return nullptr;
 }
 
+struct SessionOptions
+{
+  uint32_t Work;
+  uint32_t Break;
+  uint32_t Repeat;
+  flag_t Flags = 0;
+  uint8_t CueSet = 0;
+};
+
+/*
+   @brief Options shared by start and schedule, both schemas include schema::Session.
+   A typed option wins, then the user's saved default, then the server's, then the schema default
+*/
+template <auto const &Schema> //
+static inline SessionOptions GetSessionOptions(
+    Pomodoro &self, opt::Values<Schema> const &values, dpp::snowflake guild_id, dpp::snowflake usr_id) noexcept
+{
+  using Flag = SessionManager::Session::Flag;
+  using Store = ProfileStore;
+  Store::Profile user, guild;
+  self.ProfilesRef.Get(Store::Scope::User, usr_id, user);
+  self.ProfilesRef.Get(Store::Scope::Guild, guild_id, guild);
+  auto saved = [&](Store::Field f) -> Store::Profile const *
+  { return user.Fields & f ? &user : guild.Fields & f ? &guild : nullptr; };
+
+  SessionOptions out;
+  out.Work = values.template Get<"work">();
+  out.Break = values.template Get<"break">();
+  out.Repeat = values.template Get<"repeat">();
+  bool mute = values.template Get<"mute">(), voice = values.template Get<"voice">();
+  if (auto p = saved(Store::HasWork); p && !values.template Has<"work">())
+    out.Work = p->WorkPeriod;
+  if (auto p = saved(Store::HasBreak); p && !values.template Has<"break">())
+    out.Break = p->BreakPeriod;
+  if (auto p = saved(Store::HasRepeat); p && !values.template Has<"repeat">())
+    out.Repeat = p->Repeat;
+  if (auto p = saved(Store::HasMute); p && !values.template Has<"mute">())
+    mute = p->Switches & Store::HasMute;
+  if (auto p = saved(Store::HasVoice); p && !values.template Has<"voice">())
+    voice = p->Switches & Store::HasVoice;
+  if (auto p = saved(Store::HasCueSet))
+    out.CueSet = p->CueSet;
+  SessionManager::SetFlag(out.Flags, Flag::Mute, mute);
+  SessionManager::SetFlag(out.Flags, Flag::Voice, voice);
+  return out;
+}
+
+// Replies and returns true if new sessions are turned away because of load
+static inline bool RejectedForLoad(const dpp::slashcommand_t &event) noexcept
+{
+  if (!shed::Active(shed::Level::RejectSessions))
+    return 0;
+  event.reply(msg_fl(
+      std::string(loc::Get(loc::FromTag(event.command.guild_locale), loc::Word::Overloaded)), dpp::m_ephemeral));
+  return 1;
+}
+
+static inline void StopSession(Pomodoro &self, SessionManager::Session *session) noexcept
+{
+  self.ManagerRef.CancelSession(
+      session,
+      [&self](SessionManager::Session const &s)
+      { // Called if session found and before it removed
+        std::string msg;
+        loc::CanceledBy(s.Locale, std::back_inserter(msg), s.OwnerId);
+        self.ManagerRef.Notices.Post(s.ChannelId, std::move(msg));
+      });
+}
+
+static inline void ApplyMute(Pomodoro &self, SessionManager::Session *session, bool mode) noexcept
+{
+  using Flag = SessionManager::Session::Flag;
+  if (SessionManager::HasFlag(session->Flags, Flag::Mute) == mode)
+    return;
+  // If work session the apply it immediatly, paused sessions are applied on resume
+  if (!SessionManager::HasFlag(session->Flags, Flag::Break) && !SessionManager::HasFlag(session->Flags, Flag::Paused))
+    session->ChangeMembersStatus(self.ManagerRef, mode);
+  SessionManager::SetFlag(session->Flags, Flag::Mute, mode);
+}
+
 static inline void
-HandlePomodoroStart(Pomodoro &self, const dpp::slashcommand_t &event, dpp::command_data_option &subcmd)
+HandlePomodoroStart(Pomodoro &self, const dpp::slashcommand_t &event, dpp::command_data_option const &subcmd)
 {
   dpp::snowflake guild_id = event.command.guild_id, usr_id = event.command.usr.id;
   dpp::guild *g = dpp::find_guild(guild_id);
@@ -108,109 +179,323 @@ HandlePomodoroStart(Pomodoro &self, const dpp::slashcommand_t &event, dpp::comma
     return;
   }
 
-  uint32_t Uwork = DefaultWorkPeriod;
-  uint32_t Ubreak = DefaultBreakPeriod;
-  uint32_t Urepeat = DefaultRepeat;
-  flag_t flags = 0;
-
-  auto get_period = [&self, &event](uint32_t &var, dpp::command_data_option const &option) noexcept -> bool
-  {
-    if (auto v = GetValueSafe<int64_t>(option, &self.ManagerRef.Bot, &event))
-    {
-      if (*v <= 0)
-      {
-        event.reply(msg_fl(fmt::format("Not valid period {}", *v), dpp::m_ephemeral));
-        return 0;
-      }
-      if (*v > 4 * 3600)
-      {
-        event.reply(msg_fl("Max period is 4 hours for work/break", dpp::m_ephemeral));
-        return 0;
-      }
-      var = *v;
-      return 1;
-    }
-    else
-      return 0;
-  };
-  using Flag = SessionManager::Session::Flag;
-
-  auto get_flag = [&self, &event](flag_t &var, Flag flag, dpp::command_data_option const &option) noexcept -> bool
-  {
-    if (auto v = GetValueSafe<bool>(option, &self.ManagerRef.Bot, &event))
-    {
-      SessionManager::SetFlag(var, flag, *v);
-      return 1;
-    }
-    else
-      return 0;
-  };
-
-  if (!subcmd.empty())
-  {
-    for (auto &it : subcmd.options)
-    {
-      switch (tolower(it.name[0]))
-      {
-      case 'w':
-        if (!get_period(Uwork, it))
-          return;
-        break;
-      case 'b':
-        if (!get_period(Ubreak, it))
-          return;
-        break;
-      case 'r':
-        if (!get_period(Urepeat, it))
-          return;
-        break;
-      case 'm':
-        if (!get_flag(flags, Flag::Mute, it))
-          return;
-        break;
-      case 'v':
-        if (!get_flag(flags, Flag::Voice, it))
-          return;
-        break;
-      default:
-        self.ManagerRef.Bot.log(DL::ll_error, fmt::format("Option {} not recognized", it.name));
-      }
-    }
-  }
+  opt::Values<schema::Start> values;
+  if (!ParseOptions(self, event, subcmd, values) || RejectedForLoad(event))
+    return;
+  SessionOptions opts = GetSessionOptions(self, values, guild_id, usr_id);
 
   self.ManagerRef.StartSession(
       usr_id,
       Channel,
-      Uwork,
-      Ubreak,
-      Urepeat,
-      flags,
+      opts.Work,
+      opts.Break,
+      opts.Repeat,
+      opts.Flags,
+      loc::FromTag(event.command.guild_locale),
       [&event, Channel](SessionManager::Session const &s)
       {
+        // The reply owns its text, it's written straight into the string handed over
         std::string msg;
         msg.reserve(1024);
-        msg.append(fmt::format("Okay starting a session in channel <#{}>\nMembers are: ", Channel->id));
+        loc::SessionStarting(s.Locale, std::back_inserter(msg), Channel->id);
         for (auto const &id : s.MembersId)
-        {
-          msg.append(fmt::format("<@{}>  ", (int64_t)id));
-        }
+          loc::Mention(std::back_inserter(msg), id);
 
         if (event.command.channel_id == Channel->id)
-          event.reply(msg_fl(msg, dpp::m_ephemeral));
+          event.reply(msg_fl(std::move(msg), dpp::m_ephemeral));
         else
-          event.reply(msg);
-      } //
-  );
+          event.reply(std::move(msg));
+      },
+      opts.CueSet);
 
   return;
 }
 
+static inline void
+HandlePomodoroRoom(Pomodoro &self, const dpp::slashcommand_t &event, dpp::command_data_option const &subcmd)
+{
+  auto Session = IsInActiveSession<true, false>(self, event.command.usr.id);
+  if (!Session)
+  {
+    event.reply(msg_fl("You aren't an owner of any active session", dpp::m_ephemeral));
+    return;
+  }
+
+  opt::Values<schema::Room> values;
+  if (!ParseOptions(self, event, subcmd, values) || RejectedForLoad(event))
+    return;
+  dpp::snowflake channel_id = values.Get<"channel">();
+
+  dpp::channel *Channel = dpp::find_channel(channel_id);
+  if (!Channel || !Channel->is_voice_channel() || Channel->guild_id != Session->GuildId)
+  {
+    event.reply(msg_fl("Pick a voice channel of this server", dpp::m_ephemeral));
+    return;
+  }
+  if (self.ManagerRef.GetSessionByChannelId(channel_id))
+  {
+    event.reply(msg_fl("That channel already has a session running", dpp::m_ephemeral));
+    return;
+  }
+  if (!self.ManagerRef.AddRoom(Session, Channel))
+  {
+    event.reply(msg_fl(
+        fmt::format("A session can't have more than {} extra rooms", SessionManager::MaxRooms), dpp::m_ephemeral));
+    return;
+  }
+
+  std::string notice;
+  loc::RoomJoined(Session->Locale, std::back_inserter(notice), Session->OwnerId, Session->ChannelId);
+  self.ManagerRef.Bot.message_create(dpp::message(channel_id, notice));
+  event.reply(fmt::format("<#{}> now follows this session's timer", channel_id));
+}
+
+static inline void
+HandlePomodoroStats(Pomodoro &self, const dpp::slashcommand_t &event, dpp::command_data_option const &subcmd)
+{
+  opt::Values<schema::Stats> values;
+  if (!ParseOptions(self, event, subcmd, values))
+    return;
+  dpp::snowflake usr_id = values.Has<"user">() ? values.Get<"user">() : event.command.usr.id;
+
+  auto stats = self.ManagerRef.Stats.GetUserStats(event.command.guild_id, usr_id);
+  if (!stats.SessionsJoined && !stats.WorkPhases)
+  {
+    event.reply(msg_fl(fmt::format("<@{}> has no recorded sessions yet", (int64_t)usr_id), dpp::m_ephemeral));
+    return;
+  }
+
+  event.reply(msg_fl(
+      fmt::format(
+          "Stats for <@{}>\n"
+          "Work time: `{}` minutes in `{}` work sessions\n"
+          "Sessions: `{}` joined, `{}` completed, `{}` canceled\n"
+          "Completion rate: `{:.0f}%`",
+          (int64_t)usr_id,
+          stats.WorkMinutes,
+          stats.WorkPhases,
+          stats.SessionsJoined,
+          stats.SessionsCompleted,
+          stats.SessionsCanceled,
+          stats.CompletionRate() * 100),
+      dpp::m_ephemeral));
+}
+
+static inline void
+HandlePomodoroLeaderboard(Pomodoro &self, const dpp::slashcommand_t &event, dpp::command_data_option const &subcmd)
+{
+  opt::Values<schema::Leaderboard> values;
+  if (!ParseOptions(self, event, subcmd, values))
+    return;
+  int64_t count = values.Get<"count">();
+
+  StatsStore::LeaderboardEntry entries[schema::MaxLeaderboardSize];
+  size_t n = self.ManagerRef.Stats.GetLeaderboard(event.command.guild_id, entries, count);
+  if (!n)
+  {
+    event.reply(msg_fl("No work sessions have been completed in this server yet", dpp::m_ephemeral));
+    return;
+  }
+
+  std::string msg;
+  msg.reserve(1024);
+  msg.append("**Focus leaderboard**\n");
+  for (size_t i = 0; i < n; ++i)
+    msg.append(fmt::format(
+        "`#{}` <@{}> - `{}` minutes ({} sessions)\n",
+        i + 1,
+        (int64_t)entries[i].UserId,
+        entries[i].WorkMinutes,
+        entries[i].WorkPhases));
+
+  // Don't ping everyone on the board
+  event.reply(dpp::message(msg).set_allowed_mentions(false, false, false, false, {}, {}));
+}
+
+static inline void
+HandlePomodoroSchedule(Pomodoro &self, const dpp::slashcommand_t &event, dpp::command_data_option const &subcmd)
+{
+  opt::Values<schema::Schedule> values;
+  if (!ParseOptions(self, event, subcmd, values))
+    return;
+  SessionOptions opts = GetSessionOptions(self, values, event.command.guild_id, event.command.usr.id);
+
+  int minute = RecurringScheduler::ParseTime(values.Get<"time">());
+  uint8_t days = RecurringScheduler::Daily;
+  if (values.Has<"days">())
+    days = RecurringScheduler::ParseDays(values.Get<"days">());
+  dpp::snowflake channel_id = values.Get<"channel">();
+
+  if (minute < 0)
+  {
+    event.reply(msg_fl("Time must be `HH:MM` in UTC, for example `09:00`", dpp::m_ephemeral));
+    return;
+  }
+  if (!days)
+  {
+    event.reply(msg_fl("Days must be daily, weekdays, weekends or a list like `mon,wed,fri`", dpp::m_ephemeral));
+    return;
+  }
+  dpp::channel *Channel = dpp::find_channel(channel_id);
+  if (!Channel || !Channel->is_voice_channel() || Channel->guild_id != event.command.guild_id)
+  {
+    event.reply(msg_fl("Channel must be a voice channel in this server", dpp::m_ephemeral));
+    return;
+  }
+
+  RecurringScheduler::Schedule schedule{};
+  schedule.OwnerId = event.command.usr.id;
+  schedule.GuildId = event.command.guild_id;
+  schedule.ChannelId = channel_id;
+  schedule.MinuteOfDay = minute;
+  schedule.WorkPeriod = opts.Work;
+  schedule.BreakPeriod = opts.Break;
+  schedule.Repeat = opts.Repeat;
+  schedule.Days = days;
+  schedule.Flags = opts.Flags;
+  schedule.Locale = static_cast<uint8_t>(loc::FromTag(event.command.guild_locale));
+  schedule.Tenant = self.ManagerRef.Tenant;
+  schedule.CueSet = opts.CueSet;
+
+  int64_t id = self.SchedulerRef.Add(schedule);
+  if (id < 0)
+  {
+    event.reply(msg_fl("Couldn't save the schedule, please contact Melal", dpp::m_ephemeral));
+    return;
+  }
+
+  event.reply(fmt::format(
+      "Scheduled a session in <#{}> at `{:02}:{:02}` UTC, schedule id is `{}`\n"
+      "Use `/pomodoro unschedule id:{}` to remove it",
+      (int64_t)channel_id,
+      minute / 60,
+      minute % 60,
+      id,
+      id));
+}
+
+static inline void
+HandlePomodoroUnschedule(Pomodoro &self, const dpp::slashcommand_t &event, dpp::command_data_option const &subcmd)
+{
+  opt::Values<schema::Unschedule> values;
+  if (!ParseOptions(self, event, subcmd, values))
+    return;
+  int64_t id = values.Get<"id">();
+
+  if (!self.SchedulerRef.Remove(id, event.command.usr.id, event.command.guild_id))
+  {
+    event.reply(msg_fl("You don't have a schedule with this id in this server", dpp::m_ephemeral));
+    return;
+  }
+  event.reply(msg_fl(fmt::format("Schedule `{}` removed", id), dpp::m_ephemeral));
+}
+
+static std::string DescribeProfile(ProfileStore::Profile const &p)
+{
+  using Store = ProfileStore;
+  std::string out;
+  if (p.Fields & Store::HasWork)
+    out += fmt::format("work `{}` min, ", p.WorkPeriod);
+  if (p.Fields & Store::HasBreak)
+    out += fmt::format("break `{}` min, ", p.BreakPeriod);
+  if (p.Fields & Store::HasRepeat)
+    out += fmt::format("repeat `{}`, ", p.Repeat);
+  if (p.Fields & Store::HasMute)
+    out += fmt::format("mute `{}`, ", p.Switches & Store::HasMute ? "on" : "off");
+  if (p.Fields & Store::HasVoice)
+    out += fmt::format("voice `{}`, ", p.Switches & Store::HasVoice ? "on" : "off");
+  if (p.Fields & Store::HasCueSet)
+    out += fmt::format("cue set `{}`, ", p.CueSet);
+  if (out.empty())
+    return "nothing saved";
+  out.resize(out.size() - 2);
+  return out;
+}
+
+static inline void
+HandlePomodoroPrefs(Pomodoro &self, const dpp::slashcommand_t &event, dpp::command_data_option const &subcmd)
+{
+  using Store = ProfileStore;
+  opt::Values<schema::Prefs> values;
+  if (!ParseOptions(self, event, subcmd, values))
+    return;
+
+  bool server = values.Get<"server">();
+  if (server && !event.command.get_resolved_permission(event.command.usr.id).can(dpp::p_manage_guild))
+  {
+    event.reply(msg_fl("You need the Manage Server permission to change this server's defaults", dpp::m_ephemeral));
+    return;
+  }
+  Store::Scope scope = server ? Store::Scope::Guild : Store::Scope::User;
+  const char *whose = server ? "This server's" : "Your";
+
+  Store::Profile p;
+  self.ProfilesRef.Get(scope, server ? event.command.guild_id : event.command.usr.id, p);
+  if (values.Get<"reset">())
+  {
+    p.Fields = p.Switches = 0;
+    if (!self.ProfilesRef.Put(p))
+    {
+      event.reply(msg_fl("Couldn't save the defaults, please contact Melal", dpp::m_ephemeral));
+      return;
+    }
+    event.reply(msg_fl(fmt::format("{} saved defaults are removed", whose), dpp::m_ephemeral));
+    return;
+  }
+
+  bool changed = 0;
+  auto set = [&p, &changed](Store::Field f, bool on = 0)
+  {
+    p.Fields |= f;
+    p.Switches = on ? p.Switches | f : p.Switches & ~f;
+    changed = 1;
+  };
+  if (values.Has<"work">())
+  {
+    set(Store::HasWork);
+    p.WorkPeriod = values.Get<"work">();
+  }
+  if (values.Has<"break">())
+  {
+    set(Store::HasBreak);
+    p.BreakPeriod = values.Get<"break">();
+  }
+  if (values.Has<"repeat">())
+  {
+    set(Store::HasRepeat);
+    p.Repeat = values.Get<"repeat">();
+  }
+  if (values.Has<"mute">())
+    set(Store::HasMute, values.Get<"mute">());
+  if (values.Has<"voice">())
+    set(Store::HasVoice, values.Get<"voice">());
+  if (values.Has<"cues">())
+  {
+    set(Store::HasCueSet);
+    p.CueSet = values.Get<"cues">();
+  }
+
+  if (!changed)
+  {
+    event.reply(msg_fl(fmt::format("{} defaults: {}", whose, DescribeProfile(p)), dpp::m_ephemeral));
+    return;
+  }
+  if (!self.ProfilesRef.Put(p))
+  {
+    event.reply(msg_fl("Couldn't save the defaults, please contact Melal", dpp::m_ephemeral));
+    return;
+  }
+  event.reply(msg_fl(fmt::format("{} defaults are now: {}", whose, DescribeProfile(p)), dpp::m_ephemeral));
+}
+
 // ------------------
 
 void Pomodoro::SlashCommandHandler(dpp::slashcommand_t const &event) noexcept
 {
-  dpp::command_interaction cmd_data = event.command.get_command_interaction();
-  auto subcmd = cmd_data.options[0];
+  mem::ScopedTag tag(mem::Subsystem::Commands);
+  // Read the interaction in place, get_command_interaction() and options[0] would copy the whole option tree
+  auto const &cmd_data = std::get<dpp::command_interaction>(event.command.data);
+  auto const &subcmd = cmd_data.options[0];
   dpp::snowflake usr_id = event.command.usr.id;
 
   if (subcmd.name == "start")
@@ -226,18 +511,13 @@ void Pomodoro::SlashCommandHandler(dpp::slashcommand_t const &event) noexcept
       event.reply(msg_fl("You aren't an owner of any active session", dpp::m_ephemeral));
       return;
     }
-    ManagerRef.CancelSession(Session,
-
-                                [this](SessionManager::Session const &s)
-                                { // Called if session found and before it removed
-        ManagerRef.Bot.message_create(
-            dpp::message(s.ChannelId, std::format("Session has been canceled by <@{}>", (long)s.OwnerId)));
-                                }
-        );
-    if (event.command.channel_id != Session->ChannelId)
+    dpp::snowflake ChannelId = Session->ChannelId; // Session is gone after StopSession
+    StopSession(*this, Session);
+    if (event.command.channel_id != ChannelId)
       event.reply("Session is seccusfully canceled");
     else
       event.reply(msg_fl("Session is seccusfully canceled", dpp::m_ephemeral));
+    return;
   }
   if (subcmd.name == "time")
   {
@@ -249,13 +529,14 @@ void Pomodoro::SlashCommandHandler(dpp::slashcommand_t const &event) noexcept
     }
     long RemainingTime = Session->GetRemainingTime();
     bool IsMinute = RemainingTime > 60;
-    std::string msg = fmt::format(
-        "Remaining time for **{}** '{}' is `{}` {}",
-        Session->Flags & 1u ? "Break" : "Work",
+    std::string msg;
+    loc::RemainingTime(
+        Session->Locale,
+        std::back_inserter(msg),
+        Session->Flags & 1u,
         Session->CurrentSessionNumber - 1,
         IsMinute ? RemainingTime / 60 : RemainingTime, // If RemainingTime is more than minute display it in minutes
-        IsMinute ? "minutes" : "seconds"               // Unit
-    );
+        IsMinute);
 
     if (event.command.channel_id == Session->ChannelId)
       event.reply(msg_fl(msg, dpp::m_ephemeral));
@@ -272,76 +553,139 @@ void Pomodoro::SlashCommandHandler(dpp::slashcommand_t const &event) noexcept
       return;
     }
 
-    if (subcmd.empty())
+    opt::Values<schema::Set> values;
+    if (!ParseOptions(*this, event, subcmd, values))
+      return;
+    if (values.Empty())
     {
       event.reply(msg_fl("No options were provided", dpp::m_ephemeral));
       return;
     }
 
-    for (auto &option : subcmd.options)
-    {
-      using Flag = SessionManager::Session::Flag;
-      bool mode;
-      if (auto v = GetValueSafe<bool>(option))
-        mode = *v;
-      else
-      {
-        event.reply("Error happend please contact melal");
-        ManagerRef.Bot.log(DL::ll_error, fmt::format("While obtaining value {}", option.name));
-        return;
-      }
-
-      switch (tolower(option.name[0]))
-      {
-      case 'm': // mute
-        if (SessionManager::HasFlag(Session->Flags, Flag::Mute) == mode)
-          break;
-        if (!SessionManager::HasFlag(Session->Flags, Flag::Break)) // If work session the apply it immediatly
-          Session->ChangeMembersStatus(ManagerRef, mode);
-        SessionManager::SetFlag(Session->Flags, Flag::Mute, mode);
-        break;
-      case 'v': // voice
-        SessionManager::SetFlag(Session->Flags, Flag::Voice, mode);
-        break;
-      default:
-        ManagerRef.Bot.log(DL::ll_error, fmt::format("Option {} not recognized in pomodoro set", option.name));
-      }
-    }
+    if (values.Has<"mute">())
+      ApplyMute(*this, Session, values.Get<"mute">());
+    if (values.Has<"voice">())
+      SessionManager::SetFlag(Session->Flags, SessionManager::Session::Flag::Voice, values.Get<"voice">());
     event.reply("Option(s) has been successfully changed");
     return;
   }
-  if (subcmd.name == "")
+  if (subcmd.name == "schedule")
+  {
+    HandlePomodoroSchedule(*this, event, subcmd);
+    return;
+  }
+  if (subcmd.name == "unschedule")
+  {
+    HandlePomodoroUnschedule(*this, event, subcmd);
+    return;
+  }
+  if (subcmd.name == "room")
+  {
+    HandlePomodoroRoom(*this, event, subcmd);
+    return;
+  }
+  if (subcmd.name == "stats")
+  {
+    HandlePomodoroStats(*this, event, subcmd);
+    return;
+  }
+  if (subcmd.name == "leaderboard")
   {
+    HandlePomodoroLeaderboard(*this, event, subcmd);
+    return;
+  }
+  if (subcmd.name == "prefs")
+  {
+    HandlePomodoroPrefs(*this, event, subcmd);
+    return;
   }
 }
 
+void Pomodoro::ComponentHandler(dpp::button_click_t const &event, uint8_t action, uint32_t handle) noexcept
+{
+  using Control = StatusBoard::Control;
+  auto Session = ManagerRef.GetSessionByHandle(handle);
+  if (!Session)
+  {
+    event.reply(msg_fl("This session has already ended", dpp::m_ephemeral));
+    return;
+  }
+  if (event.command.usr.id != Session->OwnerId)
+  {
+    event.reply(msg_fl(
+        fmt::format("Only the session owner <@{}> can use these controls", (int64_t)Session->OwnerId),
+        dpp::m_ephemeral));
+    return;
+  }
+
+  switch (static_cast<Control>(action))
+  {
+  case Control::Pause:
+    if (!Session->Pause(ManagerRef))
+    {
+      event.reply(msg_fl("Session is already paused", dpp::m_ephemeral));
+      return;
+    }
+    break;
+  case Control::Resume:
+    if (!Session->Resume(ManagerRef))
+    {
+      event.reply(msg_fl("Session isn't paused", dpp::m_ephemeral));
+      return;
+    }
+    break;
+  case Control::Skip:
+    Session->SkipPhase(ManagerRef);
+    break;
+  case Control::Stop:
+    StopSession(*this, Session);
+    break;
+  case Control::Mute:
+    ApplyMute(*this, Session, !SessionManager::HasFlag(Session->Flags, SessionManager::Session::Flag::Mute));
+    break;
+  default:
+    ManagerRef.Bot.log(DL::ll_error, fmt::format("Unknown session control '{}'", static_cast<char>(action)));
+    event.reply(msg_fl("Unknown control", dpp::m_ephemeral));
+    return;
+  }
+  event.reply(); // Acknowledge, the status message shows the change
+}
+
 void Pomodoro::VCHandler(dpp::voice_state_update_t const &e) noexcept
 {
+  TRACE_SCOPE("pomodoro.vc_handler");
+  watchdog::Busy busy("pomodoro.vc_handler");
+  shed::HandlerTimer timer;
   if (ManagerRef.GetActiveSessions() == 0)
     return;
-  dpp::cluster &bot = this->ManagerRef.Bot;
   SessionManager::Session *res = ManagerRef.GetSessionByOwnerId(e.state.user_id);
+  // Moving between the rooms of a study hall isn't leaving it
+  if (auto s = res ? res : ManagerRef.GetSessionByUserId(e.state.user_id); s && s->HasChannel(e.state.channel_id))
+    return;
   auto HandleOwnerLeave = [&]()
   {
     if (res->MembersId.size() == 1)
     {
       ManagerRef.CancelSession(
           res,
-          [&bot](SessionManager::Session const &s)
+          [this](SessionManager::Session const &s)
           {
-            bot.message_create(
-                {s.ChannelId, fmt::format("<@{}>'s session is canceled because he left the VC", s.OwnerId)});
+            std::string msg;
+            loc::OwnerLeftCanceled(s.Locale, std::back_inserter(msg), s.OwnerId);
+            ManagerRef.Notices.Post(s.ChannelId, std::move(msg));
           });
       return;
     }
     for (auto it = res->MembersId.begin(); it != res->MembersId.end(); ++it)
       if (*it == res->OwnerId)
       {
+        ManagerRef.Stats.RecordSessionEnd(res->GuildId, {&*it, 1}, 0); // left before the end, like a cancel
         res->MembersId.erase(it);
         break;
       }
-    bot.message_create(
-        {res->ChannelId, fmt::format("<@{}> left the channel the new owner is <@{}>.", e.state.user_id, res->OwnerId)});
+    std::string msg;
+    loc::OwnerLeft(res->Locale, std::back_inserter(msg), e.state.user_id, res->MembersId[0]);
+    ManagerRef.Notices.Post(res->ChannelId, std::move(msg));
     ManagerRef.ChangeOwnerId(res, res->MembersId[0]);
 
     return;
@@ -351,8 +695,10 @@ void Pomodoro::VCHandler(dpp::voice_state_update_t const &e) noexcept
     for (auto it = res->MembersId.begin(); it != res->MembersId.end(); ++it)
       if (*it == e.state.user_id)
       {
-        bot.message_create(
-            {res->ChannelId, fmt::format("<@{}> left the channel and is removed from the session.", e.state.user_id)});
+        std::string msg;
+        loc::MemberLeft(res->Locale, std::back_inserter(msg), e.state.user_id);
+        ManagerRef.Notices.Post(res->ChannelId, std::move(msg));
+        ManagerRef.Stats.RecordSessionEnd(res->GuildId, {&*it, 1}, 0);
         res->MembersId.erase(it);
         break;
       }
@@ -376,18 +722,7 @@ void AddPomodoroSlashCommand(std::vector<dpp::slashcommand> &SlashCommands, dpp:
   // Start
 
   dpp::command_option Start{dpp::co_sub_command, "start", "Start the a session"};
-  Start.add_option({dpp::co_integer, "work", "Work period in minutes, defaults to 40", false});
-  Start.add_option({dpp::co_integer, "break", "Break period in minutes, defaults to 15", false});
-  Start.add_option({dpp::co_integer, "repeat", "How many work sessions, defaults to 3", false});
-
-  Start.add_option(
-      {dpp::co_boolean, "mute", "If you want the bot to mute members during work sessions, defaults to off", false});
-
-  Start.add_option(
-      {dpp::co_boolean,
-       "voice",
-       "If you want the bot to join and notify when a work/break session ends, defaults to off",
-       false});
+  opt::AddOptions<schema::Start>(Start);
 
   Pomodoro.add_option(std::move(Start));
 
@@ -401,9 +736,43 @@ void AddPomodoroSlashCommand(std::vector<dpp::slashcommand> &SlashCommands, dpp:
 
   // Set
   dpp::command_option Set{dpp::co_sub_command, "set", "Change an active session settings"};
-  Set.add_option({dpp::co_boolean, "mute", "Turn mute between session on/off", false});
-  Set.add_option({dpp::co_boolean, "voice", "Turn voice notifications between session on/off", false});
+  opt::AddOptions<schema::Set>(Set);
 
   Pomodoro.add_option(std::move(Set));
+
+  // Schedule
+  dpp::command_option Schedule{dpp::co_sub_command, "schedule", "Start a session in a channel on a recurring schedule"};
+  opt::AddOptions<schema::Schedule>(Schedule);
+
+  Pomodoro.add_option(std::move(Schedule));
+
+  dpp::command_option Unschedule{dpp::co_sub_command, "unschedule", "Remove one of your recurring sessions"};
+  opt::AddOptions<schema::Unschedule>(Unschedule);
+
+  Pomodoro.add_option(std::move(Unschedule));
+
+  // Room
+  dpp::command_option Room{dpp::co_sub_command, "room", "Run your session in one more voice channel as a study hall"};
+  opt::AddOptions<schema::Room>(Room);
+
+  Pomodoro.add_option(std::move(Room));
+
+  // Stats
+  dpp::command_option Stats{dpp::co_sub_command, "stats", "Show focus statistics in this server"};
+  opt::AddOptions<schema::Stats>(Stats);
+
+  Pomodoro.add_option(std::move(Stats));
+
+  // Leaderboard
+  dpp::command_option Leaderboard{dpp::co_sub_command, "leaderboard", "Show the members with the most work time"};
+  opt::AddOptions<schema::Leaderboard>(Leaderboard);
+
+  Pomodoro.add_option(std::move(Leaderboard));
+
+  // Prefs
+  dpp::command_option Prefs{dpp::co_sub_command, "prefs", "Show or save your defaults for start and schedule"};
+  opt::AddOptions<schema::Prefs>(Prefs);
+
+  Pomodoro.add_option(std::move(Prefs));
   SlashCommands.push_back(std::move(Pomodoro));
 }
@@ -1,14 +1,22 @@
 #ifndef POMODORO_HANDLER
 #define POMODORO_HANDLER
+#include "profile_store.h"
+#include "recurring_scheduler.h"
 #include "session_manager.h"
 
 class Pomodoro
 {
 public:
-  Pomodoro(SessionManager &manager) noexcept;
+  Pomodoro(SessionManager &manager, RecurringScheduler &scheduler, ProfileStore &profiles) noexcept;
   void SlashCommandHandler(dpp::slashcommand_t const &event) noexcept;
   void VCHandler(dpp::voice_state_update_t const &event) noexcept;
+  /*
+     @brief Handles the status message buttons, routed by ComponentRouter with StatusBoard::ControlsTag
+  */
+  void ComponentHandler(dpp::button_click_t const &event, uint8_t action, uint32_t handle) noexcept;
   SessionManager &ManagerRef;
+  RecurringScheduler &SchedulerRef;
+  ProfileStore &ProfilesRef;
 };
 #endif
 
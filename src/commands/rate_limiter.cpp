@@ -0,0 +1,238 @@
+#include "rate_limiter.h"
+#include <algorithm>
+#include <fmt/format.h>
+
+// State word: last refill in ms since _epoch (upper 40 bits, never 0) and tokens in 1/1024ths (lower 24 bits)
+constexpr uint64_t FracBits = 10;
+constexpr uint64_t One = 1ull << FracBits;
+constexpr uint64_t TokenBits = 24;
+constexpr uint64_t TokenMask = (1ull << TokenBits) - 1;
+constexpr uint64_t Evicting = ~0ull; // set while a slot is being freed, readers look the key up again
+
+static_assert(sizeof(uint64_t) * 8 - TokenBits >= 40, "40 bits of ms is ~34 years of uptime");
+
+static constexpr uint64_t Pack(uint64_t ms, uint64_t tokens) noexcept
+{
+  return ms << TokenBits | tokens;
+}
+
+static inline uint64_t Mix(uint64_t key) noexcept
+{
+  // Snowflakes are mostly timestamp, fold the whole id before using the low bits
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33;
+  return key;
+}
+
+// Tokens after refilling up to now, last moves by the time that was turned into tokens
+static inline void Refill(uint64_t state, uint64_t now, RateLimiter::Rule limits, uint64_t &last, uint64_t &tokens)
+{
+  uint64_t full = uint64_t(limits.Burst) << FracBits;
+  if (!state)
+  {
+    last = now;
+    tokens = full;
+    return;
+  }
+  last = state >> TokenBits;
+  tokens = state & TokenMask;
+  uint64_t elapsed = now > last ? now - last : 0;
+  uint64_t gained = (elapsed << FracBits) / limits.RefillMs;
+  if (tokens + gained >= full)
+  {
+    last = now;
+    tokens = full;
+  }
+  else
+  {
+    last += gained * limits.RefillMs >> FracBits;
+    tokens += gained;
+  }
+}
+
+RateLimiter::RateLimiter(Rule user, Rule guild) noexcept
+    : _users{user, std::make_unique<std::array<Slot, Shards * SlotsPerShard>>()},
+      _guilds{guild, std::make_unique<std::array<Slot, Shards * SlotsPerShard>>()},
+      _epoch(std::chrono::steady_clock::now())
+{
+}
+
+uint64_t RateLimiter::NowMs() const noexcept
+{
+  using namespace std::chrono;
+  return duration_cast<milliseconds>(steady_clock::now() - _epoch).count() + 1;
+}
+
+RateLimiter::Slot *RateLimiter::FindOrInsert(Table &table, uint64_t key) noexcept
+{
+  uint64_t h = Mix(key);
+  Slot *shard = table.Slots->data() + (h % Shards) * SlotsPerShard;
+  size_t start = (h / Shards) % SlotsPerShard;
+
+  // The whole window is searched, so freeing a slot never hides a key stored after it
+  for (size_t i = 0; i < Window; ++i)
+  {
+    Slot &slot = shard[(start + i) % SlotsPerShard];
+    if (slot.Key.load(std::memory_order_acquire) == key)
+      return &slot;
+  }
+  // Everyone inserting the same key races for the same first empty slot, the losers see the winner's key
+  for (size_t i = 0; i < Window; ++i)
+  {
+    Slot &slot = shard[(start + i) % SlotsPerShard];
+    uint64_t expected = 0;
+    if (slot.Key.compare_exchange_strong(expected, key, std::memory_order_acq_rel))
+    {
+      _buckets.fetch_add(1, std::memory_order_relaxed);
+      return &slot;
+    }
+    if (expected == key)
+      return &slot;
+  }
+  return nullptr;
+}
+
+uint32_t RateLimiter::Take(Table &table, uint64_t key, uint64_t now, Slot *&slot) noexcept
+{
+  slot = FindOrInsert(table, key);
+  if (!slot)
+  {
+    _table_full.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+  }
+
+  uint64_t state = slot->State.load(std::memory_order_acquire);
+  for (;;)
+  {
+    if (state == Evicting) // Freed under us, the key gets a new slot
+    {
+      if (!(slot = FindOrInsert(table, key)))
+      {
+        _table_full.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+      }
+      state = slot->State.load(std::memory_order_acquire);
+      continue;
+    }
+
+    uint64_t last, tokens;
+    Refill(state, now, table.Limits, last, tokens);
+    if (tokens < One)
+    {
+      slot = nullptr;
+      return ((One - tokens) * table.Limits.RefillMs + One - 1) >> FracBits;
+    }
+    if (!slot->State.compare_exchange_weak(
+            state, Pack(last, tokens - One), std::memory_order_acq_rel, std::memory_order_acquire))
+      continue;
+    // Evicted and taken by another key between the lookup and the CAS: that key gets its token back and this one
+    // is looked up again
+    if (slot->Key.load(std::memory_order_acquire) == key)
+      return 0;
+    Refund(table, slot);
+    if (!(slot = FindOrInsert(table, key)))
+    {
+      _table_full.fetch_add(1, std::memory_order_relaxed);
+      return 0;
+    }
+    state = slot->State.load(std::memory_order_acquire);
+  }
+}
+
+void RateLimiter::Refund(Table &table, Slot *slot) noexcept
+{
+  uint64_t full = uint64_t(table.Limits.Burst) << FracBits;
+  uint64_t state = slot->State.load(std::memory_order_acquire);
+  while (state && state != Evicting)
+  {
+    uint64_t tokens = std::min(full, (state & TokenMask) + One);
+    if (slot->State.compare_exchange_weak(
+            state, Pack(state >> TokenBits, tokens), std::memory_order_acq_rel, std::memory_order_acquire))
+      return;
+  }
+}
+
+RateLimiter::Result RateLimiter::Acquire(snflake user_id, snflake guild_id) noexcept
+{
+  uint64_t now = NowMs();
+  Slot *user_slot, *guild_slot;
+  if (uint32_t wait = Take(_users, user_id, now, user_slot))
+  {
+    _user_limited.fetch_add(1, std::memory_order_relaxed);
+    return {Verdict::UserLimited, wait};
+  }
+
+  if (guild_id) // 0 in DMs
+    if (uint32_t wait = Take(_guilds, guild_id, now, guild_slot))
+    {
+      if (user_slot) // The user didn't get to run anything
+        Refund(_users, user_slot);
+      _guild_limited.fetch_add(1, std::memory_order_relaxed);
+      return {Verdict::GuildLimited, wait};
+    }
+
+  _allowed.fetch_add(1, std::memory_order_relaxed);
+  return {Verdict::Allowed, 0};
+}
+
+void RateLimiter::EvictShard(Table &table, size_t shard, uint64_t now) noexcept
+{
+  uint64_t full = uint64_t(table.Limits.Burst) << FracBits;
+  Slot *slots = table.Slots->data() + shard * SlotsPerShard;
+  for (size_t i = 0; i < SlotsPerShard; ++i)
+  {
+    Slot &slot = slots[i];
+    if (!slot.Key.load(std::memory_order_relaxed))
+      continue;
+
+    uint64_t state = slot.State.load(std::memory_order_acquire);
+    if (state == Evicting)
+      continue;
+    uint64_t last, tokens;
+    Refill(state, now, table.Limits, last, tokens);
+    if (tokens < full)
+      continue;
+
+    // A full bucket is the same as no bucket, unless someone takes a token before we claim it
+    if (!slot.State.compare_exchange_strong(state, Evicting, std::memory_order_acq_rel))
+      continue;
+    slot.Key.store(0, std::memory_order_release);
+    slot.State.store(0, std::memory_order_release);
+    _evicted.fetch_add(1, std::memory_order_relaxed);
+    _buckets.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+void RateLimiter::Evict() noexcept
+{
+  uint64_t now = NowMs();
+  EvictShard(_users, _next_shard, now);
+  EvictShard(_guilds, _next_shard, now);
+  _next_shard = (_next_shard + 1) % Shards;
+}
+
+RateLimiter::Metrics RateLimiter::GetMetrics() const noexcept
+{
+  return {
+      _allowed.load(std::memory_order_relaxed),
+      _user_limited.load(std::memory_order_relaxed),
+      _guild_limited.load(std::memory_order_relaxed),
+      _table_full.load(std::memory_order_relaxed),
+      _evicted.load(std::memory_order_relaxed),
+      _buckets.load(std::memory_order_relaxed),
+  };
+}
+
+std::string RateLimiter::Report() const
+{
+  Metrics m = GetMetrics();
+  return fmt::format(
+      "Rate limiter: {} allowed, {} user limited, {} guild limited, {} unbucketed, {} buckets ({} evicted)",
+      m.Allowed,
+      m.UserLimited,
+      m.GuildLimited,
+      m.TableFull,
+      m.Buckets,
+      m.Evicted);
+}
@@ -0,0 +1,109 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <dpp/snowflake.h>
+#include <memory>
+#include <string>
+
+/*
+   Token buckets per user and per guild in front of command dispatch, so one member (or one busy guild) can't spend
+   the bot's whole REST budget by starting and stopping sessions in a loop.
+   Buckets live in fixed sharded tables of 16-byte slots: key and a packed (last refill, tokens) word updated with
+   CAS, refilled lazily from the timestamp on each acquire. Nothing takes a lock on the command path; idle buckets
+   (full again) are evicted by Evict() from a single background timer.
+*/
+class RateLimiter
+{
+  using snflake = dpp::snowflake;
+
+public:
+  struct Rule
+  {
+    uint32_t Burst;    // bucket size in commands
+    uint32_t RefillMs; // one command is refilled every RefillMs
+  };
+
+  enum class Verdict : uint8_t
+  {
+    Allowed,
+    UserLimited,
+    GuildLimited
+  };
+
+  struct Result
+  {
+    Verdict Status;
+    uint32_t RetryMs; // when the next command would be allowed, 0 if allowed
+  };
+
+  struct Metrics
+  {
+    uint64_t Allowed;
+    uint64_t UserLimited;
+    uint64_t GuildLimited;
+    uint64_t TableFull; // allowed without a bucket because its window was full
+    uint64_t Evicted;
+    uint64_t Buckets;
+  };
+
+  RateLimiter(Rule user, Rule guild) noexcept;
+  RateLimiter(RateLimiter const &) = delete;
+  RateLimiter &operator=(RateLimiter const &) = delete;
+
+  /*
+     @brief Takes one token from the user's and the guild's buckets
+     @return Allowed, or which bucket is empty and how long until it has a token
+  */
+  Result Acquire(snflake user_id, snflake guild_id) noexcept;
+
+  /*
+     @brief Frees the buckets of one shard that are full again, the next call takes the next shard.
+     Must be called from one thread only.
+  */
+  void Evict() noexcept;
+
+  Metrics GetMetrics() const noexcept;
+  std::string Report() const;
+
+  static constexpr size_t Shards = 16;
+  static constexpr size_t SlotsPerShard = 1024;
+  static constexpr size_t Window = 16; // slots probed per key
+
+private:
+  struct Slot
+  {
+    std::atomic<uint64_t> Key{0};   // 0 is empty
+    std::atomic<uint64_t> State{0}; // 0 is a full bucket, see Pack
+  };
+  static_assert(sizeof(Slot) == 16);
+
+  struct Table
+  {
+    Rule Limits;
+    std::unique_ptr<std::array<Slot, Shards * SlotsPerShard>> Slots;
+  };
+
+  // Takes a token from key's bucket, returns the wait in ms if there is none
+  uint32_t Take(Table &table, uint64_t key, uint64_t now, Slot *&slot) noexcept;
+  void Refund(Table &table, Slot *slot) noexcept;
+  Slot *FindOrInsert(Table &table, uint64_t key) noexcept;
+  void EvictShard(Table &table, size_t shard, uint64_t now) noexcept;
+  uint64_t NowMs() const noexcept;
+
+  Table _users;
+  Table _guilds;
+  std::chrono::steady_clock::time_point _epoch;
+  size_t _next_shard = 0; // only touched by Evict
+
+  std::atomic<uint64_t> _allowed{0};
+  std::atomic<uint64_t> _user_limited{0};
+  std::atomic<uint64_t> _guild_limited{0};
+  std::atomic<uint64_t> _table_full{0};
+  std::atomic<uint64_t> _evicted{0};
+  std::atomic<uint64_t> _buckets{0};
+};
+
+#endif
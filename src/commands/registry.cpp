@@ -1,4 +1,7 @@
 #include "registry.h"
+#include "load_shedder.h"
+#include "trace.h"
+#include "watchdog.h"
 #include <fmt/format.h>
 
 void Registry::Add(command const &cmd) noexcept
@@ -9,6 +12,9 @@ void Registry::Add(command const &cmd) noexcept
 
 bool Registry::Dispatch(std::string_view command_name, dpp::slashcommand_t const &event) noexcept
 {
+  TRACE_SCOPE("registry.dispatch");
+  watchdog::Busy busy("registry.dispatch");
+  shed::HandlerTimer timer;
   auto it = _handlers.find(command_name);
   if (it == _handlers.end())
     return 0;
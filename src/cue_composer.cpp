@@ -0,0 +1,116 @@
+#include "cue_composer.h"
+#include "opus_track.h"
+#include <fmt/format.h>
+
+CueComposer::CueComposer(std::string fragments_dir, size_t capacity) noexcept
+    : _dir(std::move(fragments_dir)), _capacity(capacity ? capacity : 1)
+{
+}
+
+bool CueComposer::LoadFragment(std::string const &path, Cue &out) noexcept
+{
+  // Fragments are copied into the cache once, the mapping doesn't need to outlive this
+  OpusTrack track(path.c_str());
+  if (!track.IsOpen())
+    return 0;
+
+  size_t bytes = 0;
+  for (auto packet : track.Packets())
+    bytes += packet.size();
+  out.Data.reserve(bytes);
+  out.Sizes.reserve(track.Packets().size());
+  for (auto packet : track.Packets())
+  {
+    out.Data.insert(out.Data.end(), packet.begin(), packet.end());
+    out.Sizes.push_back(packet.size());
+  }
+  out.Duration = track.Duration();
+  return !out.Sizes.empty();
+}
+
+CueComposer::Cue const *CueComposer::GetFragment(std::string_view token, uint8_t set) noexcept
+{
+  std::string name = fmt::format("{}/{}", set, token);
+  auto it = _fragments.find(name);
+  if (it == _fragments.end())
+  {
+    auto fragment = std::make_unique<Cue>();
+    std::string path = set ? fmt::format("{}/{}.opus", _dir, name) : fmt::format("{}/{}.opus", _dir, token);
+    if (!LoadFragment(path, *fragment))
+      fragment.reset();
+    it = _fragments.emplace(std::move(name), std::move(fragment)).first;
+  }
+
+  if (!it->second && set) // Sets only need to record the fragments that sound different
+    return GetFragment(token, 0);
+  return it->second.get();
+}
+
+std::shared_ptr<const CueComposer::Cue>
+CueComposer::Compose(std::span<const std::string_view> tokens, uint8_t set) noexcept
+{
+  std::string key = fmt::format("{}|", set);
+  for (auto token : tokens)
+  {
+    key.append(token);
+    key.push_back('|');
+  }
+
+  std::lock_guard lock(_mtx);
+  if (auto it = _index.find(key); it != _index.end())
+  {
+    _lru.splice(_lru.begin(), _lru, it->second);
+    return it->second->second;
+  }
+
+  Cue const *fragments[32];
+  if (tokens.size() > std::size(fragments))
+    return nullptr;
+
+  size_t bytes = 0, packets = 0;
+  for (size_t i = 0; i < tokens.size(); ++i)
+  {
+    if (!(fragments[i] = GetFragment(tokens[i], set)))
+      return nullptr;
+    bytes += fragments[i]->Data.size();
+    packets += fragments[i]->Sizes.size();
+  }
+
+  auto cue = std::make_shared<Cue>();
+  cue->Data.reserve(bytes);
+  cue->Sizes.reserve(packets);
+  for (size_t i = 0; i < tokens.size(); ++i)
+  {
+    cue->Data.insert(cue->Data.end(), fragments[i]->Data.begin(), fragments[i]->Data.end());
+    cue->Sizes.insert(cue->Sizes.end(), fragments[i]->Sizes.begin(), fragments[i]->Sizes.end());
+    cue->Duration += fragments[i]->Duration;
+  }
+
+  if (_lru.size() >= _capacity)
+  {
+    _index.erase(_lru.back().first);
+    _lru.pop_back();
+  }
+  _lru.emplace_front(std::move(key), cue);
+  _index.emplace(_lru.front().first, _lru.begin());
+  return cue;
+}
+
+bool CueComposer::NumberTokens(unsigned n, std::vector<std::string_view> &out) noexcept
+{
+  static constexpr std::string_view units[] = {"0",  "1",  "2",  "3",  "4",  "5",  "6",  "7",  "8",  "9", "10",
+                                               "11", "12", "13", "14", "15", "16", "17", "18", "19", "20"};
+  static constexpr std::string_view tens[] = {"", "", "20", "30", "40", "50", "60", "70", "80", "90"};
+
+  if (n > 99)
+    return 0;
+  if (n <= 20)
+  {
+    out.push_back(units[n]);
+    return 1;
+  }
+  out.push_back(tens[n / 10]);
+  if (n % 10)
+    out.push_back(units[n % 10]);
+  return 1;
+}
@@ -0,0 +1,73 @@
+#ifndef CUE_COMPOSER_H
+#define CUE_COMPOSER_H
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/*
+   Builds spoken cues ("5 minutes left in work session 3") out of pre-encoded Opus fragments.
+   Fragments must share the same encoder settings (48kHz, same frame size) so their packets can be sent back to
+   back, cues are never decoded or re-encoded.
+*/
+class CueComposer
+{
+public:
+  // Opus packets laid out back to back, Sizes[i] is the length of the i-th packet
+  struct Cue
+  {
+    std::vector<uint8_t> Data;
+    std::vector<uint32_t> Sizes;
+    double Duration = 0; // seconds
+  };
+
+  /*
+     @param fragments_dir directory holding one <token>.opus file per fragment, loaded on first use. Cue set n lives
+     in the <n> subdirectory, fragments it doesn't have come from the default set
+     @param capacity how many composed cues are kept
+  */
+  CueComposer(std::string fragments_dir, size_t capacity = 64) noexcept;
+
+  static constexpr uint8_t MaxCueSet = 15;
+
+  /*
+     @brief Concatenates the fragments of tokens, in order, into a cue
+     @param set cue set to take the fragments from, 0 is the default set
+     @return the composed cue (cached) or nullptr if a fragment is missing
+  */
+  std::shared_ptr<const Cue> Compose(std::span<const std::string_view> tokens, uint8_t set = 0) noexcept;
+
+  /*
+     @brief Appends the tokens that spell n (0-99), e.g 25 -> "20", "5"
+     @return false if n can't be spelled
+  */
+  static bool NumberTokens(unsigned n, std::vector<std::string_view> &out) noexcept;
+
+  size_t CachedCues() const noexcept
+  {
+    std::lock_guard lock(_mtx);
+    return _lru.size();
+  }
+
+private:
+  Cue const *GetFragment(std::string_view token, uint8_t set) noexcept;
+  bool LoadFragment(std::string const &path, Cue &out) noexcept;
+
+  std::string _dir;
+  size_t _capacity;
+
+  mutable std::mutex _mtx;
+  // Keyed "<set>/<token>", nullptr means the fragment doesn't exist so it's not looked up on disk again
+  std::unordered_map<std::string, std::unique_ptr<Cue>> _fragments;
+
+  using LruList = std::list<std::pair<std::string, std::shared_ptr<const Cue>>>;
+  LruList _lru; // most recent first
+  std::unordered_map<std::string_view, LruList::iterator> _index;
+};
+
+#endif
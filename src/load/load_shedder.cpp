@@ -0,0 +1,145 @@
+#include "load_shedder.h"
+#include "clock.h"
+#include "utils.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fmt/format.h>
+#include <iterator>
+#include <memory>
+
+namespace shed
+{
+constexpr uint32_t RecoverTicks = 10; // calm ticks before stepping down a level
+
+static std::atomic<Level> current{Level::Normal};
+static std::atomic<int64_t> rest_in_flight{0};
+static std::atomic<uint64_t> max_lateness_ms{0}; // worst value since the last tick
+static std::atomic<uint64_t> max_handler_us{0};
+
+static void StoreMax(std::atomic<uint64_t> &var, uint64_t value) noexcept
+{
+  uint64_t seen = var.load(std::memory_order_relaxed);
+  while (seen < value && !var.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+    ;
+}
+
+Level Current() noexcept
+{
+  return current.load(std::memory_order_relaxed);
+}
+
+void RestStarted() noexcept
+{
+  rest_in_flight.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RestFinished() noexcept
+{
+  rest_in_flight.fetch_sub(1, std::memory_order_relaxed);
+}
+
+dpp::command_completion_event_t Tracked(dpp::command_completion_event_t then) noexcept
+{
+  RestStarted();
+  return [then = std::move(then)](dpp::confirmation_callback_t const &cb)
+  {
+    RestFinished();
+    if (then)
+      then(cb);
+  };
+}
+
+void ReportTimerLateness(uint64_t ms) noexcept
+{
+  StoreMax(max_lateness_ms, ms);
+}
+
+void ReportHandlerTime(uint64_t us) noexcept
+{
+  StoreMax(max_handler_us, us);
+}
+
+const char *Name(Level level) noexcept
+{
+  constexpr const char *names[] = {"normal", "skip cues", "merge announcements", "defer mutes", "reject sessions"};
+  return names[std::min<size_t>((size_t)level, std::size(names) - 1)];
+}
+
+// Highest level whose thresholds, scaled by num/den, any signal reaches
+static Level Evaluate(uint64_t rest, uint64_t lateness_ms, uint64_t handler_ms, uint32_t num, uint32_t den) noexcept
+{
+  Level res = Level::Normal;
+  for (size_t i = 0; i < std::size(LevelThresholds); ++i)
+  {
+    auto const &t = LevelThresholds[i];
+    if (rest * den >= uint64_t(t.RestInFlight) * num || lateness_ms * den >= uint64_t(t.TimerLatenessMs) * num ||
+        handler_ms * den >= uint64_t(t.HandlerMs) * num)
+      res = Level(i + 1);
+  }
+  return res;
+}
+
+void Start(dpp::cluster &bot, std::function<void(Level, Level)> on_change) noexcept
+{
+  using clock = utl::Clock;
+  struct State
+  {
+    clock::time_point LastTick = clock::now();
+    uint32_t CalmTicks = 0;
+    std::function<void(Level, Level)> OnChange;
+  };
+  auto state = std::make_shared<State>();
+  state->OnChange = std::move(on_change);
+
+  bot.start_timer(
+      [&bot, state](dpp::timer)
+      {
+        using namespace std::chrono;
+        // The tick is a timer like the session ones, how late it runs is the event loop's lag
+        auto now = clock::now();
+        auto late = duration_cast<milliseconds>(now - state->LastTick - seconds(1)).count();
+        state->LastTick = now;
+        if (late > 0)
+          ReportTimerLateness(late);
+
+        uint64_t rest = std::max<int64_t>(0, rest_in_flight.load(std::memory_order_relaxed));
+        uint64_t lateness = max_lateness_ms.exchange(0, std::memory_order_relaxed);
+        uint64_t handler = max_handler_us.exchange(0, std::memory_order_relaxed) / 1000;
+
+        Level from = Current(), to = from;
+        Level target = Evaluate(rest, lateness, handler, 1, 1);
+        if (target > from)
+        {
+          to = target;
+          state->CalmTicks = 0;
+        }
+        else if (from != Level::Normal && Evaluate(rest, lateness, handler, 1, 2) < from)
+        {
+          if (++state->CalmTicks >= RecoverTicks)
+          {
+            to = Level((uint8_t)from - 1);
+            state->CalmTicks = 0;
+          }
+        }
+        else
+          state->CalmTicks = 0;
+
+        if (to == from)
+          return;
+        current.store(to, std::memory_order_relaxed);
+        bot.log(
+            to > from ? DL::ll_warning : DL::ll_info,
+            fmt::format(
+                "Load level {} -> {} (rest in flight {}, timer lateness {}ms, handler {}ms)",
+                Name(from),
+                Name(to),
+                rest,
+                lateness,
+                handler));
+        if (state->OnChange)
+          state->OnChange(from, to);
+      },
+      1);
+}
+} // namespace shed
@@ -0,0 +1,89 @@
+#ifndef LOAD_SHEDDER_H
+#define LOAD_SHEDDER_H
+#include <chrono>
+#include <cstdint>
+#include <dpp/cluster.h>
+#include <functional>
+
+/*
+   Degrades the bot step by step when it can't keep up instead of falling further behind.
+   Pressure comes from three live signals: REST requests waiting for an answer, how late timers fire and how long
+   event handlers take. A 1s tick turns them into a level; it goes up as soon as a threshold is crossed and comes
+   down one level at a time after the signals stayed under half of that level's thresholds for a while.
+*/
+namespace shed
+{
+enum class Level : uint8_t
+{
+  Normal,
+  SkipCues,           // no voice clips or spoken cues
+  MergeAnnouncements, // one phase message per session instead of one per room
+  DeferMutes,         // mutes wait until the pressure drops, unmutes are never held back
+  RejectSessions,     // no new sessions or rooms
+  Count
+};
+
+struct Thresholds
+{
+  uint32_t RestInFlight;
+  uint32_t TimerLatenessMs;
+  uint32_t HandlerMs;
+};
+
+// Entering threshold of each level above Normal, any one signal crossing it is enough
+inline constexpr Thresholds LevelThresholds[(size_t)Level::Count - 1] = {
+    {50, 1500, 250},
+    {100, 3000, 500},
+    {200, 5000, 1000},
+    {400, 10000, 2000},
+};
+
+Level Current() noexcept;
+
+inline bool Active(Level level) noexcept
+{
+  return Current() >= level;
+}
+
+// Signals
+
+void RestStarted() noexcept;
+void RestFinished() noexcept;
+
+/*
+   @brief Counts a REST request as in flight until its completion callback runs
+   @param then optional callback to run on completion
+*/
+dpp::command_completion_event_t Tracked(dpp::command_completion_event_t then = {}) noexcept;
+
+void ReportTimerLateness(uint64_t ms) noexcept;
+void ReportHandlerTime(uint64_t us) noexcept;
+
+// Reports how long the enclosing handler took
+class HandlerTimer
+{
+public:
+  HandlerTimer() noexcept : _start(std::chrono::steady_clock::now())
+  {
+  }
+  ~HandlerTimer()
+  {
+    using namespace std::chrono;
+    ReportHandlerTime(duration_cast<microseconds>(steady_clock::now() - _start).count());
+  }
+  HandlerTimer(HandlerTimer const &) = delete;
+  HandlerTimer &operator=(HandlerTimer const &) = delete;
+
+private:
+  std::chrono::steady_clock::time_point _start;
+};
+
+/*
+   @brief Starts the 1s evaluation tick, on_change runs on the tick's thread after the level changed
+*/
+void Start(dpp::cluster &bot, std::function<void(Level from, Level to)> on_change) noexcept;
+
+const char *Name(Level level) noexcept;
+} // namespace shed
+
+#endif
@@ -1,11 +1,12 @@
 #ifndef LOADCOMMANDS_H
 #define LOADCOMMANDS_H
 // This is a helper header to load all commands in one place
+#include "component_router.h"
 #include "pomodoro.h"
 #include "registry.h"
 constexpr uint32_t command_count = 1;
 
-constexpr inline void LoadAllCommands(Registry &registry, Pomodoro &pomodoro_handler) noexcept
+inline void LoadAllCommands(Registry &registry, Pomodoro &pomodoro_handler) noexcept
 {
   Registry::command commands[command_count] = {
       {"pomodoro",
@@ -15,4 +16,12 @@ constexpr inline void LoadAllCommands(Registry &registry, Pomodoro &pomodoro_han
   return;
 }
 
+inline void LoadAllComponents(ComponentRouter &router, Pomodoro &pomodoro_handler) noexcept
+{
+  router.Add(
+      StatusBoard::ControlsTag,
+      [&pomodoro_handler](dpp::button_click_t const &event, uint8_t action, uint32_t handle)
+      { pomodoro_handler.ComponentHandler(event, action, handle); });
+}
+
 #endif
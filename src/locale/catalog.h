@@ -0,0 +1,241 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+#include <cstdint>
+#include <dpp/snowflake.h>
+#include <fmt/compile.h>
+#include <fmt/format.h>
+#include <string_view>
+
+/*
+   Message catalogs for the text sessions send, picked by the guild locale.
+   Every message has one FMT_COMPILE format per locale so argument types are checked at compile time and nothing is
+   parsed when formatting; fixed words live in one constexpr table in read-only storage.
+*/
+namespace loc
+{
+enum class Locale : uint8_t
+{
+  En,
+  Ar,
+  Count
+};
+
+/*
+   @brief Maps a Discord locale tag ("en-US", "ar", ...) to a catalog, unknown tags fall back to English
+*/
+constexpr Locale FromTag(std::string_view tag) noexcept
+{
+  if (tag.size() >= 2 && tag[0] == 'a' && tag[1] == 'r')
+    return Locale::Ar;
+  return Locale::En;
+}
+
+enum class Word : uint8_t
+{
+  Work,
+  Break,
+  Minutes,
+  Seconds,
+  Paused,
+  SessionEnded,
+  SessionFinished,
+  Pause,
+  Resume,
+  SkipPhase,
+  Mute,
+  Unmute,
+  Stop,
+  Overloaded,
+  Count
+};
+
+inline constexpr std::string_view Words[(size_t)Locale::Count][(size_t)Word::Count] = {
+    {
+        "Work",
+        "Break",
+        "minutes",
+        "seconds",
+        "paused, ",
+        "Session ended",
+        "Pomodoro session finished!\n",
+        "Pause",
+        "Resume",
+        "Skip phase",
+        "Mute",
+        "Unmute",
+        "Stop",
+        "The bot is overloaded right now and isn't starting new sessions, please try again in a few minutes",
+    },
+    {
+        "عمل",
+        "استراحة",
+        "دقائق",
+        "ثوان",
+        "متوقفة، ",
+        "انتهت الجلسة",
+        "انتهت جلسة البومودورو!\n",
+        "إيقاف مؤقت",
+        "استئناف",
+        "تخطي المرحلة",
+        "كتم",
+        "إلغاء الكتم",
+        "إنهاء",
+        "البوت تحت ضغط كبير الآن ولا يبدأ جلسات جديدة، حاول مجدداً بعد بضع دقائق",
+    },
+};
+
+constexpr std::string_view Get(Locale locale, Word word) noexcept
+{
+  return Words[(size_t)locale][(size_t)word];
+}
+
+constexpr Word Phase(bool is_break) noexcept
+{
+  return is_break ? Word::Break : Word::Work;
+}
+
+// Picks the compiled format of the locale, both formats must take the same arguments
+#define LOC_FORMAT(locale, out, en, ar, ...)                                                                           \
+  ((locale) == Locale::Ar ? fmt::format_to(out, FMT_COMPILE(ar), __VA_ARGS__)                                        \
+                          : fmt::format_to(out, FMT_COMPILE(en), __VA_ARGS__))
+
+// Messages ----------
+
+template <class Out> //
+Out PhaseStarted(Locale l, Out out, bool is_break, unsigned number)
+{
+  auto phase = Get(l, Phase(is_break));
+  return LOC_FORMAT(l, out, "Session **{} {}** - Started !\n", "جلسة **{} {}** - بدأت !\n", phase, number);
+}
+
+template <class Out> //
+Out Mention(Out out, dpp::snowflake usr_id)
+{
+  return fmt::format_to(out, FMT_COMPILE("<@{}>  "), (uint64_t)usr_id);
+}
+
+template <class Out> //
+Out StatusLine(Locale l, Out out, bool is_break, unsigned number, bool paused, uint32_t value, bool in_seconds)
+{
+  return LOC_FORMAT(
+      l,
+      out,
+      "**{} {}** - {}`{}` {} left",
+      "**{} {}** - {}متبقي `{}` {}",
+      Get(l, Phase(is_break)),
+      number,
+      paused ? Get(l, Word::Paused) : std::string_view(),
+      value,
+      Get(l, in_seconds ? Word::Seconds : Word::Minutes));
+}
+
+template <class Out> //
+Out RemainingTime(Locale l, Out out, bool is_break, unsigned number, long value, bool in_minutes)
+{
+  return LOC_FORMAT(
+      l,
+      out,
+      "Remaining time for **{}** '{}' is `{}` {}",
+      "الوقت المتبقي لـ **{}** '{}' هو `{}` {}",
+      Get(l, Phase(is_break)),
+      number,
+      value,
+      Get(l, in_minutes ? Word::Minutes : Word::Seconds));
+}
+
+template <class Out> //
+Out SessionStarting(Locale l, Out out, dpp::snowflake channel_id)
+{
+  return LOC_FORMAT(
+      l,
+      out,
+      "Okay starting a session in channel <#{}>\nMembers are: ",
+      "حسناً، بدأت جلسة في القناة <#{}>\nالأعضاء: ",
+      (uint64_t)channel_id);
+}
+
+template <class Out> //
+Out ScheduledStarting(Locale l, Out out, uint32_t slot, dpp::snowflake owner_id)
+{
+  return LOC_FORMAT(
+      l,
+      out,
+      "Scheduled session #{} is starting, owner is <@{}>",
+      "الجلسة المجدولة #{} تبدأ الآن، المالك <@{}>",
+      slot,
+      (uint64_t)owner_id);
+}
+
+template <class Out> //
+Out CanceledBy(Locale l, Out out, dpp::snowflake owner_id)
+{
+  return LOC_FORMAT(l, out, "Session has been canceled by <@{}>", "ألغى <@{}> الجلسة", (uint64_t)owner_id);
+}
+
+template <class Out> //
+Out OwnerLeftCanceled(Locale l, Out out, dpp::snowflake owner_id)
+{
+  return LOC_FORMAT(
+      l,
+      out,
+      "<@{}>'s session is canceled because they left the VC",
+      "أُلغيت جلسة <@{}> بسبب مغادرة القناة الصوتية",
+      (uint64_t)owner_id);
+}
+
+template <class Out> //
+Out OwnerLeft(Locale l, Out out, dpp::snowflake left_id, dpp::snowflake new_owner_id)
+{
+  return LOC_FORMAT(
+      l,
+      out,
+      "<@{}> left the channel the new owner is <@{}>.",
+      "بعد مغادرة <@{}> القناة، المالك الجديد <@{}>.",
+      (uint64_t)left_id,
+      (uint64_t)new_owner_id);
+}
+
+template <class Out> //
+Out MemberLeft(Locale l, Out out, dpp::snowflake usr_id)
+{
+  return LOC_FORMAT(
+      l,
+      out,
+      "<@{}> left the channel and is removed from the session.",
+      "تمت إزالة <@{}> من الجلسة بعد مغادرة القناة.",
+      (uint64_t)usr_id);
+}
+
+template <class Out> //
+Out RoomJoined(Locale l, Out out, dpp::snowflake owner_id, dpp::snowflake channel_id)
+{
+  return LOC_FORMAT(
+      l,
+      out,
+      "This channel joined <@{}>'s study hall, it follows the timer of <#{}>",
+      "انضمت هذه القناة إلى قاعة دراسة <@{}>، وتتبع مؤقت <#{}>",
+      (uint64_t)owner_id,
+      (uint64_t)channel_id);
+}
+
+template <class Out> //
+Out Throttled(Locale l, Out out, bool whole_guild, uint32_t seconds)
+{
+  if (whole_guild)
+    return LOC_FORMAT(
+        l,
+        out,
+        "This server is running commands too fast, try again in `{}` seconds",
+        "هذا الخادم يرسل الأوامر بسرعة كبيرة، حاول مجدداً بعد `{}` ثانية",
+        seconds);
+  return LOC_FORMAT(
+      l,
+      out,
+      "You're running commands too fast, try again in `{}` seconds",
+      "أنت ترسل الأوامر بسرعة كبيرة، حاول مجدداً بعد `{}` ثانية",
+      seconds);
+}
+
+#undef LOC_FORMAT
+} // namespace loc
+#endif
@@ -1,54 +1,480 @@
-#include "loadcommands.h"
+#include "arena.h"
+#include "cue_composer.h"
+#include "event_capture.h"
+#include "catalog.h"
+#include "live_upgrade.h"
+#include "load_shedder.h"
+#include "profile_store.h"
+#include "rate_limiter.h"
+#include "recurring_scheduler.h"
 #include "session_manager.h"
+#include "stats_store.h"
+#include "tenants.h"
+#include "topology.h"
+#include "trace.h"
 #include "utils.h"
+#include "watchdog.h"
 #include <dpp/appcommand.h>
 #include <dpp/message.h>
 #include <dpp/misc-enum.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <vector>
 
-int main()
+constexpr const char *StatsLogPath = "data/stats.log";
+constexpr const char *SchedulesPath = "data/schedules.db";
+constexpr const char *ProfilesPath = "data/profiles.db";
+constexpr const char *CueFragmentsDir = "assests/audio/fragments";
+constexpr const char *HandoffDir = "data/handoff"; // shared by all the processes of a deployment
+constexpr uint32_t ClaimSeconds = 5;               // how often snapshots left by other processes are looked for
+constexpr const char *UpgradeSocket = "data/upgrade.sock";
+constexpr unsigned UpgradeWaitSeconds = 600; // how long a new build started with POMODORO_UPGRADE=1 waits for SIGHUP
+constexpr uint32_t DefaultRequestThreads = 12; // D++'s default per cluster
+constexpr RateLimiter::Rule UserCommandRate{5, 6000};   // bursts of 5, then one every 6s
+constexpr RateLimiter::Rule GuildCommandRate{30, 1000}; // bursts of 30, then one every second
+
+static std::atomic<bool> StopRequested{false};
+static std::atomic<bool> UpgradeRequested{false};
+
+// Replies ephemerally and returns false if the user or the guild is over its command rate
+template <class Event> // slashcommand_t or button_click_t
+static bool Admit(RateLimiter &limiter, Event const &event)
 {
+  auto res = limiter.Acquire(event.command.usr.id, event.command.guild_id);
+  if (res.Status == RateLimiter::Verdict::Allowed)
+    return 1;
+  std::string msg;
+  loc::Throttled(
+      loc::FromTag(event.command.guild_locale),
+      std::back_inserter(msg),
+      res.Status == RateLimiter::Verdict::GuildLimited,
+      (res.RetryMs + 999) / 1000);
+  event.reply(msg_fl(msg, dpp::m_ephemeral));
+  return 0;
+}
+
+// Tenants from POMODORO_TENANTS, or a single one with the DisBotTok token
+static bool LoadTenantConfigs(std::vector<tenant::Config> &configs)
+{
+  if (const char *path = getenv("POMODORO_TENANTS"); path && *path)
+  {
+    std::string error;
+    if (tenant::Load(path, configs, error))
+      return 1;
+    fmt::print(stderr, "{}\n", error);
+    return 0;
+  }
   std::string BotToken;
   if (!utl::GetBotToken(BotToken))
   {
     fmt::print(stderr, "No Bot Token found in env var DisBotTok");
+    return 0;
+  }
+  configs.push_back({"default", std::move(BotToken)});
+  return 1;
+}
+
+int main()
+{
+  uint64_t BaseKiB = tenant::ResidentKiB();
+  std::vector<tenant::Config> Configs;
+  if (!LoadTenantConfigs(Configs))
+    return 1;
+
+  // POMODORO_CLUSTER=<id>/<count> with POMODORO_SHARDS=<total> runs one slice of the shards, see session_handoff.h
+  handoff::ShardMap Shards;
+  if (!handoff::ShardMap::Parse(getenv("POMODORO_CLUSTER"), getenv("POMODORO_SHARDS"), Shards))
+  {
+    fmt::print(stderr, "POMODORO_CLUSTER must be <id>/<count> and POMODORO_SHARDS a shard count of at least <count>");
     return 1;
   }
-  dpp::cluster bot(BotToken, dpp::i_default_intents | dpp::i_message_content | dpp::i_guild_voice_states);
 
-  bot.on_log(
-      [](dpp::log_t const &e)
+  // POMODORO_THREADS places the timer, audio and event threads, see topology.h
+  topo::Layout Threads;
+  if (std::string error; !topo::Parse(getenv("POMODORO_THREADS"), Threads, error))
+  {
+    fmt::print(stderr, "POMODORO_THREADS: {}\n", error);
+    return 1;
+  }
+  topo::Start(Threads);
+
+  // D++ can't share REST threads between clusters, tenants split the default budget instead
+  const uint32_t RequestThreads = std::max<uint32_t>(2, DefaultRequestThreads / Configs.size());
+  std::vector<std::unique_ptr<dpp::cluster>> Bots;
+  // Resident growth while each tenant's cluster and state are built, sampled around each one
+  std::vector<uint64_t> TenantKiB(Configs.size());
+  for (size_t i = 0; i < Configs.size(); ++i)
+  {
+    auto const &config = Configs[i];
+    uint64_t before = tenant::ResidentKiB();
+    auto &b = Bots.emplace_back(std::make_unique<dpp::cluster>(
+        config.Token,
+        dpp::i_default_intents | dpp::i_message_content | dpp::i_guild_voice_states,
+        Shards.Shards,
+        Shards.ClusterId,
+        Shards.MaxClusters,
+        true,
+        dpp::cache_policy::cpol_default,
+        RequestThreads));
+    b->on_log(
+        [multi = Configs.size() > 1, name = config.Name](dpp::log_t const &e)
+        {
+          if (e.severity < dpp::loglevel::ll_debug)
+            return;
+          if (multi)
+            fmt::print(stderr, "[{}\x1b[0m] {}: {}\n", utl::SeverityName(e.severity), name, e.message);
+          else
+            fmt::print(stderr, "[{}\x1b[0m] {}\n", utl::SeverityName(e.severity), e.message);
+        });
+    uint64_t after = tenant::ResidentKiB();
+    TenantKiB[i] = after - std::min(after, before);
+  }
+  // Shared infrastructure logs and runs its timers on the first tenant's cluster
+  dpp::cluster &bot = *Bots[0];
+  bot.log(DL::ll_info, topo::Report()); // the layout, threads are listed once all tenants are ready
+
+  StatsStore Stats(bot, StatsLogPath);
+  CueComposer Cues(CueFragmentsDir);
+  RecurringScheduler Scheduler(bot, SchedulesPath);
+  ProfileStore Profiles(bot, ProfilesPath);
+  RateLimiter Limiter(UserCommandRate, GuildCommandRate);
+  std::vector<std::unique_ptr<tenant::Tenant>> Tenants;
+  for (size_t i = 0; i < Configs.size(); ++i)
+  {
+    uint64_t before = tenant::ResidentKiB();
+    Tenants.push_back(
+        std::make_unique<tenant::Tenant>(Configs[i].Name, *Bots[i], i, Stats, Cues, Scheduler, Profiles));
+    uint64_t after = tenant::ResidentKiB();
+    TenantKiB[i] += after - std::min(after, before);
+  }
+
+  // POMODORO_PHASE_GRID=<seconds> rounds phase ends up to a grid so more of them change phase in one batch
+  if (const char *grid = getenv("POMODORO_PHASE_GRID"); grid && *grid)
+  {
+    unsigned seconds = std::clamp(atoi(grid), 1, 60);
+    for (auto &t : Tenants)
+      t->Manager.PhaseGrid = seconds;
+    bot.log(DL::ll_info, fmt::format("Phase ends are aligned to {}s", seconds));
+  }
+
+  // POMODORO_WEBHOOK_NAME and POMODORO_WEBHOOK_AVATAR=<png file> set how announcements are signed
+  {
+    std::string avatar;
+    if (const char *path = getenv("POMODORO_WEBHOOK_AVATAR"); path && *path)
+    {
+      std::ifstream file(path, std::ios::binary);
+      avatar.assign(std::istreambuf_iterator<char>(file), {});
+      if (avatar.empty())
+        bot.log(DL::ll_warning, fmt::format("Webhook avatar '{}' not read, the default one is used", path));
+    }
+    const char *name = getenv("POMODORO_WEBHOOK_NAME");
+    for (auto &t : Tenants)
+    {
+      if (name && *name)
+        t->Manager.Notices.Name = name;
+      t->Manager.Notices.AvatarPng = avatar;
+    }
+  }
+
+  // POMODORO_UPGRADE=1 takes the sessions of the running process over before connecting, see live_upgrade.h
+  handoff::Directory Handoff(HandoffDir);
+  if (const char *u = getenv("POMODORO_UPGRADE"); u && *u == '1')
+  {
+    bot.log(DL::ll_info, fmt::format("Waiting on {} for the running process, send it SIGHUP", UpgradeSocket));
+    upgrade::State inherited;
+    std::string error;
+    if (!upgrade::Receive(UpgradeSocket, UpgradeWaitSeconds, inherited, error))
+      bot.log(DL::ll_error, fmt::format("Live upgrade failed: {}, starting without its sessions", error));
+
+    // Sessions of guilds on other processes' shards go through the handoff directory like on SIGTERM
+    size_t adopted = 0, passed = 0;
+    for (auto const &s : inherited.Sessions)
+      if (s.Tenant >= Tenants.size() || !Shards.Owns(s.GuildId))
+        passed += Handoff.Put(s);
+      else if (Tenants[s.Tenant]->Manager.Adopt(s))
+        adopted++;
+      else // its owner can't have two sessions, it's ended rather than dropped with its members muted
+        Tenants[s.Tenant]->Manager.Discard(s);
+    if (!inherited.Sessions.empty())
+    {
+      auto now = std::chrono::system_clock::now().time_since_epoch();
+      bot.log(
+          DL::ll_info,
+          fmt::format(
+              "Live upgrade: adopted {} of {} sessions {}ms after the old process released them, {} passed on to {}",
+              adopted,
+              inherited.Sessions.size(),
+              std::chrono::duration_cast<std::chrono::milliseconds>(now).count() - inherited.StoppedAtMs,
+              passed,
+              Handoff.Path()));
+    }
+  }
+
+  // POMODORO_CAPTURE=<path> copies incoming events to an event log for tools/replay
+  std::unique_ptr<capture::Recorder> Capture;
+  if (const char *path = getenv("POMODORO_CAPTURE"); path && *path)
+  {
+    Capture = std::make_unique<capture::Recorder>(path);
+    if (Capture->IsOpen())
+      bot.log(DL::ll_info, fmt::format("Capturing events to {}", path));
+    else
+    {
+      bot.log(DL::ll_error, fmt::format("Couldn't open capture log {}", path));
+      Capture.reset();
+    }
+  }
+
+  std::atomic<size_t> ReadyTenants{0};
+  for (auto &t : Tenants)
+  {
+    t->Bot.on_slashcommand(
+        [&, &t = *t](const dpp::slashcommand_t &event)
+        {
+          topo::Adopt(topo::Role::Events);
+          if (Capture)
+            Capture->Record(event);
+          if (StopRequested.load(std::memory_order_relaxed)) // Sessions are being handed over
+          {
+            event.reply(msg_fl("The bot is restarting, try again in a few seconds", dpp::m_ephemeral));
+            return;
+          }
+          if (!Admit(Limiter, event))
+            return;
+          std::lock_guard lock(t.Manager.Mtx);
+          if (!t.Commands.Dispatch(event.command.get_command_name(), event))
+            event.reply(msg_fl("UNKOWN COMMAND Please contact Melal", dpp::m_ephemeral));
+        });
+
+    t->Bot.on_button_click(
+        [&, &t = *t](const dpp::button_click_t &event)
+        {
+          topo::Adopt(topo::Role::Events);
+          if (Capture)
+            Capture->Record(event);
+          if (!Admit(Limiter, event))
+            return;
+          std::lock_guard lock(t.Manager.Mtx);
+          if (!t.Components.Dispatch(event))
+            event.reply(msg_fl("This button is no longer active", dpp::m_ephemeral));
+        });
+
+    t->Bot.on_voice_state_update(
+        [&, &t = *t](dpp::voice_state_update_t const &e)
+        {
+          topo::Adopt(topo::Role::Events);
+          if (Capture)
+            Capture->Record(e);
+          std::lock_guard lock(t.Manager.Mtx);
+          t.Handler.VCHandler(e);
+        });
+
+    // Sessions of guilds behind a dropped shard are paused, and diffed against the cache once the guild is back
+    t->Bot.on_resumed([&t = *t](dpp::resumed_t const &e) { t.Manager.ReconcileShard(e.shard_id); });
+    t->Bot.on_guild_create(
+        [&t = *t](dpp::guild_create_t const &e)
+        {
+          if (e.created)
+            t.Manager.ReconcileGuilds({&e.created->id, 1});
+        });
+    t->Bot.on_guild_delete(
+        [&t = *t](dpp::guild_delete_t const &e)
+        {
+          if (e.deleted.is_unavailable())
+            t.Manager.SuspendGuild(e.guild_id);
+          else
+            t.Manager.EndGuilds({&e.guild_id, 1});
+        });
+    t->Bot.start_timer([&t = *t](dpp::timer) { t.Manager.CheckShards(); }, 1);
+    // The timer thread is placed by its first callback, the timer stops after it
+    t->Bot.start_timer(
+        [&bot = t->Bot](dpp::timer self)
+        {
+          topo::Adopt(topo::Role::Timer);
+          bot.stop_timer(self);
+        },
+        1);
+
+    t->Bot.on_ready(
+        [&, &t = *t](const dpp::ready_t &)
+        {
+          topo::Adopt(topo::Role::Events);
+          if (dpp::run_once<struct start_recurring_scheduler>())
+            Scheduler.Start();
+
+          std::call_once(
+              t.Ready,
+              [&]
+              {
+                std::vector<dpp::slashcommand> SlashCommands;
+                SlashCommands.reserve(1);
+                AddPomodoroSlashCommand(SlashCommands, t.Bot.me.id);
+                t.Bot.global_bulk_command_create(SlashCommands);
+
+                // Compare a tenant's figure with the resident size of a single tenant process
+                t.Bot.log(
+                    DL::ll_info,
+                    fmt::format(
+                        "Tenant {} ready, its cluster and state took {} KiB", t.Name, TenantKiB[t.Manager.Tenant]));
+                if (++ReadyTenants == Tenants.size())
+                {
+                  bot.log(
+                      DL::ll_info,
+                      fmt::format(
+                          "{} tenant(s) ready, resident {} KiB over the {} KiB startup base",
+                          Tenants.size(),
+                          tenant::ResidentKiB(),
+                          BaseKiB));
+                  bot.log(DL::ll_info, topo::Report());
+                }
+              });
+        });
+  }
+
+  // POMODORO_TRACE=1 records trace points from startup, SIGUSR1 dumps them
+  if (const char *t = getenv("POMODORO_TRACE"); t && *t == '1')
+    trace::Enabled.store(true);
+  trace::ExportOnSignal(SIGUSR1);
+  bot.start_timer(
+      [&bot](dpp::timer)
       {
-        if (e.severity >= dpp::loglevel::ll_debug)
-          fmt::print(stderr, "[{}\x1b[0m] {}\n", utl::SeverityName(e.severity), e.message);
+        if (!trace::TakeExportRequest())
+          return;
+        std::string path = fmt::format("trace-{}.json", time(nullptr));
+        if (trace::WriteChromeJson(path.c_str()))
+          bot.log(DL::ll_info, fmt::format("Trace written to {}", path));
+        else
+          bot.log(DL::ll_error, fmt::format("Couldn't write trace to {}", path));
+      },
+      1);
+
+  shed::Start(
+      bot,
+      [&Tenants](shed::Level, shed::Level to)
+      {
+        if (to < shed::Level::DeferMutes)
+          for (auto &t : Tenants)
+            t->Manager.FlushDeferredMutes();
       });
 
-  SessionManager mgr(bot);
-  Pomodoro PomHandler(mgr);
-  Registry Commands(bot);
-  LoadAllCommands(Commands, PomHandler);
+  if (Capture)
+    bot.start_timer([&Capture](dpp::timer) { Capture->Flush(); }, 5);
 
-  bot.on_slashcommand(
-      [&](const dpp::slashcommand_t &event)
+  // SIGTERM hands the live sessions over to whichever process owns their guild next, then stops.
+  // SIGHUP hands them to a new build waiting on UpgradeSocket, the handoff directory is the fallback
+  std::signal(SIGTERM, [](int) { StopRequested.store(true, std::memory_order_relaxed); });
+  std::signal(SIGHUP, [](int) { UpgradeRequested.store(true, std::memory_order_relaxed); });
+  bot.start_timer(
+      [&](dpp::timer t)
       {
-        if (!Commands.Dispatch(event.command.get_command_name(), event))
-          event.reply(msg_fl("UNKOWN COMMAND Please contact Melal", dpp::m_ephemeral));
-      });
+        bool upgrade = UpgradeRequested.load(std::memory_order_relaxed);
+        if (!upgrade && !StopRequested.load(std::memory_order_relaxed))
+          return;
+        bot.stop_timer(t);
+        StopRequested.store(true, std::memory_order_relaxed);
 
-  bot.on_voice_state_update([&bot, &PomHandler](dpp::voice_state_update_t const &e) { PomHandler.VCHandler(e); });
+        upgrade::State state;
+        for (auto &ten : Tenants)
+          ten->Manager.ReleaseAll(state.Sessions);
+        state.StoppedAtMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                std::chrono::system_clock::now().time_since_epoch())
+                                .count();
+        if (upgrade)
+        {
+          std::string error;
+          if (upgrade::Send(UpgradeSocket, state, error))
+          {
+            bot.log(DL::ll_info, fmt::format("Handed {} sessions to the new build, stopping", state.Sessions.size()));
+            for (auto &b : Bots)
+              b->shutdown();
+            return;
+          }
+          bot.log(DL::ll_error, fmt::format("Live upgrade failed: {}", error));
+        }
+
+        size_t written = 0;
+        for (auto const &s : state.Sessions)
+          written += Handoff.Put(s);
+        bot.log(
+            written == state.Sessions.size() ? DL::ll_info : DL::ll_error,
+            fmt::format(
+                "Handed over {} of {} sessions to {}, stopping", written, state.Sessions.size(), Handoff.Path()));
+        for (auto &b : Bots)
+          b->shutdown();
+      },
+      1);
 
-  bot.on_ready(
-      [&bot](const dpp::ready_t &event)
+  bot.start_timer(
+      [&](dpp::timer)
       {
-        if (dpp::run_once<struct register_bot_commands>())
+        if (StopRequested.load(std::memory_order_relaxed))
+          return;
+        for (auto &ten : Tenants)
         {
-          std::vector<dpp::slashcommand> SlashCommands;
-          SlashCommands.reserve(1);
-          AddPomodoroSlashCommand(SlashCommands, bot.me.id);
+          std::vector<handoff::Snapshot> snapshots;
+          if (!Handoff.Claim(Shards, ten->Manager.Tenant, snapshots))
+            continue;
+          // Too old to carry on, or refused by Adopt because its owner has a session here: the session is ended so
+          // its members aren't left muted, the snapshot is done either way
+          size_t adopted = 0, discarded = 0;
+          int64_t now_ms = utl::WallMs();
+          for (auto const &s : snapshots)
+          {
+            if (!handoff::Stale(s, now_ms) && ten->Manager.Adopt(s))
+              adopted++;
+            else
+            {
+              ten->Manager.Discard(s);
+              discarded++;
+            }
+            Handoff.Done(s);
+          }
+          bot.log(
+              DL::ll_info,
+              fmt::format(
+                  "{}: took over {} handed over session(s), ended {} that waited too long or whose owner had one here",
+                  ten->Name,
+                  adopted,
+                  discarded));
+        }
+      },
+      ClaimSeconds);
+
+  // Stacks of threads stuck for watchdog::StallMs are logged, the worst lag is reported every minute
+  watchdog::Start(bot, SIGUSR2);
+  bot.start_timer(
+      [&bot](dpp::timer)
+      { bot.log(DL::ll_debug, fmt::format("Event loop lag: worst {}ms in the last minute", watchdog::TakeMaxLagMs())); },
+      60);
 
-          bot.global_bulk_command_create(SlashCommands);
+  // One shard of idle buckets is freed per second, the counters are logged every minute with the others
+  bot.start_timer([&Limiter](dpp::timer) { Limiter.Evict(); }, 1);
+  bot.start_timer(
+      [&bot, &Tenants, &Limiter](dpp::timer)
+      {
+        bot.log(
+            DL::ll_debug,
+            fmt::format("Resources: resident {} KiB, {} open fds", tenant::ResidentKiB(), tenant::OpenFds()));
+        bot.log(DL::ll_debug, Limiter.Report());
+        for (auto &t : Tenants)
+        {
+          bot.log(DL::ll_debug, t->Manager.Report());
+          bot.log(DL::ll_debug, t->Manager.Notices.Report());
         }
-      });
+      },
+      60);
+
+#ifdef POMODORO_ALLOC_STATS
+  bot.start_timer([&bot](dpp::timer) { bot.log(DL::ll_debug, "Allocations:\n" + mem::Report()); }, 60);
+#endif
 
+  for (size_t i = 1; i < Bots.size(); ++i)
+    Bots[i]->start(dpp::st_return);
   bot.start(dpp::st_wait);
 }
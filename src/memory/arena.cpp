@@ -0,0 +1,119 @@
+#include "arena.h"
+
+#ifdef POMODORO_ALLOC_STATS
+#include <cstdlib>
+#include <fmt/format.h>
+#include <new>
+
+namespace mem
+{
+static AllocCounters counters[static_cast<size_t>(Subsystem::Count)];
+static std::atomic<int64_t> live_blocks{0}; // all subsystems, a block may be freed under another tag
+static constexpr const char *SubsystemNames[] = {"other", "commands", "sessions", "status"};
+static_assert(std::size(SubsystemNames) == static_cast<size_t>(Subsystem::Count));
+
+AllocCounters &Counters(Subsystem s) noexcept
+{
+  return counters[static_cast<size_t>(s)];
+}
+
+int64_t LiveBlocks() noexcept
+{
+  return live_blocks.load(std::memory_order_relaxed);
+}
+
+Subsystem &CurrentSubsystem() noexcept
+{
+  thread_local Subsystem current = Subsystem::Other;
+  return current;
+}
+
+std::string Report()
+{
+  std::string out;
+  for (size_t i = 0; i < std::size(counters); ++i)
+    fmt::format_to(
+        std::back_inserter(out),
+        "[{}] heap allocations: {}, heap bytes: {}, arena spills: {}\n",
+        SubsystemNames[i],
+        counters[i].HeapAllocations.load(std::memory_order_relaxed),
+        counters[i].HeapBytes.load(std::memory_order_relaxed),
+        counters[i].ArenaSpills.load(std::memory_order_relaxed));
+  fmt::format_to(std::back_inserter(out), "live heap blocks: {}\n", LiveBlocks());
+  return out;
+}
+} // namespace mem
+
+// Counting replacements of the global allocation functions, attributed to the thread's current subsystem
+
+static void *CountedAlloc(size_t size, size_t align = 0)
+{
+  auto &c = mem::Counters(mem::CurrentSubsystem());
+  c.HeapAllocations.fetch_add(1, std::memory_order_relaxed);
+  c.HeapBytes.fetch_add(size, std::memory_order_relaxed);
+
+  if (size == 0)
+    size = 1;
+  void *p = align ? std::aligned_alloc(align, (size + align - 1) / align * align) : std::malloc(size);
+  if (!p)
+    throw std::bad_alloc();
+  mem::live_blocks.fetch_add(1, std::memory_order_relaxed);
+  return p;
+}
+
+static void CountedFree(void *p) noexcept
+{
+  if (p)
+    mem::live_blocks.fetch_sub(1, std::memory_order_relaxed);
+  std::free(p);
+}
+
+void *operator new(size_t size)
+{
+  return CountedAlloc(size);
+}
+void *operator new[](size_t size)
+{
+  return CountedAlloc(size);
+}
+void *operator new(size_t size, std::align_val_t align)
+{
+  return CountedAlloc(size, static_cast<size_t>(align));
+}
+void *operator new[](size_t size, std::align_val_t align)
+{
+  return CountedAlloc(size, static_cast<size_t>(align));
+}
+void operator delete(void *p) noexcept
+{
+  CountedFree(p);
+}
+void operator delete[](void *p) noexcept
+{
+  CountedFree(p);
+}
+void operator delete(void *p, size_t) noexcept
+{
+  CountedFree(p);
+}
+void operator delete[](void *p, size_t) noexcept
+{
+  CountedFree(p);
+}
+void operator delete(void *p, std::align_val_t) noexcept
+{
+  CountedFree(p);
+}
+void operator delete[](void *p, std::align_val_t) noexcept
+{
+  CountedFree(p);
+}
+void operator delete(void *p, size_t, std::align_val_t) noexcept
+{
+  CountedFree(p);
+}
+void operator delete[](void *p, size_t, std::align_val_t) noexcept
+{
+  CountedFree(p);
+}
+#endif
@@ -0,0 +1,167 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+// Allocation accounting is compiled in for debug builds and when POMODORO_ALLOC_STATS is defined (see CMakeLists.txt)
+
+namespace mem
+{
+enum class Subsystem : uint8_t
+{
+  Other = 0,
+  Commands,
+  Sessions,
+  Status,
+  Count
+};
+
+struct AllocCounters
+{
+  std::atomic<uint64_t> HeapAllocations{0};
+  std::atomic<uint64_t> HeapBytes{0};
+  std::atomic<uint64_t> ArenaSpills{0}; // arena ran out of its inline buffer and went to the heap
+};
+
+#ifdef POMODORO_ALLOC_STATS
+AllocCounters &Counters(Subsystem s) noexcept;
+/*
+   @brief Heap blocks allocated and not freed yet, for leak checks over a long run
+*/
+int64_t LiveBlocks() noexcept;
+Subsystem &CurrentSubsystem() noexcept;
+
+/*
+   @brief Attributes heap allocations made by this thread to a subsystem until it goes out of scope
+*/
+class ScopedTag
+{
+public:
+  explicit ScopedTag(Subsystem s) noexcept : _prev(CurrentSubsystem())
+  {
+    CurrentSubsystem() = s;
+  }
+  ~ScopedTag()
+  {
+    CurrentSubsystem() = _prev;
+  }
+
+private:
+  Subsystem _prev;
+};
+
+/*
+   @brief One line per subsystem with its counters, for the periodic log
+*/
+std::string Report();
+#else
+class ScopedTag
+{
+public:
+  explicit ScopedTag(Subsystem) noexcept {};
+};
+#endif
+
+/*
+   Monotonic arena living for one event (a slash command, a phase transition).
+   Temporaries are carved out of an inline buffer and released all at once when it goes out of scope,
+   only an overflow reaches the heap.
+*/
+template <size_t N = 4096> //
+class EventArena
+{
+public:
+  explicit EventArena(Subsystem s = Subsystem::Other) noexcept : _spill(s), _resource(_buffer, N, &_spill) {};
+  EventArena(EventArena const &) = delete;
+  EventArena &operator=(EventArena const &) = delete;
+
+  std::pmr::memory_resource *Resource() noexcept
+  {
+    return &_resource;
+  }
+
+  std::pmr::string String(size_t reserve = 0)
+  {
+    std::pmr::string s(&_resource);
+    s.reserve(reserve);
+    return s;
+  }
+
+private:
+  // Counts arena overflows, then forwards to the default heap resource
+  class SpillResource : public std::pmr::memory_resource
+  {
+  public:
+    explicit SpillResource(Subsystem s) noexcept : _subsystem(s) {};
+
+  private:
+    void *do_allocate(size_t bytes, size_t align) override
+    {
+#ifdef POMODORO_ALLOC_STATS
+      Counters(_subsystem).ArenaSpills.fetch_add(1, std::memory_order_relaxed);
+#endif
+      return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+    void do_deallocate(void *p, size_t bytes, size_t align) override
+    {
+      std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+    }
+    bool do_is_equal(std::pmr::memory_resource const &other) const noexcept override
+    {
+      return this == &other;
+    }
+
+    [[maybe_unused]] Subsystem _subsystem;
+  };
+
+  alignas(std::max_align_t) std::byte _buffer[N];
+  SpillResource _spill;
+  std::pmr::monotonic_buffer_resource _resource;
+};
+
+/*
+   Non owning reference to a callable, unlike std::function it never allocates.
+   Only valid while the referenced callable is alive, use it for callbacks that are called before returning.
+*/
+template <class Sig> //
+class FunctionRef;
+
+template <class R, class... Args> //
+class FunctionRef<R(Args...)>
+{
+public:
+  FunctionRef(std::nullptr_t = nullptr) noexcept {};
+
+  template <class F>
+    requires(!std::is_same_v<std::decay_t<F>, FunctionRef> && std::is_invocable_r_v<R, F &, Args...>)
+  FunctionRef(F &&f) noexcept
+      : _obj(const_cast<void *>(static_cast<void const *>(std::addressof(f)))),
+        _call([](void *obj, Args... args) -> R
+              { return (*static_cast<std::remove_reference_t<F> *>(obj))(std::forward<Args>(args)...); })
+  {
+  }
+
+  explicit operator bool() const noexcept
+  {
+    return _call;
+  }
+
+  R operator()(Args... args) const
+  {
+    return _call(_obj, std::forward<Args>(args)...);
+  }
+
+private:
+  void *_obj = nullptr;
+  R (*_call)(void *, Args...) = nullptr;
+};
+
+} // namespace mem
+
+#endif
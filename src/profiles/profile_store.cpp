@@ -0,0 +1,342 @@
+#include "profile_store.h"
+#include "utils.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fmt/format.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr const char TableMagic[4] = {'P', 'M', 'P', 'F'};
+constexpr uint32_t TableVersion = 1;
+constexpr uint64_t InitialCapacity = 4096; // slots, 96KiB
+constexpr uint8_t Removed = 0xff;          // Kind of a removed slot, probes go past it
+
+static size_t BytesFor(uint64_t capacity) noexcept
+{
+  return 64 + sizeof(ProfileStore::Profile) * capacity;
+}
+
+// splitmix64 finalizer, the low bits of a snowflake are a per-process counter
+static uint64_t Mix(uint64_t x) noexcept
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ull;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebull;
+  return x ^ x >> 31;
+}
+
+// Holds an flock until the end of the scope, nothing for a store kept in memory only
+struct FileLock
+{
+  int Fd;
+  FileLock(int fd, int op) noexcept : Fd(fd != -1 && flock(fd, op) == 0 ? fd : -1)
+  {
+  }
+  ~FileLock()
+  {
+    if (Fd != -1)
+      flock(Fd, LOCK_UN);
+  }
+};
+
+size_t ProfileStore::KeyHash::operator()(Key const &k) const noexcept
+{
+  return Mix(k.Id + static_cast<uint8_t>(k.Kind));
+}
+
+ProfileStore::ProfileStore(dpp::cluster &bot, const char *path, size_t cache_capacity) noexcept
+    : Bot(bot), _capacity(cache_capacity ? cache_capacity : 1)
+{
+  if (Open(path))
+  {
+    _path = path;
+    _seen_writes = _header->Writes;
+    Bot.log(DL::ll_info, fmt::format("Profile store init, {} profiles", _header->Live));
+    return;
+  }
+
+  Bot.log(DL::ll_warning, fmt::format("Profile store '{}' unavailable, profiles are kept in memory only", path));
+  if (_fd != -1)
+    close(_fd);
+  if (_lock_fd != -1)
+    close(_lock_fd);
+  _fd = _lock_fd = -1;
+  _header = Map(-1, InitialCapacity, 1);
+}
+
+ProfileStore::~ProfileStore()
+{
+  if (_header)
+  {
+    if (_fd != -1)
+      msync(_header, BytesFor(_header->Capacity), MS_SYNC);
+    munmap(_header, BytesFor(_header->Capacity));
+  }
+  if (_fd != -1)
+    close(_fd);
+  if (_lock_fd != -1)
+    close(_lock_fd);
+}
+
+// Table ------------
+
+ProfileStore::TableHeader *ProfileStore::Map(int fd, uint64_t capacity, bool fresh) noexcept
+{
+  size_t bytes = BytesFor(capacity);
+  if (fd != -1 && fresh && ftruncate(fd, bytes) == -1)
+    return nullptr;
+
+  void *p = fd == -1 ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+                     : mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+    return nullptr;
+
+  auto *header = static_cast<TableHeader *>(p);
+  if (fresh)
+  {
+    std::memcpy(header->Magic, TableMagic, sizeof(TableMagic));
+    header->Version = TableVersion;
+    header->Capacity = capacity;
+    header->Used = 0;
+    header->Live = 0;
+  }
+  return header;
+}
+
+bool ProfileStore::Open(const char *path) noexcept
+{
+  std::error_code ec;
+  auto parent = std::filesystem::path(path).parent_path();
+  if (!parent.empty())
+    std::filesystem::create_directories(parent, ec);
+
+  _lock_fd = open(fmt::format("{}.lock", path).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (_lock_fd == -1)
+    return 0;
+  FileLock lock(_lock_fd, LOCK_EX); // processes starting together set a fresh table up once
+  _fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (_fd == -1)
+    return 0;
+
+  struct stat st;
+  if (fstat(_fd, &st) == -1)
+    return 0;
+  if (st.st_size == 0)
+    return (_header = Map(_fd, InitialCapacity, 1));
+
+  // Only the header is read here, the slots are paged in by lookups
+  TableHeader header;
+  if (pread(_fd, &header, sizeof(header), 0) != sizeof(header) ||
+      std::memcmp(header.Magic, TableMagic, sizeof(TableMagic)) != 0 || header.Version != TableVersion ||
+      !header.Capacity || (header.Capacity & (header.Capacity - 1)) || header.Used >= header.Capacity ||
+      static_cast<uint64_t>(st.st_size) < BytesFor(header.Capacity))
+    return 0;
+  return (_header = Map(_fd, header.Capacity, 0));
+}
+
+ProfileStore::Profile *ProfileStore::Find(Key key) const noexcept
+{
+  Profile *slots = Slots();
+  uint64_t mask = _header->Capacity - 1;
+  // Used stays below Capacity so there's always an empty slot to end the probe
+  for (uint64_t i = KeyHash{}(key) & mask;; i = (i + 1) & mask)
+  {
+    if (!slots[i].Id)
+      return nullptr;
+    if (slots[i].Id == key.Id && slots[i].Kind == key.Kind)
+      return &slots[i];
+  }
+}
+
+bool ProfileStore::Grow() noexcept
+{
+  // Doubles when mostly live, otherwise rebuilds at the same size to drop removed slots
+  uint64_t capacity = _header->Capacity;
+  if (_header->Live * 2 >= capacity)
+    capacity *= 2;
+
+  std::string tmp = _path.empty() ? "" : _path + ".tmp";
+  int fd = -1;
+  if (!tmp.empty() && (fd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1)
+    return 0;
+
+  TableHeader *header = Map(fd, capacity, 1);
+  if (!header)
+  {
+    if (fd != -1)
+    {
+      close(fd);
+      unlink(tmp.c_str());
+    }
+    return 0;
+  }
+
+  Profile *from = Slots(), *to = reinterpret_cast<Profile *>(header + 1);
+  for (uint64_t i = 0; i < _header->Capacity; ++i)
+  {
+    Profile const &p = from[i];
+    if (!p.Id || static_cast<uint8_t>(p.Kind) == Removed)
+      continue;
+    uint64_t j = KeyHash{}({p.Id, p.Kind}) & (capacity - 1);
+    while (to[j].Id)
+      j = (j + 1) & (capacity - 1);
+    to[j] = p;
+  }
+  header->Used = header->Live = _header->Live;
+
+  // The new table is complete on disk before it replaces the old one
+  if (fd != -1 && (msync(header, BytesFor(capacity), MS_SYNC) == -1 || rename(tmp.c_str(), _path.c_str()) == -1))
+  {
+    munmap(header, BytesFor(capacity));
+    close(fd);
+    unlink(tmp.c_str());
+    return 0;
+  }
+
+  if (fd != -1)
+    _header->Moved = 1; // the other processes still map the old table
+  munmap(_header, BytesFor(_header->Capacity));
+  if (_fd != -1)
+    close(_fd);
+  _header = header;
+  _fd = fd;
+  return 1;
+}
+
+void ProfileStore::Sync(bool locked) noexcept
+{
+  if (_lock_fd == -1)
+    return;
+  if (_header->Moved)
+  {
+    FileLock lock(locked ? -1 : _lock_fd, LOCK_SH); // not while the next Grow renames
+    TableHeader h;
+    int fd = open(_path.c_str(), O_RDWR | O_CLOEXEC);
+    TableHeader *header = fd != -1 && pread(fd, &h, sizeof(h), 0) == sizeof(h) ? Map(fd, h.Capacity, 0) : nullptr;
+    if (!header)
+    {
+      if (fd != -1)
+        close(fd);
+      Bot.log(DL::ll_error, "Profile store was rebuilt by another process and couldn't be mapped again");
+      return;
+    }
+    munmap(_header, BytesFor(_header->Capacity));
+    close(_fd);
+    _header = header;
+    _fd = fd;
+  }
+  if (_header->Writes != _seen_writes)
+  {
+    _lru.clear();
+    _index.clear();
+    _seen_writes = _header->Writes;
+  }
+}
+
+void ProfileStore::Changed() noexcept
+{
+  _seen_writes = ++_header->Writes;
+}
+
+// Lookups ----------
+
+void ProfileStore::Cache(Profile const &profile) noexcept
+{
+  Key key{profile.Id, profile.Kind};
+  if (auto it = _index.find(key); it != _index.end())
+  {
+    *it->second = profile;
+    _lru.splice(_lru.begin(), _lru, it->second);
+    return;
+  }
+
+  if (_lru.size() >= _capacity) // The oldest entry's node is reused, a full cache doesn't allocate
+  {
+    _index.erase({_lru.back().Id, _lru.back().Kind});
+    _lru.back() = profile;
+    _lru.splice(_lru.begin(), _lru, std::prev(_lru.end()));
+  }
+  else
+    _lru.push_front(profile);
+  _index.emplace(key, _lru.begin());
+}
+
+bool ProfileStore::Get(Scope scope, uint64_t id, Profile &out) noexcept
+{
+  Key key{id, scope};
+  std::lock_guard lock(_mtx);
+  Sync(0);
+  if (auto it = _index.find(key); it != _index.end())
+  {
+    _lru.splice(_lru.begin(), _lru, it->second);
+    out = *it->second;
+    return out.Fields;
+  }
+
+  FileLock file(_lock_fd, LOCK_SH);
+  Profile const *p = _header ? Find(key) : nullptr;
+  if (p)
+    out = *p;
+  else
+  {
+    out = {};
+    out.Id = id;
+    out.Kind = scope;
+  }
+  Cache(out); // misses too, most members never save a profile
+  return out.Fields;
+}
+
+bool ProfileStore::Put(Profile const &profile) noexcept
+{
+  Key key{profile.Id, profile.Kind};
+  std::lock_guard lock(_mtx);
+  if (!_header)
+    return 0;
+  FileLock file(_lock_fd, LOCK_EX);
+  Sync(1);
+
+  if (Profile *p = Find(key))
+  {
+    if (profile.Fields)
+      *p = profile;
+    else
+    {
+      p->Kind = static_cast<Scope>(Removed);
+      _header->Live--;
+    }
+    Changed();
+    Cache(profile);
+    return 1;
+  }
+  if (!profile.Fields)
+  {
+    Cache(profile);
+    return 1;
+  }
+
+  // Keeps the load under 3/4 so probes stay short
+  if ((_header->Used + 1) * 4 > _header->Capacity * 3 && !Grow())
+  {
+    Bot.log(DL::ll_error, "Profile store couldn't grow, profile isn't saved");
+    return 0;
+  }
+
+  Profile *slots = Slots();
+  uint64_t mask = _header->Capacity - 1;
+  uint64_t i = KeyHash{}(key) & mask;
+  while (slots[i].Id && static_cast<uint8_t>(slots[i].Kind) != Removed)
+    i = (i + 1) & mask;
+  if (!slots[i].Id)
+    _header->Used++;
+  slots[i] = profile;
+  _header->Live++;
+  Changed();
+  Cache(profile);
+  return 1;
+}
@@ -0,0 +1,140 @@
+#ifndef PROFILE_STORE_H
+#define PROFILE_STORE_H
+#include <cstddef>
+#include <cstdint>
+#include <dpp/cluster.h>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*
+   Saved defaults for new sessions, one profile per user and one per guild.
+   Profiles are fixed records in an open-addressing hash table mapped from disk: opening the store only reads its
+   header, a lookup touches the page its probe lands on and the kernel loads it on first use. Recent lookups, misses
+   included, are kept in a bounded LRU in front of the table.
+   The processes of a sharded deployment share the table: writes hold an flock on <path>.lock, each write is counted
+   in the header so the others drop their LRU, and a table rebuilt by Grow marks the old one so they map the new file.
+*/
+class ProfileStore
+{
+public:
+  enum class Scope : uint8_t
+  {
+    User = 1,
+    Guild = 2
+  };
+
+  // Which fields of a profile are saved, the others fall through to the next profile or the command's default
+  enum Field : uint8_t
+  {
+    HasWork = 1u << 0,
+    HasBreak = 1u << 1,
+    HasRepeat = 1u << 2,
+    HasMute = 1u << 3,
+    HasVoice = 1u << 4,
+    HasCueSet = 1u << 5
+  };
+
+  // On-disk record
+  struct Profile
+  {
+    uint64_t Id;          // user or guild snowflake, 0 marks an empty slot
+    uint16_t WorkPeriod;  // in minutes
+    uint16_t BreakPeriod; // in minutes
+    uint8_t Repeat;
+    Scope Kind;
+    uint8_t Fields;   // Field mask
+    uint8_t Switches; // HasMute and HasVoice bits hold whether mute and voice are on
+    uint8_t CueSet;   // CueComposer set, 0 is the default one
+    uint8_t Reserved[7];
+  };
+  static_assert(sizeof(Profile) == 24, "Profile layout is part of the file format");
+
+  /*
+     @param cache_capacity how many lookups are kept in memory
+  */
+  ProfileStore(dpp::cluster &bot, const char *path, size_t cache_capacity = 4096) noexcept;
+  ~ProfileStore();
+  ProfileStore(ProfileStore const &) = delete;
+  ProfileStore &operator=(ProfileStore const &) = delete;
+
+  /*
+     @brief Looks a profile up, out has no fields set if there's none
+     @return false if there's no profile
+  */
+  bool Get(Scope scope, uint64_t id, Profile &out) noexcept;
+
+  /*
+     @brief Saves profile in place of the one with the same scope and id, a profile without fields removes it
+     @return false if the table couldn't grow
+  */
+  bool Put(Profile const &profile) noexcept;
+
+  size_t CachedProfiles() const noexcept
+  {
+    std::lock_guard lock(_mtx);
+    return _lru.size();
+  }
+
+  dpp::cluster &Bot;
+
+private:
+  struct TableHeader
+  {
+    char Magic[4];
+    uint32_t Version;
+    uint64_t Capacity; // slots, a power of two
+    uint64_t Used;     // slots that aren't empty, removed ones included
+    uint64_t Live;
+    uint64_t Writes; // bumped by every change, 0 in tables written before it
+    uint8_t Moved;   // set once Grow renamed a new table over this one
+    uint8_t Reserved[23];
+  };
+  static_assert(sizeof(TableHeader) == 64);
+
+  struct Key
+  {
+    uint64_t Id;
+    Scope Kind;
+    bool operator==(Key const &) const = default;
+  };
+  struct KeyHash
+  {
+    size_t operator()(Key const &k) const noexcept;
+  };
+
+  bool Open(const char *path) noexcept;
+  /*
+     @brief Follows what other processes did: maps the new table if this one was rebuilt, drops the LRU if the
+     table changed
+     @param locked the caller holds the flock
+  */
+  void Sync(bool locked) noexcept;
+  void Changed() noexcept;
+  /*
+     @brief Maps a table of capacity slots, backed by fd or anonymous memory if fd is -1
+  */
+  TableHeader *Map(int fd, uint64_t capacity, bool fresh) noexcept;
+  bool Grow() noexcept;
+  Profile *Slots() const noexcept
+  {
+    return reinterpret_cast<Profile *>(_header + 1);
+  }
+  Profile *Find(Key key) const noexcept;
+  void Cache(Profile const &profile) noexcept;
+
+  std::string _path; // empty if the table only lives in memory
+  int _fd = -1;
+  int _lock_fd = -1; // <path>.lock, flocked by writers of every process
+  TableHeader *_header = nullptr;
+  uint64_t _seen_writes = 0;
+  size_t _capacity;
+
+  mutable std::mutex _mtx;
+  using LruList = std::list<Profile>;
+  LruList _lru; // most recent first
+  std::unordered_map<Key, LruList::iterator, KeyHash> _index;
+};
+
+#endif
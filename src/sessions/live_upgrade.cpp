@@ -0,0 +1,229 @@
+#include "live_upgrade.h"
+#include <cerrno>
+#include <cstring>
+#include <fmt/format.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace upgrade
+{
+constexpr char Magic[4] = {'P', 'M', 'U', 'P'};
+constexpr uint8_t Version = 2;
+constexpr uint32_t MaxFrame = 1u << 20; // a single session bigger than this means the stream is corrupt
+constexpr uint32_t MaxCount = 1u << 22;
+constexpr int ReadTimeoutSeconds = 10;  // the old process only writes what it encoded up front
+constexpr int CommitTimeoutSeconds = 60; // the sender commits right after the answer, this only bounds a hung one
+constexpr char Ack = 1;
+constexpr char Commit = 2;
+
+static void PutInt(std::string &out, uint64_t v, size_t bytes)
+{
+  for (size_t i = 0; i < bytes; ++i)
+    out.push_back(static_cast<char>(v >> (8 * i)));
+}
+
+static bool Address(const char *path, sockaddr_un &addr, std::string &error) noexcept
+{
+  addr = {};
+  addr.sun_family = AF_UNIX;
+  if (std::strlen(path) >= sizeof(addr.sun_path))
+  {
+    error = fmt::format("socket path '{}' is too long", path);
+    return 0;
+  }
+  std::strcpy(addr.sun_path, path);
+  return 1;
+}
+
+static bool WriteAll(int fd, const char *p, size_t n) noexcept
+{
+  while (n)
+  {
+    ssize_t w = send(fd, p, n, MSG_NOSIGNAL); // a receiver that went away is an error, not SIGPIPE
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w <= 0)
+      return 0;
+    p += w;
+    n -= w;
+  }
+  return 1;
+}
+
+static bool ReadAll(int fd, char *p, size_t n) noexcept
+{
+  while (n)
+  {
+    ssize_t r = read(fd, p, n);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      return 0;
+    p += r;
+    n -= r;
+  }
+  return 1;
+}
+
+template <class T> static bool ReadInt(int fd, T &v, size_t bytes = sizeof(T)) noexcept
+{
+  unsigned char buf[8];
+  if (!ReadAll(fd, reinterpret_cast<char *>(buf), bytes))
+    return 0;
+  uint64_t r = 0;
+  for (size_t i = 0; i < bytes; ++i)
+    r |= uint64_t(buf[i]) << (8 * i);
+  v = static_cast<T>(r);
+  return 1;
+}
+
+void Encode(State const &state, std::string &out)
+{
+  out.append(Magic, sizeof(Magic));
+  PutInt(out, Version, 1);
+  PutInt(out, state.StoppedAtMs, 8);
+  PutInt(out, state.Sessions.size(), 4);
+  std::string session;
+  for (auto const &s : state.Sessions)
+  {
+    session.clear();
+    handoff::Encode(s, session);
+    PutInt(out, session.size(), 4);
+    out += session;
+  }
+}
+
+bool Send(const char *socket_path, State const &state, std::string &error, unsigned ack_timeout_s) noexcept
+{
+  sockaddr_un addr;
+  if (!Address(socket_path, addr, error))
+    return 0;
+
+  // Encoded up front so the connection only carries one write
+  std::string buf;
+  Encode(state, buf);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1)
+  {
+    error = fmt::format("socket: {}", std::strerror(errno));
+    return 0;
+  }
+  // Bounds the connect and every write too, a receiver that stopped reading mustn't keep the sessions from Handoff
+  timeval timeout{static_cast<time_t>(ack_timeout_s), 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  // Closing without the commit byte leaves the sessions with this process, the receiver drops them
+  char ack = 0;
+  bool ok = 0;
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1)
+    error = fmt::format("nothing is waiting on {}: {}", socket_path, std::strerror(errno));
+  else if (!WriteAll(fd, buf.data(), buf.size()))
+    error = errno == EAGAIN || errno == EWOULDBLOCK
+                ? fmt::format("the new process didn't read the sessions in {}s", ack_timeout_s)
+                : fmt::format("write: {}", std::strerror(errno));
+  else if (!ReadAll(fd, &ack, 1) || ack != Ack)
+    error = fmt::format("the new process didn't confirm in {}s", ack_timeout_s);
+  else if (!WriteAll(fd, &Commit, 1))
+    error = fmt::format("commit: {}", std::strerror(errno));
+  else
+    ok = 1;
+  close(fd);
+  return ok;
+}
+
+// Reads the stream of the accepted connection fd
+static bool ReadState(int fd, State &out, std::string &error) noexcept
+{
+  char magic[sizeof(Magic)];
+  uint8_t version;
+  uint32_t sessions;
+  if (!ReadAll(fd, magic, sizeof(magic)) || std::memcmp(magic, Magic, sizeof(Magic)) || !ReadInt(fd, version) ||
+      version != Version)
+  {
+    error = "not an upgrade stream of this version";
+    return 0;
+  }
+  if (!ReadInt(fd, out.StoppedAtMs) || !ReadInt(fd, sessions) || sessions > MaxCount)
+  {
+    error = "truncated or corrupt header";
+    return 0;
+  }
+
+  std::string frame;
+  out.Sessions.resize(sessions);
+  for (auto &s : out.Sessions)
+  {
+    uint32_t len;
+    if (!ReadInt(fd, len) || len > MaxFrame)
+    {
+      error = "truncated or oversized session";
+      return 0;
+    }
+    frame.resize(len);
+    if (!ReadAll(fd, frame.data(), len) || !handoff::Decode(frame, s))
+    {
+      error = "unreadable session";
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+bool Receive(const char *socket_path, unsigned timeout_s, State &out, std::string &error) noexcept
+{
+  sockaddr_un addr;
+  if (!Address(socket_path, addr, error))
+    return 0;
+
+  int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listener == -1)
+  {
+    error = fmt::format("socket: {}", std::strerror(errno));
+    return 0;
+  }
+  unlink(socket_path); // left behind by an upgrade that didn't finish
+  if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1 || listen(listener, 1) == -1)
+  {
+    error = fmt::format("can't listen on {}: {}", socket_path, std::strerror(errno));
+    close(listener);
+    return 0;
+  }
+
+  bool ok = 0;
+  pollfd p{listener, POLLIN, 0};
+  int ready = poll(&p, 1, static_cast<int>(timeout_s) * 1000);
+  if (ready <= 0)
+    error = ready == 0 ? fmt::format("no process handed over in {}s", timeout_s) : std::strerror(errno);
+  else if (int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC); fd == -1)
+    error = fmt::format("accept: {}", std::strerror(errno));
+  else
+  {
+    timeval timeout{ReadTimeoutSeconds, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if ((ok = ReadState(fd, out, error)))
+    {
+      // The sessions are only this process's once the sender commits, it may have given up on the answer
+      char commit = 0;
+      timeout = {CommitTimeoutSeconds, 0};
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      if (!WriteAll(fd, &Ack, 1) || !ReadAll(fd, &commit, 1) || commit != Commit)
+      {
+        error = "the old process didn't commit, it keeps its sessions";
+        ok = 0;
+      }
+    }
+    if (!ok)
+      out.Sessions.clear();
+    close(fd);
+  }
+  close(listener);
+  unlink(socket_path);
+  return ok;
+}
+} // namespace upgrade
@@ -0,0 +1,47 @@
+#ifndef LIVE_UPGRADE_H
+#define LIVE_UPGRADE_H
+#include "session_handoff.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+   Replacing a running process with a new build without ending its sessions.
+   The new process is started with POMODORO_UPGRADE=1 and waits on a unix socket; SIGHUP to the old process makes it
+   release its sessions and send them over that socket before it stops. The new process adopts them with their phase
+   deadlines and status messages, as the shared handoff directory does but without the claim interval. The shards of
+   the new process identify again, D++ can't resume a gateway session another process opened.
+
+   Stream: "PMUP" version(2), i64 stopped-at (unix ms), u32 session count, then every session as a u32 length and its
+   handoff::Encode bytes. The receiver answers with one byte once it has all of it and the sender commits with one
+   more. A sender that gave up waiting for the answer closes without committing and writes its sessions to the
+   handoff directory instead, the receiver drops what it read then, so no session is adopted twice.
+*/
+namespace upgrade
+{
+struct State
+{
+  int64_t StoppedAtMs = 0; // when the old process released its sessions
+  std::vector<handoff::Snapshot> Sessions;
+};
+
+/*
+   @brief Appends the stream for state to out, without the commit byte
+*/
+void Encode(State const &state, std::string &out);
+
+/*
+   @brief Sends state to the process waiting on socket_path
+   @return false if it isn't there or didn't accept, read or confirm in ack_timeout_s, state is still the caller's
+   to hand over another way then
+*/
+bool Send(const char *socket_path, State const &state, std::string &error, unsigned ack_timeout_s = 10) noexcept;
+
+/*
+   @brief Waits up to timeout_s for the old process and reads its state
+   @return false on timeout, a malformed stream or a sender that didn't commit, out holds no sessions then
+*/
+bool Receive(const char *socket_path, unsigned timeout_s, State &out, std::string &error) noexcept;
+} // namespace upgrade
+
+#endif
@@ -0,0 +1,330 @@
+#include "recurring_scheduler.h"
+#include "load_shedder.h"
+#include "utils.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <dpp/cache.h>
+#include <dpp/channel.h>
+#include <dpp/message.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <fmt/format.h>
+#include <functional>
+#include <iterator>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr const char ScheduleMagic[8] = {'P', 'M', 'S', 'C', 1, 0, 0, 0}; // magic + version
+constexpr uint32_t TickSeconds = 10;
+constexpr uint32_t LoadBatchSize = 1u << 16; // slots read per tick while loading
+constexpr uint32_t MinInDay = 24 * 60;
+
+static inline uint32_t NowMinute() noexcept
+{
+  using namespace std::chrono;
+  return duration_cast<minutes>(system_clock::now().time_since_epoch()).count();
+}
+
+static inline off_t SlotOffset(uint32_t slot) noexcept
+{
+  return sizeof(ScheduleMagic) + static_cast<off_t>(slot) * sizeof(RecurringScheduler::Schedule);
+}
+
+// Constructors
+
+RecurringScheduler::RecurringScheduler(dpp::cluster &bot, const char *path) noexcept : Bot(bot)
+{
+  std::error_code ec;
+  auto parent = std::filesystem::path(path).parent_path();
+  if (!parent.empty())
+    std::filesystem::create_directories(parent, ec);
+
+  _fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  struct stat st;
+  if (_fd == -1 || fstat(_fd, &st) == -1)
+  {
+    Bot.log(DL::ll_warning, fmt::format("Schedule store '{}' unavailable, /pomodoro schedule is off", path));
+    return;
+  }
+
+  if (st.st_size == 0)
+  {
+    if (pwrite(_fd, ScheduleMagic, sizeof(ScheduleMagic), 0) != sizeof(ScheduleMagic))
+      Bot.log(DL::ll_error, "Couldn't write schedule store header");
+  }
+  else
+  {
+    char magic[sizeof(ScheduleMagic)];
+    if (pread(_fd, magic, sizeof(magic), 0) != sizeof(magic) || std::memcmp(magic, ScheduleMagic, sizeof(magic)))
+    {
+      Bot.log(DL::ll_error, fmt::format("'{}' is not a schedule store, /pomodoro schedule is off", path));
+      close(_fd);
+      _fd = -1;
+      return;
+    }
+    _slot_count = (st.st_size - sizeof(ScheduleMagic)) / sizeof(Schedule);
+  }
+
+  Bot.log(DL::ll_info, fmt::format("Recurring scheduler init, {} stored schedules", _slot_count));
+}
+
+RecurringScheduler::~RecurringScheduler()
+{
+  if (_timer)
+    Bot.stop_timer(_timer);
+  if (_fd != -1)
+    close(_fd);
+}
+
+//-------------
+
+void RecurringScheduler::Start() noexcept
+{
+  if (_fd == -1 || _timer)
+    return;
+  _timer = Bot.start_timer([this](dpp::timer) { Tick(); }, TickSeconds);
+}
+
+int64_t RecurringScheduler::Add(Schedule const &schedule) noexcept
+{
+  if (_fd == -1 || !schedule.Days)
+    return -1;
+
+  std::lock_guard lock(_mtx);
+  // Processes of other clusters append to the same file, the next slot is the end of the file under its lock
+  if (flock(_fd, LOCK_EX) == -1)
+    return -1;
+  struct stat st;
+  uint32_t slot = fstat(_fd, &st) == -1 ? _slot_count
+                                        : std::max<uint32_t>(
+                                              _slot_count,
+                                              (st.st_size - sizeof(ScheduleMagic) + sizeof(Schedule) - 1) /
+                                                  sizeof(Schedule)); // past a torn record too
+  bool written = WriteSlot(slot, schedule);
+  flock(_fd, LOCK_UN);
+  if (!written)
+    return -1;
+  // Slots other processes added in between are loaded by LoadBatch, their schedules fire where their guild is
+  _slot_count = slot + 1;
+
+  // Not loaded yet slots are picked up by LoadBatch, don't push them twice
+  if (_loaded == slot)
+  {
+    _loaded++;
+    Push({NextFire(schedule, NowMinute()), slot});
+  }
+  return slot;
+}
+
+bool RecurringScheduler::Remove(uint32_t id, snflake owner_id, snflake guild_id) noexcept
+{
+  std::lock_guard lock(_mtx);
+  Schedule s;
+  if (id >= _slot_count || !ReadSlot(id, s) || !s.Days)
+    return 0;
+  if (s.OwnerId != owner_id || s.GuildId != guild_id)
+    return 0;
+
+  // The heap entry stays and is dropped when it fires, slots are never reused so it can't hit another schedule
+  s.Days = 0;
+  return WriteSlot(id, s);
+}
+
+// Helpers
+
+uint32_t RecurringScheduler::NextFire(Schedule const &s, uint32_t after) noexcept
+{
+  uint32_t day = after / MinInDay;
+  for (uint32_t d = 0; d <= 7; ++d)
+  {
+    uint32_t candidate = (day + d) * MinInDay + s.MinuteOfDay;
+    uint32_t weekday = (day + d + 3) % 7; // 1970-01-01 was a Thursday, Monday == 0
+    if (candidate > after && (s.Days & (1u << weekday)))
+      return candidate;
+  }
+  return UINT32_MAX; // Days == 0, never fires
+}
+
+bool RecurringScheduler::ReadSlot(uint32_t slot, Schedule &out) const noexcept
+{
+  return pread(_fd, &out, sizeof(Schedule), SlotOffset(slot)) == sizeof(Schedule);
+}
+
+bool RecurringScheduler::WriteSlot(uint32_t slot, Schedule const &s) noexcept
+{
+  return pwrite(_fd, &s, sizeof(Schedule), SlotOffset(slot)) == sizeof(Schedule);
+}
+
+void RecurringScheduler::Push(Entry e) noexcept
+{
+  _heap.push_back(e);
+  std::push_heap(_heap.begin(), _heap.end(), std::greater<Entry>{});
+}
+
+void RecurringScheduler::LoadBatch(uint32_t now_minute) noexcept
+{
+  uint32_t count = std::min(LoadBatchSize, _slot_count - _loaded);
+  std::vector<Schedule> batch(count);
+  ssize_t bytes = pread(_fd, batch.data(), count * sizeof(Schedule), SlotOffset(_loaded));
+  if (bytes < 0)
+  {
+    Bot.log(DL::ll_error, "Couldn't read schedule store");
+    return;
+  }
+  count = bytes / sizeof(Schedule);
+
+  _heap.reserve(_heap.size() + count);
+  for (uint32_t i = 0; i < count; ++i)
+    if (batch[i].Days) // now_minute - 1 so schedules due this minute still fire
+      _heap.push_back({NextFire(batch[i], now_minute - 1), _loaded + i});
+  std::make_heap(_heap.begin(), _heap.end(), std::greater<Entry>{});
+
+  _loaded += count;
+  if (_loaded == _slot_count)
+    Bot.log(DL::ll_info, fmt::format("Recurring scheduler loaded, {} active schedules", _heap.size()));
+}
+
+void RecurringScheduler::Tick() noexcept
+{
+  uint32_t now = NowMinute();
+  std::vector<std::pair<uint32_t, Schedule>> due;
+  {
+    std::lock_guard lock(_mtx);
+    if (_loaded < _slot_count)
+      LoadBatch(now);
+
+    while (!_heap.empty() && _heap.front().FireMinute <= now)
+    {
+      std::pop_heap(_heap.begin(), _heap.end(), std::greater<Entry>{});
+      Entry e = _heap.back();
+      _heap.pop_back();
+
+      Schedule s;
+      if (!ReadSlot(e.Slot, s) || !s.Days) // Removed
+        continue;
+      due.emplace_back(e.Slot, s);
+      Push({NextFire(s, now), e.Slot});
+    }
+  }
+
+  for (auto const &[slot, s] : due)
+    Fire(slot, s);
+}
+
+void RecurringScheduler::Attach(SessionManager &manager) noexcept
+{
+  if (_managers.size() <= manager.Tenant)
+    _managers.resize(manager.Tenant + 1, nullptr);
+  _managers[manager.Tenant] = &manager;
+}
+
+void RecurringScheduler::Fire(uint32_t slot, Schedule const &s) noexcept
+{
+  SessionManager *manager = s.Tenant < _managers.size() ? _managers[s.Tenant] : nullptr;
+  if (!manager)
+  {
+    Bot.log(DL::ll_warning, fmt::format("Schedule #{}: tenant {} isn't running, skipping", slot, s.Tenant));
+    return;
+  }
+  if (shed::Active(shed::Level::RejectSessions))
+  {
+    Bot.log(DL::ll_warning, fmt::format("Schedule #{}: skipped, the bot is overloaded", slot));
+    return;
+  }
+  std::lock_guard lock(manager->Mtx);
+  dpp::channel *channel = dpp::find_channel(s.ChannelId);
+  if (!channel)
+  {
+    Bot.log(DL::ll_warning, fmt::format("Schedule #{}: channel {} not found, skipping", slot, s.ChannelId));
+    return;
+  }
+
+  auto members = channel->get_voice_members();
+  if (members.empty())
+  {
+    Bot.log(DL::ll_debug, fmt::format("Schedule #{}: nobody is in the channel, skipping", slot));
+    return;
+  }
+
+  // The owner may not be around, the first member present owns the session then
+  snflake owner = members.contains(s.OwnerId) ? snflake(s.OwnerId) : members.begin()->first;
+  if (manager->GetSessionByOwnerId(owner) || manager->GetSessionByUserId(owner))
+  {
+    Bot.log(DL::ll_debug, fmt::format("Schedule #{}: <@{}> is already in a session, skipping", slot, owner));
+    return;
+  }
+
+  manager->StartSession(
+      owner,
+      channel,
+      s.WorkPeriod,
+      s.BreakPeriod,
+      s.Repeat,
+      s.Flags,
+      s.Locale < (uint8_t)loc::Locale::Count ? loc::Locale(s.Locale) : loc::Locale::En,
+      [manager, slot](SessionManager::Session const &session)
+      {
+        std::string msg;
+        loc::ScheduledStarting(session.Locale, std::back_inserter(msg), slot, session.OwnerId);
+        manager->Bot.message_create(dpp::message(session.ChannelId, msg));
+      },
+      s.CueSet);
+}
+
+// Parsing
+
+int RecurringScheduler::ParseTime(std::string_view text) noexcept
+{
+  auto parse = [](std::string_view part, unsigned &out) noexcept
+  {
+    auto [end, ec] = std::from_chars(part.data(), part.data() + part.size(), out);
+    return ec == std::errc() && end == part.data() + part.size();
+  };
+
+  size_t colon = text.find(':');
+  if (colon == std::string_view::npos)
+    return -1;
+  std::string_view hours = text.substr(0, colon), minutes = text.substr(colon + 1);
+  if (hours.empty() || hours.size() > 2 || minutes.size() != 2)
+    return -1;
+
+  unsigned h, m;
+  if (!parse(hours, h) || !parse(minutes, m) || h > 23 || m > 59)
+    return -1;
+  return h * 60 + m;
+}
+
+uint8_t RecurringScheduler::ParseDays(std::string_view text) noexcept
+{
+  constexpr std::string_view names[7] = {"mon", "tue", "wed", "thu", "fri", "sat", "sun"};
+  if (text == "daily")
+    return Daily;
+  if (text == "weekdays")
+    return Weekdays;
+  if (text == "weekends")
+    return Weekends;
+
+  uint8_t mask = 0;
+  while (!text.empty())
+  {
+    size_t comma = text.find(',');
+    std::string_view token = text.substr(0, comma);
+    while (!token.empty() && token.front() == ' ')
+      token.remove_prefix(1);
+    while (!token.empty() && token.back() == ' ')
+      token.remove_suffix(1);
+
+    auto it = std::find(std::begin(names), std::end(names), token.substr(0, 3));
+    if (token.size() < 3 || it == std::end(names))
+      return 0;
+    mask |= 1u << (it - std::begin(names));
+
+    if (comma == std::string_view::npos)
+      break;
+    text.remove_prefix(comma + 1);
+  }
+  return mask;
+}
@@ -0,0 +1,129 @@
+#ifndef RECURRING_SCHEDULER_H
+#define RECURRING_SCHEDULER_H
+#include "session_manager.h"
+#include <cstdint>
+#include <dpp/cluster.h>
+#include <dpp/snowflake.h>
+#include <dpp/timer.h>
+#include <mutex>
+#include <vector>
+
+/*
+   Recurring sessions ("weekdays at 09:00 in #study"), persisted as fixed size records.
+   Only a compact min-heap of (fire minute, slot) lives in memory, the records themselves are read
+   from the file when they fire; one shared timer drives all of them, for every tenant.
+   The processes of a sharded deployment share the file, a schedule fires in the process that has its channel.
+*/
+class RecurringScheduler
+{
+  using snflake = dpp::snowflake;
+
+public:
+  enum Day : uint8_t
+  {
+    Monday = 1u << 0,
+    Tuesday = 1u << 1,
+    Wednesday = 1u << 2,
+    Thursday = 1u << 3,
+    Friday = 1u << 4,
+    Saturday = 1u << 5,
+    Sunday = 1u << 6,
+    Weekdays = Monday | Tuesday | Wednesday | Thursday | Friday,
+    Weekends = Saturday | Sunday,
+    Daily = Weekdays | Weekends
+  };
+
+  // On-disk record, slot index is the schedule id
+  struct Schedule
+  {
+    uint64_t OwnerId;
+    uint64_t GuildId;
+    uint64_t ChannelId;
+    uint16_t MinuteOfDay; // UTC
+    uint16_t WorkPeriod;  // in minutes
+    uint16_t BreakPeriod; // in minutes
+    uint16_t Repeat;
+    uint8_t Days; // Day mask, 0 means the schedule was removed
+    flag_t Flags;
+    uint8_t Locale; // loc::Locale, records written before it existed hold 0 which is English
+    uint8_t Tenant; // SessionManager::Tenant, 0 in records written before multi-tenant mode
+    uint8_t CueSet; // CueComposer set, 0 in records written before profiles
+    uint8_t Reserved[3];
+  };
+  static_assert(sizeof(Schedule) == 40, "Schedule layout is part of the file format");
+
+  /*
+     @param bot cluster used for logging and the tick timer, sessions start on the cluster of their tenant
+  */
+  RecurringScheduler(dpp::cluster &bot, const char *path) noexcept;
+  ~RecurringScheduler();
+  RecurringScheduler(RecurringScheduler const &) = delete;
+  RecurringScheduler &operator=(RecurringScheduler const &) = delete;
+
+  /*
+     @brief Starts the shared tick timer, schedules stored on disk are loaded in batches by the tick
+     so startup doesn't wait on the whole file.
+  */
+  void Start() noexcept;
+
+  /*
+     @brief Lets schedules of manager's tenant fire, managers are attached in tenant order before Start
+  */
+  void Attach(SessionManager &manager) noexcept;
+
+  /*
+     @brief Persists a new schedule and queues its next run, its slot is taken at the end of the file under an flock
+     so processes sharing the file never write the same slot
+     @return the schedule id, or -1 if it couldn't be stored
+  */
+  int64_t Add(Schedule const &schedule) noexcept;
+
+  /*
+     @brief Removes a schedule owned by owner_id in guild_id
+     @return true if the schedule existed and belonged to the owner
+  */
+  bool Remove(uint32_t id, snflake owner_id, snflake guild_id) noexcept;
+
+  /*
+     @brief Parses "HH:MM" into minutes since midnight
+     @return minute of day or -1 if not valid
+  */
+  static int ParseTime(std::string_view text) noexcept;
+
+  /*
+     @brief Parses "daily", "weekdays", "weekends" or a comma separated list like "mon,wed,fri"
+     @return Day mask, 0 if not valid
+  */
+  static uint8_t ParseDays(std::string_view text) noexcept;
+
+  dpp::cluster &Bot;
+
+private:
+  struct Entry
+  {
+    uint32_t FireMinute; // minutes since unix epoch
+    uint32_t Slot;
+    bool operator>(Entry const &other) const noexcept
+    {
+      return FireMinute > other.FireMinute;
+    }
+  };
+
+  static uint32_t NextFire(Schedule const &s, uint32_t now_minute) noexcept;
+  bool ReadSlot(uint32_t slot, Schedule &out) const noexcept;
+  bool WriteSlot(uint32_t slot, Schedule const &s) noexcept;
+  void LoadBatch(uint32_t now_minute) noexcept;
+  void Tick() noexcept;
+  void Fire(uint32_t slot, Schedule const &s) noexcept;
+  void Push(Entry e) noexcept;
+
+  std::mutex _mtx;
+  std::vector<Entry> _heap; // min-heap on FireMinute
+  std::vector<SessionManager *> _managers; // indexed by tenant
+  int _fd = -1;
+  uint32_t _slot_count = 0;
+  uint32_t _loaded = 0; // slots below this have been pushed into the heap
+  dpp::timer _timer = 0;
+};
+
+#endif
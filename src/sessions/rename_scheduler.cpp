@@ -0,0 +1,185 @@
+#include "rename_scheduler.h"
+#include "load_shedder.h"
+#include "utils.h"
+#include <dpp/cache.h>
+#include <dpp/channel.h>
+#include <fmt/format.h>
+
+constexpr auto RenameWindow = std::chrono::minutes(10); // 2 renames per channel in this window
+constexpr uint32_t TickSeconds = 5;
+constexpr size_t MaxChannelName = 100;
+constexpr uint16_t RateLimited = 429;
+constexpr auto FirstRetry = std::chrono::seconds(30); // doubles with every failure, up to RenameWindow
+constexpr uint8_t MaxFailures = 8;                    // about 45 minutes of retries, then the channel is dropped
+
+RenameScheduler::RenameScheduler(dpp::cluster &bot) noexcept : Bot(bot)
+{
+}
+
+RenameScheduler::~RenameScheduler()
+{
+  if (_timer)
+    Bot.stop_timer(_timer);
+}
+
+RenameScheduler::clock::time_point RenameScheduler::NextSlot(Channel const &c) const noexcept
+{
+  auto oldest = std::min(c.Sent[0], c.Sent[1]);
+  return oldest == clock::time_point{} ? clock::time_point{} : oldest + RenameWindow;
+}
+
+void RenameScheduler::Label(
+    snflake channel_id, std::string_view original_name, std::string_view label, clock::time_point deadline) noexcept
+{
+  std::lock_guard lock(_mtx);
+  auto [it, inserted] = _channels.try_emplace(channel_id);
+  auto &c = it->second;
+  if (inserted)
+    c.Original = c.Current = original_name;
+  if (c.Restoring) // Session ended, another one is labeling the channel again
+    c.Restoring = 0;
+  if (c.GaveUp)
+    return;
+
+  c.Wanted = fmt::format("{} - {}", label, c.Original);
+  if (c.Wanted.size() > MaxChannelName)
+    c.Wanted.resize(MaxChannelName);
+  c.Deadline = deadline;
+  Process(channel_id, c, clock::now());
+
+  if (!_timer)
+    _timer = Bot.start_timer([this](dpp::timer) { Tick(); }, TickSeconds);
+}
+
+void RenameScheduler::Restore(snflake channel_id) noexcept
+{
+  std::lock_guard lock(_mtx);
+  auto it = _channels.find(channel_id);
+  if (it == _channels.end())
+    return;
+
+  auto &c = it->second;
+  c.Wanted = c.Original;
+  c.Deadline = clock::time_point::max();
+  c.Restoring = 1;
+  Process(channel_id, c, clock::now());
+}
+
+void RenameScheduler::Restore(snflake channel_id, std::string_view original_name) noexcept
+{
+  std::lock_guard lock(_mtx);
+  auto [it, inserted] = _channels.try_emplace(channel_id);
+  auto &c = it->second;
+  if (inserted) // What the channel shows is unknown, Current stays empty so the original name is sent
+    c.Original = original_name;
+  c.Wanted = c.Original;
+  c.Deadline = clock::time_point::max();
+  c.Restoring = 1;
+  Process(channel_id, c, clock::now());
+
+  if (!_timer)
+    _timer = Bot.start_timer([this](dpp::timer) { Tick(); }, TickSeconds);
+}
+
+void RenameScheduler::Forget(snflake channel_id) noexcept
+{
+  std::lock_guard lock(_mtx);
+  _channels.erase(channel_id);
+}
+
+// Decides what to do with a channel: nothing, send now, wait for a slot or drop the wanted name
+void RenameScheduler::Process(snflake channel_id, Channel &c, clock::time_point now) noexcept
+{
+  if (c.InFlight)
+    return; // Looked at again when the answer comes
+
+  if (c.Wanted == c.Current)
+  {
+    if (c.Restoring)
+      _channels.erase(channel_id);
+    return;
+  }
+
+  auto slot = std::max(NextSlot(c), c.RetryAt);
+  if (slot > c.Deadline) // Can't be shown before the phase ends, skip it
+  {
+    c.Wanted = c.Current;
+    return;
+  }
+  if (slot <= now)
+    Send(channel_id, c, now);
+}
+
+void RenameScheduler::Send(snflake channel_id, Channel &c, clock::time_point now) noexcept
+{
+  dpp::channel *channel = dpp::find_channel(channel_id);
+  if (!channel)
+  {
+    _channels.erase(channel_id);
+    return;
+  }
+
+  (c.Sent[0] < c.Sent[1] ? c.Sent[0] : c.Sent[1]) = now;
+  c.InFlight = 1;
+
+  dpp::channel edited = *channel;
+  edited.set_name(c.Wanted);
+  Bot.channel_edit(
+      edited,
+      shed::Tracked(
+          [this, channel_id, name = c.Wanted](dpp::confirmation_callback_t const &cb)
+          {
+            std::lock_guard lock(_mtx);
+            auto it = _channels.find(channel_id);
+            if (it == _channels.end())
+              return;
+
+            auto &c = it->second;
+            c.InFlight = 0;
+            if (!cb.is_error())
+            {
+              c.Current = name;
+              c.Failures = 0;
+            }
+            else if (cb.http_info.status == RateLimited) // Renamed by someone else, assume the window is used up
+              c.Sent[0] = c.Sent[1] = clock::now();
+            else
+            {
+              Failed(channel_id, c, cb);
+              if (c.Failures > MaxFailures)
+              {
+                Bot.log(DL::ll_error, fmt::format("Gave up restoring the name of channel {}", channel_id));
+                _channels.erase(it);
+                return;
+              }
+            }
+            Process(channel_id, c, clock::now());
+          }));
+}
+
+// Most likely missing permissions: stop labeling the channel, but its name must come back when the permission does
+void RenameScheduler::Failed(snflake channel_id, Channel &c, dpp::confirmation_callback_t const &cb) noexcept
+{
+  if (!c.GaveUp)
+    Bot.log(DL::ll_warning, fmt::format("Couldn't rename channel {}: {}", channel_id, cb.get_error().message));
+  c.GaveUp = 1;
+  c.Wanted = c.Original;
+  c.Deadline = clock::time_point::max();
+  // Without an answer the rename may have gone through, then only sending the original name brings it back
+  if (cb.http_info.status == 0)
+    c.Current.clear();
+  c.Failures++;
+  c.RetryAt = clock::now() + std::min<clock::duration>(FirstRetry * (1u << (c.Failures - 1)), RenameWindow);
+}
+
+void RenameScheduler::Tick() noexcept
+{
+  auto now = clock::now();
+  std::lock_guard lock(_mtx);
+  for (auto it = _channels.begin(); it != _channels.end();)
+  {
+    auto next = std::next(it); // Process may erase it
+    Process(it->first, it->second, now);
+    it = next;
+  }
+}
@@ -0,0 +1,89 @@
+#ifndef RENAME_SCHEDULER_H
+#define RENAME_SCHEDULER_H
+#include "clock.h"
+#include <chrono>
+#include <dpp/cluster.h>
+#include <dpp/snowflake.h>
+#include <dpp/timer.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*
+   Renames voice channels ("Work - Study room") within Discord's limit of 2 renames per channel every 10 minutes.
+   Only the latest wanted name of a channel is kept, a rename that can't go out before the deadline given with it is
+   dropped, and restoring the original name always goes out eventually. After a failed rename the channel gets no more
+   labels, and its original name is retried with backoff until it's back.
+*/
+class RenameScheduler
+{
+  using snflake = dpp::snowflake;
+  using clock = utl::Clock;
+
+public:
+  explicit RenameScheduler(dpp::cluster &bot) noexcept;
+  ~RenameScheduler();
+  RenameScheduler(RenameScheduler const &) = delete;
+  RenameScheduler &operator=(RenameScheduler const &) = delete;
+
+  /*
+     @brief Wants channel_id renamed to "<label> - <original_name>"
+     @param original_name name to restore later, only the first call for a channel keeps it
+     @param deadline the rename is dropped if the budget doesn't allow it before this point (next phase boundary)
+  */
+  void Label(snflake channel_id, std::string_view original_name, std::string_view label, clock::time_point deadline) noexcept;
+
+  /*
+     @brief Wants the original name back, replaces any pending label and has no deadline
+  */
+  void Restore(snflake channel_id) noexcept;
+
+  /*
+     @brief Wants original_name back on a channel labeled by another process, it's sent even if this process never
+     renamed the channel
+  */
+  void Restore(snflake channel_id, std::string_view original_name) noexcept;
+
+  /*
+     @brief Drops the channel without restoring it, for channels that no longer exist
+  */
+  void Forget(snflake channel_id) noexcept;
+
+  /*
+     @brief Channels with a label or a restore that isn't done yet
+  */
+  size_t Pending() noexcept
+  {
+    std::lock_guard lock(_mtx);
+    return _channels.size();
+  }
+
+  dpp::cluster &Bot;
+
+private:
+  struct Channel
+  {
+    std::string Original;
+    std::string Current; // as far as we know, what Discord shows
+    std::string Wanted;
+    clock::time_point Deadline = clock::time_point::max();
+    clock::time_point Sent[2]{}; // last two renames, the oldest one frees the next slot
+    clock::time_point RetryAt{};  // after a failed rename, nothing is sent before it
+    uint8_t Failures = 0;         // failed renames in a row
+    bool InFlight = 0;
+    bool Restoring = 0;
+    bool GaveUp = 0; // a rename failed, labels are ignored and only the original name is wanted
+  };
+
+  clock::time_point NextSlot(Channel const &c) const noexcept;
+  void Process(snflake channel_id, Channel &c, clock::time_point now) noexcept;
+  void Send(snflake channel_id, Channel &c, clock::time_point now) noexcept;
+  void Failed(snflake channel_id, Channel &c, dpp::confirmation_callback_t const &cb) noexcept;
+  void Tick() noexcept;
+
+  std::mutex _mtx;
+  std::unordered_map<snflake, Channel> _channels;
+  dpp::timer _timer = 0;
+};
+
+#endif
@@ -0,0 +1,268 @@
+#include "session_handoff.h"
+#include "clock.h"
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <fmt/format.h>
+#include <signal.h>
+#include <unistd.h>
+
+namespace handoff
+{
+constexpr char Magic[4] = {'P', 'M', 'H', 'O'};
+constexpr uint8_t Version = 3; // 2 added the cue set, 3 the release time
+constexpr std::string_view Suffix = ".session";
+constexpr std::string_view ClaimedSuffix = ".claimed"; // <name>.session.<pid>.claimed
+
+// Encoding, little endian integers and u16 length prefixed strings
+
+static void PutInt(std::string &out, uint64_t v, size_t bytes)
+{
+  for (size_t i = 0; i < bytes; ++i)
+    out.push_back(static_cast<char>(v >> (8 * i)));
+}
+
+static void PutStr(std::string &out, std::string const &s)
+{
+  size_t len = std::min<size_t>(s.size(), UINT16_MAX);
+  PutInt(out, len, 2);
+  out.append(s, 0, len);
+}
+
+struct Cursor
+{
+  std::string_view Rest;
+
+  template <class T> bool Int(T &v, size_t bytes = sizeof(T)) noexcept
+  {
+    if (Rest.size() < bytes)
+      return 0;
+    uint64_t r = 0;
+    for (size_t i = 0; i < bytes; ++i)
+      r |= uint64_t(static_cast<uint8_t>(Rest[i])) << (8 * i);
+    v = static_cast<T>(r);
+    Rest.remove_prefix(bytes);
+    return 1;
+  }
+
+  bool Str(std::string &s) noexcept
+  {
+    uint16_t len;
+    if (!Int(len) || Rest.size() < len)
+      return 0;
+    s.assign(Rest.data(), len);
+    Rest.remove_prefix(len);
+    return 1;
+  }
+};
+
+void Encode(Snapshot const &s, std::string &out)
+{
+  out.append(Magic, sizeof(Magic));
+  PutInt(out, Version, 1);
+  PutInt(out, s.Tenant, 1);
+  PutInt(out, s.OwnerId, 8);
+  PutInt(out, s.ChannelId, 8);
+  PutInt(out, s.GuildId, 8);
+  PutInt(out, s.StatusMessageId, 8);
+  PutInt(out, s.WorkPeriod, 4);
+  PutInt(out, s.BreakPeriod, 4);
+  PutInt(out, s.Repeat, 4);
+  PutInt(out, s.CurrentSessionNumber, 4);
+  PutInt(out, s.PhaseEndMs, 8);
+  PutInt(out, s.ReleasedAtMs, 8);
+  PutInt(out, s.PausedRemaining, 8);
+  PutInt(out, s.Flags, 1);
+  PutInt(out, s.Locale, 1);
+  PutInt(out, s.CueSet, 1);
+  PutStr(out, s.VoiceChannelName);
+  PutInt(out, s.Members.size(), 4);
+  for (uint64_t id : s.Members)
+    PutInt(out, id, 8);
+  PutInt(out, s.Rooms.size(), 1);
+  for (auto const &[id, name] : s.Rooms)
+  {
+    PutInt(out, id, 8);
+    PutStr(out, name);
+  }
+}
+
+bool Decode(std::string_view data, Snapshot &out)
+{
+  // Version 2 is still read, snapshots written by the previous build during an upgrade must not be lost
+  if (data.size() < sizeof(Magic) + 1 || std::memcmp(data.data(), Magic, sizeof(Magic)))
+    return 0;
+  uint8_t version = data[sizeof(Magic)];
+  if (version < 2 || version > Version)
+    return 0;
+  out.ReleasedAtMs = 0;
+  Cursor c{data.substr(sizeof(Magic) + 1)};
+  uint32_t members;
+  uint8_t rooms;
+  if (!c.Int(out.Tenant) || !c.Int(out.OwnerId) || !c.Int(out.ChannelId) || !c.Int(out.GuildId) ||
+      !c.Int(out.StatusMessageId) || !c.Int(out.WorkPeriod) || !c.Int(out.BreakPeriod) || !c.Int(out.Repeat) ||
+      !c.Int(out.CurrentSessionNumber) || !c.Int(out.PhaseEndMs) || (version >= 3 && !c.Int(out.ReleasedAtMs)) ||
+      !c.Int(out.PausedRemaining) ||
+      !c.Int(out.Flags) || !c.Int(out.Locale) || !c.Int(out.CueSet) || !c.Str(out.VoiceChannelName) ||
+      !c.Int(members) || members > c.Rest.size() / 8)
+    return 0;
+  out.Members.resize(members);
+  for (auto &id : out.Members)
+    c.Int(id);
+  if (!c.Int(rooms))
+    return 0;
+  out.Rooms.resize(rooms);
+  for (auto &[id, name] : out.Rooms)
+    if (!c.Int(id) || !c.Str(name))
+      return 0;
+  return c.Rest.empty();
+}
+
+bool ShardMap::Parse(const char *cluster, const char *shards, ShardMap &out) noexcept
+{
+  auto number = [](std::string_view text, uint32_t &v)
+  {
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), v);
+    return ec == std::errc() && end == text.data() + text.size();
+  };
+
+  out = {};
+  if (shards && *shards && !number(shards, out.Shards))
+    return 0;
+  if (cluster && *cluster)
+  {
+    std::string_view text(cluster);
+    size_t slash = text.find('/');
+    if (slash == text.npos || !number(text.substr(0, slash), out.ClusterId) ||
+        !number(text.substr(slash + 1), out.MaxClusters) || !out.MaxClusters || out.ClusterId >= out.MaxClusters)
+      return 0;
+  }
+  return out.MaxClusters == 1 || out.Shards >= out.MaxClusters;
+}
+
+Directory::Directory(std::string path) noexcept : _path(std::move(path))
+{
+  std::error_code ec;
+  std::filesystem::create_directories(_path, ec);
+}
+
+std::string Directory::Name(uint64_t guild_id, uint8_t tenant, uint64_t owner_id) const
+{
+  // Named after the guild so claimers can skip foreign snapshots without reading them
+  return fmt::format("{}/{}-{}-{}{}", _path, guild_id, tenant, owner_id, Suffix);
+}
+
+bool Directory::Put(Snapshot const &s) noexcept
+{
+  std::string data;
+  Encode(s, data);
+  std::string name = Name(s.GuildId, s.Tenant, s.OwnerId);
+  std::string tmp = fmt::format("{}.{}.tmp", name, getpid());
+
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1)
+    return 0;
+  bool ok = write(fd, data.data(), data.size()) == ssize_t(data.size()) && fsync(fd) == 0;
+  close(fd);
+  if (ok && rename(tmp.c_str(), name.c_str()) == 0)
+    return 1;
+  unlink(tmp.c_str());
+  return 0;
+}
+
+// A pid that no longer exists, the process that claimed a snapshot or wrote a temporary file died
+static bool Dead(pid_t pid) noexcept
+{
+  return pid > 0 && kill(pid, 0) == -1 && errno == ESRCH;
+}
+
+size_t Directory::Claim(ShardMap const &shards, uint8_t tenant, std::vector<Snapshot> &out) noexcept
+{
+  DIR *dir = opendir(_path.c_str());
+  if (!dir)
+    return 0;
+
+  size_t claimed = 0;
+  int64_t now_ms = utl::WallMs();
+  pid_t self = getpid();
+  while (dirent *e = readdir(dir))
+  {
+    std::string_view name(e->d_name);
+    size_t suffix = name.find(Suffix);
+    if (suffix == name.npos)
+      continue;
+    std::string_view base = name.substr(0, suffix + Suffix.size());
+    if (name != base) // "<base>.<pid>.claimed" or "<base>.<pid>.tmp"
+    {
+      int pid = 0;
+      std::string_view rest = name.substr(base.size() + 1);
+      auto [end, ec] = std::from_chars(rest.data(), rest.data() + rest.size(), pid);
+      if (ec != std::errc() || !Dead(pid))
+        continue;
+      std::string path = fmt::format("{}/{}", _path, name);
+      if (std::string_view(end) != ClaimedSuffix)
+      {
+        unlink(path.c_str()); // half written by a writer that died, the snapshot never made it
+        continue;
+      }
+      // Claimed by a process that died before adopting it, hand it back under its own name
+      if (rename(path.c_str(), fmt::format("{}/{}", _path, base).c_str()) != 0)
+        continue;
+    }
+
+    uint64_t guild;
+    unsigned file_tenant;
+    std::string base_str(base);
+    if (std::sscanf(base_str.c_str(), "%" SCNu64 "-%u-", &guild, &file_tenant) != 2 || file_tenant != tenant)
+      continue;
+    std::string path = fmt::format("{}/{}", _path, base);
+    std::error_code ec;
+    auto mtime = std::filesystem::last_write_time(path, ec);
+    if (ec)
+      continue;
+    int64_t written_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                             std::chrono::file_clock::to_sys(mtime).time_since_epoch())
+                             .count();
+    // Another process's guild, unless that process didn't show up in time
+    if (!shards.Owns(guild) && now_ms - written_ms <= MaxAgeMs)
+      continue;
+
+    // rename is atomic, if two processes race for a file only one of them gets it
+    std::string taken = fmt::format("{}.{}{}", path, self, ClaimedSuffix);
+    if (rename(path.c_str(), taken.c_str()) != 0)
+      continue;
+
+    std::string data;
+    if (FILE *f = std::fopen(taken.c_str(), "rb"))
+    {
+      char buf[4096];
+      for (size_t n; (n = std::fread(buf, 1, sizeof(buf), f));)
+        data.append(buf, n);
+      std::fclose(f);
+    }
+    Snapshot s;
+    if (!Decode(data, s))
+    {
+      rename(taken.c_str(), fmt::format("{}.bad", path).c_str());
+      continue;
+    }
+    if (!s.ReleasedAtMs) // Version 2, released about when it was written
+      s.ReleasedAtMs = written_ms;
+    out.push_back(std::move(s));
+    claimed++;
+  }
+  closedir(dir);
+  return claimed;
+}
+
+void Directory::Done(Snapshot const &s) noexcept
+{
+  unlink(fmt::format("{}.{}{}", Name(s.GuildId, s.Tenant, s.OwnerId), getpid(), ClaimedSuffix).c_str());
+}
+} // namespace handoff
@@ -0,0 +1,114 @@
+#ifndef SESSION_HANDOFF_H
+#define SESSION_HANDOFF_H
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+   Moving live sessions between bot processes.
+   A process runs the shards of one D++ cluster (POMODORO_CLUSTER=<id>/<count>, POMODORO_SHARDS=<total>) and owns the
+   sessions of the guilds on those shards. A process that stops writes its sessions as snapshots into a directory
+   shared by all processes; the process owning a snapshot's guild claims it and carries the session on with the same
+   phase deadline and status message. A snapshot nobody claimed within MaxAgeMs is too old to carry on: any process of
+   the tenant takes it and ends the session, unmuting its members and restoring its channel names.
+*/
+namespace handoff
+{
+// A session as it crosses processes, periods are in seconds like in SessionManager::Session
+struct Snapshot
+{
+  uint64_t OwnerId = 0;
+  uint64_t ChannelId = 0;
+  uint64_t GuildId = 0;
+  uint64_t StatusMessageId = 0; // 0 if the status message wasn't created yet
+  std::vector<uint64_t> Members;
+  std::vector<std::pair<uint64_t, std::string>> Rooms; // channel id, name to restore
+  std::string VoiceChannelName;
+  uint32_t WorkPeriod = 0;
+  uint32_t BreakPeriod = 0;
+  uint32_t Repeat = 0;
+  uint32_t CurrentSessionNumber = 0;
+  int64_t PhaseEndMs = 0; // unix time, steady clocks don't compare across processes
+  int64_t ReleasedAtMs = 0; // unix time the session stopped running
+  int64_t PausedRemaining = 0;
+  uint8_t Flags = 0;
+  uint8_t Locale = 0;
+  uint8_t CueSet = 0;
+  uint8_t Tenant = 0;
+};
+
+void Encode(Snapshot const &s, std::string &out);
+
+/*
+   @return false if data isn't a complete snapshot of this version
+*/
+bool Decode(std::string_view data, Snapshot &out);
+
+// Members have been muted and channels labeled without a timer for this long, the session is ended instead
+constexpr int64_t MaxAgeMs = 15 * 60 * 1000;
+
+inline bool Stale(Snapshot const &s, int64_t now_ms) noexcept
+{
+  return now_ms - s.ReleasedAtMs > MaxAgeMs;
+}
+
+// Which guilds this process serves, D++ gives shard s to cluster s % MaxClusters
+struct ShardMap
+{
+  uint32_t Shards = 0; // 0 lets D++ pick the count, only valid with a single cluster
+  uint32_t ClusterId = 0;
+  uint32_t MaxClusters = 1;
+
+  bool Owns(uint64_t guild_id) const noexcept
+  {
+    if (MaxClusters <= 1)
+      return 1;
+    return (guild_id >> 22) % Shards % MaxClusters == ClusterId;
+  }
+
+  /*
+     @brief Reads "<id>/<count>" and the total shard count, either may be null for the defaults
+     @return false if they're malformed or several clusters are asked for without a shard count
+  */
+  static bool Parse(const char *cluster, const char *shards, ShardMap &out) noexcept;
+};
+
+class Directory
+{
+public:
+  explicit Directory(std::string path) noexcept;
+
+  /*
+     @brief Writes a snapshot, readers never see it half written
+  */
+  bool Put(Snapshot const &s) noexcept;
+
+  /*
+     @brief Takes the snapshots of tenant whose guild is owned by shards, and the ones of any guild left unclaimed for
+     MaxAgeMs. Each snapshot is claimed by one process only and stays in the directory until Done, a claim whose
+     process died is taken again (the processes sharing the directory run on one host); unreadable ones are renamed
+     *.bad and skipped
+     @return number of snapshots appended to out
+  */
+  size_t Claim(ShardMap const &shards, uint8_t tenant, std::vector<Snapshot> &out) noexcept;
+
+  /*
+     @brief Removes a claimed snapshot once its session was adopted or ended
+  */
+  void Done(Snapshot const &s) noexcept;
+
+  std::string const &Path() const noexcept
+  {
+    return _path;
+  }
+
+private:
+  std::string Name(uint64_t guild_id, uint8_t tenant, uint64_t owner_id) const;
+
+  std::string _path;
+};
+} // namespace handoff
+
+#endif
@@ -1,6 +1,11 @@
 #include "session_manager.h"
+#include "arena.h"
+#include "load_shedder.h"
+#include "trace.h"
 #include "utils.h"
 #include "voice.h"
+#include <algorithm>
+#include <array>
 #include <chrono>
 #include <dpp/cache.h>
 #include <dpp/channel.h>
@@ -13,17 +18,28 @@
 #include <dpp/voicestate.h>
 #include <fmt/format.h>
 #include <functional>
+#include <iterator>
+#include <memory_resource>
 #include <string>
 #include <type_traits>
+#include <unordered_set>
 using SMS = SessionManager::Session;
 constexpr const uint32_t sec_in_min = 2;
+constexpr const unsigned CueLeadMinutes = 5; // "5 minutes left in ..." is played this long before a phase ends
 
 // Constructors
-SessionManager::SessionManager(dpp::cluster &bot) noexcept : Bot(bot)
+SessionManager::SessionManager(dpp::cluster &bot, StatsStore &stats, CueComposer &cues, uint8_t tenant) noexcept
+    : Bot(bot), Stats(stats), Cues(cues), Tenant(tenant), Board(*this), Renames(bot), Notices(bot)
 {
   Bot.log(dpp::loglevel::ll_info, "Session manager init");
 }
 
+SessionManager::~SessionManager()
+{
+  if (_tick_timer)
+    Bot.stop_timer(_tick_timer);
+}
+
 static_assert(sec_in_min >= 1, "sec in min var must be positve");
 static_assert(std::is_integral_v<decltype(sec_in_min)>, "sec in min var must be and intger");
 
@@ -81,80 +97,261 @@ SMS const *SessionManager::GetSessionByUserId(snflake usr_id) const noexcept
   return nullptr;
 }
 
+SMS *SessionManager::GetSessionByHandle(uint32_t handle) noexcept
+{
+  auto it = _by_handle.find(handle);
+  return it == _by_handle.end() ? nullptr : it->second;
+}
+
+SMS const *SessionManager::GetSessionByHandle(uint32_t handle) const noexcept
+{
+  auto it = _by_handle.find(handle);
+  return it == _by_handle.end() ? nullptr : it->second;
+}
+
 //// Session
-long SMS::GetRemainingTime() noexcept
+long SMS::GetRemainingTime() const noexcept
 {
   using namespace std::chrono;
-  auto elapsed = duration_cast<seconds>(steady_clock::now() - PhaseStartTime).count();
+  if (mFlagCmp(Flags, Paused))
+    return PausedRemaining;
+  auto elapsed = duration_cast<seconds>(utl::Clock::now() - PhaseStartTime).count();
   return !mFlagCmp(Flags, Break) ? WorkPeriod - elapsed : BreakPeriod - elapsed;
 }
 
-void SMS::SchedulePhase(SessionManager &manager) noexcept
+// Queues the end of the phase that is running and arms its spoken countdown cue
+void SMS::ArmTimers(SessionManager &manager, unsigned remaining) noexcept
+{
+  auto &Bot = manager.Bot;
+  DueAt = utl::Clock::now() + std::chrono::seconds(remaining);
+  DueTick = manager.QueueTransition(Handle, remaining);
+
+  if (!mFlagCmp(Flags, Voice) || remaining <= CueLeadMinutes * sec_in_min)
+    return;
+
+  // Fragments: <n>.opus, minutes_left_in.opus, work.opus, break.opus, session.opus
+  // Captures are kept to a pointer and the handle so std::function stores them inline. The handle is looked up when
+  // it fires, a session that ended without stopping the timer is never touched
+  CueTimerId = Bot.start_timer(
+      [&manager, handle = Handle](dpp::timer t)
+      {
+        manager.Bot.stop_timer(t);
+        std::lock_guard lock(manager.Mtx);
+        SMS const *s = manager.GetSessionByHandle(handle);
+        if (!s || shed::Active(shed::Level::SkipCues))
+          return;
+        std::vector<std::string_view> tokens;
+        tokens.reserve(8);
+        CueComposer::NumberTokens(CueLeadMinutes, tokens);
+        tokens.insert(tokens.end(), {"minutes_left_in", mFlagCmp(s->Flags, Break) ? "break" : "work", "session"});
+        CueComposer::NumberTokens(s->CurrentSessionNumber - 1, tokens);
+
+        if (auto cue = manager.Cues.Compose(tokens, s->CueSet))
+        {
+          if (s->Rooms.empty())
+            PlayAudio(manager.Bot, s->GuildId, s->ChannelId, std::move(cue));
+          else
+            PlayAudio(manager.Bot, s->GuildId, s->RoomChannels(), std::move(cue));
+        }
+        else
+          manager.Bot.log(DL::ll_debug, "Countdown cue fragments missing, skipping cue");
+      },
+      remaining - CueLeadMinutes * sec_in_min);
+}
+
+bool SMS::Pause(SessionManager &manager) noexcept
+{
+  if (mFlagCmp(Flags, Paused))
+    return 0;
+  PausedRemaining = std::max(0l, GetRemainingTime());
+  manager.Unqueue(*this);
+  manager.Bot.stop_timer(CueTimerId);
+  SessionManager::SetFlag(Flags, Flag::Paused, 1);
+  if (mFlagCmp(Flags, Mute) && !mFlagCmp(Flags, Break))
+    ChangeMembersStatus(manager, 0);
+  return 1;
+}
+
+bool SMS::Resume(SessionManager &manager) noexcept
+{
+  if (!mFlagCmp(Flags, Paused))
+    return 0;
+  SessionManager::SetFlag(Flags, Flag::Paused, 0);
+  unsigned period = mFlagCmp(Flags, Break) ? BreakPeriod : WorkPeriod;
+  PhaseStartTime = utl::Clock::now() - std::chrono::seconds(period - PausedRemaining);
+  if (mFlagCmp(Flags, Mute) && !mFlagCmp(Flags, Break))
+    ChangeMembersStatus(manager, 1);
+  ArmTimers(manager, std::max(1l, PausedRemaining));
+  return 1;
+}
+
+void SMS::SkipPhase(SessionManager &manager) noexcept
 {
+  manager.Unqueue(*this);
+  manager.Bot.stop_timer(CueTimerId);
+  SessionManager::SetFlag(Flags, Flag::Paused, 0);
+  SchedulePhase(manager, 0);
+}
 
-  PhaseStartTime = std::chrono::steady_clock::now();
+void SMS::RunPhase(SessionManager &manager, bool completed, dpp::guild const *guild) noexcept
+{
+  mem::ScopedTag tag(mem::Subsystem::Sessions);
+  TRACE_SCOPE("phase.transition");
+  PhaseStartTime = utl::Clock::now();
   auto &Bot = manager.Bot;
+  if (completed && !mFlagCmp(Flags, Break)) // A work phase just ended
+    manager.Stats.RecordWorkPhase(GuildId, MembersId, WorkPeriod / sec_in_min);
   if (CurrentSessionNumber >= Repeat)
   {
-    Bot.message_create(dpp::message(ChannelId, "Pomodoro session finished!"));
-    ChangeMembersStatus(manager, 0);
-    manager.CancelSession(OwnerId);
+    Announce(manager, loc::Get(Locale, loc::Word::SessionFinished), guild);
+    ChangeMembersStatus(manager, 0, guild);
+    manager.CancelSession(OwnerId, nullptr, 1);
     return;
   }
 
-  auto ScheduleNext = [&](unsigned period)
+  dpp::channel *channel;
   {
-    TimerId = Bot.start_timer(
-        [&](dpp::timer t)
-        {
-          Bot.stop_timer(t);
-          SchedulePhase(manager);
-        },
-        period);
-  };
-
-  dpp::channel *channel = dpp::find_channel(ChannelId);
+    TRACE_SCOPE("phase.find_channel");
+    channel = dpp::find_channel(ChannelId);
+  }
   if (!channel)
     return; // TODO: Handle this
 
-  std::string msg;
-  msg.reserve(1024);
   Flags ^= 1u;
 
-  msg.append(fmt::format(
-      "Session **{} {}** - Started !\n",
-      !mFlagCmp(Flags, Break) ? "Work" : "Break",
-      mFlagCmp(Flags, Break) ? CurrentSessionNumber - 1 : CurrentSessionNumber));
-  for (auto const &id : MembersId)
-    msg.append(fmt::format("<@{}>  ", (long)id));
-  Bot.message_create(dpp::message(ChannelId, msg));
+  std::array<char, 128> header;
+  char *end;
+  {
+    TRACE_SCOPE("phase.format");
+    end = loc::PhaseStarted(
+        Locale,
+        header.data(),
+        mFlagCmp(Flags, Break),
+        mFlagCmp(Flags, Break) ? CurrentSessionNumber - 1 : CurrentSessionNumber);
+  }
+  Announce(manager, std::string_view(header.data(), end), guild);
 
   switch (Flags & 1u)
   {
   case 0: // Starting work session
     if (mFlagCmp(Flags, Mute))
-      ChangeMembersStatus(manager, 1);
+      ChangeMembersStatus(manager, 1, guild);
     if (CurrentSessionNumber > 1 && mFlagCmp(Flags, Voice))
-      PlayAudio(Bot, GuildId, ChannelId, BreakToWorkAudio.path, BreakToWorkAudio.duration);
-    ScheduleNext(WorkPeriod);
+    {
+      if (Rooms.empty())
+        PlayAudio(Bot, GuildId, ChannelId, BreakToWorkAudio.path, BreakToWorkAudio.duration);
+      else
+        PlayAudio(Bot, GuildId, RoomChannels(), BreakToWorkAudio.path, BreakToWorkAudio.duration);
+    }
     CurrentSessionNumber++;
-    // channel->set_name(fmt::format("{} - {}", "Work", VoiceChannelName));
+    ArmTimers(manager, WorkPeriod);
+    manager.Renames.Label(ChannelId, VoiceChannelName, "Work", PhaseStartTime + std::chrono::seconds(WorkPeriod));
+    for (auto const &room : Rooms)
+      manager.Renames.Label(room.ChannelId, room.Name, "Work", PhaseStartTime + std::chrono::seconds(WorkPeriod));
     break;
   case 1: // Starting break session
     if (mFlagCmp(Flags, Mute))
-      ChangeMembersStatus(manager, 0);
+      ChangeMembersStatus(manager, 0, guild);
     if (mFlagCmp(Flags, Voice))
-      PlayAudio(Bot, GuildId, ChannelId, WorkToBreakAudio.path, WorkToBreakAudio.duration);
-    ScheduleNext(BreakPeriod);
-    // channel->set_name(fmt::format("{} - {}", "Break", VoiceChannelName));
+    {
+      if (Rooms.empty())
+        PlayAudio(Bot, GuildId, ChannelId, WorkToBreakAudio.path, WorkToBreakAudio.duration);
+      else
+        PlayAudio(Bot, GuildId, RoomChannels(), WorkToBreakAudio.path, WorkToBreakAudio.duration);
+    }
+    ArmTimers(manager, BreakPeriod);
+    manager.Renames.Label(ChannelId, VoiceChannelName, "Break", PhaseStartTime + std::chrono::seconds(BreakPeriod));
+    for (auto const &room : Rooms)
+      manager.Renames.Label(room.ChannelId, room.Name, "Break", PhaseStartTime + std::chrono::seconds(BreakPeriod));
     break;
   }
-  // manager.Bot.channel_edit(*channel);
 }
 
-void SMS::ChangeMembersStatus(SessionManager &manager, bool mute) noexcept
+std::vector<dpp::snowflake> SMS::RoomChannels() const
+{
+  std::vector<snflake> channels;
+  channels.reserve(Rooms.size() + 1);
+  channels.push_back(ChannelId);
+  for (auto const &room : Rooms)
+    channels.push_back(room.ChannelId);
+  return channels;
+}
+
+bool SMS::HasChannel(snflake channel_id) const noexcept
+{
+  if (channel_id == ChannelId)
+    return 1;
+  for (auto const &room : Rooms)
+    if (room.ChannelId == channel_id)
+      return 1;
+  return 0;
+}
+
+// Sends header to every channel of the session mentioning the members in it, members that aren't in any room right
+// now are mentioned in the primary channel
+void SMS::Announce(SessionManager &manager, std::string_view header, dpp::guild const *guild) noexcept
 {
-  dpp::guild const *g = dpp::find_guild(GuildId);
+  // Posts own their text, so it's written straight into the string handed over instead of copied out of the arena
+  constexpr size_t MentionSize = 25; // "<@" 20 digits ">  "
+  auto text = [&](size_t mentions)
+  {
+    std::string msg;
+    msg.reserve(header.size() + mentions * MentionSize);
+    msg.append(header);
+    return msg;
+  };
+
+  // Under load a study hall gets one message in the primary channel like any session
+  if (Rooms.empty() || shed::Active(shed::Level::MergeAnnouncements))
+  {
+    std::string msg = text(MembersId.size());
+    for (auto const &id : MembersId)
+      loc::Mention(std::back_inserter(msg), id);
+    TRACE_SCOPE("phase.announce");
+    manager.Notices.Post(ChannelId, std::move(msg));
+    return;
+  }
+
+  // Room index of every member, 0 is the primary channel
+  mem::EventArena<> arena(mem::Subsystem::Sessions);
+  std::pmr::vector<uint8_t> room_of(MembersId.size(), 0, arena.Resource());
+  std::pmr::vector<uint32_t> in_room(Rooms.size() + 1, 0, arena.Resource());
+  if (guild)
+    for (size_t i = 0; i < MembersId.size(); ++i)
+    {
+      auto it = guild->voice_members.find(MembersId[i]);
+      if (it == guild->voice_members.end())
+        continue;
+      for (size_t r = 0; r < Rooms.size(); ++r)
+        if (Rooms[r].ChannelId == it->second.channel_id)
+        {
+          room_of[i] = r + 1;
+          break;
+        }
+    }
+  for (uint8_t r : room_of)
+    in_room[r]++;
+
+  for (size_t r = 0; r <= Rooms.size(); ++r)
+  {
+    std::string msg = text(in_room[r]);
+    for (size_t i = 0; i < MembersId.size(); ++i)
+      if (room_of[i] == r)
+        loc::Mention(std::back_inserter(msg), MembersId[i]);
+    TRACE_SCOPE("phase.announce");
+    manager.Notices.Post(r ? Rooms[r - 1].ChannelId : ChannelId, std::move(msg));
+  }
+}
+
+void SMS::ChangeMembersStatus(SessionManager &manager, bool mute, dpp::guild const *g) noexcept
+{
+  TRACE_SCOPE("session.mute");
+  // Unmutes always go out, nobody is left muted because the bot was busy
+  if (mute && shed::Active(shed::Level::DeferMutes))
+  {
+    manager.DeferMute(Handle);
+    return;
+  }
   if (!g)
     return;
   dpp::guild_member GuildMember;
@@ -168,11 +365,584 @@ void SMS::ChangeMembersStatus(SessionManager &manager, bool mute) noexcept
     if (it != g->voice_members.end())
     {
       GuildMember.user_id = id;
-      manager.Bot.guild_edit_member(GuildMember);
+      manager.Bot.guild_edit_member(GuildMember, shed::Tracked());
     }
   }
 };
 
+SMS *SessionManager::GetSessionByChannelId(snflake channel_id) noexcept
+{
+  for (auto &[_, Session] : _active_sessions)
+    if (Session.HasChannel(channel_id))
+      return &Session;
+
+  return nullptr;
+}
+
+bool SessionManager::AddRoom(Session *session, dpp::channel *channel)
+{
+  mem::ScopedTag tag(mem::Subsystem::Sessions);
+  if (session->Rooms.size() >= MaxRooms)
+    return 0;
+
+  session->Rooms.push_back({channel->id, channel->name});
+
+  std::vector<snflake> joined;
+  for (auto const &[UsrId, _] : channel->get_voice_members())
+    if (!GetSessionByUserId(UsrId))
+      joined.push_back(UsrId);
+  session->MembersId.insert(session->MembersId.end(), joined.begin(), joined.end());
+  Stats.RecordSessionJoined(session->GuildId, joined);
+
+  bool work = !HasFlag(session->Flags, Session::Flag::Break);
+  if (work && HasFlag(session->Flags, Session::Flag::Mute) && !HasFlag(session->Flags, Session::Flag::Paused))
+  {
+    if (shed::Active(shed::Level::DeferMutes))
+      DeferMute(session->Handle);
+    else
+    {
+      dpp::guild_member GuildMember;
+      GuildMember.guild_id = session->GuildId;
+      GuildMember.set_mute(1);
+      for (auto id : joined)
+      {
+        GuildMember.user_id = id;
+        Bot.guild_edit_member(GuildMember, shed::Tracked());
+      }
+    }
+  }
+
+  unsigned period = work ? session->WorkPeriod : session->BreakPeriod;
+  Renames.Label(
+      channel->id, channel->name, work ? "Work" : "Break", session->PhaseStartTime + std::chrono::seconds(period));
+  return 1;
+}
+
+void SessionManager::DeferMute(uint32_t handle)
+{
+  std::lock_guard lock(_deferred_mtx);
+  if (std::find(_deferred_mutes.begin(), _deferred_mutes.end(), handle) == _deferred_mutes.end())
+    _deferred_mutes.push_back(handle);
+}
+
+void SessionManager::FlushDeferredMutes() noexcept
+{
+  // Runs on the shed tick, the sessions may be ended or lose members on event threads meanwhile
+  std::lock_guard session_lock(Mtx);
+  std::vector<uint32_t> handles;
+  {
+    std::lock_guard lock(_deferred_mtx);
+    handles.swap(_deferred_mutes);
+  }
+  for (uint32_t handle : handles)
+  {
+    Session *session = GetSessionByHandle(handle);
+    if (!session) // Ended while waiting
+      continue;
+    // Only if the session still wants its members muted
+    using Flag = Session::Flag;
+    if (HasFlag(session->Flags, Flag::Mute) && !HasFlag(session->Flags, Flag::Break) &&
+        !HasFlag(session->Flags, Flag::Paused))
+      session->ChangeMembersStatus(*this, 1);
+  }
+}
+
+// Transition stage --
+
+static int64_t CurrentTick() noexcept
+{
+  using namespace std::chrono;
+  return duration_cast<seconds>(utl::Clock::now().time_since_epoch()).count();
+}
+
+int64_t SessionManager::QueueTransition(uint32_t handle, unsigned seconds) noexcept
+{
+  int64_t tick = CurrentTick() + std::max(1u, seconds);
+  if (PhaseGrid > 1)
+    tick = (tick + PhaseGrid - 1) / PhaseGrid * PhaseGrid;
+  _due[tick].push_back(handle);
+  if (!_tick_timer)
+    _tick_timer = Bot.start_timer(
+        [this](dpp::timer)
+        {
+          std::lock_guard lock(Mtx);
+          RunDueTransitions();
+        },
+        1);
+  return tick;
+}
+
+void SessionManager::Unqueue(Session &session) noexcept
+{
+  // Pause, resume and skip in the same second queue the same handle again and again, this keeps the tick from growing
+  if (auto it = _due.find(session.DueTick); it != _due.end() && it->second.back() == session.Handle)
+  {
+    it->second.pop_back();
+    if (it->second.empty())
+      _due.erase(it);
+  }
+  session.DueTick = 0;
+}
+
+void SessionManager::RunDueTransitions() noexcept
+{
+  mem::ScopedTag tag(mem::Subsystem::Sessions);
+  int64_t now = CurrentTick();
+  if (_due.empty() || _due.begin()->first > now)
+    return;
+
+  TRACE_SCOPE("phase.batch");
+  std::vector<Session *> due;
+  auto clock_now = utl::Clock::now();
+  utl::Clock::duration late{};
+  while (!_due.empty() && _due.begin()->first <= now)
+  {
+    auto node = _due.extract(_due.begin());
+    for (uint32_t handle : node.mapped())
+    {
+      // Paused, skipped or ended sessions left their entry behind
+      Session *s = GetSessionByHandle(handle);
+      if (s && s->DueTick == node.key())
+      {
+        // A phase rounded up to the grid is due at its tick, not at the end it was asked for
+        auto due_at = std::max(s->DueAt, utl::Clock::time_point(std::chrono::seconds(node.key())));
+        late = std::max(late, clock_now - due_at);
+        s->DueTick = 0;
+        due.push_back(s);
+      }
+    }
+  }
+
+  // The batch is as late as its latest session
+  if (late > utl::Clock::duration::zero())
+  {
+    uint64_t late_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(late).count();
+    shed::ReportTimerLateness(late_ns / 1'000'000);
+    if (trace::Enabled.load(std::memory_order_relaxed)) // traces are on the real clock
+      trace::Record("phase.timer_lateness", trace::NowNs() - late_ns, trace::NowNs());
+  }
+
+  // Sessions of a guild run back to back on the guild found once, channel order keeps a channel's requests together
+  std::sort(
+      due.begin(),
+      due.end(),
+      [](Session const *a, Session const *b)
+      { return a->GuildId != b->GuildId ? a->GuildId < b->GuildId : a->ChannelId < b->ChannelId; });
+  snflake guild_id = 0;
+  dpp::guild const *guild = nullptr;
+  for (Session *s : due)
+  {
+    if (s->GuildId != guild_id)
+    {
+      TRACE_SCOPE("phase.find_guild");
+      guild_id = s->GuildId;
+      guild = dpp::find_guild(guild_id);
+    }
+    s->RunPhase(*this, 1, guild); // May end s, the other sessions of the batch stay valid
+  }
+}
+
+std::string SessionManager::Report() noexcept
+{
+  std::lock_guard lock(Mtx);
+  size_t queued = 0;
+  for (auto const &[_, handles] : _due)
+    queued += handles.size();
+  size_t deferred;
+  {
+    std::lock_guard lock(_deferred_mtx);
+    deferred = _deferred_mutes.size();
+  }
+  return fmt::format(
+      "Sessions: {} live, {} handles, {} queued transitions in {} ticks, {} deferred mutes, {} suspended guilds, {} "
+      "status messages, {} pending renames, {} webhook channels",
+      _active_sessions.size(),
+      _by_handle.size(),
+      queued,
+      _due.size(),
+      deferred,
+      _suspended.size(),
+      Board.Tracked(),
+      Renames.Pending(),
+      Notices.Channels());
+}
+
+// Shard health -----
+
+static uint32_t ShardOf(dpp::snowflake guild_id, uint32_t shards) noexcept
+{
+  return shards ? (static_cast<uint64_t>(guild_id) >> 22) % shards : 0;
+}
+
+void SessionManager::CheckShards() noexcept
+{
+  std::lock_guard lock(Mtx);
+  uint32_t count = Bot.get_shard_count();
+  if (_shard_up.size() < count) // A shard only goes down after it was seen up, not while it's still connecting
+    _shard_up.resize(count, 0);
+
+  std::vector<uint32_t> went_down;
+  for (auto const &[id, shard] : Bot.get_shards())
+  {
+    if (id >= _shard_up.size())
+      continue;
+    bool up = shard->is_connected();
+    if (_shard_up[id] && !up)
+      went_down.push_back(id);
+    _shard_up[id] = up;
+  }
+
+  if (!went_down.empty())
+  {
+    std::vector<snflake> guilds;
+    for (auto const &[_, s] : _active_sessions)
+      if (std::find(went_down.begin(), went_down.end(), ShardOf(s.GuildId, count)) != went_down.end())
+        guilds.push_back(s.GuildId);
+    for (snflake g : guilds)
+      SuspendGuild(g);
+    Bot.log(
+        DL::ll_warning,
+        fmt::format("{} shard(s) down, suspended the sessions of {} guild(s)", went_down.size(), _suspended.size()));
+  }
+
+  // Guilds that didn't come back while their shard is up were deleted, or went through a reconcile that was missed
+  auto now = utl::Clock::now();
+  std::vector<snflake> gone, back;
+  for (auto const &[guild_id, since] : _suspended)
+  {
+    uint32_t shard = ShardOf(guild_id, count);
+    if (shard < _shard_up.size() && !_shard_up[shard])
+      continue;
+    dpp::guild const *g = dpp::find_guild(guild_id);
+    if (g && !g->is_unavailable())
+      back.push_back(guild_id);
+    else if (now - since >= GuildGoneAfter)
+      gone.push_back(guild_id);
+  }
+  if (!back.empty())
+    ReconcileGuilds(back);
+  if (!gone.empty())
+    EndGuilds(gone);
+}
+
+void SessionManager::SuspendGuild(snflake guild_id) noexcept
+{
+  std::lock_guard lock(Mtx);
+  if (_suspended.contains(guild_id))
+    return;
+  bool any = 0;
+  for (auto &[_, s] : _active_sessions)
+    if (s.GuildId == guild_id)
+    {
+      any = 1;
+      if (s.Pause(*this))
+        SetFlag(s.Flags, Session::Flag::Suspended, 1);
+    }
+  if (any)
+    _suspended.emplace(guild_id, utl::Clock::now());
+}
+
+void SessionManager::ReconcileShard(uint32_t shard_id) noexcept
+{
+  std::lock_guard lock(Mtx);
+  uint32_t count = Bot.get_shard_count();
+  if (shard_id < _shard_up.size())
+    _shard_up[shard_id] = 1;
+  std::vector<snflake> guilds;
+  for (auto const &[guild_id, _] : _suspended)
+    if (ShardOf(guild_id, count) == shard_id)
+      guilds.push_back(guild_id);
+  if (!guilds.empty())
+    ReconcileGuilds(guilds);
+}
+
+void SessionManager::ReconcileGuilds(std::span<const snflake> guild_ids) noexcept
+{
+  std::lock_guard lock(Mtx);
+  // Every GUILD_CREATE comes through here, only the suspended guilds cost a pass over the sessions
+  if (std::none_of(guild_ids.begin(), guild_ids.end(), [this](snflake id) { return _suspended.contains(id); }))
+    return;
+  mem::ScopedTag tag(mem::Subsystem::Sessions);
+  TRACE_SCOPE("session.reconcile");
+  // A shard's worth of guilds is looked up for every session, sorted it's log n instead of n
+  std::vector<snflake> wanted(guild_ids.begin(), guild_ids.end());
+  std::sort(wanted.begin(), wanted.end());
+  std::vector<Session *> sessions;
+  for (auto &[_, s] : _active_sessions)
+    if (_suspended.contains(s.GuildId) && std::binary_search(wanted.begin(), wanted.end(), s.GuildId))
+      sessions.push_back(&s);
+  std::sort(
+      sessions.begin(),
+      sessions.end(),
+      [](Session const *a, Session const *b) { return a->GuildId < b->GuildId; });
+
+  // Members of every session, built on the first member that may have joined
+  std::unordered_set<snflake> in_session;
+  auto in_any_session = [&](snflake id)
+  {
+    if (in_session.empty())
+      for (auto const &[_, s] : _active_sessions)
+        in_session.insert(s.MembersId.begin(), s.MembersId.end());
+    return in_session.contains(id);
+  };
+
+  snflake guild_id = 0;
+  dpp::guild const *g = nullptr;
+  std::vector<snflake> joined, gone;
+  size_t left = 0, added = 0, ended = 0;
+  for (Session *s : sessions)
+  {
+    if (s->GuildId != guild_id)
+    {
+      guild_id = s->GuildId;
+      g = dpp::find_guild(guild_id);
+    }
+    if (!g || g->is_unavailable())
+      continue; // Still suspended, looked at again by CheckShards
+    _suspended.erase(guild_id);
+
+    // Diff against the voice states, the session keeps everything else
+    gone.clear();
+    std::erase_if(
+        s->MembersId,
+        [&](snflake id)
+        {
+          auto it = g->voice_members.find(id);
+          if (it != g->voice_members.end() && s->HasChannel(it->second.channel_id))
+            return 0;
+          gone.push_back(id);
+          return 1;
+        });
+    if (!gone.empty())
+      Stats.RecordSessionEnd(s->GuildId, gone, 0); // left before the end, like a cancel
+    left += gone.size();
+
+    joined.clear();
+    for (auto const &[id, state] : g->voice_members)
+      if (s->HasChannel(state.channel_id) &&
+          std::find(s->MembersId.begin(), s->MembersId.end(), id) == s->MembersId.end() && !in_any_session(id))
+        joined.push_back(id);
+    if (!joined.empty())
+    {
+      s->MembersId.insert(s->MembersId.end(), joined.begin(), joined.end());
+      in_session.insert(joined.begin(), joined.end());
+      Stats.RecordSessionJoined(s->GuildId, joined);
+      added += joined.size();
+    }
+
+    if (std::find(s->MembersId.begin(), s->MembersId.end(), s->OwnerId) == s->MembersId.end())
+    {
+      std::string msg;
+      if (s->MembersId.empty())
+      {
+        loc::OwnerLeftCanceled(s->Locale, std::back_inserter(msg), s->OwnerId);
+        Notices.Post(s->ChannelId, std::move(msg));
+        CancelSession(s);
+        ended++;
+        continue;
+      }
+      loc::OwnerLeft(s->Locale, std::back_inserter(msg), s->OwnerId, s->MembersId[0]);
+      Notices.Post(s->ChannelId, std::move(msg));
+      ChangeOwnerId(s, s->MembersId[0]);
+    }
+
+    if (HasFlag(s->Flags, Session::Flag::Suspended))
+    {
+      SetFlag(s->Flags, Session::Flag::Suspended, 0);
+      s->Resume(*this);
+    }
+  }
+  // Guilds whose sessions all ended while they were away had nothing to reconcile
+  for (snflake id : guild_ids)
+    if (_suspended.contains(id))
+      if (dpp::guild const *back = dpp::find_guild(id); back && !back->is_unavailable())
+        _suspended.erase(id);
+  Bot.log(
+      DL::ll_info,
+      fmt::format(
+          "Reconciled {} session(s): {} member(s) left, {} joined, {} session(s) ended",
+          sessions.size(),
+          left,
+          added,
+          ended));
+}
+
+void SessionManager::EndGuilds(std::span<const snflake> guild_ids) noexcept
+{
+  std::lock_guard lock(Mtx);
+  std::vector<snflake> owners;
+  for (auto &[owner, s] : _active_sessions)
+  {
+    if (std::find(guild_ids.begin(), guild_ids.end(), s.GuildId) == guild_ids.end())
+      continue;
+    owners.push_back(owner);
+    // The channels and the status message went with the guild
+    Unqueue(s);
+    Bot.stop_timer(s.CueTimerId);
+    Board.Release(s.Handle);
+    Renames.Forget(s.ChannelId);
+    Notices.Forget(s.ChannelId);
+    for (auto const &room : s.Rooms)
+    {
+      Renames.Forget(room.ChannelId);
+      Notices.Forget(room.ChannelId);
+    }
+    Stats.RecordSessionEnd(s.GuildId, s.MembersId, 0);
+    _by_handle.erase(s.Handle);
+  }
+  for (snflake owner : owners)
+    _active_sessions.erase(owner);
+  for (snflake guild_id : guild_ids)
+    _suspended.erase(guild_id);
+  {
+    std::lock_guard lock(_deferred_mtx);
+    std::erase_if(_deferred_mutes, [this](uint32_t handle) { return !_by_handle.contains(handle); });
+  }
+  if (!owners.empty())
+    Bot.log(DL::ll_info, fmt::format("Ended {} session(s) of {} deleted guild(s)", owners.size(), guild_ids.size()));
+}
+
+void SessionManager::ReleaseAll(std::vector<handoff::Snapshot> &out) noexcept
+{
+  std::lock_guard lock(Mtx);
+  using namespace std::chrono;
+  auto now = utl::Clock::now();
+  int64_t now_ms = utl::WallMs();
+  out.reserve(out.size() + _active_sessions.size());
+  for (auto &[_, s] : _active_sessions)
+  {
+    Unqueue(s);
+    Bot.stop_timer(s.CueTimerId);
+    auto &snap = out.emplace_back();
+    snap.OwnerId = s.OwnerId;
+    snap.ChannelId = s.ChannelId;
+    snap.GuildId = s.GuildId;
+    snap.StatusMessageId = Board.Release(s.Handle);
+    snap.Members.assign(s.MembersId.begin(), s.MembersId.end());
+    for (auto const &room : s.Rooms)
+      snap.Rooms.emplace_back(room.ChannelId, room.Name);
+    snap.VoiceChannelName = s.VoiceChannelName;
+    snap.WorkPeriod = s.WorkPeriod;
+    snap.BreakPeriod = s.BreakPeriod;
+    snap.Repeat = s.Repeat;
+    snap.CurrentSessionNumber = s.CurrentSessionNumber;
+    auto end = s.PhaseStartTime + seconds(HasFlag(s.Flags, Session::Flag::Break) ? s.BreakPeriod : s.WorkPeriod);
+    snap.PhaseEndMs = now_ms + duration_cast<milliseconds>(end - now).count();
+    snap.ReleasedAtMs = now_ms;
+    snap.PausedRemaining = s.PausedRemaining;
+    snap.Flags = s.Flags;
+    snap.Locale = static_cast<uint8_t>(s.Locale);
+    snap.CueSet = s.CueSet;
+    snap.Tenant = Tenant;
+  }
+  _active_sessions.clear();
+  _by_handle.clear();
+  {
+    std::lock_guard lock(_deferred_mtx);
+    _deferred_mutes.clear();
+  }
+  _due.clear();
+}
+
+SessionManager::Session &SessionManager::Rebuild(handoff::Snapshot const &snap)
+{
+  std::vector<snflake> members(snap.Members.begin(), snap.Members.end());
+  Session &s = _active_sessions
+                   .emplace(
+                       snap.OwnerId,
+                       Session(snap.OwnerId, snap.ChannelId, snap.GuildId, std::move(members), 0, 0, 0, "", snap.Flags))
+                   .first->second;
+  // Periods are already in seconds, the constructor's conversions are overwritten
+  s.VoiceChannelName = snap.VoiceChannelName;
+  for (auto const &[id, name] : snap.Rooms)
+    s.Rooms.push_back({id, name});
+  s.WorkPeriod = snap.WorkPeriod;
+  s.BreakPeriod = snap.BreakPeriod;
+  s.Repeat = snap.Repeat;
+  s.CurrentSessionNumber = snap.CurrentSessionNumber;
+  s.Flags = snap.Flags;
+  s.PausedRemaining = snap.PausedRemaining;
+  s.Locale = snap.Locale < (uint8_t)loc::Locale::Count ? loc::Locale(snap.Locale) : loc::Locale::En;
+  s.CueSet = snap.CueSet;
+  s.Handle = _next_handle++;
+  _by_handle.emplace(s.Handle, &s);
+  return s;
+}
+
+bool SessionManager::Adopt(handoff::Snapshot const &snap) noexcept
+{
+  std::lock_guard lock(Mtx);
+  using namespace std::chrono;
+  mem::ScopedTag tag(mem::Subsystem::Sessions);
+  if (_active_sessions.contains(snap.OwnerId))
+    return 0;
+
+  Session &s = Rebuild(snap);
+  unsigned period = HasFlag(s.Flags, Session::Flag::Break) ? s.BreakPeriod : s.WorkPeriod;
+  int64_t now_ms = utl::WallMs();
+  int64_t remaining_ms = std::max<int64_t>(snap.PhaseEndMs - now_ms, 0);
+  s.PhaseStartTime = utl::Clock::now() + milliseconds(remaining_ms) - seconds(period);
+  if (!HasFlag(s.Flags, Session::Flag::Paused)) // A late phase ends right away
+    s.ArmTimers(*this, std::max<int64_t>(1, (remaining_ms + 999) / 1000));
+  // The labels are already there, the scheduler needs the names to restore them
+  const char *label = HasFlag(s.Flags, Session::Flag::Break) ? "Break" : "Work";
+  Renames.Label(s.ChannelId, s.VoiceChannelName, label, s.PhaseStartTime + seconds(period));
+  for (auto const &room : s.Rooms)
+    Renames.Label(room.ChannelId, room.Name, label, s.PhaseStartTime + seconds(period));
+  Board.Adopt(s.Handle, s.ChannelId, s.Locale, snap.StatusMessageId);
+  return 1;
+}
+
+void SessionManager::Discard(handoff::Snapshot const &snap) noexcept
+{
+  std::lock_guard lock(Mtx);
+  mem::ScopedTag tag(mem::Subsystem::Sessions);
+  if (_active_sessions.contains(snap.OwnerId))
+    return EndBeside(snap);
+
+  Session &s = Rebuild(snap);
+  if (snap.StatusMessageId) // Closed by the teardown, a session without one doesn't get a new one
+    Board.Adopt(s.Handle, s.ChannelId, s.Locale, snap.StatusMessageId);
+  // The channels show a label this process never sent, their names come back whatever the scheduler thinks
+  Renames.Restore(s.ChannelId, s.VoiceChannelName);
+  for (auto const &room : s.Rooms)
+    Renames.Restore(room.ChannelId, room.Name);
+  CancelSession(&s);
+}
+
+void SessionManager::EndBeside(handoff::Snapshot const &snap) noexcept
+{
+  if (snap.StatusMessageId) // Closed like Untrack closes any other
+  {
+    uint32_t handle = _next_handle++;
+    auto locale = snap.Locale < (uint8_t)loc::Locale::Count ? loc::Locale(snap.Locale) : loc::Locale::En;
+    Board.Adopt(handle, snap.ChannelId, locale, snap.StatusMessageId);
+    Board.Untrack(handle);
+  }
+  std::vector<snflake> members(snap.Members.begin(), snap.Members.end());
+  Stats.RecordSessionEnd(snap.GuildId, members, 0);
+
+  // What a session running here uses is left to it: its members stay muted, its channels keep their labels
+  if (HasFlag(snap.Flags, Session::Flag::Mute))
+    if (dpp::guild *g = dpp::find_guild(snap.GuildId))
+    {
+      dpp::guild_member member;
+      member.guild_id = snap.GuildId;
+      member.set_mute(0);
+      for (auto id : members)
+        if (g->voice_members.contains(id) && !GetSessionByUserId(id) && !GetSessionByOwnerId(id))
+        {
+          member.user_id = id;
+          Bot.guild_edit_member(member, shed::Tracked());
+        }
+    }
+  if (!GetSessionByChannelId(snap.ChannelId))
+    Renames.Restore(snap.ChannelId, snap.VoiceChannelName);
+  for (auto const &[id, name] : snap.Rooms)
+    if (!GetSessionByChannelId(id))
+      Renames.Restore(id, name);
+}
+
 void SessionManager::StartSession(
     snflake usr_id,
     dpp::channel *channel,
@@ -180,12 +950,16 @@ void SessionManager::StartSession(
     unsigned break_period_in_min,
     unsigned repeat,
     flag_t flags,
-    std::function<void(Session const &session)> call_back)
+    loc::Locale locale,
+    mem::FunctionRef<void(Session const &session)> call_back,
+    uint8_t cue_set)
 {
 
+  mem::ScopedTag tag(mem::Subsystem::Sessions);
+  auto VoiceMembers = channel->get_voice_members();
   std::vector<snflake> MembersIds;
-  MembersIds.reserve(5);
-  for (auto [UsrId, _] : channel->get_voice_members())
+  MembersIds.reserve(VoiceMembers.size());
+  for (auto const &[UsrId, _] : VoiceMembers)
     MembersIds.push_back(UsrId);
 
   auto res = _active_sessions.emplace(
@@ -201,9 +975,17 @@ void SessionManager::StartSession(
           channel->name,
           flags //
           ));
+  Session &session = res.first->second;
+  session.Handle = _next_handle++;
+  session.Locale = locale;
+  session.CueSet = cue_set;
+  _by_handle.emplace(session.Handle, &session);
+  Stats.RecordSessionJoined(channel->guild_id, session.MembersId);
   if (call_back)
-    call_back(res.first->second);
-  res.first->second.SchedulePhase(*this);
+    call_back(session);
+  // Tracked first, the first phase updates the status message and may already end the session
+  Board.Track(session.Handle, session.ChannelId, session.Locale);
+  session.SchedulePhase(*this);
 }
 
 bool SessionManager::ChangeOwnerId(dpp::snowflake old_id, dpp::snowflake new_id) noexcept
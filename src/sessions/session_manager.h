@@ -1,12 +1,25 @@
 #ifndef SESSION_MANAGER_H
 #define SESSION_MANAGER_H
+#include "arena.h"
+#include "catalog.h"
+#include "clock.h"
+#include "cue_composer.h"
+#include "rename_scheduler.h"
+#include "session_handoff.h"
+#include "stats_store.h"
+#include "status_board.h"
+#include "webhook_pool.h"
 #include <chrono>
 #include <cstddef>
+#include <dpp/cache.h>
 #include <dpp/channel.h>
 #include <dpp/cluster.h>
 #include <dpp/snowflake.h>
 #include <dpp/timer.h>
 #include <functional>
+#include <map>
+#include <mutex>
+#include <span>
 #include <unordered_map>
 #include <vector>
 using flag_t = uint8_t;
@@ -33,22 +46,37 @@ public:
     {
       Break = 1u << 0, // So if bit-0 was 1 in the flags then it's a break session
       Mute = 1u << 1,  // So if the bit-1 was 1 in the flags then mute is on ( 0-off )
-      Voice = 1u << 2
+      Voice = 1u << 2,
+      Paused = 1u << 3,
+      Suspended = 1u << 4 // paused by the manager while its guild can't be reached, resumed by reconciliation
+    };
+    // Extra voice channel of a study hall, it shares the timer of the primary ChannelId
+    struct Room
+    {
+      snflake ChannelId;
+      std::string Name; // Restored when the session ends
     };
     snflake OwnerId;
     snflake ChannelId;
     snflake GuildId;
 
     std::vector<snflake> MembersId;
-    dpp::timer TimerId;
-    std::chrono::steady_clock::time_point PhaseStartTime;
+    std::vector<Room> Rooms; // empty unless the session is a study hall
+    int64_t DueTick = 0;       // tick the phase ends in, 0 if no transition is queued
+    dpp::timer CueTimerId = 0; // spoken "minutes left" cue of the current phase
+    uint32_t Handle = 0;       // stable id, unlike OwnerId it doesn't change
+    utl::Clock::time_point PhaseStartTime;
+    utl::Clock::time_point DueAt; // end of the queued phase, what the lateness of its transition is measured against
 
     unsigned WorkPeriod;
     unsigned BreakPeriod;
     unsigned Repeat;
     unsigned CurrentSessionNumber;
+    long PausedRemaining = 0; // remaining seconds of the phase while paused
 
     std::string VoiceChannelName;
+    loc::Locale Locale = loc::Locale::En; // catalog of the messages the session sends
+    uint8_t CueSet = 0;                   // CueComposer set of the spoken cues
     // 1-byte
     flag_t Flags; // bit-0 for current phase , bit-1 for mute flag
     Session(
@@ -62,19 +90,133 @@ public:
         std::string_view vc_channel_name,
         flag_t flags = 1u << 0 //
     );
-    void SchedulePhase(SessionManager &manager) noexcept;
-    long GetRemainingTime() noexcept;
+    /*
+       @brief Moves to the next phase
+       @param completed false when the current phase was skipped, it's not counted in the stats then
+    */
+    void SchedulePhase(SessionManager &manager, bool completed = 1) noexcept
+    {
+      RunPhase(manager, completed, dpp::find_guild(GuildId));
+    }
+    long GetRemainingTime() const noexcept;
+
+    /*
+       @brief Stops the phase timer keeping the remaining time, members are unmuted while paused
+       @return false if already paused
+    */
+    bool Pause(SessionManager &manager) noexcept;
+
+    /*
+       @brief Re-arms the phase timer with the time that was remaining when paused
+       @return false if not paused
+    */
+    bool Resume(SessionManager &manager) noexcept;
+
+    /*
+       @brief Ends the current phase now
+    */
+    void SkipPhase(SessionManager &manager) noexcept;
+
+    void ChangeMembersStatus(SessionManager &manager, bool mute) noexcept
+    {
+      ChangeMembersStatus(manager, mute, dpp::find_guild(GuildId));
+    }
+
+    /*
+       @return true if channel_id is the primary channel or one of the rooms
+    */
+    bool HasChannel(snflake channel_id) const noexcept;
 
-    void ChangeMembersStatus(SessionManager &manager, bool mute) noexcept;
+  private:
+    friend class SessionManager; // Adopt re-arms the timers, the transition stage runs phases with the guild it found
+    void ArmTimers(SessionManager &manager, unsigned remaining) noexcept;
+    // guild is the cached guild of GuildId, looked up once by the caller, may be null
+    void RunPhase(SessionManager &manager, bool completed, dpp::guild const *guild) noexcept;
+    void ChangeMembersStatus(SessionManager &manager, bool mute, dpp::guild const *guild) noexcept;
+    void Announce(SessionManager &manager, std::string_view header, dpp::guild const *guild) noexcept;
+    std::vector<snflake> RoomChannels() const;
   };
 
-  explicit SessionManager(dpp::cluster &bot) noexcept;
+  /*
+     @param tenant index of the bot this manager belongs to in multi-tenant mode, see tenants.h
+  */
+  SessionManager(dpp::cluster &bot, StatsStore &stats, CueComposer &cues, uint8_t tenant = 0) noexcept;
+  ~SessionManager();
 
   Session *GetSessionByOwnerId(snflake owner_id) noexcept;
   Session const *GetSessionByOwnerId(snflake owner_id) const noexcept;
   Session *GetSessionByUserId(snflake usr_id);
+  Session *GetSessionByHandle(uint32_t handle) noexcept;
+  Session const *GetSessionByHandle(uint32_t handle) const noexcept;
 
   Session const *GetSessionByUserId(snflake usr_id) const noexcept;
+  Session *GetSessionByChannelId(snflake channel_id) noexcept;
+
+  static constexpr size_t MaxRooms = 30;
+
+  /*
+     @brief Turns the session into a study hall running in one more voice channel, members of the channel join the
+     session and follow the same timer
+     @return false if the session already has MaxRooms rooms
+  */
+  bool AddRoom(Session *session, dpp::channel *channel);
+
+  /*
+     @brief Applies the mutes held back while under load to the sessions that still want them,
+     called when the load level drops below shed::Level::DeferMutes
+  */
+  void FlushDeferredMutes() noexcept;
+
+  /*
+     @brief Stops running every session without ending it, for another process to carry on with Adopt.
+     Members stay muted and channels keep their labels, nothing is recorded in the stats
+  */
+  void ReleaseAll(std::vector<handoff::Snapshot> &out) noexcept;
+
+  /*
+     @brief Resumes a session released by another process, keeping its phase deadline
+     @return false if the owner already has a session here
+  */
+  bool Adopt(handoff::Snapshot const &snapshot) noexcept;
+
+  /*
+     @brief Ends a session released by another process that is too old to resume (handoff::Stale) or that Adopt
+     refused: members are unmuted, channel names restored and the status message closed, it's recorded as canceled.
+     If the owner already has a session here, the members and channels that session uses are left to it
+  */
+  void Discard(handoff::Snapshot const &snapshot) noexcept;
+
+  // Shard health, sessions don't run on a cache that isn't being updated
+
+  /*
+     @brief Polls the shards, called every second. Sessions of guilds on a shard that went down are suspended,
+     guilds that stay unreachable for GuildGoneAfter while their shard is up are taken as deleted
+  */
+  void CheckShards() noexcept;
+
+  /*
+     @brief Pauses the running sessions of a guild until it's reconciled
+  */
+  void SuspendGuild(snflake guild_id) noexcept;
+
+  /*
+     @brief Reconciles the suspended guilds of a shard against the cache, after the shard resumed
+  */
+  void ReconcileShard(uint32_t shard_id) noexcept;
+
+  /*
+     @brief Brings the sessions of suspended guilds in line with the voice states in the cache: members who left are
+     dropped, members who joined a session's channels are added, a session whose owner left gets a new owner or ends.
+     Sessions the manager paused are resumed
+  */
+  void ReconcileGuilds(std::span<const snflake> guild_ids) noexcept;
+
+  /*
+     @brief Ends the sessions of deleted guilds in one pass, without any requests to them
+  */
+  void EndGuilds(std::span<const snflake> guild_ids) noexcept;
+
+  static constexpr std::chrono::minutes GuildGoneAfter{10};
   void StartSession(
       snflake usr_id,
       dpp::channel *channel,
@@ -82,34 +224,49 @@ public:
       unsigned break_period_in_min,
       unsigned repeat,
       flag_t flags = 1u << 0,
-      std::function<void(Session const &session)> call_back = nullptr);
+      loc::Locale locale = loc::Locale::En,
+      mem::FunctionRef<void(Session const &session)> call_back = nullptr,
+      uint8_t cue_set = 0);
   /*
      @brief Cancel the session associated with the given owner_id and remove it from the active sessions
      @param owner_id the snowflake id of the session owner.
      @param call_before_remove optional callback function that will be called before session is removed
      from the active sessions, it must take a single parameter of type Session const& , any return value is ignored so
      return void.
+     @param completed true when the session ran through its last phase, it's recorded as completed in the stats
      @return true if the session was found and canceled successfully, false if no session with the given owner_id was
      found.
   */
   template <class F = std::nullptr_t> //
-  bool CancelSession(snflake owner_id, F &&call_before_remove = nullptr) noexcept;
+  bool CancelSession(snflake owner_id, F &&call_before_remove = nullptr, bool completed = 0) noexcept;
   /*
-     @brief Cancel the session associated with the given session pointer.
+     @brief Cancel the session associated with the given session pointer, session is dangling afterwards.
      @param session pointer to the session to be canceled.
      @param call_before_remove optional callback function that will be called before session is removed
      from the active sessions, it must take a single parameter of type Session const& , any return value is ignored so
      return void.
-
-     @param erase if set to true, the session will be removed from the active sessions after calling the callback
-     function; if set to false, the session will not be remove ,please use this with caution as it can lead to memory
-     leaks if the session is not removed later or double erase if erase == 1 and the caller also erases the session
-     after calling this function.
+     @param completed true when the session ran through its last phase
   */
   template <class F = std::nullptr_t> //
-  void CancelSession(Session *session, F &&call_before_remove = nullptr, bool erase = 1) noexcept;
+  void CancelSession(Session *session, F &&call_before_remove = nullptr, bool completed = 0) noexcept;
+
+  /*
+     Guards the sessions, they're reached from the event threads of every shard, the timer thread and the load
+     shedder's tick. Event handlers and the recurring scheduler hold it for a whole event, the manager's own timers
+     and the methods main calls from its timers take it themselves. It's taken before the status board's lock
+  */
+  std::recursive_mutex Mtx;
 
   dpp::cluster &Bot;
+  StatsStore &Stats;
+  CueComposer &Cues;
+  const uint8_t Tenant;
+  // Seconds, phase ends are rounded up to a multiple of it so sessions started around the same time change phase in
+  // the same batch. A phase runs up to PhaseGrid - 1 seconds longer than asked for
+  unsigned PhaseGrid = 1;
+  StatusBoard Board;
+  RenameScheduler Renames;
+  WebhookPool Notices; // phase announcements and cancel notices
 
   /*
      @brief return the number of active sessions
@@ -120,6 +277,12 @@ public:
     return _active_sessions.size();
   }
 
+  /*
+     @brief What the manager and its schedulers hold, for the periodic log. With no sessions every count but the
+     queued ticks (until they pass) and the webhook channels should be back to 0
+  */
+  std::string Report() noexcept;
+
   /*
      @brief Changes the owner_id for the session and the hash map key
      @param owner_id the current owner_id of the session
@@ -152,36 +315,84 @@ public:
 
 private:
   std::unordered_map<snflake, Session> _active_sessions;
+  std::unordered_map<uint32_t, Session *> _by_handle; // nodes of _active_sessions never move
+  uint32_t _next_handle = 1;
+  std::vector<uint32_t> _deferred_mutes; // session handles, filled on event threads and flushed by the shed tick
+  std::mutex _deferred_mtx;               // guards _deferred_mutes
+  // Phase transitions by the tick they're due in, stale entries are skipped by checking Session::DueTick
+  std::map<int64_t, std::vector<uint32_t>> _due;
+  dpp::timer _tick_timer = 0;
+  std::unordered_map<snflake, utl::Clock::time_point> _suspended; // guild -> since
+  std::vector<uint8_t> _shard_up;                                 // by shard id, last poll
+
+  void DeferMute(uint32_t handle);
+  /*
+     @brief Discard for a snapshot whose owner has a session here, the snapshot is ended without becoming a session
+  */
+  void EndBeside(handoff::Snapshot const &snapshot) noexcept;
+  /*
+     @brief The session of a snapshot, without timers, labels or status message
+  */
+  Session &Rebuild(handoff::Snapshot const &snapshot);
+  /*
+     @brief Everything CancelSession does but removing the session from the active sessions
+  */
+  template <class F> //
+  void Teardown(Session *session, F &&call_before_remove, bool completed) noexcept;
+  /*
+     @brief Queues the end of a session's phase in seconds from now
+     @return the tick it's due in
+  */
+  int64_t QueueTransition(uint32_t handle, unsigned seconds) noexcept;
+  /*
+     @brief Cancels the queued end of a session's phase, its entry is dropped right away if it's the last one queued
+     in its tick, otherwise it's skipped when the tick runs
+  */
+  void Unqueue(Session &session) noexcept;
+  /*
+     @brief Transition stage: runs every phase due by now as one batch, grouped by guild so each guild is looked up
+     in the cache once
+  */
+  void RunDueTransitions() noexcept;
 };
 
 template <class F> //
-bool SessionManager::CancelSession(snflake owner_id, F &&call_before_remove) noexcept
+bool SessionManager::CancelSession(snflake owner_id, F &&call_before_remove, bool completed) noexcept
 {
   auto it = _active_sessions.find(owner_id);
   if (it == _active_sessions.end())
     return 0;
 
-  CancelSession(&it->second, call_before_remove, 0);
-
+  Teardown(&it->second, std::forward<F>(call_before_remove), completed);
   _active_sessions.erase(it);
-
   return 1;
 }
 
 template <class F> //
-void SessionManager::CancelSession(SessionManager::Session *session, F &&call_before_remove, bool erase) noexcept
+void SessionManager::CancelSession(SessionManager::Session *session, F &&call_before_remove, bool completed) noexcept
+{
+  snflake owner_id = session->OwnerId; // the key can't be a reference into the node being erased
+  Teardown(session, std::forward<F>(call_before_remove), completed);
+  _active_sessions.erase(owner_id);
+}
+
+template <class F> //
+void SessionManager::Teardown(SessionManager::Session *session, F &&call_before_remove, bool completed) noexcept
 {
-  Bot.stop_timer(session->TimerId);
+  Unqueue(*session);
+  Bot.stop_timer(session->CueTimerId);
+  Board.Untrack(session->Handle);
+  _by_handle.erase(session->Handle);
+  Stats.RecordSessionEnd(session->GuildId, session->MembersId, completed);
   if (HasFlag(session->Flags, Session::Flag::Mute))
     session->ChangeMembersStatus(*this, 0);
-  // Bot.channel_edit(dpp::find_channel(it->second.ChannelId)->set_name(it->second.VoiceChannelName));
+  Renames.Restore(session->ChannelId);
+  for (auto const &room : session->Rooms)
+    Renames.Restore(room.ChannelId);
   if constexpr (!std::is_same_v<std::decay_t<F>, std::nullptr_t>)
   {
     std::forward<F>(call_before_remove)(*session);
   }
-
-  if (erase)
-    _active_sessions.erase(session->OwnerId);
 }
 
 #endif
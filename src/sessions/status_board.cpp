@@ -0,0 +1,252 @@
+#include "status_board.h"
+#include "arena.h"
+#include "component_router.h"
+#include "load_shedder.h"
+#include "session_manager.h"
+#include "utils.h"
+#include <algorithm>
+#include <iterator>
+#include <dpp/message.h>
+#include <fmt/format.h>
+
+constexpr uint32_t TickSeconds = 1;
+constexpr double EditsPerSecond = 20; // of the ~50/s global REST limit, the rest is left for everything else
+constexpr auto MinEditInterval = std::chrono::seconds(5); // message edits are limited to 5 per 5s per channel
+constexpr uint32_t RelaxTicks = 30; // ticks with spare budget before the granularity narrows again
+constexpr uint32_t UnknownMessage = 10008;
+
+static dpp::message
+BuildMessage(dpp::snowflake channel_id, uint32_t handle, loc::Locale l, StatusBoard::DisplayState const &d)
+{
+  using Control = StatusBoard::Control;
+  using loc::Word;
+  std::string content;
+  loc::StatusLine(l, std::back_inserter(content), d.Phase, d.Number, d.Paused, d.Value, d.InSeconds);
+  dpp::message msg(channel_id, content);
+
+  auto button = [handle, l](Control control, Word label, dpp::component_style style)
+  {
+    ComponentRouter::Id id;
+    ComponentRouter::Encode(id, StatusBoard::ControlsTag, static_cast<uint8_t>(control), handle);
+    return dpp::component()
+        .set_type(dpp::cot_button)
+        .set_label(std::string(loc::Get(l, label)))
+        .set_style(style)
+        .set_id(id);
+  };
+
+  dpp::component row;
+  row.set_type(dpp::cot_action_row);
+  row.add_component(
+      d.Paused ? button(Control::Resume, Word::Resume, dpp::cos_success)
+               : button(Control::Pause, Word::Pause, dpp::cos_primary));
+  row.add_component(button(Control::Skip, Word::SkipPhase, dpp::cos_secondary));
+  row.add_component(button(Control::Mute, d.Muted ? Word::Unmute : Word::Mute, dpp::cos_secondary));
+  row.add_component(button(Control::Stop, Word::Stop, dpp::cos_danger));
+  msg.add_component(row);
+  return msg;
+}
+
+StatusBoard::StatusBoard(SessionManager &manager) noexcept : ManagerRef(manager)
+{
+}
+
+StatusBoard::~StatusBoard()
+{
+  if (_timer)
+    ManagerRef.Bot.stop_timer(_timer);
+}
+
+bool StatusBoard::GetState(uint32_t handle, DisplayState &out) const noexcept
+{
+  auto const *session = ManagerRef.GetSessionByHandle(handle);
+  if (!session)
+    return 0;
+
+  using Flag = SessionManager::Session::Flag;
+  long remaining = std::max(0l, session->GetRemainingTime());
+  out.Phase = SessionManager::HasFlag(session->Flags, Flag::Break);
+  out.Paused = SessionManager::HasFlag(session->Flags, Flag::Paused);
+  out.Muted = SessionManager::HasFlag(session->Flags, Flag::Mute);
+  out.Number = session->CurrentSessionNumber - 1;
+  out.InSeconds = remaining <= 60;
+  if (out.InSeconds)
+    out.Value = (remaining + 9) / 10 * 10;
+  else
+  {
+    uint32_t g = GetGranularity();
+    uint32_t minutes = (remaining + 59) / 60;
+    out.Value = (minutes + g - 1) / g * g;
+  }
+  return 1;
+}
+
+void StatusBoard::Track(uint32_t handle, snflake channel_id, loc::Locale locale) noexcept
+{
+  std::lock_guard lock(_mtx);
+  auto &entry = _entries[handle];
+  entry.ChannelId = channel_id;
+  entry.Locale = locale;
+  entry.InFlight = 1;
+  GetState(handle, entry.Shown);
+
+  ManagerRef.Bot.message_create(
+      BuildMessage(channel_id, handle, locale, entry.Shown),
+      shed::Tracked(
+          [this, handle, locale](dpp::confirmation_callback_t const &cb)
+          {
+            std::lock_guard lock(_mtx);
+            auto it = _entries.find(handle);
+            if (cb.is_error())
+            {
+              ManagerRef.Bot.log(
+                  DL::ll_warning, fmt::format("Status message not created: {}", cb.get_error().message));
+              if (it != _entries.end())
+                _entries.erase(it);
+              return;
+            }
+
+            auto msg = cb.get<dpp::message>();
+            if (it == _entries.end()) // Session ended before the message was created
+            {
+              ManagerRef.Bot.message_edit(msg.set_content(std::string(loc::Get(locale, loc::Word::SessionEnded))));
+              return;
+            }
+            it->second.MessageId = msg.id;
+            it->second.LastEdit = clock::now();
+            it->second.InFlight = 0;
+            ManagerRef.Bot.message_pin(msg.channel_id, msg.id);
+          }));
+
+  if (!_timer)
+    _timer = ManagerRef.Bot.start_timer([this](dpp::timer) { Tick(); }, TickSeconds);
+}
+
+void StatusBoard::Untrack(uint32_t handle) noexcept
+{
+  std::lock_guard lock(_mtx);
+  auto it = _entries.find(handle);
+  if (it == _entries.end())
+    return;
+
+  Entry entry = it->second;
+  _entries.erase(it);
+  if (!entry.MessageId)
+    return;
+
+  dpp::message msg(entry.ChannelId, std::string(loc::Get(entry.Locale, loc::Word::SessionEnded)));
+  msg.id = entry.MessageId;
+  ManagerRef.Bot.message_edit(msg);
+  ManagerRef.Bot.message_unpin(entry.ChannelId, entry.MessageId);
+}
+
+dpp::snowflake StatusBoard::Release(uint32_t handle) noexcept
+{
+  std::lock_guard lock(_mtx);
+  auto it = _entries.find(handle);
+  if (it == _entries.end())
+    return 0;
+  snflake id = it->second.MessageId;
+  _entries.erase(it);
+  return id;
+}
+
+void StatusBoard::Adopt(uint32_t handle, snflake channel_id, loc::Locale locale, snflake message_id) noexcept
+{
+  if (!message_id)
+    return Track(handle, channel_id, locale);
+
+  std::lock_guard lock(_mtx);
+  auto &entry = _entries[handle];
+  entry.ChannelId = channel_id;
+  entry.MessageId = message_id;
+  entry.Locale = locale;
+  entry.Shown = {}; // differs from any real state
+  entry.LastEdit = clock::now() - MinEditInterval;
+  if (!_timer)
+    _timer = ManagerRef.Bot.start_timer([this](dpp::timer) { Tick(); }, TickSeconds);
+}
+
+void StatusBoard::Edit(uint32_t handle, Entry &entry, DisplayState const &state) noexcept
+{
+  entry.InFlight = 1;
+  entry.LastEdit = clock::now();
+  entry.Shown = state;
+
+  dpp::message msg = BuildMessage(entry.ChannelId, handle, entry.Locale, state);
+  msg.id = entry.MessageId;
+  ManagerRef.Bot.message_edit(
+      msg,
+      shed::Tracked(
+          [this, handle](dpp::confirmation_callback_t const &cb)
+          {
+            std::lock_guard lock(_mtx);
+            auto it = _entries.find(handle);
+            if (it == _entries.end())
+              return;
+            it->second.InFlight = 0;
+            if (!cb.is_error())
+              return;
+
+            if (cb.get_error().code == UnknownMessage) // Deleted by someone, stop updating it
+              _entries.erase(it);
+            else
+              it->second.Shown = {}; // Retried on a later tick
+          }));
+}
+
+void StatusBoard::Tick() noexcept
+{
+  struct Candidate
+  {
+    uint32_t Handle;
+    uint32_t Priority; // lower goes first
+    DisplayState State;
+  };
+
+  mem::ScopedTag tag(mem::Subsystem::Status);
+  auto now = clock::now();
+  std::lock_guard sessions(ManagerRef.Mtx); // the states are read from the sessions, the manager's lock goes first
+  std::lock_guard lock(_mtx);
+  _tokens = std::min(_tokens + EditsPerSecond * TickSeconds, EditsPerSecond * 2);
+
+  std::vector<Candidate> candidates;
+  for (auto &[handle, entry] : _entries)
+  {
+    if (entry.InFlight || !entry.MessageId || now - entry.LastEdit < MinEditInterval)
+      continue;
+
+    DisplayState state;
+    if (!GetState(handle, state) || state == entry.Shown)
+      continue;
+
+    // Phase changes and button presses go before countdown updates
+    bool urgent = state.Phase != entry.Shown.Phase || state.Number != entry.Shown.Number ||
+                         state.Paused != entry.Shown.Paused || state.Muted != entry.Shown.Muted;
+    candidates.push_back({handle, urgent ? 0 : (state.InSeconds ? state.Value : state.Value * 60) + 1, state});
+  }
+
+  size_t budget = static_cast<size_t>(_tokens);
+  if (candidates.size() > budget)
+  {
+    std::nth_element(
+        candidates.begin(),
+        candidates.begin() + budget,
+        candidates.end(),
+        [](Candidate const &a, Candidate const &b) { return a.Priority < b.Priority; });
+    candidates.resize(budget);
+
+    if (_level + 1 < std::size(GranularityLevels))
+      _level++;
+    _idle_ticks = 0;
+  }
+  else if (_level && candidates.size() * 2 < budget && ++_idle_ticks >= RelaxTicks)
+  {
+    _level--;
+    _idle_ticks = 0;
+  }
+
+  for (auto const &c : candidates)
+    Edit(c.Handle, _entries[c.Handle], c.State);
+  _tokens -= candidates.size();
+}
@@ -0,0 +1,119 @@
+#ifndef STATUS_BOARD_H
+#define STATUS_BOARD_H
+#include "catalog.h"
+#include "clock.h"
+#include <chrono>
+#include <cstdint>
+#include <dpp/cluster.h>
+#include <dpp/snowflake.h>
+#include <dpp/timer.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class SessionManager;
+
+/*
+   One pinned status message per session, edited in place with the phase and remaining time.
+   A single timer decides for all sessions which messages get edited, keeping the total under a REST budget:
+   only messages whose displayed text changed are edited, phase changes and sessions near a boundary go first,
+   and the minute granularity widens when there are more changes than budget.
+*/
+class StatusBoard
+{
+  using snflake = dpp::snowflake;
+  using clock = utl::Clock;
+
+public:
+  // Buttons under the status message, routed back with ComponentRouter using ControlsTag
+  static constexpr uint8_t ControlsTag = 'P';
+  enum class Control : uint8_t
+  {
+    Pause = 'p',
+    Resume = 'r',
+    Skip = 's',
+    Stop = 'x',
+    Mute = 'm'
+  };
+
+  // What the message shows, edits are skipped while it doesn't change
+  struct DisplayState
+  {
+    uint8_t Phase = 0; // 0 work, 1 break
+    uint16_t Number = 0;
+    uint32_t Value = 0;
+    bool InSeconds = 0;
+    bool Paused = 0;
+    bool Muted = 0;
+    bool operator==(DisplayState const &) const = default;
+  };
+
+  explicit StatusBoard(SessionManager &manager) noexcept;
+  ~StatusBoard();
+  StatusBoard(StatusBoard const &) = delete;
+  StatusBoard &operator=(StatusBoard const &) = delete;
+
+  /*
+     @brief Posts and pins the status message of a session
+  */
+  void Track(uint32_t handle, snflake channel_id, loc::Locale locale = loc::Locale::En) noexcept;
+
+  /*
+     @brief Stops updating a session, its message is edited one last time and unpinned
+  */
+  void Untrack(uint32_t handle) noexcept;
+
+  /*
+     @brief Stops updating a session that moves to another process, its message is left as it is
+     @return id of the message for Adopt, 0 if it wasn't created yet
+  */
+  snflake Release(uint32_t handle) noexcept;
+
+  /*
+     @brief Takes over the message of a session handed over by another process, it's rewritten on the next tick so
+     its buttons carry the new handle; without a message_id a new message is posted like Track
+  */
+  void Adopt(uint32_t handle, snflake channel_id, loc::Locale locale, snflake message_id) noexcept;
+
+  /*
+     @brief Current minute granularity of the countdown, 1 unless the edit budget is short
+  */
+  uint32_t GetGranularity() const noexcept
+  {
+    return GranularityLevels[_level];
+  }
+
+  size_t Tracked() noexcept
+  {
+    std::lock_guard lock(_mtx);
+    return _entries.size();
+  }
+
+  SessionManager &ManagerRef;
+
+private:
+  struct Entry
+  {
+    snflake ChannelId;
+    snflake MessageId;
+    loc::Locale Locale;
+    DisplayState Shown;
+    clock::time_point LastEdit;
+    bool InFlight = 0; // create or edit not answered yet, edits are merged until it is
+  };
+
+  static constexpr uint32_t GranularityLevels[] = {1, 2, 5, 10};
+
+  bool GetState(uint32_t handle, DisplayState &out) const noexcept;
+  void Tick() noexcept;
+  void Edit(uint32_t handle, Entry &entry, DisplayState const &state) noexcept;
+
+  std::mutex _mtx;
+  std::unordered_map<uint32_t, Entry> _entries;
+  dpp::timer _timer = 0;
+  double _tokens = 0;
+  uint32_t _level = 0;     // index in GranularityLevels
+  uint32_t _idle_ticks = 0; // ticks with budget to spare, used to narrow the granularity back
+};
+
+#endif
@@ -0,0 +1,180 @@
+#include "webhook_pool.h"
+#include "load_shedder.h"
+#include "utils.h"
+#include <fmt/format.h>
+
+constexpr auto DeniedFor = std::chrono::hours(1); // permissions are rarely fixed sooner
+constexpr uint32_t UnknownWebhook = 10015; // deleted by someone in the guild
+
+WebhookPool::WebhookPool(dpp::cluster &bot) noexcept : Bot(bot)
+{
+}
+
+void WebhookPool::Record(PathStats &stats, clock::time_point sent, bool failed) noexcept
+{
+  using namespace std::chrono;
+  uint64_t ms = duration_cast<milliseconds>(clock::now() - sent).count();
+  (failed ? stats.Failed : stats.Sent).fetch_add(1, std::memory_order_relaxed);
+  uint64_t seen = stats.MaxMs.load(std::memory_order_relaxed);
+  while (seen < ms && !stats.MaxMs.compare_exchange_weak(seen, ms, std::memory_order_relaxed))
+    ;
+}
+
+void WebhookPool::SendAsBot(snflake channel_id, std::string content) noexcept
+{
+  Bot.message_create(
+      dpp::message(channel_id, std::move(content)),
+      shed::Tracked([this, sent = clock::now()](dpp::confirmation_callback_t const &cb)
+                    { Record(_plain, sent, cb.is_error()); }));
+}
+
+void WebhookPool::Post(snflake channel_id, std::string content) noexcept
+{
+  std::unique_lock lock(_mtx);
+  auto [it, inserted] = _channels.try_emplace(channel_id);
+  Channel &c = it->second;
+  if (c.Status != State::Ready)
+  {
+    bool look = inserted || (c.Status == State::Denied && clock::now() - c.Since >= DeniedFor);
+    if (look)
+    {
+      c.Status = State::Looking;
+      c.Since = clock::now();
+    }
+    lock.unlock();
+    if (look)
+      Lookup(channel_id);
+    SendAsBot(channel_id, std::move(content));
+    return;
+  }
+
+  dpp::webhook hook = c.Hook;
+  lock.unlock();
+  dpp::message msg(channel_id, content);
+  Bot.execute_webhook(
+      hook,
+      msg,
+      0,
+      0,
+      "",
+      shed::Tracked(
+          [this, channel_id, id = hook.id, content = std::move(content), sent = clock::now()](
+              dpp::confirmation_callback_t const &cb) mutable
+          {
+            Record(_hooked, sent, cb.is_error());
+            if (!cb.is_error())
+              return;
+            // Without a 4xx the post may have gone through (a timeout, a 5xx after Discord took it), resending it
+            // as the bot could show it twice
+            if (cb.http_info.status < 400 || cb.http_info.status >= 500)
+            {
+              Bot.log(
+                  DL::ll_debug,
+                  fmt::format("Webhook post in channel {} has no definite answer, not resent", channel_id));
+              return;
+            }
+            if (cb.get_error().code == UnknownWebhook)
+            {
+              std::lock_guard lock(_mtx);
+              if (auto it = _channels.find(channel_id); it != _channels.end() && it->second.Hook.id == id)
+                _channels.erase(it); // made again on the next post
+            }
+            SendAsBot(channel_id, std::move(content));
+          }));
+}
+
+void WebhookPool::Forget(snflake channel_id) noexcept
+{
+  std::lock_guard lock(_mtx);
+  _channels.erase(channel_id);
+}
+
+// Webhooks ---------
+
+// A webhook made by an earlier run is reused, a channel holds at most 15
+void WebhookPool::Lookup(snflake channel_id) noexcept
+{
+  Bot.get_channel_webhooks(
+      channel_id,
+      shed::Tracked(
+          [this, channel_id](dpp::confirmation_callback_t const &cb)
+          {
+            if (cb.is_error())
+            {
+              Settle(channel_id, nullptr, cb.get_error().message);
+              return;
+            }
+            for (auto const &[_, hook] : cb.get<dpp::webhook_map>())
+              if (hook.user_id == Bot.me.id && hook.name == Name && !hook.token.empty())
+              {
+                Settle(channel_id, &hook, "");
+                return;
+              }
+            Create(channel_id);
+          }));
+}
+
+void WebhookPool::Create(snflake channel_id) noexcept
+{
+  dpp::webhook hook;
+  hook.channel_id = channel_id;
+  hook.name = Name;
+  if (!AvatarPng.empty())
+    hook.load_image(AvatarPng, dpp::i_png);
+  Bot.create_webhook(
+      hook,
+      shed::Tracked(
+          [this, channel_id](dpp::confirmation_callback_t const &cb)
+          {
+            if (cb.is_error())
+            {
+              Settle(channel_id, nullptr, cb.get_error().message);
+              return;
+            }
+            auto hook = cb.get<dpp::webhook>();
+            Settle(channel_id, &hook, "");
+          }));
+}
+
+void WebhookPool::Settle(snflake channel_id, dpp::webhook const *hook, std::string_view error) noexcept
+{
+  std::lock_guard lock(_mtx);
+  auto it = _channels.find(channel_id);
+  if (it == _channels.end()) // Forgotten meanwhile
+    return;
+
+  Channel &c = it->second;
+  c.Since = clock::now();
+  if (hook)
+  {
+    c.Status = State::Ready;
+    c.Hook = *hook;
+    return;
+  }
+  // Missing Manage Webhooks, missing access or the channel's webhooks are used up: posts go out as the bot
+  c.Status = State::Denied;
+  Bot.log(DL::ll_debug, fmt::format("No webhook in channel {}, posting as the bot: {}", channel_id, error));
+}
+
+std::string WebhookPool::Report() noexcept
+{
+  size_t ready = 0, channels;
+  {
+    std::lock_guard lock(_mtx);
+    channels = _channels.size();
+    for (auto const &[_, c] : _channels)
+      ready += c.Status == State::Ready;
+  }
+  auto take = [](std::atomic<uint64_t> &v) { return v.exchange(0, std::memory_order_relaxed); };
+  return fmt::format(
+      "Webhooks: {}/{} channels hooked, {} posts ({} failed, worst {}ms) through webhooks, {} ({} failed, worst "
+      "{}ms) as the bot",
+      ready,
+      channels,
+      take(_hooked.Sent),
+      take(_hooked.Failed),
+      take(_hooked.MaxMs),
+      take(_plain.Sent),
+      take(_plain.Failed),
+      take(_plain.MaxMs));
+}
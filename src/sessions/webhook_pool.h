@@ -0,0 +1,89 @@
+#ifndef WEBHOOK_POOL_H
+#define WEBHOOK_POOL_H
+#include <atomic>
+#include "clock.h"
+#include <chrono>
+#include <cstdint>
+#include <dpp/cluster.h>
+#include <dpp/snowflake.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/*
+   Posts phase announcements and session notices through one webhook per channel.
+   A webhook has its own rate-limit bucket, so a busy channel's announcements don't queue behind the bot's other
+   messages in it, and it shows its own name and avatar. The webhook of a channel is looked up (one the bot made
+   before a restart) or created on the first post and kept; until it's ready, and in channels where the bot can't
+   manage webhooks, posts go out as plain bot messages.
+*/
+class WebhookPool
+{
+  using snflake = dpp::snowflake;
+  using clock = utl::Clock;
+
+public:
+  explicit WebhookPool(dpp::cluster &bot) noexcept;
+  WebhookPool(WebhookPool const &) = delete;
+  WebhookPool &operator=(WebhookPool const &) = delete;
+
+  /*
+     @brief Posts content in channel_id, through its webhook when there's one. A webhook post Discord refused (4xx)
+     is sent again as the bot, one without an answer isn't since it may have been shown
+  */
+  void Post(snflake channel_id, std::string content) noexcept;
+
+  /*
+     @brief Drops the channel's webhook from the pool, for channels that no longer exist
+  */
+  void Forget(snflake channel_id) noexcept;
+
+  /*
+     @brief Posts and their worst time to be answered since the last report, per path
+  */
+  std::string Report() noexcept;
+
+  size_t Channels() noexcept
+  {
+    std::lock_guard lock(_mtx);
+    return _channels.size();
+  }
+
+  dpp::cluster &Bot;
+  std::string Name = "Pomodoro"; // shown as the author of the posts, set before the first post
+  std::string AvatarPng;         // image data, the default avatar if empty
+
+private:
+  enum class State : uint8_t
+  {
+    Looking, // get_channel_webhooks or create_webhook not answered yet
+    Ready,
+    Denied // no permission or no room for another webhook, retried after DeniedFor
+  };
+
+  struct Channel
+  {
+    State Status = State::Looking;
+    dpp::webhook Hook;
+    clock::time_point Since;
+  };
+
+  struct PathStats
+  {
+    std::atomic<uint64_t> Sent{0};
+    std::atomic<uint64_t> Failed{0};
+    std::atomic<uint64_t> MaxMs{0};
+  };
+
+  void Lookup(snflake channel_id) noexcept;
+  void Create(snflake channel_id) noexcept;
+  void Settle(snflake channel_id, dpp::webhook const *hook, std::string_view error) noexcept;
+  void SendAsBot(snflake channel_id, std::string content) noexcept;
+  static void Record(PathStats &stats, clock::time_point sent, bool failed) noexcept;
+
+  std::mutex _mtx;
+  std::unordered_map<snflake, Channel> _channels;
+  PathStats _hooked, _plain;
+};
+
+#endif
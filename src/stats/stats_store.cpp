@@ -0,0 +1,273 @@
+#include "stats_store.h"
+#include "utils.h"
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fmt/format.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr const char LogMagic[4] = {'P', 'M', 'S', 'T'};
+constexpr uint32_t LogVersion = 1;
+constexpr uint64_t InitialCapacity = 4096; // events
+
+size_t StatsStore::BytesFor(uint64_t count) noexcept
+{
+  return sizeof(LogHeader) + sizeof(Event) * count;
+}
+
+StatsStore::StatsStore(dpp::cluster &bot, const char *path) noexcept : Bot(bot)
+{
+  if (!OpenLog(path))
+  {
+    Bot.log(DL::ll_warning, fmt::format("Stats log '{}' unavailable, stats are kept in memory only", path));
+    return;
+  }
+
+  Event const *events = reinterpret_cast<Event const *>(_header + 1);
+  for (; _applied < _header->Count; ++_applied)
+    Apply(events[_applied]);
+
+  Bot.log(DL::ll_info, fmt::format("Stats store init, {} events loaded", _header->Count));
+}
+
+StatsStore::~StatsStore()
+{
+  if (_header)
+  {
+    msync(_header, _mapped_bytes, MS_SYNC);
+    munmap(_header, _mapped_bytes);
+  }
+  if (_fd != -1)
+    close(_fd);
+}
+
+// Log --------------
+
+bool StatsStore::OpenLog(const char *path) noexcept
+{
+  std::error_code ec;
+  auto parent = std::filesystem::path(path).parent_path();
+  if (!parent.empty())
+    std::filesystem::create_directories(parent, ec);
+
+  _fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (_fd == -1)
+    return 0;
+
+  // Processes starting together set a fresh log up once
+  if (flock(_fd, LOCK_EX) == -1)
+    return 0;
+  bool mapped = MapLog();
+  flock(_fd, LOCK_UN);
+  return mapped;
+}
+
+bool StatsStore::MapLog() noexcept
+{
+  struct stat st;
+  if (fstat(_fd, &st) == -1)
+    return 0;
+
+  bool fresh = st.st_size == 0;
+  if (!fresh && static_cast<size_t>(st.st_size) < sizeof(LogHeader))
+    return 0;
+
+  _mapped_bytes = fresh ? BytesFor(InitialCapacity) : st.st_size;
+  if (fresh && ftruncate(_fd, _mapped_bytes) == -1)
+    return 0;
+
+  void *p = mmap(nullptr, _mapped_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+  if (p == MAP_FAILED)
+  {
+    _mapped_bytes = 0;
+    return 0;
+  }
+  _header = static_cast<LogHeader *>(p);
+
+  if (fresh)
+  {
+    std::memcpy(_header->Magic, LogMagic, sizeof(LogMagic));
+    _header->Version = LogVersion;
+    _header->Count = 0;
+    return 1;
+  }
+
+  if (std::memcmp(_header->Magic, LogMagic, sizeof(LogMagic)) != 0 || _header->Version != LogVersion ||
+      BytesFor(_header->Count) > _mapped_bytes)
+  {
+    munmap(_header, _mapped_bytes);
+    _header = nullptr;
+    _mapped_bytes = 0;
+    return 0;
+  }
+  return 1;
+}
+
+bool StatsStore::CatchUp() noexcept
+{
+  struct stat st;
+  if (fstat(_fd, &st) == -1)
+    return 0;
+  if (static_cast<size_t>(st.st_size) > _mapped_bytes)
+  {
+    void *p = mremap(_header, _mapped_bytes, st.st_size, MREMAP_MAYMOVE);
+    if (p == MAP_FAILED)
+      return 0;
+    _header = static_cast<LogHeader *>(p);
+    _mapped_bytes = st.st_size;
+  }
+  if (BytesFor(_header->Count) > _mapped_bytes)
+    return 0;
+
+  Event const *events = reinterpret_cast<Event const *>(_header + 1);
+  for (; _applied < _header->Count; ++_applied)
+    Apply(events[_applied]);
+  return 1;
+}
+
+bool StatsStore::Reserve(uint64_t count) noexcept
+{
+  // Called after CatchUp, the mapping covers the whole file and growing it never shrinks what another process wrote
+  if (BytesFor(count) <= _mapped_bytes)
+    return 1;
+
+  size_t new_size = _mapped_bytes * 2;
+  while (new_size < BytesFor(count))
+    new_size *= 2;
+
+  if (ftruncate(_fd, new_size) == -1)
+    return 0;
+
+  void *p = mremap(_header, _mapped_bytes, new_size, MREMAP_MAYMOVE);
+  if (p == MAP_FAILED)
+    return 0;
+
+  _header = static_cast<LogHeader *>(p);
+  _mapped_bytes = new_size;
+  return 1;
+}
+
+void StatsStore::Append(Event const &e) noexcept
+{
+  if (!_header)
+  {
+    _mem_count++;
+    return;
+  }
+
+  if (!Reserve(_header->Count + 1))
+  {
+    Bot.log(DL::ll_error, "Stats log couldn't grow, event is kept in memory only");
+    return;
+  }
+
+  reinterpret_cast<Event *>(_header + 1)[_header->Count] = e;
+  _header->Count++; // Count is bumped after the record so a crash never exposes a torn event
+  _applied = _header->Count;
+}
+
+// Aggregates -------
+
+void StatsStore::Apply(Event const &e) noexcept
+{
+  auto &guild = _guilds[e.GuildId];
+  auto &usr = guild.Users[e.UserId];
+
+  switch (e.Kind)
+  {
+  case EventKind::SessionJoined:
+    usr.SessionsJoined++;
+    break;
+  case EventKind::WorkPhaseCompleted:
+  {
+    // The ranking node is moved to the new total rather than freed and allocated again
+    using Node = decltype(guild.Ranking)::node_type;
+    Node node = usr.WorkMinutes ? guild.Ranking.extract({usr.WorkMinutes, e.UserId}) : Node();
+    usr.WorkMinutes += e.Minutes;
+    usr.WorkPhases++;
+    if (node)
+    {
+      node.value() = {usr.WorkMinutes, e.UserId};
+      guild.Ranking.insert(std::move(node));
+    }
+    else
+      guild.Ranking.insert({usr.WorkMinutes, e.UserId});
+    break;
+  }
+  case EventKind::SessionCompleted:
+    usr.SessionsCompleted++;
+    break;
+  case EventKind::SessionCanceled:
+    usr.SessionsCanceled++;
+    break;
+  }
+}
+
+void StatsStore::Record(snflake guild_id, std::span<const snflake> members, EventKind kind, uint16_t minutes) noexcept
+{
+  using namespace std::chrono;
+  uint32_t now = duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+
+  std::lock_guard lock(_mtx);
+  // Other processes append to the same log, the flock orders the appends and their events are applied first
+  bool logged = !_header || (flock(_fd, LOCK_EX) == 0 && CatchUp());
+  if (!logged)
+    Bot.log(DL::ll_error, "Stats log couldn't be locked, events are kept in memory only");
+  for (auto id : members)
+  {
+    Event e{guild_id, id, now, minutes, kind, 0};
+    if (logged)
+      Append(e);
+    Apply(e);
+  }
+  if (_header)
+    flock(_fd, LOCK_UN);
+}
+
+void StatsStore::RecordSessionJoined(snflake guild_id, std::span<const snflake> members) noexcept
+{
+  Record(guild_id, members, EventKind::SessionJoined, 0);
+}
+
+void StatsStore::RecordWorkPhase(snflake guild_id, std::span<const snflake> members, uint16_t minutes) noexcept
+{
+  Record(guild_id, members, EventKind::WorkPhaseCompleted, minutes);
+}
+
+void StatsStore::RecordSessionEnd(snflake guild_id, std::span<const snflake> members, bool completed) noexcept
+{
+  Record(guild_id, members, completed ? EventKind::SessionCompleted : EventKind::SessionCanceled, 0);
+}
+
+// Queries ----------
+
+StatsStore::UserStats StatsStore::GetUserStats(snflake guild_id, snflake usr_id) const noexcept
+{
+  std::lock_guard lock(_mtx);
+  auto g = _guilds.find(guild_id);
+  if (g == _guilds.end())
+    return {};
+
+  auto u = g->second.Users.find(usr_id);
+  return u == g->second.Users.end() ? UserStats{} : u->second;
+}
+
+size_t StatsStore::GetLeaderboard(snflake guild_id, LeaderboardEntry *out, size_t k) const noexcept
+{
+  std::lock_guard lock(_mtx);
+  auto g = _guilds.find(guild_id);
+  if (g == _guilds.end())
+    return 0;
+
+  size_t n = 0;
+  for (auto it = g->second.Ranking.begin(); it != g->second.Ranking.end() && n < k; ++it, ++n)
+  {
+    auto const &usr = g->second.Users.at(it->second);
+    out[n] = {it->second, usr.WorkMinutes, usr.WorkPhases};
+  }
+  return n;
+}
@@ -0,0 +1,136 @@
+#ifndef STATS_STORE_H
+#define STATS_STORE_H
+#include <cstddef>
+#include <cstdint>
+#include <dpp/cluster.h>
+#include <dpp/snowflake.h>
+#include <mutex>
+#include <set>
+#include <span>
+#include <unordered_map>
+
+class StatsStore
+{
+  using snflake = dpp::snowflake;
+
+public:
+  enum class EventKind : uint8_t
+  {
+    SessionJoined = 0,
+    WorkPhaseCompleted = 1,
+    SessionCompleted = 2,
+    SessionCanceled = 3
+  };
+
+  // On-disk record, the log is an array of these after the header
+  struct Event
+  {
+    uint64_t GuildId;
+    uint64_t UserId;
+    uint32_t Timestamp; // unix seconds
+    uint16_t Minutes;
+    EventKind Kind;
+    uint8_t Reserved;
+  };
+  static_assert(sizeof(Event) == 24, "Event layout is part of the file format");
+
+  struct UserStats
+  {
+    uint64_t WorkMinutes = 0;
+    uint32_t WorkPhases = 0;
+    uint32_t SessionsJoined = 0;
+    uint32_t SessionsCompleted = 0;
+    uint32_t SessionsCanceled = 0;
+
+    /*
+       @brief completed sessions over joined sessions
+       @return value in [0, 1], 0 if the user never joined a session
+    */
+    double CompletionRate() const noexcept
+    {
+      return SessionsJoined ? static_cast<double>(SessionsCompleted) / SessionsJoined : 0.0;
+    }
+  };
+
+  struct LeaderboardEntry
+  {
+    snflake UserId;
+    uint64_t WorkMinutes;
+    uint32_t WorkPhases;
+  };
+
+  /*
+     @brief Opens (or creates) the event log at path and rebuilds the aggregates from it.
+     if the log can't be opened the store keeps working in memory only.
+     Processes sharing the log append under an flock on it, each one applies the others' events when it records.
+  */
+  StatsStore(dpp::cluster &bot, const char *path) noexcept;
+  ~StatsStore();
+  StatsStore(StatsStore const &) = delete;
+  StatsStore &operator=(StatsStore const &) = delete;
+
+  void RecordSessionJoined(snflake guild_id, std::span<const snflake> members) noexcept;
+  void RecordWorkPhase(snflake guild_id, std::span<const snflake> members, uint16_t minutes) noexcept;
+  void RecordSessionEnd(snflake guild_id, std::span<const snflake> members, bool completed) noexcept;
+
+  /*
+     @brief Get the aggregated stats of a user in a guild
+     @return copy of the stats, all zeros if the user has no recorded events
+  */
+  UserStats GetUserStats(snflake guild_id, snflake usr_id) const noexcept;
+
+  /*
+     @brief Writes the top k users of a guild ordered by work minutes, costs O(k)
+     @param out array with room for at least k entries
+     @return number of entries written
+  */
+  size_t GetLeaderboard(snflake guild_id, LeaderboardEntry *out, size_t k) const noexcept;
+
+  uint64_t GetEventCount() const noexcept
+  {
+    return _header ? _header->Count : _mem_count;
+  }
+
+  dpp::cluster &Bot;
+
+private:
+  struct LogHeader
+  {
+    char Magic[4];
+    uint32_t Version;
+    uint64_t Count;
+  };
+
+  // (minutes, user) ordered descending so begin() is the top of the board
+  using RankKey = std::pair<uint64_t, uint64_t>;
+
+  struct GuildStats
+  {
+    std::unordered_map<uint64_t, UserStats> Users;
+    std::set<RankKey, std::greater<RankKey>> Ranking;
+  };
+
+  static size_t BytesFor(uint64_t count) noexcept;
+  bool OpenLog(const char *path) noexcept;
+  bool MapLog() noexcept;
+  /*
+     @brief Maps what other processes appended to the log and applies their events, call with the log's flock held
+     @return false if the log couldn't be mapped
+  */
+  bool CatchUp() noexcept;
+  bool Reserve(uint64_t count) noexcept;
+  void Append(Event const &e) noexcept;
+  void Apply(Event const &e) noexcept;
+  void Record(snflake guild_id, std::span<const snflake> members, EventKind kind, uint16_t minutes) noexcept;
+
+  mutable std::mutex _mtx;
+  std::unordered_map<uint64_t, GuildStats> _guilds;
+
+  int _fd = -1;
+  LogHeader *_header = nullptr; // start of the mapping
+  size_t _mapped_bytes = 0;
+  uint64_t _applied = 0;   // events of the log in the aggregates, the processes of other clusters append to it too
+  uint64_t _mem_count = 0; // used when the log isn't available
+};
+
+#endif
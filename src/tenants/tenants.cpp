@@ -0,0 +1,93 @@
+#include "tenants.h"
+#include "loadcommands.h"
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+namespace tenant
+{
+bool Load(const char *path, std::vector<Config> &out, std::string &error)
+{
+  std::ifstream file(path);
+  if (!file)
+  {
+    error = fmt::format("Couldn't open '{}'", path);
+    return 0;
+  }
+
+  std::string line;
+  for (size_t line_no = 1; std::getline(file, line); ++line_no)
+  {
+    std::istringstream fields(line);
+    std::string name, token_var, extra;
+    if (!(fields >> name) || name[0] == '#')
+      continue;
+    if (!(fields >> token_var) || (fields >> extra && extra[0] != '#'))
+    {
+      error = fmt::format("{}:{}: expected '<name> <token env var>'", path, line_no);
+      return 0;
+    }
+    for (auto const &t : out)
+      if (t.Name == name)
+      {
+        error = fmt::format("{}:{}: tenant '{}' is listed twice", path, line_no, name);
+        return 0;
+      }
+    const char *token = getenv(token_var.c_str());
+    if (!token || !*token)
+    {
+      error = fmt::format("{}:{}: no token in env var {} for tenant '{}'", path, line_no, token_var, name);
+      return 0;
+    }
+    if (out.size() == MaxTenants)
+    {
+      error = fmt::format("{}: more than {} tenants", path, MaxTenants);
+      return 0;
+    }
+    out.push_back({std::move(name), token});
+  }
+
+  if (out.empty())
+  {
+    error = fmt::format("No tenants in '{}'", path);
+    return 0;
+  }
+  return 1;
+}
+
+uint64_t ResidentKiB() noexcept
+{
+  std::ifstream statm("/proc/self/statm");
+  uint64_t size, resident;
+  if (!(statm >> size >> resident))
+    return 0;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+uint64_t OpenFds() noexcept
+{
+  std::error_code ec;
+  uint64_t n = 0;
+  for (std::filesystem::directory_iterator it("/proc/self/fd", ec), end; !ec && it != end; it.increment(ec))
+    n++;
+  return n ? n - 1 : 0; // the iterator's own descriptor
+}
+
+Tenant::Tenant(
+    std::string name,
+    dpp::cluster &bot,
+    uint8_t index,
+    StatsStore &stats,
+    CueComposer &cues,
+    RecurringScheduler &scheduler,
+    ProfileStore &profiles) noexcept
+    : Name(std::move(name)), Bot(bot), Manager(bot, stats, cues, index), Handler(Manager, scheduler, profiles), Commands(bot)
+{
+  LoadAllCommands(Commands, Handler);
+  LoadAllComponents(Components, Handler);
+  scheduler.Attach(Manager);
+}
+} // namespace tenant
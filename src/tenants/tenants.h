@@ -0,0 +1,75 @@
+#ifndef TENANTS_H
+#define TENANTS_H
+#include "component_router.h"
+#include "pomodoro.h"
+#include "registry.h"
+#include <cstdint>
+#include <dpp/cluster.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+   Multi-tenant mode: one process hosts several bots (tenants), each with its own token, cluster, sessions and
+   command registry. The audio cues, the recurring scheduler, the stats store, the rate limiter and the load
+   shedder are shared by all of them.
+
+   Tenants come from the file named by POMODORO_TENANTS, one per line: a name and the env var holding its token,
+       # name   token env var
+       study    DisBotTok
+       focus    FocusBotTok
+   Schedules remember the tenant by its position in the file, add new tenants at the end.
+   Without POMODORO_TENANTS the process runs a single tenant from DisBotTok.
+*/
+namespace tenant
+{
+constexpr size_t MaxTenants = 32;
+
+struct Config
+{
+  std::string Name;
+  std::string Token;
+};
+
+/*
+   @brief Reads the tenant list
+   @param error set to what's wrong when it returns false
+   @return false if the file can't be read, a line is malformed, a token is missing or there are no tenants
+*/
+bool Load(const char *path, std::vector<Config> &out, std::string &error);
+
+/*
+   @return resident set size of the process in KiB, 0 if it can't be read
+*/
+uint64_t ResidentKiB() noexcept;
+
+/*
+   @return file descriptors the process has open, 0 if /proc can't be read
+*/
+uint64_t OpenFds() noexcept;
+
+// The state a tenant doesn't share, its cluster is owned by main
+struct Tenant
+{
+  Tenant(
+      std::string name,
+      dpp::cluster &bot,
+      uint8_t index,
+      StatsStore &stats,
+      CueComposer &cues,
+      RecurringScheduler &scheduler,
+      ProfileStore &profiles) noexcept;
+  Tenant(Tenant const &) = delete;
+  Tenant &operator=(Tenant const &) = delete;
+
+  std::string Name;
+  dpp::cluster &Bot;
+  SessionManager Manager;
+  Pomodoro Handler;
+  Registry Commands;
+  ComponentRouter Components;
+  std::once_flag Ready; // slash commands are registered once per tenant
+};
+} // namespace tenant
+
+#endif
@@ -0,0 +1,276 @@
+#include "topology.h"
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fmt/format.h>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <string_view>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+namespace topo
+{
+constexpr size_t MaxThreads = 64; // threads past that are placed but left out of the report
+
+struct Slot
+{
+  std::atomic<pid_t> Tid{0}; // 0 while the slot is free
+  std::atomic<Role> Took{Role::None};
+  std::atomic<int> Error{0}; // errno of the placement, 0 if it went through
+};
+
+static Slot slots[MaxThreads];
+static Layout layout;
+static std::atomic<bool> started{0};
+
+// Never destroyed, the audio thread is still waiting on it while statics are torn down at exit
+struct AudioQueue
+{
+  std::mutex Mtx;
+  std::condition_variable Cv;
+  std::deque<std::function<void()>> Jobs;
+};
+static AudioQueue &audio = *new AudioQueue;
+
+static pid_t ThisTid() noexcept
+{
+  thread_local pid_t tid = syscall(SYS_gettid);
+  return tid;
+}
+
+static const char *Name(Role role) noexcept
+{
+  constexpr const char *names[] = {"none", "events", "audio", "timer"};
+  return names[static_cast<uint8_t>(role)];
+}
+
+// Parsing ----------
+
+// "0-1,4", empty for any CPU
+static bool ParseCpus(std::string_view s, uint64_t &out) noexcept
+{
+  out = 0;
+  while (!s.empty())
+  {
+    size_t comma = s.find(',');
+    std::string_view range = s.substr(0, comma);
+    s = comma == s.npos ? std::string_view{} : s.substr(comma + 1);
+
+    unsigned from, to;
+    size_t dash = range.find('-');
+    std::string_view first = range.substr(0, dash), last = dash == range.npos ? first : range.substr(dash + 1);
+    if (std::from_chars(first.begin(), first.end(), from).ptr != first.end() ||
+        std::from_chars(last.begin(), last.end(), to).ptr != last.end() || first.empty() || last.empty() ||
+        from > to || to >= 64)
+      return 0;
+    for (unsigned cpu = from; cpu <= to; ++cpu)
+      out |= uint64_t(1) << cpu;
+  }
+  return 1;
+}
+
+static bool ParsePlacement(std::string_view s, Placement &out) noexcept
+{
+  size_t slash = s.find('/');
+  if (!ParseCpus(s.substr(0, slash), out.Cpus))
+    return 0;
+  if (slash == s.npos)
+    return 1;
+  std::string_view prio = s.substr(slash + 1);
+  auto [end, ec] = std::from_chars(prio.begin(), prio.end(), out.Priority);
+  return ec == std::errc{} && end == prio.end() && out.Priority <= 99 && out.Priority >= -20;
+}
+
+bool Parse(const char *spec, Layout &out, std::string &error) noexcept
+{
+  out = {};
+  std::string_view s = spec ? spec : "";
+  while (!s.empty())
+  {
+    size_t semi = s.find(';');
+    std::string_view item = s.substr(0, semi);
+    s = semi == s.npos ? std::string_view{} : s.substr(semi + 1);
+    if (item.empty())
+      continue;
+
+    size_t eq = item.find('=');
+    std::string_view role = item.substr(0, eq);
+    Placement *p = role == "timer"    ? &out.Timer
+                   : role == "audio"  ? &out.Audio
+                   : role == "events" ? &out.Events
+                                      : nullptr;
+    if (!p || eq == item.npos || !ParsePlacement(item.substr(eq + 1), *p))
+    {
+      error = fmt::format("bad thread placement '{}', expected timer|audio|events=<cpus>[/<prio>]", item);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Placement --------
+
+static int Apply(Placement const &p) noexcept
+{
+  int err = 0;
+  if (p.Cpus)
+  {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned cpu = 0; cpu < 64; ++cpu)
+      if (p.Cpus >> cpu & 1)
+        CPU_SET(cpu, &set);
+    err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+  if (p.Priority > 0)
+  {
+    sched_param param{};
+    param.sched_priority = p.Priority;
+    if (int e = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param))
+      err = e; // EPERM without CAP_SYS_NICE or an RLIMIT_RTPRIO
+  }
+  else if (p.Priority < 0 && setpriority(PRIO_PROCESS, ThisTid(), p.Priority) == -1)
+    err = errno;
+  return err;
+}
+
+static Placement const &For(Role role) noexcept
+{
+  return role == Role::Timer ? layout.Timer : role == Role::Audio ? layout.Audio : layout.Events;
+}
+
+void Adopt(Role role) noexcept
+{
+  thread_local Role mine = Role::None;
+  if (mine >= role)
+    return;
+  mine = role;
+  int err = Apply(For(role));
+
+  pid_t tid = ThisTid();
+  for (auto &s : slots)
+  {
+    pid_t seen = s.Tid.load(std::memory_order_relaxed);
+    if (seen != tid && (seen || !s.Tid.compare_exchange_strong(seen, tid)))
+      continue;
+    s.Error.store(err, std::memory_order_relaxed);
+    s.Took.store(role, std::memory_order_release);
+    return;
+  }
+}
+
+// Audio thread -----
+
+void Start(Layout const &l) noexcept
+{
+  layout = l;
+  started.store(1, std::memory_order_release);
+  std::thread(
+      []
+      {
+        Adopt(Role::Audio);
+        std::unique_lock lock(audio.Mtx);
+        for (;;)
+        {
+          audio.Cv.wait(lock, [] { return !audio.Jobs.empty(); });
+          auto job = std::move(audio.Jobs.front());
+          audio.Jobs.pop_front();
+          lock.unlock();
+          job();
+          lock.lock();
+        }
+      })
+      .detach();
+}
+
+void PostAudio(std::function<void()> job) noexcept
+{
+  if (!started.load(std::memory_order_acquire)) // tools and tests without a layout run it in place
+  {
+    job();
+    return;
+  }
+  {
+    std::lock_guard lock(audio.Mtx);
+    audio.Jobs.push_back(std::move(job));
+  }
+  audio.Cv.notify_one();
+}
+
+// Report -----------
+
+static std::string CpuList(uint64_t cpus)
+{
+  if (!cpus)
+    return "any";
+  std::string out;
+  for (unsigned cpu = 0; cpu < 64; ++cpu)
+  {
+    if (!(cpus >> cpu & 1))
+      continue;
+    unsigned last = cpu;
+    while (last + 1 < 64 && cpus >> (last + 1) & 1)
+      last++;
+    out += out.empty() ? "" : ",";
+    out += last == cpu ? fmt::format("{}", cpu) : fmt::format("{}-{}", cpu, last);
+    cpu = last;
+  }
+  return out;
+}
+
+static std::string Describe(Placement const &p)
+{
+  if (p.Priority > 0)
+    return fmt::format("cpus {}, fifo {}", CpuList(p.Cpus), p.Priority);
+  return fmt::format("cpus {}, nice {}", CpuList(p.Cpus), p.Priority);
+}
+
+std::string Report()
+{
+  std::string out = fmt::format(
+      "Threads: timer {}; audio {}; events {}",
+      Describe(layout.Timer),
+      Describe(layout.Audio),
+      Describe(layout.Events));
+  for (auto const &s : slots)
+  {
+    pid_t tid = s.Tid.load(std::memory_order_relaxed);
+    if (!tid)
+      continue;
+    Role role = s.Took.load(std::memory_order_acquire);
+
+    // What the kernel has now, the placement may have been refused
+    Placement now;
+    cpu_set_t set;
+    if (sched_getaffinity(tid, sizeof(set), &set) == -1)
+    {
+      out += fmt::format("\n  {:<6} thread {}: gone", Name(role), tid);
+      continue;
+    }
+    for (unsigned cpu = 0; cpu < 64; ++cpu)
+      if (CPU_ISSET(cpu, &set))
+        now.Cpus |= uint64_t(1) << cpu;
+    sched_param param{};
+    if (sched_getscheduler(tid) == SCHED_FIFO && sched_getparam(tid, &param) == 0)
+      now.Priority = param.sched_priority;
+    else
+      now.Priority = getpriority(PRIO_PROCESS, tid);
+
+    int err = s.Error.load(std::memory_order_relaxed);
+    out += fmt::format(
+        "\n  {:<6} thread {}: {}{}",
+        Name(role),
+        tid,
+        Describe(now),
+        err ? fmt::format(" ({})", std::strerror(err)) : "");
+  }
+  return out;
+}
+} // namespace topo
@@ -0,0 +1,66 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+#include <cstdint>
+#include <functional>
+#include <string>
+
+/*
+   Where the bot's threads run and at which priority.
+   POMODORO_THREADS="timer=<cpus>[/<prio>];audio=...;events=..." places three roles, <cpus> is a list like 2 or 0-1,4
+   (empty for any CPU) and <prio> 1..99 runs the thread SCHED_FIFO at that level, a negative one sets its nice value.
+   - timer: the thread D++ runs timers on, phase transitions, cues and the status board tick
+   - audio: a thread of its own that queues opus packets on voice connections, off the timer thread
+   - events: the shard threads that run gateway event handlers
+   D++ owns the timer and event threads, they take their placement the first time they run one of our callbacks. A
+   shard thread that also runs timers keeps the timer placement.
+*/
+namespace topo
+{
+enum class Role : uint8_t
+{
+  None,
+  Events,
+  Audio,
+  Timer // ranks above the others, a thread that has several roles takes the highest one
+};
+
+struct Placement
+{
+  uint64_t Cpus = 0; // bit per CPU below 64, 0 leaves the affinity alone
+  int Priority = 0;  // 1..99 SCHED_FIFO, negative a nice value, 0 leaves the scheduling alone
+};
+
+struct Layout
+{
+  Placement Timer, Audio, Events;
+};
+
+/*
+   @brief Parses POMODORO_THREADS, a null or empty spec is the default layout
+   @return false with error set if spec is malformed
+*/
+bool Parse(const char *spec, Layout &out, std::string &error) noexcept;
+
+/*
+   @brief Keeps layout and starts the audio thread, call once before any thread takes a role
+*/
+void Start(Layout const &layout) noexcept;
+
+/*
+   @brief Places the calling thread for role unless it already has that role or a higher one, a few ns after the
+   first call on a thread
+*/
+void Adopt(Role role) noexcept;
+
+/*
+   @brief Runs job on the audio thread, jobs run one at a time in order
+*/
+void PostAudio(std::function<void()> job) noexcept;
+
+/*
+   @brief Configured layout and the threads that took a role, with what the kernel reports for them
+*/
+std::string Report();
+} // namespace topo
+
+#endif
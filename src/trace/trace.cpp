@@ -0,0 +1,94 @@
+#include "trace.h"
+#include <csignal>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace trace
+{
+std::atomic<bool> Enabled{false};
+
+constexpr size_t RingSize = 1u << 16; // events kept per thread, older ones are overwritten
+
+struct Event
+{
+  const char *Name;
+  uint64_t Start;
+  uint64_t End;
+};
+
+// Written only by its thread, read by the exporter. A slot being rewritten during an export may come out torn,
+// which is acceptable for a diagnostic dump
+struct ThreadBuffer
+{
+  uint32_t Tid;
+  std::atomic<uint64_t> Count{0};
+  Event Events[RingSize];
+};
+
+static std::mutex registry_mtx;
+static std::vector<ThreadBuffer *> registry; // buffers are never freed, they outlive their threads for the export
+static std::atomic<bool> export_requested{false};
+
+static ThreadBuffer &LocalBuffer() noexcept
+{
+  thread_local ThreadBuffer *buffer = []
+  {
+    std::lock_guard lock(registry_mtx);
+    auto *b = new ThreadBuffer;
+    b->Tid = registry.size() + 1;
+    registry.push_back(b);
+    return b;
+  }();
+  return *buffer;
+}
+
+void Record(const char *name, uint64_t start_ns, uint64_t end_ns) noexcept
+{
+  auto &b = LocalBuffer();
+  uint64_t n = b.Count.load(std::memory_order_relaxed);
+  b.Events[n % RingSize] = {name, start_ns, end_ns};
+  b.Count.store(n + 1, std::memory_order_release);
+}
+
+bool WriteChromeJson(const char *path) noexcept
+{
+  FILE *f = fopen(path, "w");
+  if (!f)
+    return 0;
+
+  fputs("{\"traceEvents\":[", f);
+  bool first = 1;
+  std::lock_guard lock(registry_mtx);
+  for (auto *b : registry)
+  {
+    uint64_t count = b->Count.load(std::memory_order_acquire);
+    uint64_t begin = count > RingSize ? count - RingSize : 0;
+    for (uint64_t i = begin; i < count; ++i)
+    {
+      Event const &e = b->Events[i % RingSize];
+      fprintf(
+          f,
+          "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+          first ? "" : ",",
+          e.Name,
+          b->Tid,
+          e.Start / 1000.0,
+          (e.End - e.Start) / 1000.0);
+      first = 0;
+    }
+  }
+  fputs("],\"displayTimeUnit\":\"ms\"}\n", f);
+  return fclose(f) == 0;
+}
+
+void ExportOnSignal(int signo) noexcept
+{
+  std::signal(signo, [](int) { export_requested.store(true, std::memory_order_relaxed); });
+}
+
+bool TakeExportRequest() noexcept
+{
+  return export_requested.exchange(false, std::memory_order_relaxed);
+}
+} // namespace trace
@@ -0,0 +1,65 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/*
+   Lightweight tracing of the session lifecycle.
+   TRACE_SCOPE("name") records a complete event into a per-thread ring buffer; while tracing is disabled it costs a
+   relaxed load and a branch. Buffers are exported as Chrome trace-event JSON, which chrome://tracing and the
+   Perfetto UI open directly.
+*/
+namespace trace
+{
+extern std::atomic<bool> Enabled;
+
+inline uint64_t NowNs() noexcept
+{
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void Record(const char *name, uint64_t start_ns, uint64_t end_ns) noexcept;
+
+class Scope
+{
+public:
+  explicit Scope(const char *name) noexcept : _name(name), _start(Enabled.load(std::memory_order_relaxed) ? NowNs() : 0)
+  {
+  }
+  ~Scope()
+  {
+    if (_start)
+      Record(_name, _start, NowNs());
+  }
+  Scope(Scope const &) = delete;
+  Scope &operator=(Scope const &) = delete;
+
+private:
+  const char *_name; // must be a string literal, only the pointer is stored
+  uint64_t _start;
+};
+
+/*
+   @brief Writes every thread's buffered events to path as Chrome trace JSON
+   @return false if the file couldn't be written
+*/
+bool WriteChromeJson(const char *path) noexcept;
+
+/*
+   @brief Installs a handler for signo that asks for an export, the handler only sets a flag
+*/
+void ExportOnSignal(int signo) noexcept;
+
+/*
+   @brief true once after the signal was received, polled from a timer so the export runs outside the handler
+*/
+bool TakeExportRequest() noexcept;
+} // namespace trace
+
+#define TRACE_CAT_(a, b) a##b
+#define TRACE_CAT(a, b) TRACE_CAT_(a, b)
+#define TRACE_SCOPE(name) trace::Scope TRACE_CAT(_trace_scope_, __LINE__)(name)
+
+#endif
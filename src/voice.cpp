@@ -1,4 +1,9 @@
 #include "voice.h"
+#include "load_shedder.h"
+#include "opus_track.h"
+#include "topology.h"
+#include "trace.h"
+#include "watchdog.h"
 #include "utils.h"
 #include <dpp/cache.h>
 #include <dpp/cluster.h>
@@ -6,26 +11,59 @@
 #include <dpp/misc-enum.h>
 #include <dpp/snowflake.h>
 #include <dpp/timer.h>
-#include <fmt/base.h>
 #include <fmt/format.h>
-#include <opus/opusfile.h>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
 
-double ogg_opus_duration_seconds(const char *path)
+// Queues every packet of the track on the voice connection, they point into the file's mapping
+static void SendTrack(dpp::voiceconn *V, OpusTrack const &track)
 {
-  int err = 0;
-  OggOpusFile *of = op_open_file(path, &err);
-  if (!of)
+  for (auto packet : track.Packets())
   {
-    return -1.0;
+    if (!V->voiceclient || V->voiceclient->terminating)
+      break;
+    V->voiceclient->send_audio_opus(const_cast<uint8_t *>(packet.data()), packet.size());
   }
+}
 
-  ogg_int64_t total_samples = op_pcm_total(of, -1); // -1 = is for whole fle
-  op_free(of);
+// Runs send on the audio thread, off the timer thread. The shard and its connection are looked up again there, a
+// reconnect may have replaced the shard and the connection may have closed
+static void SendOnAudioThread(
+    dpp::cluster &bot, uint32_t shard_id, dpp::snowflake guild_id, std::function<void(dpp::voiceconn *)> send)
+{
+  topo::PostAudio(
+      [&bot, shard_id, guild_id, send = std::move(send)]
+      {
+        dpp::discord_client *shard = bot.get_shard(shard_id);
+        dpp::voiceconn *V = shard ? shard->get_voice(guild_id) : nullptr;
+        if (!V || !V->voiceclient)
+          return;
+        TRACE_SCOPE("voice.send");
+        watchdog::Busy busy("voice.send");
+        send(V);
+      });
+}
 
-  if (total_samples < 0)
-    return -1.0;
+static void SendCue(dpp::voiceconn *V, CueComposer::Cue const &cue)
+{
+  uint8_t const *packet = cue.Data.data();
+  for (uint32_t size : cue.Sizes)
+  {
+    if (!V->voiceclient || V->voiceclient->terminating)
+      break;
+    V->voiceclient->send_audio_opus(const_cast<uint8_t *>(packet), size);
+    packet += size;
+  }
+}
 
-  return static_cast<double>(total_samples) / 48000.0;
+static std::shared_ptr<const OpusTrack> OpenTrack(dpp::cluster &bot, const char *path_to_file)
+{
+  auto track = OpusTrack::Shared(path_to_file);
+  if (track->IsOpen())
+    return track;
+  bot.log(DL::ll_warning, fmt::format("Error in playing audio function : {}", track->Error()));
+  return nullptr;
 }
 
 inline dpp::voiceconn *HandleVoiceConnectionReady(
@@ -53,6 +91,8 @@ inline dpp::voiceconn *HandleVoiceConnectionReady(
 
 inline dpp::discord_client *FindAndJoinVoice(dpp::cluster &bot, dpp::snowflake guild_id, dpp::snowflake channel_id)
 {
+  TRACE_SCOPE("voice.connect");
+  watchdog::Busy busy("voice.connect");
   dpp::guild *guild = dpp::find_guild(guild_id);
   if (!guild)
   {
@@ -75,19 +115,18 @@ inline dpp::discord_client *FindAndJoinVoice(dpp::cluster &bot, dpp::snowflake g
 
 void PlayAudio(dpp::cluster &bot, dpp::snowflake guild_id, dpp::snowflake channel_id, const char *path_to_file)
 {
+  TRACE_SCOPE("voice.play_audio");
+  if (shed::Active(shed::Level::SkipCues)) // Voice connections are the first thing dropped under load
+    return;
   auto shard = FindAndJoinVoice(bot, guild_id, channel_id);
 
   if (!shard)
     return;
 
-  double duration = ogg_opus_duration_seconds(path_to_file);
-  OGGZ *track_og = oggz_open(path_to_file, OGGZ_READ);
-
-  if (!track_og)
-  {
-    bot.log(DL::ll_warning, fmt::format("Error in playing audio function : Couldn't open the file {}", path_to_file));
+  auto track = OpenTrack(bot, path_to_file);
+  if (!track)
     return;
-  }
+  double duration = track->Duration();
   uint32_t tries = 10;
   bot.start_timer(
       [=, &bot](dpp::timer t) mutable
@@ -96,26 +135,7 @@ void PlayAudio(dpp::cluster &bot, dpp::snowflake guild_id, dpp::snowflake channe
         if (!V)
           return;
 
-        oggz_set_read_callback(
-            track_og,
-            -1,
-            [](OGGZ *, oggz_packet *packet, long, void *user_data)
-            {
-              auto *vc = static_cast<dpp::voiceconn *>(user_data);
-              vc->voiceclient->send_audio_opus(packet->op.packet, packet->op.bytes);
-              return 0;
-            },
-            (void *)V);
-
-        while (V && V->voiceclient && !V->voiceclient->terminating)
-        {
-          static constexpr long CHUNK_READ = BUFSIZ * 2;
-          long read_bytes = oggz_read(track_og, CHUNK_READ);
-          if (read_bytes <= 0)
-            break;
-        }
-
-        oggz_close(track_og);
+        SendOnAudioThread(bot, shard->shard_id, guild_id, [track](dpp::voiceconn *V) { SendTrack(V, *track); });
 
         bot.start_timer(
             [=, &bot](dpp::timer t2)
@@ -134,18 +154,55 @@ void PlayAudio(
     dpp::cluster &bot, dpp::snowflake guild_id, dpp::snowflake channel_id, const char *path_to_file, uint32_t duration)
 
 {
+  TRACE_SCOPE("voice.play_audio");
+  if (shed::Active(shed::Level::SkipCues))
+    return;
   auto shard = FindAndJoinVoice(bot, guild_id, channel_id);
 
   if (!shard)
     return;
 
-  OGGZ *track_og = oggz_open(path_to_file, OGGZ_READ);
+  auto track = OpenTrack(bot, path_to_file);
+  if (!track)
+    return;
+  uint32_t tries = 10;
+  bot.start_timer(
+      [=, &bot](dpp::timer t) mutable
+      {
+        auto V = HandleVoiceConnectionReady(bot, shard, t, guild_id, tries);
+
+        if (!V)
+          return;
+
+        SendOnAudioThread(bot, shard->shard_id, guild_id, [track](dpp::voiceconn *V) { SendTrack(V, *track); });
+
+        bot.start_timer(
+            [=, &bot](dpp::timer t2)
+            {
+              shard->disconnect_voice(guild_id);
+              bot.stop_timer(t2);
+            },
+            duration + 2);
+      },
+      2);
+
+  return;
+}
+
+void PlayAudio(
+    dpp::cluster &bot, dpp::snowflake guild_id, dpp::snowflake channel_id, std::shared_ptr<const CueComposer::Cue> cue)
+{
+  if (!cue)
+    return;
+
+  TRACE_SCOPE("voice.play_audio");
+  if (shed::Active(shed::Level::SkipCues))
+    return;
+  auto shard = FindAndJoinVoice(bot, guild_id, channel_id);
 
-  if (!track_og)
-  {
-    bot.log(DL::ll_warning, fmt::format("Error in playing audio function : Couldn't open the file {}", path_to_file));
+  if (!shard)
     return;
-  }
+
   uint32_t tries = 10;
   bot.start_timer(
       [=, &bot](dpp::timer t) mutable
@@ -155,36 +212,155 @@ void PlayAudio(
         if (!V)
           return;
 
-        oggz_set_read_callback(
-            track_og,
-            -1,
-            [](OGGZ *, oggz_packet *packet, long, void *user_data)
+        // Packets already are opus frames, they go out as they are
+        SendOnAudioThread(bot, shard->shard_id, guild_id, [cue](dpp::voiceconn *V) { SendCue(V, *cue); });
+
+        bot.start_timer(
+            [=, &bot](dpp::timer t2)
             {
-              auto *vc = static_cast<dpp::voiceconn *>(user_data);
-              vc->voiceclient->send_audio_opus(packet->op.packet, packet->op.bytes);
-              return 0;
+              shard->disconnect_voice(guild_id);
+              bot.stop_timer(t2);
             },
-            (void *)V);
+            cue->Duration + 2);
+      },
+      2);
+}
+
+// Study halls ------
+
+using RoomList = std::shared_ptr<const std::vector<dpp::snowflake>>;
 
-        while (V && V->voiceclient && !V->voiceclient->terminating)
+// The chain of rooms playing in each guild, a chain started for the next phase supersedes the one still going
+static std::mutex chains_mtx;
+static std::unordered_map<dpp::snowflake, uint64_t> chains;
+static uint64_t last_chain = 0;
+
+static uint64_t StartChain(dpp::snowflake guild_id)
+{
+  std::lock_guard lock(chains_mtx);
+  return chains[guild_id] = ++last_chain;
+}
+
+static bool IsCurrent(dpp::snowflake guild_id, uint64_t chain) noexcept
+{
+  std::lock_guard lock(chains_mtx);
+  auto it = chains.find(guild_id);
+  return it != chains.end() && it->second == chain;
+}
+
+static void EndChain(dpp::snowflake guild_id, uint64_t chain) noexcept
+{
+  std::lock_guard lock(chains_mtx);
+  if (auto it = chains.find(guild_id); it != chains.end() && it->second == chain)
+    chains.erase(it);
+}
+
+// Plays in rooms[index], then moves the same voice connection on to the next room. A superseded chain stops where
+// it is and leaves the connection to the chain that took it over
+static void PlayInRooms(
+    dpp::cluster &bot,
+    dpp::snowflake guild_id,
+    uint64_t chain,
+    RoomList rooms,
+    size_t index,
+    std::function<void(dpp::voiceconn *)> send,
+    double duration)
+{
+  if (!IsCurrent(guild_id, chain))
+    return;
+  auto shard = FindAndJoinVoice(bot, guild_id, (*rooms)[index]);
+
+  if (!shard)
+  {
+    EndChain(guild_id, chain);
+    return;
+  }
+
+  uint32_t tries = 10;
+  bot.start_timer(
+      [=, &bot](dpp::timer t) mutable
+      {
+        if (!IsCurrent(guild_id, chain))
         {
-          static constexpr long CHUNK_READ = BUFSIZ * 2;
-          long read_bytes = oggz_read(track_og, CHUNK_READ);
-          if (read_bytes <= 0)
-            break;
+          bot.stop_timer(t);
+          return;
+        }
+        bool last_try = tries == 0;
+        auto V = HandleVoiceConnectionReady(bot, shard, t, guild_id, tries);
+
+        if (!V)
+        {
+          if (last_try) // gave up on the connection
+            EndChain(guild_id, chain);
+          return;
         }
 
-        oggz_close(track_og);
+        SendOnAudioThread(bot, shard->shard_id, guild_id, send);
 
         bot.start_timer(
             [=, &bot](dpp::timer t2)
             {
-              shard->disconnect_voice(guild_id);
               bot.stop_timer(t2);
+              if (!IsCurrent(guild_id, chain))
+                return;
+              shard->disconnect_voice(guild_id);
+              if (index + 1 >= rooms->size())
+              {
+                EndChain(guild_id, chain);
+                return;
+              }
+              bot.start_timer(
+                  [=, &bot](dpp::timer t3)
+                  {
+                    bot.stop_timer(t3);
+                    PlayInRooms(bot, guild_id, chain, rooms, index + 1, send, duration);
+                  },
+                  1);
             },
             duration + 2);
       },
       2);
+}
 
-  return;
+void PlayAudio(
+    dpp::cluster &bot,
+    dpp::snowflake guild_id,
+    std::vector<dpp::snowflake> rooms,
+    const char *path_to_file,
+    uint32_t duration)
+{
+  TRACE_SCOPE("voice.play_audio");
+  if (shed::Active(shed::Level::SkipCues) || rooms.empty())
+    return;
+  auto track = OpenTrack(bot, path_to_file);
+  if (!track)
+    return;
+  PlayInRooms(
+      bot,
+      guild_id,
+      StartChain(guild_id),
+      std::make_shared<const std::vector<dpp::snowflake>>(std::move(rooms)),
+      0,
+      [track = std::move(track)](dpp::voiceconn *V) { SendTrack(V, *track); },
+      duration);
+}
+
+void PlayAudio(
+    dpp::cluster &bot,
+    dpp::snowflake guild_id,
+    std::vector<dpp::snowflake> rooms,
+    std::shared_ptr<const CueComposer::Cue> cue)
+{
+  TRACE_SCOPE("voice.play_audio");
+  if (shed::Active(shed::Level::SkipCues) || rooms.empty() || !cue)
+    return;
+  double duration = cue->Duration;
+  PlayInRooms(
+      bot,
+      guild_id,
+      StartChain(guild_id),
+      std::make_shared<const std::vector<dpp::snowflake>>(std::move(rooms)),
+      0,
+      [cue = std::move(cue)](dpp::voiceconn *V) { SendCue(V, *cue); },
+      duration);
 }
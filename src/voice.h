@@ -1,12 +1,31 @@
 #ifndef VOICE_H
 #define VOICE_H
+#include "cue_composer.h"
 #include <dpp/cluster.h>
 #include <dpp/guild.h>
 #include <dpp/snowflake.h>
-#include <oggz/oggz.h>
+#include <memory>
+#include <vector>
 
 void PlayAudio(dpp::cluster &bot, dpp::snowflake guild_id, dpp::snowflake channel_id, const char *path_to_file);
 void PlayAudio(
     dpp::cluster &bot, dpp::snowflake guild_id, dpp::snowflake channel_id, const char *path_to_file, uint32_t duration);
+void PlayAudio(
+    dpp::cluster &bot, dpp::snowflake guild_id, dpp::snowflake channel_id, std::shared_ptr<const CueComposer::Cue> cue);
+
+/*
+   @brief Plays to several rooms of a guild one after another through a single voice connection
+*/
+void PlayAudio(
+    dpp::cluster &bot,
+    dpp::snowflake guild_id,
+    std::vector<dpp::snowflake> rooms,
+    const char *path_to_file,
+    uint32_t duration);
+void PlayAudio(
+    dpp::cluster &bot,
+    dpp::snowflake guild_id,
+    std::vector<dpp::snowflake> rooms,
+    std::shared_ptr<const CueComposer::Cue> cue);
 
 #endif
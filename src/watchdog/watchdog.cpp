@@ -0,0 +1,197 @@
+#include "watchdog.h"
+#include "load_shedder.h"
+#include "utils.h"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <execinfo.h>
+#include <fmt/format.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+namespace watchdog
+{
+constexpr auto CheckEvery = std::chrono::milliseconds(250);
+constexpr uint64_t HeartbeatMs = 1000;
+constexpr int StackDepth = 48;
+constexpr uint32_t CaptureWaitMs = 200; // the signal handler gets this long to fill the frames
+
+struct Slot
+{
+  std::atomic<pid_t> Tid{0};         // 0 while the slot is free
+  std::atomic<uint64_t> SinceMs{0};  // 0 while idle
+  std::atomic<const char *> What{nullptr};
+  uint64_t ReportedSinceMs = 0; // watchdog thread only, the stall that was already logged
+};
+
+static Slot slots[MaxThreads];
+static std::atomic<uint64_t> last_beat_ms{0};
+static std::atomic<pid_t> timer_tid{0};
+static std::atomic<uint64_t> max_lag_ms{0};
+
+// One capture at a time, requested by the watchdog thread and answered from the handler of the stalled thread
+static std::atomic<pid_t> capture_tid{0};
+static std::atomic<int> captured_frames{-1};
+static void *frames[StackDepth];
+
+static uint64_t NowMs() noexcept
+{
+  using namespace std::chrono;
+  return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static pid_t ThisTid() noexcept
+{
+  thread_local pid_t tid = syscall(SYS_gettid);
+  return tid;
+}
+
+static Slot *LocalSlot() noexcept
+{
+  thread_local Slot *slot = []() -> Slot *
+  {
+    pid_t tid = ThisTid();
+    for (auto &s : slots)
+    {
+      pid_t free = 0;
+      if (s.Tid.compare_exchange_strong(free, tid))
+        return &s;
+    }
+    return nullptr;
+  }();
+  return slot;
+}
+
+thread_local uint32_t busy_depth = 0;
+
+Busy::Busy(const char *what) noexcept : _outer(busy_depth++ == 0)
+{
+  if (!_outer)
+    return;
+  if (Slot *s = LocalSlot())
+  {
+    s->What.store(what, std::memory_order_relaxed);
+    s->SinceMs.store(NowMs(), std::memory_order_release);
+  }
+}
+
+Busy::~Busy()
+{
+  busy_depth--;
+  if (!_outer)
+    return;
+  if (Slot *s = LocalSlot())
+    s->SinceMs.store(0, std::memory_order_release);
+}
+
+uint64_t TakeMaxLagMs() noexcept
+{
+  return max_lag_ms.exchange(0, std::memory_order_relaxed);
+}
+
+static void OnCaptureSignal(int)
+{
+  // backtrace was called once at startup so it doesn't load libgcc from inside the handler
+  if (syscall(SYS_gettid) == capture_tid.load(std::memory_order_acquire))
+    captured_frames.store(backtrace(frames, StackDepth), std::memory_order_release);
+}
+
+static std::string CaptureStack(pid_t tid, int signo) noexcept
+{
+  if (!tid)
+    return "  (thread not known yet)\n";
+  captured_frames.store(-1, std::memory_order_relaxed);
+  capture_tid.store(tid, std::memory_order_release);
+  if (syscall(SYS_tgkill, getpid(), tid, signo) != 0)
+    return "  (thread is gone)\n";
+
+  int n = -1;
+  for (uint32_t waited = 0; waited < CaptureWaitMs && (n = captured_frames.load(std::memory_order_acquire)) < 0;
+       waited += 5)
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  capture_tid.store(0, std::memory_order_relaxed);
+  if (n < 0)
+    return "  (no answer to the signal, the thread may be blocked in the kernel with signals masked)\n";
+
+  std::string out;
+  char **symbols = backtrace_symbols(frames, n);
+  for (int i = 0; i < n; ++i)
+    out += fmt::format("  #{:<2} {}\n", i, symbols ? symbols[i] : fmt::format("{}", frames[i]));
+  free(symbols);
+  return out;
+}
+
+static void Check(dpp::cluster &bot, int signo, uint64_t &reported_beat) noexcept
+{
+  uint64_t now = NowMs();
+
+  // Timer thread, the heartbeat is late by how long the thread has been away
+  uint64_t beat = last_beat_ms.load(std::memory_order_acquire);
+  uint64_t lag = now > beat + HeartbeatMs ? now - beat - HeartbeatMs : 0;
+  if (lag)
+  {
+    uint64_t seen = max_lag_ms.load(std::memory_order_relaxed);
+    while (seen < lag && !max_lag_ms.compare_exchange_weak(seen, lag, std::memory_order_relaxed))
+      ;
+    shed::ReportTimerLateness(lag);
+  }
+  if (lag >= StallMs && reported_beat != beat)
+  {
+    reported_beat = beat;
+    pid_t tid = timer_tid.load(std::memory_order_relaxed);
+    bot.log(
+        DL::ll_warning,
+        fmt::format("Timer thread {} stalled, heartbeat {}ms late\n{}", tid, lag, CaptureStack(tid, signo)));
+  }
+
+  // Event handlers
+  for (auto &s : slots)
+  {
+    pid_t tid = s.Tid.load(std::memory_order_relaxed);
+    uint64_t since = s.SinceMs.load(std::memory_order_acquire);
+    // A handler that entered after now was read isn't late, now - since would wrap
+    if (!tid || !since || since > now || now - since < StallMs || s.ReportedSinceMs == since)
+      continue;
+    s.ReportedSinceMs = since;
+    const char *what = s.What.load(std::memory_order_relaxed);
+    bot.log(
+        DL::ll_warning,
+        fmt::format(
+            "Thread {} stalled {}ms in {}\n{}", tid, now - since, what ? what : "?", CaptureStack(tid, signo)));
+  }
+}
+
+void Start(dpp::cluster &bot, int signo) noexcept
+{
+  void *warmup[1];
+  backtrace(warmup, 1);
+  struct sigaction sa = {};
+  sa.sa_handler = OnCaptureSignal;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(signo, &sa, nullptr);
+
+  last_beat_ms.store(NowMs(), std::memory_order_release);
+  bot.start_timer(
+      [](dpp::timer)
+      {
+        timer_tid.store(ThisTid(), std::memory_order_relaxed);
+        last_beat_ms.store(NowMs(), std::memory_order_release);
+      },
+      HeartbeatMs / 1000);
+
+  std::thread(
+      [&bot, signo]
+      {
+        uint64_t reported_beat = 0;
+        for (;;)
+        {
+          std::this_thread::sleep_for(CheckEvery);
+          Check(bot, signo, reported_beat);
+        }
+      })
+      .detach();
+}
+} // namespace watchdog
@@ -0,0 +1,45 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+#include <cstdint>
+#include <dpp/cluster.h>
+
+/*
+   Stall detection for the threads that run timers and event handlers.
+   A heartbeat timer stamps the time every second and handlers mark themselves busy with a Busy scope; a separate
+   watchdog thread checks both every 250ms. How late the heartbeat is becomes the lag, it's fed to the load shedder
+   while the stall is still going on. A thread stuck past StallMs gets a signal and its stack is logged once per
+   stall, symbol names need the binary linked with -rdynamic.
+*/
+namespace watchdog
+{
+constexpr uint32_t StallMs = 2000;
+constexpr size_t MaxThreads = 64; // busy slots, threads past that aren't watched
+
+/*
+   @brief Starts the heartbeat on bot and the watchdog thread, call once
+   @param signo signal used to capture the stacks of stalled threads
+*/
+void Start(dpp::cluster &bot, int signo) noexcept;
+
+/*
+   @return worst heartbeat lag seen since the last call, in ms
+*/
+uint64_t TakeMaxLagMs() noexcept;
+
+/*
+   Marks the calling thread busy with what until the end of the scope, nested scopes keep the outer one
+*/
+class Busy
+{
+public:
+  explicit Busy(const char *what) noexcept; // what must be a string literal
+  ~Busy();
+  Busy(Busy const &) = delete;
+  Busy &operator=(Busy const &) = delete;
+
+private:
+  bool _outer;
+};
+} // namespace watchdog
+
+#endif
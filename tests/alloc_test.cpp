@@ -0,0 +1,68 @@
+#include "arena.h"
+#include "check.h"
+#include "fake_cluster.h"
+#include "session_manager.h"
+
+/*
+   Heap allocations of steady-state phase transitions, counted by the POMODORO_ALLOC_STATS operator new.
+   Transitions aren't allocation free: every REST call takes an owning string or object and a std::function
+   callback, and the fake cluster's bookkeeping of a call is counted with it. What is checked is that the text of a
+   transition doesn't allocate per member, nothing spills out of the event arena, and the allocations stay within
+   their budgets. Mutes are one REST call per member, Discord has no bulk mute.
+*/
+
+using namespace std::chrono_literals;
+using Flag = SessionManager::Session::Flag;
+using fake::Guild;
+
+constexpr double TransitionBudget = 12; // allocations per transition without mutes, 9 when this was written
+constexpr double MuteBudget = 2;        // allocations per member muted or unmuted
+
+struct Cost
+{
+  double Allocations;
+  uint64_t Spills;
+};
+
+// Allocations tagged Sessions per transition of one session with members in its channel
+static Cost Measure(fake::World &w, dpp::snowflake channel_id, uint64_t members, flag_t flags = 0)
+{
+  dpp::snowflake owner = channel_id * 1000;
+  for (uint64_t u = 0; u < members; u++)
+    fake::Join(w.Bot, Guild, channel_id, owner + u);
+  auto *s = w.Start(owner, channel_id, 1, 1, 1000, flags);
+  fake::Run(30s); // first transitions create the webhook and the status message
+
+  auto &c = mem::Counters(mem::Subsystem::Sessions);
+  uint64_t allocations = c.HeapAllocations.load(), spills = c.ArenaSpills.load();
+  unsigned first = s ? s->CurrentSessionNumber : 0;
+  fake::Run(2min);
+  unsigned transitions = s ? (s->CurrentSessionNumber - first) * 2 : 0;
+  Cost cost{double(c.HeapAllocations.load() - allocations) / std::max(1u, transitions), c.ArenaSpills.load() - spills};
+  w.Manager.CancelSession(owner);
+  fake::Run(1min);
+  return cost;
+}
+
+int main()
+{
+  fake::World w;
+  w.Bot.KeepCalls = 0;
+  w.Room(10, {}, "small");
+  w.Room(11, {}, "large");
+  w.Room(12, {}, "muted");
+
+  Cost small = Measure(w, 10, 1);
+  Cost large = Measure(w, 11, 40);
+  Cost muted = Measure(w, 12, 40, static_cast<flag_t>(Flag::Mute));
+  printf(
+      "allocations per transition: %.1f with 1 member, %.1f with 40, %.1f with 40 muted\n",
+      small.Allocations,
+      large.Allocations,
+      muted.Allocations);
+  CHECK(small.Spills == 0 && large.Spills == 0 && muted.Spills == 0);
+  CHECK(large.Allocations == small.Allocations);
+  CHECK(small.Allocations <= TransitionBudget);
+  CHECK(muted.Allocations - large.Allocations <= 40 * MuteBudget);
+  return test::Failures() != 0;
+}
@@ -0,0 +1,28 @@
+#ifndef CHECK_H
+#define CHECK_H
+#include <cstdio>
+
+/*
+   Assertions of the tests: a failed CHECK prints the condition and its line and the test goes on,
+   main returns test::Failures() != 0
+*/
+namespace test
+{
+inline int &Failures() noexcept
+{
+  static int failures = 0;
+  return failures;
+}
+} // namespace test
+
+#define CHECK(cond)                                                                                                    \
+  do                                                                                                                   \
+  {                                                                                                                    \
+    if (!(cond))                                                                                                       \
+    {                                                                                                                  \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);                                             \
+      test::Failures()++;                                                                                              \
+    }                                                                                                                  \
+  } while (0)
+
+#endif
@@ -0,0 +1,2 @@
+// Forwards to the single header of the fake D++
+#include "dpp.h"
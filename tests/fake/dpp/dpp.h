@@ -0,0 +1,761 @@
+#ifndef FAKE_DPP_H
+#define FAKE_DPP_H
+#include "clock.h"
+#include <any>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+/*
+   Stand-in for the part of D++ the bot uses, for the tests, benchmarks and tools that run without Discord.
+   Names and signatures follow D++. What it does instead of talking to Discord is driven from fake_cluster.h:
+   timers fire on utl::Clock when the test moves it, REST calls are logged and answered when the cluster is pumped,
+   and the cache holds what the test put in it.
+*/
+namespace fake
+{
+struct Call;
+struct Answer;
+} // namespace fake
+
+namespace dpp
+{
+struct snowflake
+{
+  uint64_t value = 0;
+  constexpr snowflake() noexcept = default;
+  constexpr snowflake(uint64_t v) noexcept : value(v)
+  {
+  }
+  constexpr operator uint64_t() const noexcept
+  {
+    return value;
+  }
+  constexpr bool empty() const noexcept
+  {
+    return value == 0;
+  }
+  std::string str() const
+  {
+    return std::to_string(value);
+  }
+};
+} // namespace dpp
+
+template <> struct std::hash<dpp::snowflake>
+{
+  size_t operator()(dpp::snowflake const &s) const noexcept
+  {
+    return std::hash<uint64_t>{}(s.value);
+  }
+};
+
+template <> struct fmt::formatter<dpp::snowflake> : fmt::formatter<uint64_t>
+{
+  auto format(dpp::snowflake const &s, format_context &ctx) const
+  {
+    return fmt::formatter<uint64_t>::format(s.value, ctx);
+  }
+};
+
+namespace dpp
+{
+using timer = size_t;
+using timer_callback_t = std::function<void(timer)>;
+
+enum loglevel
+{
+  ll_trace,
+  ll_debug,
+  ll_info,
+  ll_warning,
+  ll_error,
+  ll_critical
+};
+enum intents : uint32_t
+{
+  i_default_intents = 1u << 0,
+  i_message_content = 1u << 1,
+  i_guild_voice_states = 1u << 2
+};
+enum message_flags : uint16_t
+{
+  m_ephemeral = 1 << 6
+};
+enum command_option_type : uint8_t
+{
+  co_sub_command = 1,
+  co_sub_command_group,
+  co_string,
+  co_integer,
+  co_boolean,
+  co_user,
+  co_channel,
+  co_role,
+  co_mentionable,
+  co_number
+};
+enum channel_type : uint8_t
+{
+  CHANNEL_TEXT = 0,
+  CHANNEL_VOICE = 2
+};
+enum component_type : uint8_t
+{
+  cot_action_row = 1,
+  cot_button = 2
+};
+enum component_style : uint8_t
+{
+  cos_primary = 1,
+  cos_secondary,
+  cos_success,
+  cos_danger,
+  cos_link
+};
+enum start_type : bool
+{
+  st_wait = false,
+  st_return = true
+};
+enum image_type
+{
+  i_png,
+  i_jpg,
+  i_gif
+};
+enum permissions : uint64_t
+{
+  p_manage_guild = 1ull << 5
+};
+
+struct log_t
+{
+  loglevel severity;
+  std::string message;
+};
+
+struct voicestate
+{
+  snowflake guild_id, channel_id, user_id;
+  std::string session_id;
+  uint8_t flags = 0; // bit 0 self mute, bit 1 self deaf
+  bool is_self_mute() const noexcept
+  {
+    return flags & 1;
+  }
+  bool is_self_deaf() const noexcept
+  {
+    return flags & 2;
+  }
+};
+
+struct user
+{
+  snowflake id;
+  std::string username;
+};
+
+struct guild
+{
+  snowflake id;
+  uint32_t shard_id = 0;
+  std::string name;
+  std::map<snowflake, voicestate> voice_members;
+  bool unavailable = 0;
+  bool is_unavailable() const noexcept
+  {
+    return unavailable;
+  }
+};
+
+guild *find_guild(snowflake id);
+
+struct channel
+{
+  snowflake id, guild_id, parent_id;
+  std::string name;
+  channel_type type = CHANNEL_VOICE;
+  // Built from the guild's voice states, as in D++
+  std::map<snowflake, voicestate> get_voice_members() const
+  {
+    std::map<snowflake, voicestate> out;
+    if (guild const *g = find_guild(guild_id))
+      for (auto const &[id, state] : g->voice_members)
+        if (state.channel_id == this->id)
+          out.emplace(id, state);
+    return out;
+  }
+  channel &set_name(std::string const &n)
+  {
+    name = n;
+    return *this;
+  }
+  bool is_voice_channel() const noexcept
+  {
+    return type == CHANNEL_VOICE;
+  }
+};
+
+channel *find_channel(snowflake id);
+
+struct guild_member
+{
+  snowflake guild_id, user_id;
+  bool muted = 0;
+  guild_member &set_mute(bool m)
+  {
+    muted = m;
+    return *this;
+  }
+};
+
+struct component
+{
+  component_type type = cot_action_row;
+  component_style style = cos_primary;
+  std::string label, custom_id, emoji;
+  std::vector<component> components;
+  component &set_type(component_type t)
+  {
+    type = t;
+    return *this;
+  }
+  component &set_label(std::string const &l)
+  {
+    label = l;
+    return *this;
+  }
+  component &set_style(component_style s)
+  {
+    style = s;
+    return *this;
+  }
+  component &set_id(std::string const &id)
+  {
+    custom_id = id;
+    return *this;
+  }
+  component &set_emoji(std::string const &e)
+  {
+    emoji = e;
+    return *this;
+  }
+  component &add_component(component const &c)
+  {
+    components.push_back(c);
+    return *this;
+  }
+};
+
+struct message
+{
+  snowflake id, channel_id, guild_id;
+  std::string content;
+  std::vector<component> components;
+  uint16_t flags = 0;
+  message() = default;
+  message(std::string const &c) : content(c)
+  {
+  }
+  message(snowflake channel, std::string const &c) : channel_id(channel), content(c)
+  {
+  }
+  message &set_flags(uint16_t f)
+  {
+    flags = f;
+    return *this;
+  }
+  message &add_component(component const &c)
+  {
+    components.push_back(c);
+    return *this;
+  }
+  message &set_content(std::string const &c)
+  {
+    content = c;
+    return *this;
+  }
+  message &set_allowed_mentions(
+      bool = false,
+      bool = false,
+      bool = false,
+      bool = false,
+      std::vector<snowflake> const & = {},
+      std::vector<snowflake> const & = {})
+  {
+    return *this;
+  }
+};
+
+struct webhook
+{
+  snowflake id, channel_id, guild_id, user_id;
+  std::string token, name, image_data;
+  webhook() = default;
+  webhook &load_image(std::string const &data, image_type, bool = false)
+  {
+    image_data = data;
+    return *this;
+  }
+};
+using webhook_map = std::unordered_map<snowflake, webhook>;
+
+struct error_info
+{
+  uint32_t code = 0; // Discord's JSON error code, not the HTTP status
+  std::string message;
+};
+
+struct http_request_completion_t
+{
+  uint16_t status = 200; // 0 when the request never got an answer
+};
+
+struct confirmation_callback_t
+{
+  std::any value;
+  http_request_completion_t http_info;
+  error_info error;
+  bool is_error() const noexcept
+  {
+    return http_info.status == 0 || http_info.status >= 400;
+  }
+  error_info get_error() const
+  {
+    return error;
+  }
+  template <class T> T get() const
+  {
+    if (auto p = std::any_cast<T>(&value))
+      return *p;
+    return T{};
+  }
+};
+using command_completion_event_t = std::function<void(confirmation_callback_t const &)>;
+
+using command_value = std::variant<std::monostate, std::string, int64_t, bool, snowflake, double>;
+struct command_data_option
+{
+  std::string name;
+  command_option_type type = co_string;
+  command_value value;
+  std::vector<command_data_option> options;
+  bool empty() const noexcept
+  {
+    return options.empty();
+  }
+};
+struct command_interaction
+{
+  snowflake id;
+  std::string name;
+  std::vector<command_data_option> options;
+};
+struct component_interaction
+{
+  std::string custom_id;
+};
+
+struct permission
+{
+  uint64_t value = 0;
+  bool can(uint64_t p) const noexcept
+  {
+    return value & p;
+  }
+};
+
+struct interaction
+{
+  snowflake id, guild_id, channel_id;
+  user usr;
+  std::string locale, guild_locale;
+  std::variant<command_interaction, component_interaction> data;
+  permission permissions;
+  std::string get_command_name() const
+  {
+    auto const *cmd = std::get_if<command_interaction>(&data);
+    return cmd ? cmd->name : std::string();
+  }
+  command_interaction get_command_interaction() const
+  {
+    auto const *cmd = std::get_if<command_interaction>(&data);
+    return cmd ? *cmd : command_interaction{};
+  }
+  permission get_resolved_permission(snowflake) const
+  {
+    return permissions;
+  }
+};
+
+struct command_option_choice
+{
+  std::string name;
+  command_value value;
+  command_option_choice(std::string const &n, command_value const &v) : name(n), value(v)
+  {
+  }
+};
+struct command_option
+{
+  command_option_type type;
+  std::string name, description;
+  bool required;
+  std::vector<command_option> options;
+  std::vector<command_option_choice> choices;
+  command_option(command_option_type t, std::string const &n, std::string const &d, bool r = false)
+      : type(t), name(n), description(d), required(r)
+  {
+  }
+  command_option &add_option(command_option const &o)
+  {
+    options.push_back(o);
+    return *this;
+  }
+  command_option &add_choice(command_option_choice const &c)
+  {
+    choices.push_back(c);
+    return *this;
+  }
+  command_option &set_min_value(int64_t)
+  {
+    return *this;
+  }
+  command_option &set_max_value(int64_t)
+  {
+    return *this;
+  }
+  command_option &set_min_length(int64_t)
+  {
+    return *this;
+  }
+  command_option &set_max_length(int64_t)
+  {
+    return *this;
+  }
+  command_option &add_channel_type(channel_type)
+  {
+    return *this;
+  }
+};
+struct slashcommand
+{
+  std::string name, description;
+  snowflake application_id;
+  std::vector<command_option> options;
+  slashcommand(std::string const &n, std::string const &d, snowflake app) : name(n), description(d), application_id(app)
+  {
+  }
+  slashcommand &add_option(command_option const &o)
+  {
+    options.push_back(o);
+    return *this;
+  }
+};
+
+class cluster;
+
+// Counts what was queued on it instead of sending it
+struct discord_voice_client
+{
+  std::atomic<bool> terminating{false};
+  std::atomic<uint64_t> packets{0}, bytes{0};
+  bool is_ready() const noexcept
+  {
+    return !terminating;
+  }
+  discord_voice_client &send_audio_opus(uint8_t *, size_t length)
+  {
+    packets.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(length, std::memory_order_relaxed);
+    return *this;
+  }
+  discord_voice_client &send_audio_opus(uint8_t *data, size_t length, uint64_t)
+  {
+    return send_audio_opus(data, length);
+  }
+  bool is_playing() const noexcept
+  {
+    return 0;
+  }
+};
+
+struct voiceconn
+{
+  snowflake channel_id;
+  discord_voice_client *voiceclient = nullptr;
+  bool is_ready() const noexcept
+  {
+    return voiceclient && voiceclient->is_ready();
+  }
+};
+
+// A shard, connected unless the test says otherwise. Voice connections are ready as soon as they're asked for
+class discord_client
+{
+public:
+  discord_client(cluster *owner, uint32_t id) noexcept : creator(owner), shard_id(id)
+  {
+  }
+  discord_client &connect_voice(snowflake guild_id, snowflake channel_id, bool = false, bool = false, bool = false);
+  discord_client &disconnect_voice(snowflake guild_id);
+  voiceconn *get_voice(snowflake guild_id);
+  bool is_connected() const noexcept
+  {
+    return connected.load(std::memory_order_relaxed);
+  }
+
+  cluster *creator;
+  uint32_t shard_id;
+  std::string sessionid;
+  uint64_t last_seq = 0;
+  std::atomic<bool> connected{true};
+
+  // Fake only: voice connections made and packets queued on them over the shard's life
+  uint64_t Connects();
+  uint64_t SentPackets();
+
+private:
+  struct Voice
+  {
+    voiceconn Conn;
+    std::unique_ptr<discord_voice_client> Client;
+  };
+  std::mutex _mtx;
+  std::unordered_map<snowflake, Voice> _voice; // kept when disconnected, the audio thread may still hold it
+  uint64_t _connects = 0;
+};
+
+struct event_dispatch_t
+{
+  discord_client *from = nullptr;
+  std::string raw_event;
+};
+
+// Replies are logged on the shard's cluster as "interaction_response" calls
+struct interaction_create_t : event_dispatch_t
+{
+  interaction command;
+  void reply(message const &m, command_completion_event_t cb = {}) const;
+  void reply(std::string const &content, command_completion_event_t cb = {}) const
+  {
+    reply(message(content), std::move(cb));
+  }
+  void reply(command_completion_event_t cb = {}) const
+  {
+    reply(message(), std::move(cb));
+  }
+  void edit_response(message const &m, command_completion_event_t cb = {}) const
+  {
+    reply(m, std::move(cb));
+  }
+};
+struct slashcommand_t : interaction_create_t
+{
+};
+struct button_click_t : interaction_create_t
+{
+  std::string custom_id;
+};
+struct voice_state_update_t : event_dispatch_t
+{
+  voicestate state;
+};
+struct ready_t : event_dispatch_t
+{
+  std::string session_id;
+  uint32_t shard_id = 0;
+};
+struct resumed_t : event_dispatch_t
+{
+  std::string session_id;
+  uint32_t shard_id = 0;
+};
+struct guild_delete_t : event_dispatch_t
+{
+  guild deleted;
+  snowflake guild_id;
+};
+struct guild_create_t : event_dispatch_t
+{
+  guild *created = nullptr;
+};
+
+using event_handle = size_t;
+template <class T> class event_router_t
+{
+public:
+  template <class F> event_handle operator()(F &&handler)
+  {
+    _handlers.emplace_back(std::forward<F>(handler));
+    return _handlers.size();
+  }
+  void call(T const &event) const
+  {
+    for (auto const &h : _handlers)
+      h(event);
+  }
+  bool empty() const noexcept
+  {
+    return _handlers.empty();
+  }
+
+private:
+  std::vector<std::function<void(T const &)>> _handlers;
+};
+
+struct cache_policy_t
+{
+};
+namespace cache_policy
+{
+constexpr cache_policy_t cpol_default{};
+}
+
+class cluster
+{
+public:
+  cluster(
+      std::string const &token,
+      uint32_t intents = i_default_intents,
+      uint32_t shards = 0,
+      uint32_t cluster_id = 0,
+      uint32_t maxclusters = 1,
+      bool compressed = true,
+      cache_policy_t policy = cache_policy::cpol_default,
+      uint32_t request_threads = 12,
+      uint32_t request_threads_raw = 1);
+  ~cluster();
+  cluster(cluster const &) = delete;
+  cluster &operator=(cluster const &) = delete;
+
+  void log(loglevel severity, std::string const &msg) const;
+
+  timer start_timer(timer_callback_t on_tick, uint64_t frequency, timer_callback_t on_stop = {});
+  bool stop_timer(timer t);
+
+  void message_create(message const &m, command_completion_event_t cb = {});
+  void message_edit(message const &m, command_completion_event_t cb = {});
+  void message_delete(snowflake message_id, snowflake channel_id, command_completion_event_t cb = {});
+  void message_pin(snowflake channel_id, snowflake message_id, command_completion_event_t cb = {});
+  void message_unpin(snowflake channel_id, snowflake message_id, command_completion_event_t cb = {});
+  void guild_edit_member(guild_member const &gm, command_completion_event_t cb = {});
+  void channel_edit(channel const &c, command_completion_event_t cb = {});
+  void create_webhook(webhook const &w, command_completion_event_t cb = {});
+  void get_channel_webhooks(snowflake channel_id, command_completion_event_t cb = {});
+  void execute_webhook(
+      webhook const &w,
+      message const &m,
+      bool wait = false,
+      snowflake thread_id = 0,
+      std::string const &thread_name = "",
+      command_completion_event_t cb = {});
+  void global_bulk_command_create(std::vector<slashcommand> const &commands, command_completion_event_t cb = {});
+
+  discord_client *get_shard(uint32_t id);
+  std::map<uint32_t, discord_client *> get_shards();
+  uint32_t get_shard_count() const noexcept
+  {
+    return _shard_count;
+  }
+  void start(start_type = st_wait)
+  {
+  }
+  void shutdown()
+  {
+    Stopped = 1;
+  }
+
+  user me;
+  event_router_t<log_t> on_log;
+  event_router_t<slashcommand_t> on_slashcommand;
+  event_router_t<button_click_t> on_button_click;
+  event_router_t<voice_state_update_t> on_voice_state_update;
+  event_router_t<ready_t> on_ready;
+  event_router_t<resumed_t> on_resumed;
+  event_router_t<guild_create_t> on_guild_create;
+  event_router_t<guild_delete_t> on_guild_delete;
+
+  // Fake only, see fake_cluster.h ----
+
+  // Decides the answer to each REST call, every call succeeds with a plausible value if unset
+  std::function<fake::Answer(fake::Call const &)> Responder;
+  std::vector<fake::Call> Calls; // every REST call in order, cleared by the test when it wants
+  bool KeepCalls = 1;            // off for long runs, CallCount still counts
+  std::unordered_map<std::string_view, uint64_t> CallCount;
+  bool Stopped = 0;
+
+  /*
+     @brief Logs a REST call and queues its answer
+  */
+  void Rest(fake::Call &&call, command_completion_event_t &&cb);
+  /*
+     @brief Runs the timers due by utl::Clock::now() and delivers the answers due by then, until nothing is left due
+     @return callbacks run
+  */
+  size_t Pump();
+  size_t Timers();
+  size_t PendingAnswers();
+
+private:
+  struct Timer
+  {
+    timer_callback_t OnTick, OnStop;
+    uint64_t Frequency;
+    utl::Clock::time_point Next;
+  };
+  struct Pending
+  {
+    command_completion_event_t Callback;
+    confirmation_callback_t Result;
+  };
+
+  uint32_t _shard_count;
+  std::map<uint32_t, std::unique_ptr<discord_client>> _shards;
+  std::mutex _mtx; // timers, pending answers and the call log, never held while a callback runs
+  std::map<timer, Timer> _timers;
+  timer _next_timer = 1;
+  std::multimap<utl::Clock::time_point, Pending> _pending; // by due time, calls made together answered in order
+};
+
+template <class T> bool run_once()
+{
+  static std::atomic<bool> done{false};
+  return !done.exchange(true);
+}
+} // namespace dpp
+
+namespace fake
+{
+// A REST call as the cluster got it
+struct Call
+{
+  std::string_view Route; // the cluster method, e.g. "message_create"
+  dpp::snowflake Id;      // channel, or webhook for execute_webhook, or user for guild_edit_member
+  dpp::snowflake Target;  // message, or guild for guild_edit_member
+  std::string Content;    // message content or channel name
+  bool Flag = 0;          // mute for guild_edit_member, ephemeral for interaction_response
+  utl::Clock::time_point At;
+};
+
+// What a REST call is answered with, and how long after it was made
+struct Answer
+{
+  dpp::confirmation_callback_t Result;
+  utl::Clock::duration Delay{};
+};
+} // namespace fake
+
+#endif
@@ -0,0 +1,636 @@
+#include "fake_cluster.h"
+#include <algorithm>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+
+namespace
+{
+std::unordered_map<dpp::snowflake, dpp::guild> guilds;
+std::unordered_map<dpp::snowflake, dpp::channel> channels;
+std::atomic<uint64_t> guild_lookups{0};
+std::atomic<uint64_t> next_id{1'000'000'000'000ull}; // ids of created messages, webhooks and interactions
+
+std::mutex clusters_mtx;
+std::vector<dpp::cluster *> clusters;
+
+int LogLevel()
+{
+  static int level = []
+  {
+    const char *l = getenv("POMODORO_FAKE_LOG");
+    return l && *l ? atoi(l) : dpp::ll_critical + 1;
+  }();
+  return level;
+}
+} // namespace
+
+// dpp --------------
+
+namespace dpp
+{
+guild *find_guild(snowflake id)
+{
+  guild_lookups.fetch_add(1, std::memory_order_relaxed);
+  auto it = guilds.find(id);
+  return it == guilds.end() ? nullptr : &it->second;
+}
+
+channel *find_channel(snowflake id)
+{
+  auto it = channels.find(id);
+  return it == channels.end() ? nullptr : &it->second;
+}
+
+discord_client &discord_client::connect_voice(snowflake guild_id, snowflake channel_id, bool, bool, bool)
+{
+  std::lock_guard lock(_mtx);
+  Voice &v = _voice[guild_id];
+  if (!v.Client)
+    v.Client = std::make_unique<discord_voice_client>();
+  v.Client->terminating = 0;
+  v.Conn.channel_id = channel_id;
+  v.Conn.voiceclient = v.Client.get();
+  _connects++;
+  return *this;
+}
+
+discord_client &discord_client::disconnect_voice(snowflake guild_id)
+{
+  std::lock_guard lock(_mtx);
+  if (auto it = _voice.find(guild_id); it != _voice.end() && it->second.Client)
+    it->second.Client->terminating = 1;
+  return *this;
+}
+
+voiceconn *discord_client::get_voice(snowflake guild_id)
+{
+  std::lock_guard lock(_mtx);
+  auto it = _voice.find(guild_id);
+  if (it == _voice.end() || it->second.Client->terminating)
+    return nullptr;
+  return &it->second.Conn;
+}
+
+uint64_t discord_client::Connects()
+{
+  std::lock_guard lock(_mtx);
+  return _connects;
+}
+
+uint64_t discord_client::SentPackets()
+{
+  std::lock_guard lock(_mtx);
+  uint64_t n = 0;
+  for (auto const &[_, v] : _voice)
+    n += v.Client->packets.load(std::memory_order_relaxed);
+  return n;
+}
+
+void interaction_create_t::reply(message const &m, command_completion_event_t cb) const
+{
+  if (!from || !from->creator)
+    return;
+  from->creator->Rest(
+      {"interaction_response", command.channel_id, command.id, m.content, bool(m.flags & m_ephemeral)}, std::move(cb));
+}
+
+cluster::cluster(
+    std::string const &, uint32_t, uint32_t shards, uint32_t cluster_id, uint32_t maxclusters, bool, cache_policy_t,
+    uint32_t, uint32_t)
+    : _shard_count(std::max<uint32_t>(1, shards))
+{
+  me.id = 1;
+  me.username = "pomodoro";
+  // Like D++, a cluster runs the shards s with s % maxclusters == cluster_id
+  for (uint32_t s = 0; s < _shard_count; ++s)
+    if (s % std::max<uint32_t>(1, maxclusters) == cluster_id)
+      _shards.emplace(s, std::make_unique<discord_client>(this, s));
+  std::lock_guard lock(clusters_mtx);
+  clusters.push_back(this);
+}
+
+cluster::~cluster()
+{
+  std::lock_guard lock(clusters_mtx);
+  std::erase(clusters, this);
+}
+
+void cluster::log(loglevel severity, std::string const &msg) const
+{
+  if (!on_log.empty())
+    on_log.call({severity, msg});
+  else if (severity >= LogLevel())
+    fmt::print(stderr, "[{}] {}\n", int(severity), msg);
+}
+
+timer cluster::start_timer(timer_callback_t on_tick, uint64_t frequency, timer_callback_t on_stop)
+{
+  std::lock_guard lock(_mtx);
+  frequency = std::max<uint64_t>(1, frequency);
+  timer id = _next_timer++;
+  _timers.emplace(
+      id, Timer{std::move(on_tick), std::move(on_stop), frequency, utl::Clock::now() + std::chrono::seconds(frequency)});
+  return id;
+}
+
+bool cluster::stop_timer(timer t)
+{
+  timer_callback_t on_stop;
+  {
+    std::lock_guard lock(_mtx);
+    auto it = _timers.find(t);
+    if (it == _timers.end())
+      return 0;
+    on_stop = std::move(it->second.OnStop);
+    _timers.erase(it);
+  }
+  if (on_stop)
+    on_stop(t);
+  return 1;
+}
+
+void cluster::Rest(fake::Call &&call, command_completion_event_t &&cb)
+{
+  call.At = utl::Clock::now();
+  fake::Answer answer = Responder ? Responder(call) : fake::Default(*this, call);
+  std::lock_guard lock(_mtx);
+  CallCount[call.Route]++;
+  if (cb)
+    _pending.emplace(call.At + answer.Delay, Pending{std::move(cb), std::move(answer.Result)});
+  if (KeepCalls)
+    Calls.push_back(std::move(call));
+}
+
+size_t cluster::Pump()
+{
+  size_t ran = 0;
+  for (bool any = 1; any;)
+  {
+    any = 0;
+    auto now = utl::Clock::now();
+    // Answers first, then timers, like a REST thread that isn't behind
+    for (;;)
+    {
+      std::unique_lock lock(_mtx);
+      auto it = _pending.begin();
+      if (it == _pending.end() || it->first > now)
+        break;
+      Pending p = std::move(it->second);
+      _pending.erase(it);
+      lock.unlock();
+      p.Callback(p.Result);
+      ran++;
+      any = 1;
+    }
+
+    std::vector<timer> due;
+    {
+      std::lock_guard lock(_mtx);
+      for (auto const &[id, t] : _timers)
+        if (t.Next <= now)
+          due.push_back(id);
+    }
+    for (timer id : due)
+    {
+      timer_callback_t tick;
+      {
+        std::lock_guard lock(_mtx);
+        auto it = _timers.find(id);
+        if (it == _timers.end() || it->second.Next > now) // stopped by an earlier callback
+          continue;
+        it->second.Next = now + std::chrono::seconds(it->second.Frequency);
+        tick = it->second.OnTick;
+      }
+      tick(id);
+      ran++;
+      any = 1;
+    }
+  }
+  return ran;
+}
+
+size_t cluster::Timers()
+{
+  std::lock_guard lock(_mtx);
+  return _timers.size();
+}
+
+size_t cluster::PendingAnswers()
+{
+  std::lock_guard lock(_mtx);
+  return _pending.size();
+}
+
+void cluster::message_create(message const &m, command_completion_event_t cb)
+{
+  Rest({"message_create", m.channel_id, 0, m.content}, std::move(cb));
+}
+
+void cluster::message_edit(message const &m, command_completion_event_t cb)
+{
+  Rest({"message_edit", m.channel_id, m.id, m.content}, std::move(cb));
+}
+
+void cluster::message_delete(snowflake message_id, snowflake channel_id, command_completion_event_t cb)
+{
+  Rest({"message_delete", channel_id, message_id}, std::move(cb));
+}
+
+void cluster::message_pin(snowflake channel_id, snowflake message_id, command_completion_event_t cb)
+{
+  Rest({"message_pin", channel_id, message_id}, std::move(cb));
+}
+
+void cluster::message_unpin(snowflake channel_id, snowflake message_id, command_completion_event_t cb)
+{
+  Rest({"message_unpin", channel_id, message_id}, std::move(cb));
+}
+
+void cluster::guild_edit_member(guild_member const &gm, command_completion_event_t cb)
+{
+  Rest({"guild_edit_member", gm.user_id, gm.guild_id, "", gm.muted}, std::move(cb));
+}
+
+void cluster::channel_edit(channel const &c, command_completion_event_t cb)
+{
+  Rest({"channel_edit", c.id, c.guild_id, c.name}, std::move(cb));
+}
+
+void cluster::create_webhook(webhook const &w, command_completion_event_t cb)
+{
+  Rest({"create_webhook", w.channel_id, 0, w.name}, std::move(cb));
+}
+
+void cluster::get_channel_webhooks(snowflake channel_id, command_completion_event_t cb)
+{
+  Rest({"get_channel_webhooks", channel_id}, std::move(cb));
+}
+
+void cluster::execute_webhook(
+    webhook const &w, message const &m, bool, snowflake, std::string const &, command_completion_event_t cb)
+{
+  Rest({"execute_webhook", w.id, w.channel_id, m.content}, std::move(cb));
+}
+
+void cluster::global_bulk_command_create(std::vector<slashcommand> const &, command_completion_event_t cb)
+{
+  Rest({"global_bulk_command_create", 0}, std::move(cb));
+}
+
+discord_client *cluster::get_shard(uint32_t id)
+{
+  auto it = _shards.find(id);
+  return it == _shards.end() ? nullptr : it->second.get();
+}
+
+std::map<uint32_t, discord_client *> cluster::get_shards()
+{
+  std::map<uint32_t, discord_client *> out;
+  for (auto const &[id, shard] : _shards)
+    out.emplace(id, shard.get());
+  return out;
+}
+} // namespace dpp
+
+// fake -------------
+
+namespace fake
+{
+dpp::guild &AddGuild(dpp::snowflake id, uint32_t shard_id)
+{
+  dpp::guild &g = guilds[id];
+  g.id = id;
+  g.shard_id = shard_id;
+  return g;
+}
+
+dpp::channel &AddChannel(dpp::snowflake guild_id, dpp::snowflake id, std::string name, dpp::channel_type type)
+{
+  dpp::channel &c = channels[id];
+  c.id = id;
+  c.guild_id = guild_id;
+  c.name = std::move(name);
+  c.type = type;
+  return c;
+}
+
+void RemoveGuild(dpp::snowflake id)
+{
+  guilds.erase(id);
+  std::erase_if(channels, [id](auto const &c) { return c.second.guild_id == id; });
+}
+
+void ClearCache()
+{
+  guilds.clear();
+  channels.clear();
+}
+
+uint64_t GuildLookups() noexcept
+{
+  return guild_lookups.load(std::memory_order_relaxed);
+}
+
+dpp::voice_state_update_t
+Join(dpp::cluster &bot, dpp::snowflake guild_id, dpp::snowflake channel_id, dpp::snowflake user_id)
+{
+  dpp::voice_state_update_t e;
+  e.state.guild_id = guild_id;
+  e.state.channel_id = channel_id;
+  e.state.user_id = user_id;
+  uint32_t shard = 0;
+  if (dpp::guild *g = dpp::find_guild(guild_id))
+  {
+    shard = g->shard_id;
+    if (channel_id)
+      g->voice_members[user_id] = e.state;
+    else
+      g->voice_members.erase(user_id);
+  }
+  e.from = bot.get_shard(shard);
+  return e;
+}
+
+dpp::slashcommand_t Command(
+    dpp::cluster &bot,
+    dpp::snowflake guild_id,
+    dpp::snowflake channel_id,
+    dpp::snowflake user_id,
+    std::string name,
+    std::vector<dpp::command_data_option> options,
+    std::string guild_locale)
+{
+  dpp::slashcommand_t e;
+  dpp::guild const *g = dpp::find_guild(guild_id);
+  e.from = bot.get_shard(g ? g->shard_id : 0);
+  e.command.id = next_id++;
+  e.command.guild_id = guild_id;
+  e.command.channel_id = channel_id;
+  e.command.usr.id = user_id;
+  e.command.guild_locale = std::move(guild_locale);
+  e.command.data = dpp::command_interaction{e.command.id, std::move(name), std::move(options)};
+  return e;
+}
+
+dpp::button_click_t Click(
+    dpp::cluster &bot,
+    dpp::snowflake guild_id,
+    dpp::snowflake channel_id,
+    dpp::snowflake user_id,
+    std::string custom_id)
+{
+  dpp::button_click_t e;
+  dpp::guild const *g = dpp::find_guild(guild_id);
+  e.from = bot.get_shard(g ? g->shard_id : 0);
+  e.command.id = next_id++;
+  e.command.guild_id = guild_id;
+  e.command.channel_id = channel_id;
+  e.command.usr.id = user_id;
+  e.command.data = dpp::component_interaction{custom_id};
+  e.custom_id = std::move(custom_id);
+  return e;
+}
+
+dpp::command_data_option Sub(std::string name, std::vector<dpp::command_data_option> options)
+{
+  dpp::command_data_option o;
+  o.name = std::move(name);
+  o.type = dpp::co_sub_command;
+  o.options = std::move(options);
+  return o;
+}
+
+dpp::command_data_option Opt(std::string name, dpp::command_value value)
+{
+  dpp::command_data_option o;
+  o.name = std::move(name);
+  o.value = std::move(value);
+  return o;
+}
+
+void Settle()
+{
+  std::vector<dpp::cluster *> all;
+  {
+    std::lock_guard lock(clusters_mtx);
+    all = clusters;
+  }
+  for (bool any = 1; any;)
+  {
+    any = 0;
+    for (auto *c : all)
+      any |= c->Pump() != 0;
+  }
+}
+
+void Run(utl::Clock::duration d, utl::Clock::duration step)
+{
+  Settle();
+  for (utl::Clock::duration done{}; done < d; done += step)
+  {
+    utl::Clock::Advance(std::min(step, d - done));
+    Settle();
+  }
+}
+
+Answer Ok(std::any value, utl::Clock::duration delay)
+{
+  Answer a;
+  a.Result.value = std::move(value);
+  a.Delay = delay;
+  return a;
+}
+
+Answer Fail(uint16_t status, uint32_t code, std::string message, utl::Clock::duration delay)
+{
+  Answer a;
+  a.Result.http_info.status = status;
+  a.Result.error = {code, std::move(message)};
+  a.Delay = delay;
+  return a;
+}
+
+Answer Timeout(utl::Clock::duration delay)
+{
+  return Fail(0, 0, "Request timed out", delay);
+}
+
+Answer Default(dpp::cluster const &bot, Call const &call)
+{
+  if (call.Route == "message_create")
+  {
+    dpp::message m(call.Id, call.Content);
+    m.id = next_id++;
+    return Ok(std::move(m));
+  }
+  if (call.Route == "message_edit")
+  {
+    dpp::message m(call.Id, call.Content);
+    m.id = call.Target;
+    return Ok(std::move(m));
+  }
+  if (call.Route == "create_webhook")
+  {
+    dpp::webhook w;
+    w.id = next_id++;
+    w.channel_id = call.Id;
+    w.user_id = bot.me.id;
+    w.name = call.Content;
+    w.token = "token";
+    return Ok(std::move(w));
+  }
+  if (call.Route == "get_channel_webhooks")
+    return Ok(dpp::webhook_map{});
+  return Ok();
+}
+
+size_t Count(dpp::cluster const &bot, std::string_view route) noexcept
+{
+  auto it = bot.CallCount.find(route);
+  return it == bot.CallCount.end() ? 0 : it->second;
+}
+
+// Sessions ---------
+
+World::World(uint32_t shards)
+    : Bot("", dpp::i_default_intents, shards), Dir(TempDir()), Stats(Bot, (Dir + "/stats.log").c_str()),
+      Cues("assests/audio/fragments"), Manager(Bot, Stats, Cues)
+{
+  AddGuild(Guild);
+}
+
+dpp::channel &
+World::Room(dpp::snowflake id, std::initializer_list<dpp::snowflake> users, std::string name, dpp::snowflake guild_id)
+{
+  dpp::channel &channel = AddChannel(guild_id, id, std::move(name));
+  for (dpp::snowflake user : users)
+    Join(Bot, guild_id, id, user);
+  return channel;
+}
+
+SessionManager::Session *World::Start(
+    dpp::snowflake owner, dpp::snowflake channel_id, unsigned work, unsigned brk, unsigned repeat, flag_t flags)
+{
+  Manager.StartSession(owner, dpp::find_channel(channel_id), work, brk, repeat, flags);
+  return Manager.GetSessionByOwnerId(owner);
+}
+} // namespace fake
+
+namespace fake
+{
+std::string TempDir()
+{
+  std::string path = (std::filesystem::temp_directory_path() / "pomodoro-XXXXXX").string();
+  if (!mkdtemp(path.data()))
+  {
+    fmt::print(stderr, "Couldn't make a temporary directory\n");
+    exit(2);
+  }
+  static std::vector<std::string> made;
+  if (made.empty())
+    atexit(
+        []
+        {
+          std::error_code ec;
+          for (auto const &dir : made)
+            std::filesystem::remove_all(dir, ec);
+        });
+  made.push_back(path);
+  return path;
+}
+
+uint64_t AnonKiB() noexcept
+{
+  std::ifstream status("/proc/self/status");
+  std::string key;
+  uint64_t value = 0;
+  while (status >> key)
+    if (key == "RssAnon:")
+    {
+      status >> value;
+      return value;
+    }
+  return 0;
+}
+
+// Ogg's CRC-32, as opus_track.cpp checks it
+static uint32_t OggCrc(std::string_view data) noexcept
+{
+  uint32_t crc = 0;
+  for (unsigned char c : data)
+  {
+    crc ^= uint32_t(c) << 24;
+    for (int bit = 0; bit < 8; ++bit)
+      crc = crc & 0x80000000u ? (crc << 1) ^ 0x04c11db7u : crc << 1;
+  }
+  return crc;
+}
+
+static void PutLe(std::string &out, uint64_t v, size_t bytes)
+{
+  for (size_t i = 0; i < bytes; ++i)
+    out.push_back(static_cast<char>(v >> (8 * i)));
+}
+
+bool WriteOpus(std::string const &path, size_t packets, size_t size, size_t per_page)
+{
+  constexpr uint32_t Serial = 0x706f6d6f;
+  constexpr uint16_t PreSkip = 312;
+  constexpr uint64_t SamplesPerPacket = 960; // 20ms at 48kHz
+  std::string file;
+  uint32_t sequence = 0;
+  auto page = [&](uint8_t type, uint64_t granule, std::vector<std::string> const &body)
+  {
+    std::string p("OggS\0", 5);
+    p.push_back(static_cast<char>(type));
+    PutLe(p, granule, 8);
+    PutLe(p, Serial, 4);
+    PutLe(p, sequence++, 4);
+    PutLe(p, 0, 4); // CRC
+    std::string lacing;
+    for (auto const &packet : body)
+    {
+      lacing.append(packet.size() / 255, static_cast<char>(255));
+      lacing.push_back(static_cast<char>(packet.size() % 255));
+    }
+    p.push_back(static_cast<char>(lacing.size()));
+    p += lacing;
+    for (auto const &packet : body)
+      p += packet;
+    uint32_t crc = OggCrc(p);
+    for (size_t i = 0; i < 4; ++i)
+      p[22 + i] = static_cast<char>(crc >> (8 * i));
+    file += p;
+  };
+
+  std::string head("OpusHead\1\1", 10);
+  PutLe(head, PreSkip, 2);
+  PutLe(head, 48000, 4);
+  PutLe(head, 0, 3); // gain, mapping family
+  page(0x02, 0, {head});
+  std::string tags("OpusTags", 8);
+  PutLe(tags, 4, 4);
+  tags += "fake";
+  PutLe(tags, 0, 4);
+  page(0, 0, {tags});
+
+  std::vector<std::string> body;
+  for (size_t i = 0; i < packets; i++)
+  {
+    // TOC byte of a 20ms CELT frame, then filler that differs between packets
+    std::string packet(std::max<size_t>(size, 1), static_cast<char>('a' + i % 26));
+    packet[0] = static_cast<char>(0xfc);
+    body.push_back(std::move(packet));
+    if (body.size() == per_page || i + 1 == packets)
+    {
+      page(i + 1 == packets ? 0x04 : 0, PreSkip + (i + 1) * SamplesPerPacket, body);
+      body.clear();
+    }
+  }
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(file.data(), file.size());
+  return bool(out);
+}
+} // namespace fake
@@ -0,0 +1,150 @@
+#ifndef FAKE_CLUSTER_H
+#define FAKE_CLUSTER_H
+#include "clock.h"
+#include "session_manager.h"
+#include <chrono>
+#include <dpp/dpp.h>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+/*
+   Drives the fake D++ of tests/fake/dpp: fills the cache, makes the events a shard would dispatch, and moves the
+   virtual clock so timers fire and REST answers arrive. Everything runs on the calling thread.
+*/
+namespace fake
+{
+// Cache ------------
+
+dpp::guild &AddGuild(dpp::snowflake id, uint32_t shard_id = 0);
+dpp::channel &AddChannel(
+    dpp::snowflake guild_id, dpp::snowflake id, std::string name, dpp::channel_type type = dpp::CHANNEL_VOICE);
+/*
+   @brief Drops a guild and its channels from the cache
+*/
+void RemoveGuild(dpp::snowflake id);
+void ClearCache();
+/*
+   @return dpp::find_guild calls so far
+*/
+uint64_t GuildLookups() noexcept;
+
+// Events -----------
+
+/*
+   @brief Moves user into channel_id (0 leaves voice) in the cache
+   @return the event the guild's shard would dispatch for it
+*/
+dpp::voice_state_update_t
+Join(dpp::cluster &bot, dpp::snowflake guild_id, dpp::snowflake channel_id, dpp::snowflake user_id);
+
+dpp::slashcommand_t Command(
+    dpp::cluster &bot,
+    dpp::snowflake guild_id,
+    dpp::snowflake channel_id,
+    dpp::snowflake user_id,
+    std::string name,
+    std::vector<dpp::command_data_option> options = {},
+    std::string guild_locale = "en-US");
+
+dpp::button_click_t Click(
+    dpp::cluster &bot,
+    dpp::snowflake guild_id,
+    dpp::snowflake channel_id,
+    dpp::snowflake user_id,
+    std::string custom_id);
+
+/*
+   @brief A subcommand option holding the given options
+*/
+dpp::command_data_option Sub(std::string name, std::vector<dpp::command_data_option> options = {});
+dpp::command_data_option Opt(std::string name, dpp::command_value value);
+
+// Time -------------
+
+/*
+   @brief Moves the clock by d in steps, pumping every cluster after each step
+*/
+void Run(utl::Clock::duration d, utl::Clock::duration step = std::chrono::seconds(1));
+/*
+   @brief Pumps every cluster without moving the clock
+*/
+void Settle();
+
+// Answers ----------
+
+Answer Ok(std::any value = {}, utl::Clock::duration delay = {});
+Answer Fail(uint16_t status, uint32_t code = 0, std::string message = "", utl::Clock::duration delay = {});
+/*
+   @brief A request that never got an answer, it may or may not have been applied by Discord
+*/
+Answer Timeout(utl::Clock::duration delay = std::chrono::seconds(10));
+/*
+   @brief What a cluster without a Responder answers: success, with the created message or webhook
+*/
+Answer Default(dpp::cluster const &bot, Call const &call);
+
+size_t Count(dpp::cluster const &bot, std::string_view route) noexcept;
+
+// Sessions ---------
+
+constexpr dpp::snowflake Guild = 7;
+constexpr dpp::snowflake Owner = 100;
+constexpr dpp::snowflake Member = 101;
+
+/*
+   What a test of the sessions starts from: a cluster, its stats on a new directory, the repo's cue fragments and a
+   manager over them. Guild is in the cache, the channels and who is in them are the test's
+*/
+struct World
+{
+  explicit World(uint32_t shards = 0); // as dpp::cluster takes them
+  World(World const &) = delete;
+  World &operator=(World const &) = delete;
+
+  /*
+     @brief Adds a voice channel of guild_id and moves users into it
+  */
+  dpp::channel &Room(
+      dpp::snowflake id,
+      std::initializer_list<dpp::snowflake> users = {},
+      std::string name = "study",
+      dpp::snowflake guild_id = Guild);
+  /*
+     @brief Starts owner's session in channel_id, with mute on unless flags say otherwise
+     @return the session, nullptr if it didn't start or already ended
+  */
+  SessionManager::Session *Start(
+      dpp::snowflake owner,
+      dpp::snowflake channel_id,
+      unsigned work,
+      unsigned brk,
+      unsigned repeat,
+      flag_t flags = static_cast<flag_t>(SessionManager::Session::Flag::Mute));
+
+  dpp::cluster Bot;
+  std::string Dir; // from TempDir, for the stores a test opens besides the stats
+  StatsStore Stats;
+  CueComposer Cues;
+  SessionManager Manager;
+};
+
+// Process ----------
+
+/*
+   @brief A new empty directory under /tmp for the stores of a run, removed at exit
+*/
+std::string TempDir();
+/*
+   @return anonymous resident memory of the process in KiB (RssAnon), mappings of files don't count
+*/
+uint64_t AnonKiB() noexcept;
+/*
+   @brief Writes an Ogg/Opus file as an encoder lays it out: the OpusHead and OpusTags pages, then pages of up to
+   per_page audio packets of size bytes and 20ms each. The packets aren't real Opus, only the container is
+   @return false if it couldn't be written
+*/
+bool WriteOpus(std::string const &path, size_t packets, size_t size = 80, size_t per_page = 50);
+} // namespace fake
+
+#endif
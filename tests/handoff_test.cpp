@@ -0,0 +1,136 @@
+#include "check.h"
+#include "fake_cluster.h"
+#include "session_manager.h"
+#include <filesystem>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+   Snapshots in the handoff directory: a claim stays on disk until Done, a claim left by a dead process is taken
+   again, and a snapshot nobody claimed in time is taken by any process and ended, members unmuted and names restored.
+   A snapshot whose owner already has a session in the claiming process is ended the same way beside that session.
+*/
+
+using namespace std::chrono_literals;
+using Flag = SessionManager::Session::Flag;
+
+using fake::Guild, fake::Owner, fake::Member;
+
+constexpr dpp::snowflake Channel = 10;
+constexpr dpp::snowflake StatusMessage = 555;
+
+static size_t Files(std::string const &dir, std::string_view ending)
+{
+  size_t n = 0;
+  for (auto const &e : std::filesystem::directory_iterator(dir))
+    n += e.path().string().ends_with(ending);
+  return n;
+}
+
+static handoff::Snapshot Snapshot(dpp::snowflake owner)
+{
+  handoff::Snapshot s;
+  s.OwnerId = owner;
+  s.ChannelId = Channel;
+  s.GuildId = Guild;
+  s.StatusMessageId = StatusMessage;
+  s.Members = {owner, Member};
+  s.VoiceChannelName = "study";
+  s.WorkPeriod = 50;
+  s.BreakPeriod = 10;
+  s.Repeat = 2;
+  s.CurrentSessionNumber = 1;
+  s.PhaseEndMs = utl::WallMs() + 30'000;
+  s.ReleasedAtMs = utl::WallMs();
+  s.Flags = static_cast<flag_t>(Flag::Mute);
+  return s;
+}
+
+int main()
+{
+  std::string dir = fake::TempDir();
+  handoff::Directory handoff(dir);
+  handoff::ShardMap all;
+  handoff::ShardMap other{2, 1, 2}; // guild 7 is on shard 0, cluster 0's
+
+  // Claimed, then on disk until Done
+  std::vector<handoff::Snapshot> claimed;
+  CHECK(handoff.Put(Snapshot(Owner)));
+  CHECK(handoff.Claim(other, 0, claimed) == 0);
+  CHECK(handoff.Claim(all, 0, claimed) == 1);
+  CHECK(Files(dir, ".claimed") == 1);
+  CHECK(handoff.Claim(all, 0, claimed) == 0); // a live claim isn't taken again
+  handoff.Done(claimed.at(0));
+  CHECK(Files(dir, ".claimed") == 0);
+
+  // The claiming process died before Done
+  CHECK(handoff.Put(Snapshot(Owner)));
+  pid_t dead = fork();
+  if (!dead)
+    _exit(0);
+  waitpid(dead, nullptr, 0);
+  for (auto const &e : std::filesystem::directory_iterator(dir))
+    if (e.path().string().ends_with(".session"))
+      std::filesystem::rename(e.path(), e.path().string() + "." + std::to_string(dead) + ".claimed");
+  claimed.clear();
+  CHECK(handoff.Claim(all, 0, claimed) == 1);
+  CHECK(claimed.size() == 1 && claimed[0].OwnerId == Owner);
+  handoff.Done(claimed.at(0));
+  CHECK(std::filesystem::is_empty(dir));
+
+  // Nobody claimed it in time: another process's cluster ends it
+  fake::World w;
+  w.Room(Channel, {Owner, Member}, "Work - study");
+
+  CHECK(handoff.Put(Snapshot(Owner)));
+  fake::Run(handoff::MaxAgeMs * 1ms + 1min, 1min);
+  claimed.clear();
+  CHECK(handoff.Claim(other, 0, claimed) == 1);
+  CHECK(claimed.size() == 1 && handoff::Stale(claimed[0], utl::WallMs()));
+  for (auto const &s : claimed)
+  {
+    w.Manager.Discard(s);
+    handoff.Done(s);
+  }
+  fake::Run(1min);
+  CHECK(w.Manager.GetActiveSessions() == 0);
+  CHECK(w.Manager.Renames.Pending() == 0);
+  size_t unmuted = 0, restored = 0, closed = 0;
+  for (auto const &c : w.Bot.Calls)
+  {
+    unmuted += c.Route == "guild_edit_member" && !c.Flag;
+    restored += c.Route == "channel_edit" && c.Content == "study";
+    closed += c.Route == "message_edit" && c.Target == StatusMessage;
+  }
+  CHECK(unmuted == 2);
+  CHECK(restored == 1);
+  CHECK(closed == 1);
+  CHECK(w.Stats.GetUserStats(Guild, Member).SessionsCanceled == 1);
+  CHECK(std::filesystem::is_empty(dir));
+
+  // Adopt refuses it, the owner started again in another channel: it's ended, the owner's new session is left alone
+  w.Room(Channel + 1, {Owner}, "focus");
+  w.Start(Owner, Channel + 1, 60, 10, 2);
+  size_t from = w.Bot.Calls.size();
+  handoff::Snapshot refused = Snapshot(Owner);
+  CHECK(!w.Manager.Adopt(refused));
+  w.Manager.Discard(refused);
+  fake::Run(1min);
+  CHECK(w.Manager.GetActiveSessions() == 1);
+  size_t member_unmuted = 0, owner_unmuted = 0;
+  restored = closed = 0;
+  for (size_t i = from; i < w.Bot.Calls.size(); i++)
+  {
+    auto const &c = w.Bot.Calls[i];
+    member_unmuted += c.Route == "guild_edit_member" && !c.Flag && c.Id == Member;
+    owner_unmuted += c.Route == "guild_edit_member" && !c.Flag && c.Id == Owner;
+    restored += c.Route == "channel_edit" && c.Content == "study";
+    closed += c.Route == "message_edit" && c.Target == StatusMessage;
+  }
+  CHECK(member_unmuted == 1);
+  CHECK(owner_unmuted == 0);
+  CHECK(restored == 1);
+  CHECK(closed == 1);
+  CHECK(w.Stats.GetUserStats(Guild, Member).SessionsCanceled == 2);
+  return test::Failures() != 0;
+}
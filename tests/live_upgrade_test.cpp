@@ -0,0 +1,127 @@
+#include "check.h"
+#include "fake_cluster.h"
+#include "live_upgrade.h"
+#include <filesystem>
+#include <future>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+/*
+   The upgrade socket: sessions handed over and committed are the new process's, a sender that gives up waiting for
+   the answer keeps them and the receiver drops what it read, so neither both nor none of them adopt a session. A
+   receiver that never reads doesn't hold the sender past its timeout either.
+*/
+
+using namespace std::chrono_literals;
+
+static upgrade::State State()
+{
+  upgrade::State state;
+  state.StoppedAtMs = 1'700'000'000'000;
+  for (uint64_t owner : {100, 200})
+  {
+    handoff::Snapshot s;
+    s.OwnerId = owner;
+    s.ChannelId = owner + 1;
+    s.GuildId = 7;
+    s.Members = {owner};
+    state.Sessions.push_back(s);
+  }
+  return state;
+}
+
+static void WaitFor(std::string const &path)
+{
+  while (!std::filesystem::exists(path))
+    std::this_thread::sleep_for(1ms);
+}
+
+static int Connect(std::string const &path)
+{
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == -1)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int main()
+{
+  std::string path = fake::TempDir() + "/upgrade.sock";
+  std::string error;
+
+  // Handed over and committed
+  {
+    upgrade::State received;
+    std::string receive_error;
+    auto receiver =
+        std::async(std::launch::async, [&] { return upgrade::Receive(path.c_str(), 5, received, receive_error); });
+    WaitFor(path);
+    CHECK(upgrade::Send(path.c_str(), State(), error));
+    CHECK(receiver.get());
+    CHECK(received.StoppedAtMs == 1'700'000'000'000);
+    CHECK(received.Sessions.size() == 2 && received.Sessions[1].OwnerId == 200);
+  }
+
+  // The sender stopped waiting for the answer and closed without committing
+  {
+    upgrade::State received;
+    std::string receive_error;
+    auto receiver =
+        std::async(std::launch::async, [&] { return upgrade::Receive(path.c_str(), 5, received, receive_error); });
+    WaitFor(path);
+    std::string stream;
+    upgrade::Encode(State(), stream);
+    int fd = Connect(path);
+    CHECK(fd != -1);
+    CHECK(write(fd, stream.data(), stream.size()) == ssize_t(stream.size()));
+    shutdown(fd, SHUT_WR);
+    close(fd);
+    CHECK(!receiver.get());
+    CHECK(received.Sessions.empty());
+  }
+
+  // The receiver doesn't answer in time, the sender keeps its sessions
+  {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK(bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0 && listen(listener, 1) == 0);
+    auto t0 = std::chrono::steady_clock::now();
+    CHECK(!upgrade::Send(path.c_str(), State(), error, 1));
+    CHECK(std::chrono::steady_clock::now() - t0 >= 900ms);
+    close(listener);
+    unlink(path.c_str());
+  }
+
+  // The receiver accepts but never reads, more than the socket buffers hold: the write gives up in time too
+  {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    CHECK(bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0 && listen(listener, 1) == 0);
+    upgrade::State big = State();
+    big.Sessions[0].Members.assign(100'000, 100); // 800KB in one session
+    auto t0 = std::chrono::steady_clock::now();
+    auto sent = std::async(std::launch::async, [&] { return upgrade::Send(path.c_str(), big, error, 1); });
+    CHECK(sent.wait_for(5s) == std::future_status::ready);
+    close(listener); // drops the connection of a sender still blocked, so a failure doesn't hang the test
+    CHECK(!sent.get());
+    CHECK(std::chrono::steady_clock::now() - t0 >= 900ms);
+    CHECK(error.find("didn't read") != std::string::npos);
+    unlink(path.c_str());
+  }
+
+  // Nothing is listening
+  CHECK(!upgrade::Send(path.c_str(), State(), error));
+  return test::Failures() != 0;
+}
@@ -0,0 +1,117 @@
+#include "check.h"
+#include "fake_cluster.h"
+#include "load_shedder.h"
+#include "session_manager.h"
+#include <atomic>
+#include <thread>
+
+/*
+   Synthetic overload: Discord stops answering while sessions keep starting. The level climbs as the requests in
+   flight pile up, mutes wait while it's at DeferMutes or above, and once the answers come back it steps down and
+   the waiting mutes go out. The shed tick flushes them on its own thread, so the list is also read while another
+   thread flushes it, and the sessions are ended under the manager's lock while the flush walks them.
+*/
+
+using namespace std::chrono_literals;
+
+constexpr uint64_t Sessions = 200;
+
+static size_t Mutes(dpp::cluster const &bot, dpp::snowflake user)
+{
+  size_t n = 0;
+  for (auto const &c : bot.Calls)
+    n += c.Route == "guild_edit_member" && c.Id == user && c.Flag;
+  return n;
+}
+
+int main()
+{
+  fake::World w;
+  std::vector<shed::Level> levels;
+  shed::Start(
+      w.Bot,
+      [&](shed::Level, shed::Level to)
+      {
+        levels.push_back(to);
+        if (to < shed::Level::DeferMutes)
+          w.Manager.FlushDeferredMutes();
+      });
+
+  // Discord answers nothing for 5 minutes
+  bool slow = 1;
+  w.Bot.Responder = [&](fake::Call const &call)
+  {
+    fake::Answer a = fake::Default(w.Bot, call);
+    if (slow)
+      a.Delay = 5min;
+    return a;
+  };
+
+  for (uint64_t i = 0; i <= Sessions; i++)
+    w.Room(10 + i, {1000 + i, 2000 + i}, "room " + std::to_string(i));
+
+  for (uint64_t i = 0; i < Sessions; i++)
+  {
+    w.Start(1000 + i, 10 + i, 600, 5, 2);
+    fake::Run(100ms, 100ms);
+  }
+  fake::Run(2s);
+  printf("level after %lu sessions: %s\n", Sessions, shed::Name(shed::Current()));
+  CHECK(shed::Active(shed::Level::DeferMutes));
+
+  // Started under pressure: its members wait for their mute, as those of the sessions the level caught
+  constexpr uint64_t Late = 1000 + Sessions;
+  w.Start(Late, 10 + Sessions, 600, 5, 2);
+  fake::Run(1s); // its first phase starts on the next tick
+  CHECK(w.Manager.GetSessionByOwnerId(Late));
+  CHECK(Mutes(w.Bot, Late) == 0);
+  CHECK(w.Manager.Report().find(" 0 deferred mutes") == std::string::npos);
+
+  // Discord catches up, the level steps down and the mute goes out
+  slow = 0;
+  fake::Run(10min);
+  printf("level after the answers: %s, %zu changes\n", shed::Name(shed::Current()), levels.size());
+  CHECK(shed::Current() == shed::Level::Normal);
+  CHECK(Mutes(w.Bot, Late) == 1);
+  CHECK(Mutes(w.Bot, 2000 + Sessions) == 1);
+  CHECK(w.Manager.Report().find(" 0 deferred mutes") != std::string::npos);
+
+  // The shed tick's thread flushes while an event thread reads the list
+  std::atomic<bool> done{0};
+  std::thread flusher(
+      [&]
+      {
+        while (!done.load())
+          w.Manager.FlushDeferredMutes();
+      });
+  for (int i = 0; i < 2000; i++)
+    w.Manager.Report();
+
+  // Overloaded again, every session goes through its break back to work and waits for its mutes. An event thread
+  // then ends them while the flush looks them up and walks their members
+  slow = 1;
+  for (int round = 0; round < 2; round++)
+    for (uint64_t i = 0; i <= Sessions; i++)
+    {
+      {
+        std::lock_guard lock(w.Manager.Mtx);
+        if (auto *session = w.Manager.GetSessionByOwnerId(1000 + i))
+          session->SkipPhase(w.Manager);
+      }
+      if (!round)
+        fake::Run(100ms, 100ms);
+    }
+  CHECK(shed::Active(shed::Level::DeferMutes));
+  CHECK(w.Manager.Report().find(" 0 deferred mutes") == std::string::npos);
+  for (uint64_t i = 0; i <= Sessions; i++)
+  {
+    std::lock_guard lock(w.Manager.Mtx);
+    w.Manager.CancelSession(1000 + i);
+  }
+  done = 1;
+  flusher.join();
+  w.Manager.FlushDeferredMutes(); // the next tick drops what's left of the ended sessions
+  CHECK(w.Manager.GetActiveSessions() == 0);
+  CHECK(w.Manager.Report().find(" 0 deferred mutes") != std::string::npos);
+  return test::Failures() != 0;
+}
@@ -0,0 +1,54 @@
+#include "check.h"
+#include "fake_cluster.h"
+#include "pomodoro.h"
+#include "session_manager.h"
+
+/*
+   Members and the owner leaving the voice channel of a running session: the session keeps going without them, the
+   owner is replaced by the next member, and both notices go through the channel's webhook like the phase ones. Who
+   left has the session recorded as canceled, the ones who stayed until the end as completed.
+*/
+
+using namespace std::chrono_literals;
+using fake::Guild, fake::Owner, fake::Member;
+
+constexpr dpp::snowflake Other = 102;
+
+int main()
+{
+  fake::World w;
+  RecurringScheduler scheduler(w.Bot, (w.Dir + "/schedules.db").c_str());
+  ProfileStore profiles(w.Bot, (w.Dir + "/profiles.db").c_str());
+  Pomodoro pomodoro(w.Manager, scheduler, profiles);
+  w.Room(10, {Owner, Member, Other});
+  w.Start(Owner, 10, 1, 1, 2);
+  fake::Run(1s); // the first phase creates the webhook
+  size_t posts = fake::Count(w.Bot, "execute_webhook");
+  size_t created = fake::Count(w.Bot, "message_create");
+
+  pomodoro.VCHandler(fake::Join(w.Bot, Guild, 0, Member));
+  fake::Settle();
+  auto *session = w.Manager.GetSessionByOwnerId(Owner);
+  CHECK(session && session->MembersId.size() == 2);
+  CHECK(!w.Manager.GetSessionByUserId(Member));
+  CHECK(fake::Count(w.Bot, "execute_webhook") == posts + 1);
+
+  pomodoro.VCHandler(fake::Join(w.Bot, Guild, 0, Owner));
+  fake::Settle();
+  CHECK(!w.Manager.GetSessionByOwnerId(Owner));
+  session = w.Manager.GetSessionByOwnerId(Other);
+  CHECK(session && session->MembersId.size() == 1);
+  CHECK(fake::Count(w.Bot, "execute_webhook") == posts + 2);
+  CHECK(fake::Count(w.Bot, "message_create") == created);
+
+  fake::Run(20min);
+  CHECK(!w.Manager.GetSessionByOwnerId(Other));
+  for (dpp::snowflake user : {Owner, Member, Other})
+  {
+    auto s = w.Stats.GetUserStats(Guild, user);
+    CHECK(s.SessionsJoined == 1);
+    CHECK(s.SessionsCanceled == (user != Other));
+    CHECK(s.SessionsCompleted == (user == Other));
+  }
+  return test::Failures() != 0;
+}
@@ -0,0 +1,47 @@
+#include "check.h"
+#include "fake_cluster.h"
+#include "opus_track.h"
+#include <fstream>
+
+/*
+   OpusTrack on files written by fake::WriteOpus and on the bundled assets: packets and duration come out of the
+   pages, a corrupt page is rejected, and Shared keeps a track only once it opened.
+*/
+
+int main()
+{
+  std::string dir = fake::TempDir();
+  std::string path = dir + "/cue.opus";
+
+  // Not there yet: not kept, so the file is picked up once it's written
+  auto missing = OpusTrack::Shared(path);
+  CHECK(!missing->IsOpen());
+  CHECK(fake::WriteOpus(path, 120, 80, 50));
+  auto track = OpusTrack::Shared(path);
+  CHECK(track->IsOpen());
+  CHECK(track->Packets().size() == 120);
+  CHECK(track->Duration() == 120 * 0.02);
+  CHECK(track->CopiedBytes() == 0);
+  CHECK(OpusTrack::Shared(path) == track);
+
+  // A flipped byte fails the CRC of its page
+  std::string corrupt = dir + "/corrupt.opus";
+  CHECK(fake::WriteOpus(corrupt, 10));
+  {
+    std::fstream f(corrupt, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(-5, std::ios::end);
+    f.put('\x7f');
+  }
+  OpusTrack bad(corrupt.c_str());
+  CHECK(!bad.IsOpen());
+  CHECK(bad.Error().find("CRC mismatch") != std::string::npos);
+  CHECK(bad.Packets().empty());
+
+  for (const char *asset : {"assests/audio/BreakToWork.opus", "assests/audio/WorkToBreak.opus"})
+  {
+    OpusTrack t(asset);
+    CHECK(t.IsOpen());
+    CHECK(!t.Packets().empty() && t.Duration() > 1);
+  }
+  return test::Failures() != 0;
+}
@@ -0,0 +1,67 @@
+#include "check.h"
+#include "rate_limiter.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/*
+   Token buckets: a user gets the burst then waits, a busy guild limits users that still have tokens and gives
+   them back, and under eviction from another thread no key is ever allowed more than its bucket holds.
+*/
+
+int main()
+{
+  RateLimiter limiter({3, 3'600'000}, {5, 3'600'000}); // no refill within the test
+
+  // Burst, then the retry time of one token
+  for (int i = 0; i < 3; i++)
+    CHECK(limiter.Acquire(1, 0).Status == RateLimiter::Verdict::Allowed);
+  auto limited = limiter.Acquire(1, 0);
+  CHECK(limited.Status == RateLimiter::Verdict::UserLimited);
+  CHECK(limited.RetryMs > 3'500'000 && limited.RetryMs <= 3'600'000);
+
+  // The guild runs out first, the users keep the tokens it refused
+  for (uint64_t user = 10; user < 15; user++)
+    CHECK(limiter.Acquire(user, 7).Status == RateLimiter::Verdict::Allowed);
+  CHECK(limiter.Acquire(15, 7).Status == RateLimiter::Verdict::GuildLimited);
+  for (int i = 0; i < 3; i++)
+    CHECK(limiter.Acquire(15, 0).Status == RateLimiter::Verdict::Allowed);
+  CHECK(limiter.Acquire(15, 0).Status == RateLimiter::Verdict::UserLimited);
+
+  // A fresh key is a full bucket, which Evict may free and hand to another key while it's being taken from
+  constexpr unsigned Threads = 4;
+  constexpr uint64_t Keys = 4'000; // a quarter of the table, every key finds a slot
+  constexpr uint64_t FirstKey = 1'000'000;
+  std::vector<std::atomic<uint32_t>> allowed(Keys);
+  std::atomic<bool> done{0};
+  std::thread evictor(
+      [&]
+      {
+        while (!done.load())
+          limiter.Evict();
+      });
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < Threads; t++)
+    threads.emplace_back(
+        [&, t]
+        {
+          for (uint64_t round = 0; round < 5; round++)
+            for (uint64_t k = 0; k < Keys; k++)
+            {
+              uint64_t key = (k * Threads + t * 7919) % Keys;
+              if (limiter.Acquire(FirstKey + key, 0).Status == RateLimiter::Verdict::Allowed)
+                allowed[key]++;
+            }
+        });
+  for (auto &t : threads)
+    t.join();
+  done = 1;
+  evictor.join();
+
+  size_t over = 0;
+  for (auto const &n : allowed)
+    over += n != 3;
+  CHECK(over == 0);
+  CHECK(limiter.GetMetrics().TableFull == 0);
+  return test::Failures() != 0;
+}
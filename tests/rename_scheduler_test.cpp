@@ -0,0 +1,60 @@
+#include "check.h"
+#include "fake_cluster.h"
+#include "rename_scheduler.h"
+
+/*
+   A failed rename keeps the channel's original name: the channel gets no more labels and the original name is
+   retried with backoff until it's back.
+*/
+
+using namespace std::chrono_literals;
+
+// Names sent for a channel, in order
+static std::vector<std::string> Sent(dpp::cluster const &bot, dpp::snowflake channel_id)
+{
+  std::vector<std::string> names;
+  for (auto const &c : bot.Calls)
+    if (c.Route == "channel_edit" && c.Id == channel_id)
+      names.push_back(c.Content);
+  return names;
+}
+
+int main()
+{
+  fake::World w;
+  RenameScheduler renames(w.Bot);
+  w.Room(10, {}, "denied");
+  w.Room(11, {}, "flaky");
+  auto far = utl::Clock::now() + 24h;
+
+  // Missing permission: the label didn't apply, nothing to restore
+  w.Bot.Responder = [](fake::Call const &) { return fake::Fail(403, 50013, "Missing Permissions"); };
+  renames.Label(10, "denied", "Work", far);
+  fake::Settle();
+  CHECK(renames.Pending() == 1);
+  renames.Label(10, "denied", "Break", far);
+  fake::Run(1h);
+  CHECK(Sent(w.Bot, 10) == std::vector<std::string>{"Work - denied"});
+  renames.Restore(10);
+  CHECK(renames.Pending() == 0);
+
+  // No answer: the label may have applied, the original name is retried with backoff until it goes through
+  int failures = 3;
+  w.Bot.Responder = [&](fake::Call const &call) {
+    return failures-- > 0 ? fake::Timeout() : fake::Default(w.Bot, call);
+  };
+  renames.Label(11, "flaky", "Work", far);
+  fake::Run(15s);
+  renames.Label(11, "flaky", "Break", far);
+  renames.Restore(11);
+  fake::Run(1min);
+  CHECK(renames.Pending() == 1);
+  CHECK(Sent(w.Bot, 11).size() == 2);
+  fake::Run(2h);
+  CHECK(renames.Pending() == 0);
+  auto names = Sent(w.Bot, 11);
+  CHECK(names.size() == 4); // 3 timeouts, the retries waiting for rename slots too
+  CHECK(!names.empty() && names.front() == "Work - flaky");
+  CHECK(!names.empty() && names.back() == "flaky");
+  return test::Failures() != 0;
+}
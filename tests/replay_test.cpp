@@ -0,0 +1,98 @@
+#include "check.h"
+#include "event_log.h"
+#include "fake_cluster.h"
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <sys/wait.h>
+
+/*
+   tools/replay drives the handlers with a captured log: the session it starts mutes the members and runs to its end,
+   the buttons reach the session, and a corrupt log makes it exit non-zero.
+
+   usage: replay_test <replay binary>
+*/
+
+constexpr uint64_t Guild = 7;
+constexpr uint64_t Voice = 10;
+constexpr uint64_t Text = 20;
+constexpr uint64_t Owner = 100;
+constexpr uint64_t Member = 101;
+
+static capture::Event Join(uint64_t ms, uint64_t user)
+{
+  return {capture::Kind::VoiceState, ms * 1'000'000, Guild, Voice, user};
+}
+
+static capture::Event Button(uint64_t ms, std::string custom_id)
+{
+  return {capture::Kind::ButtonClick, ms * 1'000'000, Guild, Text, Owner, 0, "en-US", std::move(custom_id)};
+}
+
+static void WriteLog(std::string const &path)
+{
+  capture::Writer log(path.c_str());
+  log.Append(Join(0, Owner));
+  log.Append(Join(500, Member));
+  capture::Event start{capture::Kind::SlashCommand, 1'000'000'000, Guild, Text, Owner, 0, "en-US", "pomodoro"};
+  capture::Option mute{"mute", capture::ValueType::Boolean, "", 1};
+  start.Options.push_back({"start", capture::ValueType::None, "", 0, 0, {mute}});
+  log.Append(start);
+  log.Append(Button(3000, "Pp00000001")); // pause the session with handle 1
+  log.Append(Button(5000, "Pr00000001"));
+}
+
+// Runs replay on the log, returns its exit status and what it printed
+static int Replay(std::string const &replay, std::string const &log, std::string &out)
+{
+  std::FILE *p = popen((replay + " " + log + " 2>&1").c_str(), "r");
+  if (!p)
+    return -1;
+  char buf[4096];
+  for (size_t n; (n = std::fread(buf, 1, sizeof(buf), p));)
+    out.append(buf, n);
+  int status = pclose(p);
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    std::printf("usage: %s <replay binary>\n", argv[0]);
+    return 2;
+  }
+  std::string dir = fake::TempDir();
+  std::string path = dir + "/events.log";
+  WriteLog(path);
+
+  std::string out;
+  CHECK(Replay(argv[1], path, out) == 0);
+  CHECK(out.find("/pomodoro start") != std::string::npos);
+  CHECK(out.find("-> interaction_response") != std::string::npos);
+  CHECK(out.find(" -> guild_edit_member 101 7 mute") != std::string::npos); // muted by the work phase
+  CHECK(out.find("button Pp00000001") != std::string::npos);
+  CHECK(out.find(" -> guild_edit_member 101 7\n") != std::string::npos); // unmuted by the pause or the end
+  CHECK(out.find("0 sessions still running") != std::string::npos);
+  if (test::Failures())
+    std::printf("%s", out.c_str());
+
+  // The last record cut short
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+  out.clear();
+  CHECK(Replay(argv[1], path, out) == 1);
+  CHECK(out.find("record 4 is truncated or malformed") != std::string::npos);
+
+  // A record of a kind that doesn't exist
+  {
+    capture::Writer log(path.c_str());
+    log.Append(Join(0, Owner));
+    capture::Event bad = Join(1, Member);
+    bad.Type = static_cast<capture::Kind>(9);
+    log.Append(bad);
+  }
+  out.clear();
+  CHECK(Replay(argv[1], path, out) == 1);
+  CHECK(out.find("record 1 is truncated or malformed") != std::string::npos);
+  return test::Failures() != 0;
+}
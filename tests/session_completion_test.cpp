@@ -0,0 +1,69 @@
+#include "check.h"
+#include "fake_cluster.h"
+#include "session_manager.h"
+#include <algorithm>
+
+/*
+   A session that runs through all its phases is recorded as completed, one that's canceled before is recorded as
+   canceled, and the members are unmuted either way. A session with no phase to run ends as it starts.
+*/
+
+using namespace std::chrono_literals;
+using fake::Guild, fake::Owner, fake::Member;
+
+// The mute state the last guild_edit_member call left the user in
+static bool LastMute(dpp::cluster const &bot, dpp::snowflake user_id)
+{
+  auto it = std::find_if(bot.Calls.rbegin(), bot.Calls.rend(), [&](fake::Call const &c) {
+    return c.Route == "guild_edit_member" && c.Id == user_id;
+  });
+  return it != bot.Calls.rend() && it->Flag;
+}
+
+int main()
+{
+  fake::World w;
+  w.Room(10, {Owner, Member});
+
+  // Run to completion: 2 work phases and the break between them
+  CHECK(w.Start(Owner, 10, 1, 1, 2));
+  fake::Run(1s);
+  CHECK(LastMute(w.Bot, Member));
+  fake::Run(20min);
+  CHECK(!w.Manager.GetSessionByOwnerId(Owner));
+  for (dpp::snowflake user : {Owner, Member})
+  {
+    auto s = w.Stats.GetUserStats(Guild, user);
+    CHECK(s.SessionsJoined == 1);
+    CHECK(s.WorkPhases == 2);
+    CHECK(s.SessionsCompleted == 1);
+    CHECK(s.SessionsCanceled == 0);
+    CHECK(!LastMute(w.Bot, user));
+  }
+
+  // Canceled during its last work phase
+  auto *session = w.Start(Owner, 10, 1, 1, 2);
+  CHECK(session);
+  if (session)
+  {
+    session->SkipPhase(w.Manager);
+    session->SkipPhase(w.Manager);
+    CHECK(session->CurrentSessionNumber == session->Repeat);
+    CHECK(w.Manager.CancelSession(Owner));
+  }
+  fake::Run(1min);
+  for (dpp::snowflake user : {Owner, Member})
+  {
+    auto s = w.Stats.GetUserStats(Guild, user);
+    CHECK(s.SessionsJoined == 2);
+    CHECK(s.SessionsCompleted == 1);
+    CHECK(s.SessionsCanceled == 1);
+    CHECK(!LastMute(w.Bot, user));
+  }
+
+  // Without any phase to run it ends as it starts, its status message goes with it
+  CHECK(!w.Start(Owner, 10, 1, 1, 0));
+  fake::Run(1min);
+  CHECK(w.Manager.Board.Tracked() == 0);
+  return test::Failures() != 0;
+}
@@ -0,0 +1,53 @@
+#include "check.h"
+#include "fake_cluster.h"
+#include "session_manager.h"
+
+/*
+   Sessions are suspended when their shard drops after it was up, not while it's still connecting, and reconciled
+   against the cache when it's back: the owner who left is replaced, has the session recorded as canceled, and the
+   notice goes through the webhook.
+*/
+
+using namespace std::chrono_literals;
+using Flag = SessionManager::Session::Flag;
+using fake::Guild, fake::Owner, fake::Member;
+
+int main()
+{
+  fake::World w;
+  w.Room(10, {Owner, Member});
+  auto *session = w.Start(Owner, 10, 1, 1, 2);
+  fake::Run(1s);
+  CHECK(session);
+  if (!session)
+    return 1;
+
+  // Still connecting: not down
+  dpp::discord_client *shard = w.Bot.get_shard(0);
+  shard->connected = 0;
+  w.Manager.CheckShards();
+  CHECK(!SessionManager::HasFlag(session->Flags, Flag::Suspended));
+
+  // Up, then dropped
+  shard->connected = 1;
+  w.Manager.CheckShards();
+  shard->connected = 0;
+  w.Manager.CheckShards();
+  CHECK(SessionManager::HasFlag(session->Flags, Flag::Suspended));
+
+  // The owner left while the shard was down
+  fake::Join(w.Bot, Guild, 0, Owner);
+  size_t posts = fake::Count(w.Bot, "execute_webhook") + fake::Count(w.Bot, "message_create");
+  size_t created = fake::Count(w.Bot, "message_create");
+  shard->connected = 1;
+  w.Manager.ReconcileShard(0);
+  fake::Settle();
+  session = w.Manager.GetSessionByOwnerId(Member);
+  CHECK(session);
+  CHECK(session && !SessionManager::HasFlag(session->Flags, Flag::Suspended));
+  CHECK(fake::Count(w.Bot, "execute_webhook") + fake::Count(w.Bot, "message_create") == posts + 1);
+  CHECK(fake::Count(w.Bot, "message_create") == created); // the channel has a webhook by now
+  CHECK(w.Stats.GetUserStats(Guild, Owner).SessionsCanceled == 1);
+  CHECK(w.Stats.GetUserStats(Guild, Member).SessionsCanceled == 0);
+  return test::Failures() != 0;
+}
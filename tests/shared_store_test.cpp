@@ -0,0 +1,158 @@
+#include "check.h"
+#include "fake_cluster.h"
+#include "profile_store.h"
+#include "recurring_scheduler.h"
+#include "stats_store.h"
+#include <functional>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+/*
+   The stores on files every process of a sharded deployment opens: forked processes record stats, add schedules and
+   save profiles at the same time. No event or schedule is lost to another process's write, the stats log grows
+   under all of them, and a process sees the profiles the others saved, also once the table was rebuilt.
+*/
+
+constexpr int Processes = 4;
+constexpr uint64_t EventsEach = 3000; // past the log's initial 4096 events together
+constexpr uint64_t SchedulesEach = 200;
+constexpr uint64_t ProfilesEach = 1000; // past the table's initial 4096 slots together
+
+// Runs body in Processes children started together, each one writes what it has to tell to its pipe
+static std::vector<std::vector<uint64_t>> InChildren(std::function<std::vector<uint64_t>(int)> body)
+{
+  int gate[2];
+  if (pipe(gate))
+    return {};
+  std::vector<std::pair<pid_t, int>> children;
+  for (int i = 0; i < Processes; i++)
+  {
+    int fds[2];
+    if (pipe(fds))
+      return {};
+    pid_t pid = fork();
+    if (!pid)
+    {
+      close(fds[0]);
+      close(gate[1]);
+      char go;
+      while (read(gate[0], &go, 1) > 0) // returns 0 once the parent closed the gate
+        ;
+      std::vector<uint64_t> out = body(i);
+      size_t bytes = out.size() * sizeof(uint64_t);
+      _exit(write(fds[1], out.data(), bytes) == ssize_t(bytes) ? 0 : 1);
+    }
+    close(fds[1]);
+    children.emplace_back(pid, fds[0]);
+  }
+  close(gate[0]);
+  close(gate[1]);
+
+  std::vector<std::vector<uint64_t>> out;
+  for (auto [pid, fd] : children)
+  {
+    auto &told = out.emplace_back();
+    uint64_t v;
+    while (read(fd, &v, sizeof(v)) == sizeof(v))
+      told.push_back(v);
+    close(fd);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+  return out;
+}
+
+int main()
+{
+  dpp::cluster bot("");
+  std::string dir = fake::TempDir();
+
+  // Stats: the parent's store is open the whole time and applies the children's events when it records
+  std::string stats_path = dir + "/stats.log";
+  StatsStore stats(bot, stats_path.c_str());
+  InChildren(
+      [&](int i)
+      {
+        dpp::cluster bot("");
+        StatsStore mine(bot, stats_path.c_str());
+        dpp::snowflake member = 100 + i;
+        for (uint64_t n = 0; n < EventsEach; n++)
+        {
+          mine.RecordSessionJoined(1 + i, {&member, 1});
+          sched_yield(); // the processes interleave on a single CPU too
+        }
+        return std::vector<uint64_t>{};
+      });
+  dpp::snowflake parent = 99;
+  stats.RecordSessionJoined(99, {&parent, 1});
+  CHECK(stats.GetEventCount() == Processes * EventsEach + 1);
+  {
+    StatsStore reopened(bot, stats_path.c_str());
+    CHECK(reopened.GetEventCount() == Processes * EventsEach + 1);
+    for (int i = 0; i < Processes; i++)
+    {
+      CHECK(stats.GetUserStats(1 + i, 100 + i).SessionsJoined == EventsEach);
+      CHECK(reopened.GetUserStats(1 + i, 100 + i).SessionsJoined == EventsEach);
+    }
+  }
+
+  // Schedules: every child's schedules keep their own slots
+  std::string schedules_path = dir + "/schedules.db";
+  auto ids = InChildren(
+      [&](int i)
+      {
+        dpp::cluster bot("");
+        RecurringScheduler mine(bot, schedules_path.c_str());
+        std::vector<uint64_t> out;
+        for (uint64_t n = 0; n < SchedulesEach; n++)
+        {
+          RecurringScheduler::Schedule s{};
+          s.OwnerId = 1000 * (i + 1) + n;
+          s.GuildId = 1 + i;
+          s.ChannelId = 10;
+          s.Days = RecurringScheduler::Daily;
+          out.push_back(mine.Add(s));
+          sched_yield();
+        }
+        return out;
+      });
+  {
+    RecurringScheduler scheduler(bot, schedules_path.c_str());
+    size_t kept = 0;
+    for (int i = 0; i < Processes && i < int(ids.size()); i++)
+      for (uint64_t n = 0; n < ids[i].size(); n++)
+        kept += scheduler.Remove(ids[i][n], 1000 * (i + 1) + n, 1 + i);
+    CHECK(kept == Processes * SchedulesEach);
+  }
+
+  // Profiles: the parent looked one up before a child saved it, then the children grow the table
+  std::string profiles_path = dir + "/profiles.db";
+  ProfileStore profiles(bot, profiles_path.c_str());
+  ProfileStore::Profile p;
+  CHECK(!profiles.Get(ProfileStore::Scope::User, 1, p));
+  InChildren(
+      [&](int i)
+      {
+        dpp::cluster bot("");
+        ProfileStore mine(bot, profiles_path.c_str());
+        for (uint64_t n = 0; n < ProfilesEach; n++)
+        {
+          ProfileStore::Profile saved{};
+          saved.Id = 1 + i * ProfilesEach + n;
+          saved.Kind = ProfileStore::Scope::User;
+          saved.WorkPeriod = 25;
+          saved.Fields = ProfileStore::HasWork;
+          mine.Put(saved);
+          sched_yield();
+        }
+        return std::vector<uint64_t>{};
+      });
+  size_t found = 0;
+  for (uint64_t id = 1; id <= Processes * ProfilesEach; id++)
+    found += profiles.Get(ProfileStore::Scope::User, id, p) && p.WorkPeriod == 25;
+  CHECK(found == Processes * ProfilesEach);
+  return test::Failures() != 0;
+}
@@ -0,0 +1,48 @@
+#include "check.h"
+#include "fake_cluster.h"
+#include "voice.h"
+
+/*
+   Cues of a study hall visit its rooms one after another. A chain started for the next phase while the previous
+   one is still going takes the voice connection over: the old chain stops moving through its rooms and doesn't
+   disconnect the new one.
+*/
+
+using namespace std::chrono_literals;
+using fake::Guild;
+
+constexpr uint32_t CueSeconds = 5; // a room takes 2s to connect, the cue, 2s more and 1s before the next room
+
+int main()
+{
+  fake::World w;
+  std::string path = w.Dir + "/cue.opus";
+  CHECK(fake::WriteOpus(path, CueSeconds * 50));
+
+  std::vector<dpp::snowflake> first, second;
+  for (uint64_t room = 100; room < 106; room++)
+  {
+    first.push_back(w.Room(room, {}, "room").id);
+    second.push_back(w.Room(room + 100, {}, "room").id);
+  }
+  dpp::discord_client *shard = w.Bot.get_shard(0);
+
+  // A chain left alone visits every room
+  PlayAudio(w.Bot, Guild, first, path.c_str(), CueSeconds);
+  fake::Run(2min);
+  CHECK(shard->Connects() == first.size());
+  CHECK(!shard->get_voice(Guild));
+
+  // The next chain starts while the first one plays in its second room
+  uint64_t connects = shard->Connects();
+  PlayAudio(w.Bot, Guild, first, path.c_str(), CueSeconds);
+  fake::Run(13s);
+  PlayAudio(w.Bot, Guild, second, path.c_str(), CueSeconds);
+  fake::Run(6s); // the first chain's room ends in there
+  dpp::voiceconn *V = shard->get_voice(Guild);
+  CHECK(V && V->channel_id == second[0]);
+  fake::Run(2min);
+  CHECK(shard->Connects() - connects == 2 + second.size());
+  CHECK(!shard->get_voice(Guild));
+  return test::Failures() != 0;
+}
@@ -0,0 +1,315 @@
+// Plays an event log written by capture mode (POMODORO_CAPTURE=<path>) back into the bot's handlers on a fake cluster
+// and a virtual clock, and prints the events with the REST calls the bot made for them.
+//
+//   replay <log> [--speed N] [--stats]
+//
+// --speed N  plays N times faster than the capture, 0 (the default) doesn't wait at all
+// --stats    prints a summary instead of the timeline
+//
+// Slash commands go through Registry::Dispatch, buttons through the ComponentRouter and voice states through
+// Pomodoro::VCHandler, like in main but without the rate limiter. Guilds and channels are made up from the ids in
+// the log. After the last event the sessions it left are run to their end. The timeline only depends on the log,
+// so two captures of the same scenario, or one log on two builds, can be diffed.
+#include "event_log.h"
+#include "fake_cluster.h"
+#include "tenants.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/format.h>
+#include <map>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+constexpr const char *CueFragmentsDir = "assests/audio/fragments";
+constexpr auto MaxTail = std::chrono::hours(24); // sessions still running this long after the last event are left
+
+static void AppendOptions(std::string &out, std::vector<capture::Option> const &options)
+{
+  using capture::ValueType;
+  for (auto const &o : options)
+  {
+    switch (o.Type)
+    {
+    case ValueType::None: // Subcommand or group
+      out += fmt::format(" {}", o.Name);
+      break;
+    case ValueType::String:
+      out += fmt::format(" {}:\"{}\"", o.Name, o.Str);
+      break;
+    case ValueType::Integer:
+      out += fmt::format(" {}:{}", o.Name, o.Int);
+      break;
+    case ValueType::Boolean:
+      out += fmt::format(" {}:{}", o.Name, o.Int ? "true" : "false");
+      break;
+    case ValueType::Snowflake:
+      out += fmt::format(" {}:<{}>", o.Name, static_cast<uint64_t>(o.Int));
+      break;
+    case ValueType::Double:
+      out += fmt::format(" {}:{}", o.Name, o.Real);
+      break;
+    }
+    AppendOptions(out, o.Options);
+  }
+}
+
+static std::string Describe(capture::Event const &e)
+{
+  std::string out = fmt::format("+{:.3f}s guild={} user={} ", e.TimeNs / 1e9, e.GuildId, e.UserId);
+  if (e.Type == capture::Kind::SlashCommand)
+  {
+    out += fmt::format("/{}", e.Command);
+    AppendOptions(out, e.Options);
+    out += fmt::format(" (channel={} locale={})", e.ChannelId, e.Locale.empty() ? "-" : e.Locale);
+  }
+  else if (e.Type == capture::Kind::ButtonClick)
+    out += fmt::format("button {} (channel={})", e.Command, e.ChannelId);
+  else if (e.ChannelId)
+    out += fmt::format(
+        "voice join channel={}{}{}", e.ChannelId, e.Flags & 1 ? " self-mute" : "", e.Flags & 2 ? " self-deaf" : "");
+  else
+    out += "voice leave";
+  return out;
+}
+
+struct Summary
+{
+  uint64_t Commands = 0;
+  uint64_t VoiceStates = 0;
+  uint64_t Buttons = 0;
+  uint64_t FirstNs = 0;
+  uint64_t LastNs = 0;
+  uint32_t PeakPerSecond = 0;
+  std::map<std::string, uint64_t> PerCommand; // "pomodoro start"
+  std::unordered_map<uint64_t, uint64_t> PerGuild;
+};
+
+static void Count(Summary &s, capture::Event const &e, uint64_t &second, uint32_t &in_second)
+{
+  if (!s.Commands && !s.VoiceStates && !s.Buttons)
+    s.FirstNs = e.TimeNs;
+  s.LastNs = e.TimeNs;
+  s.PerGuild[e.GuildId]++;
+  if (e.Type == capture::Kind::SlashCommand)
+  {
+    s.Commands++;
+    std::string name = e.Command;
+    if (!e.Options.empty() && e.Options[0].Type == capture::ValueType::None)
+      name += " " + e.Options[0].Name;
+    s.PerCommand[name]++;
+  }
+  else if (e.Type == capture::Kind::ButtonClick)
+    s.Buttons++;
+  else
+    s.VoiceStates++;
+
+  if (e.TimeNs / 1'000'000'000 != second)
+  {
+    second = e.TimeNs / 1'000'000'000;
+    in_second = 0;
+  }
+  s.PeakPerSecond = std::max(s.PeakPerSecond, ++in_second);
+}
+
+static void PrintStats(Summary const &s, dpp::cluster const &bot)
+{
+  double span = (s.LastNs - s.FirstNs) / 1e9;
+  fmt::print(
+      "{} events over {:.1f}s: {} slash commands, {} button clicks, {} voice state updates\n",
+      s.Commands + s.Buttons + s.VoiceStates,
+      span,
+      s.Commands,
+      s.Buttons,
+      s.VoiceStates);
+  fmt::print("peak {} events/s, {} guilds\n", s.PeakPerSecond, s.PerGuild.size());
+  for (auto const &[name, n] : s.PerCommand)
+    fmt::print("  /{:<24} {}\n", name, n);
+
+  std::vector<std::pair<uint64_t, uint64_t>> guilds(s.PerGuild.begin(), s.PerGuild.end());
+  std::sort(
+      guilds.begin(),
+      guilds.end(),
+      [](auto const &a, auto const &b) { return a.second > b.second || (a.second == b.second && a.first < b.first); });
+  if (guilds.size() > 10)
+    guilds.resize(10);
+  fmt::print("busiest guilds:\n");
+  for (auto const &[guild, n] : guilds)
+    fmt::print("  {:<20} {}\n", guild, n);
+
+  std::map<std::string_view, uint64_t> calls(bot.CallCount.begin(), bot.CallCount.end());
+  fmt::print("REST calls:\n");
+  for (auto const &[route, n] : calls)
+    fmt::print("  {:<24} {}\n", route, n);
+}
+
+static std::vector<dpp::command_data_option> ToOptions(std::vector<capture::Option> const &options)
+{
+  using capture::ValueType;
+  std::vector<dpp::command_data_option> out;
+  for (auto const &o : options)
+  {
+    switch (o.Type)
+    {
+    case ValueType::None:
+      out.push_back(fake::Sub(o.Name, ToOptions(o.Options)));
+      break;
+    case ValueType::String:
+      out.push_back(fake::Opt(o.Name, o.Str));
+      break;
+    case ValueType::Integer:
+      out.push_back(fake::Opt(o.Name, o.Int));
+      break;
+    case ValueType::Boolean:
+      out.push_back(fake::Opt(o.Name, o.Int != 0));
+      break;
+    case ValueType::Snowflake:
+      out.push_back(fake::Opt(o.Name, dpp::snowflake(static_cast<uint64_t>(o.Int))));
+      break;
+    case ValueType::Double:
+      out.push_back(fake::Opt(o.Name, o.Real));
+      break;
+    }
+  }
+  return out;
+}
+
+// The log only has ids, the cache gets a guild and a channel for each one it names
+static void Populate(capture::Event const &e)
+{
+  if (!dpp::find_guild(e.GuildId))
+    fake::AddGuild(e.GuildId);
+  if (e.ChannelId && !dpp::find_channel(e.ChannelId))
+    fake::AddChannel(
+        e.GuildId,
+        e.ChannelId,
+        fmt::format("channel-{}", e.ChannelId),
+        e.Type == capture::Kind::VoiceState ? dpp::CHANNEL_VOICE : dpp::CHANNEL_TEXT);
+}
+
+static void Dispatch(tenant::Tenant &t, capture::Event const &e)
+{
+  Populate(e);
+  switch (e.Type)
+  {
+  case capture::Kind::SlashCommand:
+  {
+    auto event = fake::Command(t.Bot, e.GuildId, e.ChannelId, e.UserId, e.Command, ToOptions(e.Options), e.Locale);
+    if (!t.Commands.Dispatch(e.Command, event))
+      event.reply(msg_fl("UNKOWN COMMAND Please contact Melal", dpp::m_ephemeral));
+    break;
+  }
+  case capture::Kind::ButtonClick:
+  {
+    auto event = fake::Click(t.Bot, e.GuildId, e.ChannelId, e.UserId, e.Command);
+    event.command.guild_locale = e.Locale;
+    if (!t.Components.Dispatch(event))
+      event.reply(msg_fl("This button is no longer active", dpp::m_ephemeral));
+    break;
+  }
+  case capture::Kind::VoiceState:
+    t.Handler.VCHandler(fake::Join(t.Bot, e.GuildId, e.ChannelId, e.UserId));
+    break;
+  }
+}
+
+// Prints the calls made since the last time, with the virtual time they were made at
+static void PrintCalls(dpp::cluster &bot, utl::Clock::time_point start, size_t &printed)
+{
+  for (; printed < bot.Calls.size(); ++printed)
+  {
+    auto const &c = bot.Calls[printed];
+    std::string line = fmt::format(
+        "+{:.3f}s   -> {} {}", std::chrono::duration<double>(c.At - start).count(), c.Route, c.Id);
+    if (c.Target)
+      line += fmt::format(" {}", c.Target);
+    if (!c.Content.empty())
+      line += fmt::format(" {:?}", c.Content);
+    if (c.Flag)
+      line += c.Route == "guild_edit_member" ? " mute" : " ephemeral";
+    fmt::print("{}\n", line);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const char *path = nullptr;
+  double speed = 0;
+  bool stats = 0;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!std::strcmp(argv[i], "--speed") && i + 1 < argc)
+      speed = std::atof(argv[++i]);
+    else if (!std::strcmp(argv[i], "--stats"))
+      stats = 1;
+    else
+      path = argv[i];
+  }
+  if (!path)
+  {
+    fmt::print(stderr, "usage: {} <log> [--speed N] [--stats]\n", argv[0]);
+    return 2;
+  }
+
+  capture::Reader log(path);
+  if (!log.IsOpen())
+  {
+    fmt::print(stderr, "'{}' isn't an event log\n", path);
+    return 1;
+  }
+
+  // The bot's state lives in a temporary directory, stores of a live deployment are never touched
+  dpp::cluster bot("");
+  std::string dir = fake::TempDir();
+  StatsStore Stats(bot, (dir + "/stats.log").c_str());
+  CueComposer Cues(CueFragmentsDir);
+  RecurringScheduler Scheduler(bot, (dir + "/schedules.db").c_str());
+  ProfileStore Profiles(bot, (dir + "/profiles.db").c_str());
+  tenant::Tenant t("replay", bot, 0, Stats, Cues, Scheduler, Profiles);
+  Scheduler.Start();
+
+  auto start = std::chrono::steady_clock::now();
+  auto virtual_start = utl::Clock::now();
+  size_t printed = 0;
+  capture::Event e;
+  Summary summary;
+  uint64_t second = 0;
+  uint32_t in_second = 0;
+  while (log.Next(e))
+  {
+    if (speed > 0) // Virtual time runs speed times faster than the capture
+      std::this_thread::sleep_until(start + std::chrono::nanoseconds(static_cast<uint64_t>(e.TimeNs / speed)));
+    auto at = virtual_start + std::chrono::nanoseconds(e.TimeNs);
+    if (at > utl::Clock::now())
+      fake::Run(at - utl::Clock::now());
+    if (!stats)
+    {
+      PrintCalls(bot, virtual_start, printed);
+      fmt::print("{}\n", Describe(e));
+    }
+    Count(summary, e, second, in_second);
+    Dispatch(t, e);
+    fake::Settle();
+  }
+  if (log.Corrupt())
+  {
+    fmt::print(stderr, "'{}': record {} is truncated or malformed, replay stopped there\n", path, log.Records());
+    return 1;
+  }
+
+  auto tail_end = utl::Clock::now() + MaxTail;
+  while (t.Manager.GetActiveSessions() && utl::Clock::now() < tail_end)
+    fake::Run(std::chrono::minutes(1));
+  fake::Run(std::chrono::minutes(20)); // renames and status messages the last sessions left
+  if (stats)
+    PrintStats(summary, bot);
+  else
+  {
+    PrintCalls(bot, virtual_start, printed);
+    fmt::print("{} sessions still running\n", t.Manager.GetActiveSessions());
+  }
+  return 0;
+}